@@ -0,0 +1,374 @@
+#include <benchmark/benchmark.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "ptypair.h"
+#include "serial_data.h"
+
+#include "serial.h"
+#include "78m6610.h"
+#include "frameparser.h"
+#include "rollup.h"
+#include "quantile.h"
+#include "timeseries.h"
+#include "journal.h"
+
+namespace PFC
+{
+
+	// Frames from tests/serial_data.txt, repeated to fill a batch
+	static const std::vector<Frame> &Frames()
+	{
+		static std::vector<Frame> frames = LoadSerialData(MONIP_SERIAL_DATA);
+		return frames;
+	}
+
+	static std::vector<uint8_t> Payloads(size_t count)
+	{
+		std::vector<uint8_t> payloads;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const Frame &frame = Frames()[i % Frames().size()];
+			payloads.insert(payloads.end(), frame.begin() + 2, frame.end());
+		}
+
+		return payloads;
+	}
+
+	static void BM_CheckSum(benchmark::State &state)
+	{
+		Frame frame = Frames()[0];
+
+		for (auto _ : state)
+		{
+			benchmark::DoNotOptimize(CheckSum(&frame[0], frame.size()));
+		}
+		state.SetBytesProcessed(state.iterations() * frame.size());
+	}
+	BENCHMARK(BM_CheckSum);
+
+	static void BM_ValidateMessage(benchmark::State &state)
+	{
+		Frame frame = Frames()[0];
+
+		for (auto _ : state)
+		{
+			benchmark::DoNotOptimize(ValidateMessage(frame[0], frame[1], &frame[2], frame.size() - 2));
+		}
+		state.SetBytesProcessed(state.iterations() * frame.size());
+	}
+	BENCHMARK(BM_ValidateMessage);
+
+	static void BM_ConvertAutoReport(benchmark::State &state)
+	{
+		std::vector<uint8_t> payloads = Payloads(Frames().size());
+		AutoReportValues values;
+		size_t i = 0;
+
+		for (auto _ : state)
+		{
+			ConvertAutoReport((const AutoReportMessage *)&payloads[(i++ % Frames().size()) * AUTOREPORT_PAYLOAD_SIZE], &values);
+			benchmark::DoNotOptimize(values);
+		}
+		state.SetItemsProcessed(state.iterations());
+	}
+	BENCHMARK(BM_ConvertAutoReport);
+
+	template <void (*Convert)(const uint8_t *, size_t, const AutoReportBatch *)>
+	static void BM_ConvertAutoReportBatch(benchmark::State &state)
+	{
+		const size_t count = state.range(0);
+		std::vector<uint8_t> payloads = Payloads(count);
+		std::vector<float> out(7 * count);
+		AutoReportBatch batch = { &out[0], &out[count], &out[2 * count], &out[3 * count], &out[4 * count], &out[5 * count], &out[6 * count] };
+
+		for (auto _ : state)
+		{
+			Convert(&payloads[0], count, &batch);
+			benchmark::ClobberMemory();
+		}
+		state.SetItemsProcessed(state.iterations() * count);
+		state.SetLabel(Convert == ConvertAutoReportBatch ? ConvertAutoReportBatchImplementation() : "scalar");
+	}
+	BENCHMARK_TEMPLATE(BM_ConvertAutoReportBatch, ConvertAutoReportBatchScalar)->Arg(4096);
+	BENCHMARK_TEMPLATE(BM_ConvertAutoReportBatch, ConvertAutoReportBatch)->Arg(4096);
+
+	static void BM_ConvertAutoReportToJSON(benchmark::State &state)
+	{
+		std::vector<uint8_t> payloads = Payloads(Frames().size());
+		size_t i = 0;
+
+		for (auto _ : state)
+		{
+			char * json = ConvertAutoReportToJSON((const AutoReportMessage *)&payloads[(i++ % Frames().size()) * AUTOREPORT_PAYLOAD_SIZE]);
+			benchmark::DoNotOptimize(json);
+			free(json);
+		}
+		state.SetItemsProcessed(state.iterations());
+	}
+	BENCHMARK(BM_ConvertAutoReportToJSON);
+
+	static void BM_AutoReportToJSON(benchmark::State &state)
+	{
+		std::vector<uint8_t> payloads = Payloads(Frames().size());
+		char text[AUTOREPORT_JSON_MAX];
+		size_t i = 0;
+
+		for (auto _ : state)
+		{
+			benchmark::DoNotOptimize(AutoReportToJSON((const AutoReportMessage *)&payloads[(i++ % Frames().size()) * AUTOREPORT_PAYLOAD_SIZE], text, sizeof(text)));
+		}
+		state.SetItemsProcessed(state.iterations());
+	}
+	BENCHMARK(BM_AutoReportToJSON);
+
+	// Float free path for gateways without an FPU
+	static void BM_AutoReportFixedToJSON(benchmark::State &state)
+	{
+		std::vector<uint8_t> payloads = Payloads(Frames().size());
+		char text[AUTOREPORT_JSON_MAX];
+		size_t i = 0;
+
+		for (auto _ : state)
+		{
+			AutoReportValuesFixed values;
+
+			ConvertAutoReportFixed((const AutoReportMessage *)&payloads[(i++ % Frames().size()) * AUTOREPORT_PAYLOAD_SIZE], &values);
+			benchmark::DoNotOptimize(AutoReportFixedToJSON(&values, text, sizeof(text)));
+		}
+		state.SetItemsProcessed(state.iterations());
+	}
+	BENCHMARK(BM_AutoReportFixedToJSON);
+
+	static void BM_JSONBuffer_AppendAutoReport(benchmark::State &state)
+	{
+		const size_t count = state.range(0);
+		std::vector<uint8_t> payloads = Payloads(count);
+		JSONBuffer buffer;
+
+		JSONBuffer_Init(&buffer, JSON_MODE_ARRAY);
+
+		for (auto _ : state)
+		{
+			JSONBuffer_Reset(&buffer);
+			for (size_t i = 0; i < count; i++)
+			{
+				JSONBuffer_AppendAutoReport(&buffer, (const AutoReportMessage *)&payloads[i * AUTOREPORT_PAYLOAD_SIZE]);
+			}
+			benchmark::DoNotOptimize(JSONBuffer_Finish(&buffer));
+		}
+		state.SetItemsProcessed(state.iterations() * count);
+
+		JSONBuffer_Free(&buffer);
+	}
+	BENCHMARK(BM_JSONBuffer_AppendAutoReport)->Arg(256);
+
+	// Push a chunk of noisy stream through the parser, as one read() would,
+	// counting into a Serial's statistics when range(1) is set
+	static void BM_FrameParser(benchmark::State &state)
+	{
+		FrameParser * parser = FrameParser_New(AUTOREPORT_HEADER, AUTOREPORT_LENGTH);
+		PtyPair pty;
+		Serial * serial = NULL;
+		std::vector<uint8_t> stream;
+		uint8_t buffer[FRAME_MAX_LENGTH];
+		int64_t frames = 0;
+
+		srand(1);
+		for (size_t i = 0; i < 16; i++)
+		{
+			const Frame &frame = Frames()[i % Frames().size()];
+
+			for (int64_t j = 0; j < state.range(0); j++)
+			{
+				stream.push_back((uint8_t)rand());
+			}
+			stream.insert(stream.end(), frame.begin(), frame.end());
+		}
+
+		if (state.range(1) != 0 && pty.Open())
+		{
+			serial = Serial_New(pty.path.c_str());
+			FrameParser_SetSerial(parser, serial);
+		}
+
+		for (auto _ : state)
+		{
+			FrameParser_Push(parser, &stream[0], stream.size());
+			while (FrameParser_Next(parser, NULL, buffer) > 0)
+			{
+				frames++;
+			}
+		}
+		state.SetItemsProcessed(frames);
+		state.SetBytesProcessed(state.iterations() * stream.size());
+
+		FrameParser_Free(parser);
+		Serial_Free(serial);
+	}
+	BENCHMARK(BM_FrameParser)->ArgNames({"noise", "stats"})->Args({0, 0})->Args({0, 1})->Args({8, 0})->Args({8, 1});
+
+	// A snapshot as a monitoring thread takes it
+	static void BM_Serial_GetStats(benchmark::State &state)
+	{
+		PtyPair pty;
+		pty.Open();
+		Serial * serial = Serial_New(pty.path.c_str());
+		SerialStats stats;
+
+		for (auto _ : state)
+		{
+			Serial_GetStats(serial, &stats);
+			benchmark::DoNotOptimize(stats);
+		}
+
+		Serial_Free(serial);
+	}
+	BENCHMARK(BM_Serial_GetStats);
+
+	static void CountWindow(void * context, const RollupWindow * window)
+	{
+		(*(int64_t *)context)++;
+	}
+
+	// 1 s / 1 min / 15 min rollups over range(0) devices sampled every 100 ms
+	static void BM_Rollup_Add(benchmark::State &state)
+	{
+		const uint32_t lengths[] = {1000, 60000, 900000};
+		std::vector<AutoReportValues> values(Frames().size());
+		int64_t windows = 0;
+		uint64_t timestamp = 0;
+		Rollup * rollup = Rollup_New(lengths, 3, CountWindow, &windows);
+
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			ConvertAutoReport((const AutoReportMessage *)&Frames()[i][2], &values[i]);
+		}
+
+		for (auto _ : state)
+		{
+			for (int64_t device = 0; device < state.range(0); device++)
+			{
+				Rollup_Add(rollup, (uint32_t)device, timestamp, &values[(timestamp / 100000000 + device) % values.size()]);
+			}
+			timestamp += 100000000;
+		}
+		state.SetItemsProcessed(state.iterations() * state.range(0));
+		state.counters["windows"] = benchmark::Counter(windows);
+
+		Rollup_Free(rollup);
+	}
+	BENCHMARK(BM_Rollup_Add)->Arg(1)->Arg(1024);
+
+	// Watts of the recorded frames into a sketch, then p50/p95/p99 of it
+	static void BM_QuantileSketch_Add(benchmark::State &state)
+	{
+		std::vector<float> watts(Frames().size());
+		QuantileSketch * sketch = QuantileSketch_New((unsigned int)state.range(0));
+		size_t i = 0;
+
+		for (size_t k = 0; k < watts.size(); k++)
+		{
+			AutoReportValues values;
+
+			ConvertAutoReport((const AutoReportMessage *)&Frames()[k][2], &values);
+			watts[k] = values.Watts;
+		}
+
+		for (auto _ : state)
+		{
+			QuantileSketch_Add(sketch, watts[i] + (float)(i & 0xff));
+			i = (i + 1 < watts.size()) ? i + 1 : 0;
+		}
+		state.SetItemsProcessed(state.iterations());
+		state.counters["p99"] = QuantileSketch_Quantile(sketch, 0.99);
+
+		QuantileSketch_Free(sketch);
+	}
+	BENCHMARK(BM_QuantileSketch_Add)->ArgName("compression")->Arg(100)->Arg(400);
+
+	// Ten minutes of the recorded frames played back and forth every 100 ms, with up to 3 ms jitter
+	static TimeSeries * RecordedSeries(size_t count)
+	{
+		const std::vector<Frame> &frames = Frames();
+		TimeSeries * series = TimeSeries_New(0, 0);
+
+		for (size_t k = 0; k < count; k++)
+		{
+			size_t cycle = k % (2 * frames.size() - 2);
+			size_t index = (cycle < frames.size()) ? cycle : 2 * frames.size() - 2 - cycle;
+
+			TimeSeries_Append(series, k * 100000000ull + (k * 7919) % 3000000, (const AutoReportMessage *)&frames[index][2]);
+		}
+
+		return series;
+	}
+
+	static void BM_TimeSeries_Append(benchmark::State &state)
+	{
+		TimeSeries * series = NULL;
+
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			TimeSeries_Free(series);
+			state.ResumeTiming();
+			series = RecordedSeries(6000);
+		}
+		state.SetItemsProcessed(state.iterations() * 6000);
+		state.counters["bytes_per_sample"] = (double)TimeSeries_MemoryUsage(series) / 6000;
+
+		TimeSeries_Free(series);
+	}
+	BENCHMARK(BM_TimeSeries_Append);
+
+	static void CountSample(void * context, uint64_t timestamp, const AutoReportValues * values)
+	{
+		*(float *)context += values->Watts;
+	}
+
+	static void BM_TimeSeries_Query(benchmark::State &state)
+	{
+		TimeSeries * series = RecordedSeries(6000);
+		float sum = 0;
+
+		for (auto _ : state)
+		{
+			benchmark::DoNotOptimize(TimeSeries_Query(series, 0, UINT64_MAX, CountSample, &sum));
+		}
+		state.SetItemsProcessed(state.iterations() * 6000);
+
+		TimeSeries_Free(series);
+	}
+	BENCHMARK(BM_TimeSeries_Query);
+
+	// Journaling the recorded frames into a 64k record ring, no system call per frame
+	static void BM_Journal_Append(benchmark::State &state)
+	{
+		char path[] = "/tmp/monip_bench_journal_XXXXXX";
+		int fd = mkstemp(path);
+		Journal * journal = NULL;
+		size_t i = 0;
+
+		close(fd);
+		unlink(path);
+		journal = Journal_Open(path, 1, 65536);
+
+		for (auto _ : state)
+		{
+			const Frame &frame = Frames()[i++ % Frames().size()];
+
+			Journal_Append(journal, i, frame[0], &frame[2], frame.size() - 2);
+		}
+		state.SetItemsProcessed(state.iterations());
+
+		Journal_Close(journal);
+		unlink(path);
+	}
+	BENCHMARK(BM_Journal_Append);
+
+}
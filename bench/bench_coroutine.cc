@@ -0,0 +1,197 @@
+#include <benchmark/benchmark.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "ptypair.h"
+#include "serial_data.h"
+
+#include "serial.h"
+#include "78m6610.h"
+#include "frameparser.h"
+#include "coroutine.hpp"
+
+namespace PFC
+{
+
+	static double NowUs()
+	{
+		struct timespec now;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+	}
+
+	// range(0) simulated meters on ptys, a frame from each per iteration
+	struct Meters
+	{
+		std::vector<PtyPair> ptys;
+		std::vector<Serial *> serials;
+		Frame frame;
+		int64_t frames;
+
+		explicit Meters(size_t count) : ptys(count), serials(count), frames(0)
+		{
+			frame = LoadSerialData(MONIP_SERIAL_DATA)[0];
+
+			for (size_t i = 0; i < count; i++)
+			{
+				ptys[i].Open();
+				serials[i] = Serial_New(ptys[i].path.c_str());
+			}
+		}
+
+		~Meters()
+		{
+			for (size_t i = 0; i < serials.size(); i++)
+			{
+				Serial_Free(serials[i]);
+			}
+		}
+
+		void Round()
+		{
+			int64_t target = __atomic_load_n(&frames, __ATOMIC_RELAXED) + ptys.size();
+			double deadline = NowUs() + 1e6;
+
+			for (size_t i = 0; i < ptys.size(); i++)
+			{
+				ssize_t ret = write(ptys[i].master, &frame[0], frame.size());
+				(void)ret;
+			}
+
+			while (__atomic_load_n(&frames, __ATOMIC_ACQUIRE) < target && NowUs() < deadline)
+			{
+				sched_yield();
+			}
+		}
+
+		// readers see EIO and finish
+		void HangUp()
+		{
+			for (size_t i = 0; i < ptys.size(); i++)
+			{
+				ptys[i].Close();
+			}
+		}
+	};
+
+	static monip::Task CountFrames(monip::AsyncPort * port, int64_t * frames)
+	{
+		uint8_t buffer[FRAME_MAX_LENGTH];
+		monip::FrameView view;
+
+		while (co_await port->NextFrame(buffer, &view) > 0)
+		{
+			__atomic_add_fetch(frames, view.IsAutoReport(), __ATOMIC_RELEASE);
+		}
+	}
+
+	static void * RunExecutor(void * arg)
+	{
+		((monip::Executor *)arg)->Run();
+		return NULL;
+	}
+
+	// A session coroutine per meter spread over range(1) executor threads
+	static void BM_Coroutine_Sessions(benchmark::State &state)
+	{
+		Meters meters(state.range(0));
+		std::vector<monip::Executor> executors(state.range(1));
+		std::vector<monip::AsyncPort *> ports;
+		std::vector<pthread_t> threads(executors.size());
+
+		for (size_t i = 0; i < meters.serials.size(); i++)
+		{
+			ports.push_back(new monip::AsyncPort(executors[i % executors.size()], meters.serials[i]));
+			executors[i % executors.size()].Spawn(CountFrames(ports[i], &meters.frames));
+		}
+
+		for (size_t i = 0; i < executors.size(); i++)
+		{
+			pthread_create(&threads[i], NULL, RunExecutor, &executors[i]);
+		}
+
+		for (auto _ : state)
+		{
+			meters.Round();
+		}
+
+		state.SetItemsProcessed(meters.frames);
+		state.counters["frames_per_second"] = benchmark::Counter(meters.frames, benchmark::Counter::kIsRate);
+
+		meters.HangUp();
+		for (size_t i = 0; i < threads.size(); i++)
+		{
+			pthread_join(threads[i], NULL);
+		}
+
+		for (size_t i = 0; i < ports.size(); i++)
+		{
+			delete ports[i];
+		}
+	}
+	BENCHMARK(BM_Coroutine_Sessions)->Args({128, 1})->Args({128, 4})->Args({512, 1})->Args({512, 4})->UseRealTime();
+
+	struct PortThread
+	{
+		Serial * serial;
+		int64_t * frames;
+	};
+
+	static void * ReadPort(void * arg)
+	{
+		PortThread * port = (PortThread *)arg;
+		FrameParser * parser = FrameParser_New(AUTOREPORT_HEADER, AUTOREPORT_LENGTH);
+		uint8_t buffer[FRAME_MAX_LENGTH];
+		int ret = 0;
+
+		while ((ret = FrameParser_Read(parser, port->serial, buffer)) >= 0 || ret == -EAGAIN)
+		{
+			if (ret == AUTOREPORT_PAYLOAD_SIZE)
+			{
+				__atomic_add_fetch(port->frames, 1, __ATOMIC_RELEASE);
+			}
+		}
+
+		FrameParser_Free(parser);
+		return NULL;
+	}
+
+	// The same load with a blocking reader thread per meter
+	static void BM_ThreadPerPort(benchmark::State &state)
+	{
+		Meters meters(state.range(0));
+		std::vector<PortThread> ports(meters.serials.size());
+		std::vector<pthread_t> threads(ports.size());
+
+		for (size_t i = 0; i < ports.size(); i++)
+		{
+			ports[i].serial = meters.serials[i];
+			ports[i].frames = &meters.frames;
+			pthread_create(&threads[i], NULL, ReadPort, &ports[i]);
+		}
+
+		for (auto _ : state)
+		{
+			meters.Round();
+		}
+
+		state.SetItemsProcessed(meters.frames);
+		state.counters["frames_per_second"] = benchmark::Counter(meters.frames, benchmark::Counter::kIsRate);
+
+		meters.HangUp();
+		for (size_t i = 0; i < threads.size(); i++)
+		{
+			pthread_join(threads[i], NULL);
+		}
+	}
+	BENCHMARK(BM_ThreadPerPort)->Arg(128)->Arg(512)->UseRealTime();
+
+}
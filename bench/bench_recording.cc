@@ -0,0 +1,111 @@
+#include <benchmark/benchmark.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "serial_data.h"
+
+#include "78m6610.h"
+#include "recording.h"
+
+namespace PFC
+{
+
+	// A temporary recording and the equivalent hex log of count frames
+	struct RecordingFiles
+	{
+		std::string binary;
+		std::string hex;
+
+		explicit RecordingFiles(size_t count)
+		{
+			std::vector<Frame> frames = LoadSerialData(MONIP_SERIAL_DATA);
+			char name[] = "/tmp/monip_bench_XXXXXX";
+			int fd = mkstemp(name);
+
+			close(fd);
+			binary = std::string(name) + ".rec";
+			hex = std::string(name) + ".txt";
+			unlink(name);
+
+			Recorder * recorder = Recorder_Open(binary.c_str());
+			FILE * text = fopen(hex.c_str(), "w");
+
+			for (size_t i = 0; i < count; i++)
+			{
+				const Frame &frame = frames[i % frames.size()];
+
+				Recorder_Write(recorder, i, i % 64, frame[0], &frame[2], frame.size() - 2);
+				for (size_t j = 0; j < frame.size(); j++)
+				{
+					fprintf(text, "%02X", frame[j]);
+				}
+				fputc('\n', text);
+			}
+
+			Recorder_Close(recorder);
+			fclose(text);
+		}
+
+		~RecordingFiles()
+		{
+			unlink(binary.c_str());
+			unlink(hex.c_str());
+		}
+	};
+
+	// mmap and decode every record in place
+	static void BM_Recording_Replay(benchmark::State &state)
+	{
+		RecordingFiles files(state.range(0));
+		AutoReportValues values;
+		double energy = 0;
+
+		for (auto _ : state)
+		{
+			Recording * recording = Recording_Open(files.binary.c_str());
+			const RecordingRecord * records = Recording_Records(recording);
+
+			for (size_t i = 0; i < Recording_Count(recording); i++)
+			{
+				ConvertAutoReport((const AutoReportMessage *)&records[i].Frame[2], &values);
+				energy += values.KwH;
+			}
+
+			Recording_Close(recording);
+		}
+
+		benchmark::DoNotOptimize(energy);
+		state.SetItemsProcessed(state.iterations() * state.range(0));
+		state.SetBytesProcessed(state.iterations() * (sizeof(RecordingHeader) + state.range(0) * sizeof(RecordingRecord)));
+	}
+	BENCHMARK(BM_Recording_Replay)->Arg(1 << 20);
+
+	// The same frames read back from the hex text log
+	static void BM_Recording_ReplayHex(benchmark::State &state)
+	{
+		RecordingFiles files(state.range(0));
+		AutoReportValues values;
+		double energy = 0;
+
+		for (auto _ : state)
+		{
+			std::vector<Frame> frames = LoadSerialData(files.hex);
+
+			for (size_t i = 0; i < frames.size(); i++)
+			{
+				ConvertAutoReport((const AutoReportMessage *)&frames[i][2], &values);
+				energy += values.KwH;
+			}
+		}
+
+		benchmark::DoNotOptimize(energy);
+		state.SetItemsProcessed(state.iterations() * state.range(0));
+	}
+	BENCHMARK(BM_Recording_ReplayHex)->Arg(1 << 20);
+
+}
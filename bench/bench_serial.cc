@@ -0,0 +1,283 @@
+#include <benchmark/benchmark.h>
+#include <sched.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "ptypair.h"
+#include "serial_data.h"
+
+#include "serial.h"
+#include "78m6610.h"
+#include "frameparser.h"
+#include "reactor.h"
+#include "shardedreactor.h"
+
+namespace PFC
+{
+
+	static std::vector<uint8_t> Stream(size_t frames)
+	{
+		static std::vector<Frame> data = LoadSerialData(MONIP_SERIAL_DATA);
+		std::vector<uint8_t> stream;
+
+		for (size_t i = 0; i < frames; i++)
+		{
+			stream.insert(stream.end(), data[i % data.size()].begin(), data[i % data.size()].end());
+		}
+
+		return stream;
+	}
+
+	static double NowUs()
+	{
+		struct timespec now;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+	}
+
+	static void WriteAll(int fd, const std::vector<uint8_t> &data)
+	{
+		size_t done = 0;
+
+		while (done < data.size())
+		{
+			ssize_t ret = write(fd, &data[done], data.size() - done);
+
+			if (ret <= 0)
+			{
+				break;
+			}
+			done += ret;
+		}
+	}
+
+	// End to end over a pty: one write of range(0) frames, read back frame by frame
+	static void BM_Loopback_ReadMessage(benchmark::State &state)
+	{
+		PtyPair pty;
+		pty.Open();
+		Serial * serial = Serial_New(pty.path.c_str());
+		std::vector<uint8_t> stream = Stream(state.range(0));
+		uint8_t buffer[FRAME_MAX_LENGTH];
+		int64_t frames = 0;
+
+		for (auto _ : state)
+		{
+			WriteAll(pty.master, stream);
+			for (int64_t i = 0; i < state.range(0); i++)
+			{
+				frames += (ReadMessage(serial, AUTOREPORT_HEADER, buffer) == AUTOREPORT_PAYLOAD_SIZE);
+			}
+		}
+
+		state.SetItemsProcessed(frames);
+		state.counters["frames_per_second"] = benchmark::Counter(frames, benchmark::Counter::kIsRate);
+
+		Serial_Free(serial);
+	}
+	BENCHMARK(BM_Loopback_ReadMessage)->Arg(32)->UseRealTime();
+
+	static void BM_Loopback_FrameParser(benchmark::State &state)
+	{
+		PtyPair pty;
+		pty.Open();
+		Serial * serial = Serial_New(pty.path.c_str());
+		FrameParser * parser = FrameParser_New(AUTOREPORT_HEADER, AUTOREPORT_LENGTH);
+		std::vector<uint8_t> stream = Stream(state.range(0));
+		uint8_t buffer[FRAME_MAX_LENGTH];
+		int64_t frames = 0;
+
+		for (auto _ : state)
+		{
+			WriteAll(pty.master, stream);
+			for (int64_t i = 0; i < state.range(0); i++)
+			{
+				frames += (FrameParser_Read(parser, serial, buffer) == AUTOREPORT_PAYLOAD_SIZE);
+			}
+		}
+
+		state.SetItemsProcessed(frames);
+		state.counters["frames_per_second"] = benchmark::Counter(frames, benchmark::Counter::kIsRate);
+
+		FrameParser_Free(parser);
+		Serial_Free(serial);
+	}
+	BENCHMARK(BM_Loopback_FrameParser)->Arg(32)->UseRealTime();
+
+	// Per frame latency from write() on the master to a decoded frame
+	static void BM_Loopback_Latency(benchmark::State &state)
+	{
+		PtyPair pty;
+		pty.Open();
+		Serial * serial = Serial_New(pty.path.c_str());
+		FrameParser * parser = FrameParser_New(AUTOREPORT_HEADER, AUTOREPORT_LENGTH);
+		std::vector<uint8_t> stream = Stream(1);
+		uint8_t buffer[FRAME_MAX_LENGTH];
+		AutoReportValues values;
+		double total = 0;
+		double worst = 0;
+
+		for (auto _ : state)
+		{
+			double start = NowUs();
+
+			WriteAll(pty.master, stream);
+			if (FrameParser_Read(parser, serial, buffer) == AUTOREPORT_PAYLOAD_SIZE)
+			{
+				ConvertAutoReport((const AutoReportMessage *)buffer, &values);
+			}
+
+			double elapsed = NowUs() - start;
+			total += elapsed;
+			worst = std::max(worst, elapsed);
+		}
+
+		state.counters["latency_us"] = total / state.iterations();
+		state.counters["latency_max_us"] = worst;
+
+		FrameParser_Free(parser);
+		Serial_Free(serial);
+	}
+	BENCHMARK(BM_Loopback_Latency)->UseRealTime();
+
+	struct DeviceSet
+	{
+		std::vector<PtyPair> ptys;
+		std::vector<Serial *> serials;
+		std::vector<uint8_t> frame;
+
+		explicit DeviceSet(size_t count) : ptys(count), serials(count), frame(Stream(1))
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				ptys[i].Open();
+				serials[i] = Serial_New(ptys[i].path.c_str());
+			}
+		}
+
+		~DeviceSet()
+		{
+			for (size_t i = 0; i < serials.size(); i++)
+			{
+				Serial_Free(serials[i]);
+			}
+		}
+
+		void SendAll()
+		{
+			for (size_t i = 0; i < ptys.size(); i++)
+			{
+				WriteAll(ptys[i].master, frame);
+			}
+		}
+	};
+
+	static void CountFrame(void * context, Serial * serial, const AutoReportMessage * message, const AutoReportValues * values)
+	{
+		if (message != NULL)
+		{
+			__atomic_add_fetch((int64_t *)context, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	// One frame from every device per iteration through a single Reactor
+	static void RunReactor(benchmark::State &state, ReactorBackend backend)
+	{
+		DeviceSet devices(state.range(0));
+		Reactor * reactor = Reactor_NewWithBackend(backend);
+		int64_t frames = 0;
+
+		if (reactor == NULL)
+		{
+			state.SkipWithError("backend not available");
+			return;
+		}
+
+		for (size_t i = 0; i < devices.serials.size(); i++)
+		{
+			Reactor_Add(reactor, devices.serials[i], CountFrame, &frames);
+		}
+
+		for (auto _ : state)
+		{
+			int64_t target = frames + state.range(0);
+
+			devices.SendAll();
+			while (frames < target && Reactor_RunOnce(reactor, 100) >= 0)
+			{
+			}
+		}
+
+		state.SetItemsProcessed(frames);
+		state.counters["frames_per_second"] = benchmark::Counter(frames, benchmark::Counter::kIsRate);
+
+		Reactor_Free(reactor);
+	}
+
+	static void BM_Reactor(benchmark::State &state)
+	{
+		RunReactor(state, REACTOR_BACKEND_EPOLL);
+	}
+	BENCHMARK(BM_Reactor)->Arg(16)->Arg(64)->Arg(256)->Arg(1024)->UseRealTime();
+
+	// Same load with reads kept outstanding through io_uring
+	static void BM_Reactor_Uring(benchmark::State &state)
+	{
+		RunReactor(state, REACTOR_BACKEND_URING);
+	}
+	BENCHMARK(BM_Reactor_Uring)->Arg(16)->Arg(64)->Arg(256)->Arg(1024)->UseRealTime();
+
+	// Stand-in for per frame export work: serialize the frame a few times
+	static void ExportFrame(void * context, Serial * serial, const AutoReportMessage * message, const AutoReportValues * values)
+	{
+		if (message != NULL)
+		{
+			char text[AUTOREPORT_JSON_MAX];
+
+			for (int i = 0; i < 32; i++)
+			{
+				benchmark::DoNotOptimize(AutoReportToJSON(message, text, sizeof(text)));
+			}
+			__atomic_add_fetch((int64_t *)context, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	// Throughput against shard count with 64 devices, should scale with cores
+	static void BM_ShardedReactor(benchmark::State &state)
+	{
+		const size_t DeviceCount = 64;
+		DeviceSet devices(DeviceCount);
+		ShardedReactor * sharded = ShardedReactor_New(state.range(0), 1);
+		int64_t frames = 0;
+
+		for (size_t i = 0; i < DeviceCount; i++)
+		{
+			ShardedReactor_Add(sharded, devices.serials[i], ExportFrame, &frames);
+		}
+
+		for (auto _ : state)
+		{
+			int64_t target = __atomic_load_n(&frames, __ATOMIC_RELAXED) + DeviceCount;
+			double deadline = NowUs() + 1e6;
+
+			devices.SendAll();
+			while (__atomic_load_n(&frames, __ATOMIC_RELAXED) < target && NowUs() < deadline)
+			{
+				sched_yield();
+			}
+		}
+
+		state.SetItemsProcessed(frames);
+		state.counters["frames_per_second"] = benchmark::Counter(frames, benchmark::Counter::kIsRate);
+
+		ShardedReactor_Free(sharded);
+	}
+	BENCHMARK(BM_ShardedReactor)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+}
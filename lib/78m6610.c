@@ -4,12 +4,17 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <time.h>
 
 #include "serial.h"
 #include "78m6610.h"
+#include "jsonbuffer.h"
+#include "journal.h"
+#include "serialstats.h"
 
 
 
+#ifndef MONIP_STATIC_ALLOCATION
 size_t msprintf(char ** string, const char * format, ...)
 {
     int len = 0;
@@ -26,7 +31,7 @@ size_t msprintf(char ** string, const char * format, ...)
 
         if (len > 0)
         {
-            *string = (char *)calloc(len + 1, 0);
+            *string = (char *)calloc(len + 1, 1);
             if (*string != NULL)
             {
                 va_list args;
@@ -38,22 +43,10 @@ size_t msprintf(char ** string, const char * format, ...)
     }
     return (len > 0) ? len : 0;
 }
+#endif
 
 
 
-struct __attribute__((__packed__)) _AutoReportMessage
-{
-    uint32_t Unkown1 : 24;
-    uint32_t Unkown2 : 24;
-    uint32_t Vrms : 24;
-    uint32_t Irms : 24;
-    uint32_t Watts : 24;
-    uint32_t Pavg : 24;
-    uint32_t PF : 24;
-    uint32_t Freq : 24;
-    uint32_t KwH : 24;
-};
-
 /*
 vrms = np.mean(result[:,2])*1e-3
 irms = np.mean(result[:,3])*7.77e-6
@@ -75,54 +68,107 @@ kwh = [float(x)/1000 for x in data['kwh']]
 */
 
 
-#define CONVERT_INT24(value) (int32_t)(value & 0x800000 ? value | 0xff000000 : value)
+/*
+ * ConvertAutoReport(), AutoReportToJSON(), AutoReportToCSV(),
+ * JSONBuffer_AppendAutoReport() and ValidateMessage() are generated from the
+ * field table in framelayout.hpp, see 78m6610_layout.cc
+ */
 
+#define JSON_SCRATCH_SIZE (7 * JSON_FIXED2_MAX + 64)
 
-void ConvertAutoReport(const AutoReportMessage * message, AutoReportValues * values)
+/*
+ * Fixed point decode, payload layout from 78m6610.h. Power is raw * 1000 /
+ * AUTOREPORT_WATTS_DIVISOR in mW, the other fields but Irms are raw already
+ * in thousandths. Irms is raw * 10^6 / 128700.125 (AUTOREPORT_IRMS_DIVISOR
+ * as a float) in uA, taken as a 2^28 fixed point multiplier that fits a
+ * 32x32->64 multiply.
+ */
+#define WATTS_MW_MULTIPLIER ((int32_t)(1000.0f / AUTOREPORT_WATTS_DIVISOR))
+#define PAVG_MW_MULTIPLIER  ((int32_t)(1000.0f / AUTOREPORT_PAVG_DIVISOR))
+#define IRMS_UA_MULTIPLIER  2085743553
+#define IRMS_UA_SHIFT       28
+
+static inline int32_t LoadInt24(const uint8_t * ptr)
 {
-    values->Vrms  = CONVERT_INT24(message->Vrms)   / 1000.0f;
-    values->Irms  = CONVERT_INT24(message->Irms)   / 128700.1287f;
-    values->Watts = CONVERT_INT24(message->Watts)  / 200.0f;
-    values->Pavg  = CONVERT_INT24(message->Pavg)   / 200.0f;
-    values->PF    = CONVERT_INT24(message->PF)     / 1000.0f;
-    values->Freq  = CONVERT_INT24(message->Freq)   / 1000.0f;
-    values->KwH   = CONVERT_INT24(message->KwH)    / 1000.0f;   
+    uint32_t value = (uint32_t)ptr[0] | ((uint32_t)ptr[1] << 8) | ((uint32_t)ptr[2] << 16);
+
+    return (int32_t)(value & 0x800000 ? value | 0xff000000 : value);
 }
 
-char * ConvertAutoReportToJSON(const AutoReportMessage * message)
+void ConvertAutoReportFixed(const AutoReportMessage * message, AutoReportValuesFixed * values)
 {
-    AutoReportValues values = {0};
-    char * Result = NULL;
+    const uint8_t * payload = (const uint8_t *)message;
+    int64_t irms = (int64_t)LoadInt24(payload + AUTOREPORT_IRMS_OFFSET) * IRMS_UA_MULTIPLIER;
+
+    values->Vrms  = LoadInt24(payload + AUTOREPORT_VRMS_OFFSET);
+    values->Irms  = (int32_t)((irms + (1 << (IRMS_UA_SHIFT - 1))) >> IRMS_UA_SHIFT);
+    values->Watts = LoadInt24(payload + AUTOREPORT_WATTS_OFFSET) * WATTS_MW_MULTIPLIER;
+    values->Pavg  = LoadInt24(payload + AUTOREPORT_PAVG_OFFSET) * PAVG_MW_MULTIPLIER;
+    values->PF    = LoadInt24(payload + AUTOREPORT_PF_OFFSET);
+    values->Freq  = LoadInt24(payload + AUTOREPORT_FREQ_OFFSET);
+    values->KwH   = LoadInt24(payload + AUTOREPORT_KWH_OFFSET);
+}
+
+static char * AppendScaledField(char * ptr, const char * name, size_t nameLength, int32_t value, unsigned scaleDigits)
+{
+    memcpy(ptr, name, nameLength);
+    ptr += nameLength;
 
-    ConvertAutoReport(message, &values);
-
-    msprintf(&Result, 
-        "{"
-        "\"Vrms\":%3.2f,"
-        "\"Irms\":%3.2f,"
-        "\"Watts\":%3.2f,"
-        "\"Pavg\":%3.2f,"
-        "\"PF\":%3.2f,"
-        "\"Freq\":%3.2f,"
-        "\"kWh\":%3.2f"
-        "}"
-        , 
-        values.Vrms,
-        values.Irms,
-        values.Watts,
-        values.Pavg,
-        values.PF,
-        values.Freq,
-        values.KwH
-    );
+    return ptr + JSON_FormatScaled2(ptr, value, scaleDigits);
+}
 
-    return Result;
+#define APPEND_SCALED(ptr, name, value, digits) AppendScaledField((ptr), (name), sizeof(name) - 1, (value), (digits))
+
+int AutoReportFixedToJSON(const AutoReportValuesFixed * values, char * buffer, size_t size)
+{
+    char scratch[JSON_SCRATCH_SIZE];
+    char * ptr = scratch;
+    size_t length = 0;
+
+    if(values == NULL || buffer == NULL)
+    {
+        return -EINVAL;
+    }
+
+    ptr = APPEND_SCALED(ptr, "{\"Vrms\":", values->Vrms, 3);
+    ptr = APPEND_SCALED(ptr, ",\"Irms\":", values->Irms, 6);
+    ptr = APPEND_SCALED(ptr, ",\"Watts\":", values->Watts, 3);
+    ptr = APPEND_SCALED(ptr, ",\"Pavg\":", values->Pavg, 3);
+    ptr = APPEND_SCALED(ptr, ",\"PF\":", values->PF, 3);
+    ptr = APPEND_SCALED(ptr, ",\"Freq\":", values->Freq, 3);
+    ptr = APPEND_SCALED(ptr, ",\"kWh\":", values->KwH, 3);
+    *ptr++ = '}';
+    *ptr = '\0';
+
+    length = ptr - scratch;
+
+    if(length >= size)
+    {
+        return -ENOSPC;
+    }
+
+    memcpy(buffer, scratch, length + 1);
 
+    return (int)length;
 }
 
+#ifndef MONIP_STATIC_ALLOCATION
+char * ConvertAutoReportToJSON(const AutoReportMessage * message)
+{
+    char text[AUTOREPORT_JSON_MAX];
+    char * Result = NULL;
+    int length = AutoReportToJSON(message, text, sizeof(text));
 
+    Result = (length >= 0) ? malloc(length + 1) : NULL;
 
+    if(Result != NULL)
+    {
+        memcpy(Result, text, length + 1);
+    }
 
+    return Result;
+}
+#endif
 
 int ReadMessage(Serial * serial, uint8_t expectedHeader, uint8_t * buffer)
 {
@@ -138,20 +184,7 @@ int ReadMessage(Serial * serial, uint8_t expectedHeader, uint8_t * buffer)
 
             if(Result > 0)
             {
-                uint8_t sum = 0;
-                uint8_t pos = 0;
-
-                sum += PacketHeader;
-                sum += PacketLength;
-
-                for(pos = 0; pos < Result; pos++)
-                {
-                    sum += buffer[pos];
-                }
-
-                sum = ((~sum)+1);
-
-                if(sum != 0)
+                if(ValidateMessage(PacketHeader, PacketLength, buffer, Result) != 0)
                 {
                     Result = -EIO;
                 }
@@ -176,5 +209,22 @@ int ReadMessage(Serial * serial, uint8_t expectedHeader, uint8_t * buffer)
         Result = -EAGAIN;
     }
 
+    if(serial != NULL)
+    {
+        if(Result == -EAGAIN)
+        {
+            SerialStats_Timeout(serial);
+        }
+        SerialStats_Parsed(serial, Result, 0, Result == -EIO, Result == -EFAULT, 0);
+
+        if(Result > 0 && Serial_Journal(serial) != NULL)
+        {
+            struct timespec now;
+
+            clock_gettime(CLOCK_REALTIME, &now);
+            Journal_Append(Serial_Journal(serial), (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec, PacketHeader, buffer, (uint8_t)Result);
+        }
+    }
+
     return Result;
 }
\ No newline at end of file
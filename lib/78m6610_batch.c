@@ -0,0 +1,261 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "serial.h"
+#include "78m6610.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BATCH_X86
+#endif
+
+/*
+ * Batch decoding of AutoReport payloads into structure-of-arrays output.
+ *
+ * Payload byte layout (little endian 24-bit fields, see 78m6610.h):
+ *   0 Unknown1, 3 Unknown2, 6 Vrms, 9 Irms, 12 Watts, 15 Pavg, 18 PF,
+ *   21 Freq, 24 KwH, 27 checksum
+ *
+ * All implementations multiply by the same float reciprocals, so the SIMD
+ * paths are bit-for-bit identical to the scalar one.
+ */
+
+#define FIELD_COUNT AUTOREPORT_FIELD_COUNT
+
+static const size_t FieldOffset[FIELD_COUNT] =
+{
+    AUTOREPORT_VRMS_OFFSET, AUTOREPORT_IRMS_OFFSET, AUTOREPORT_WATTS_OFFSET, AUTOREPORT_PAVG_OFFSET,
+    AUTOREPORT_PF_OFFSET, AUTOREPORT_FREQ_OFFSET, AUTOREPORT_KWH_OFFSET,
+};
+
+static const float FieldScale[FIELD_COUNT] =
+{
+    1.0f / AUTOREPORT_VRMS_DIVISOR,
+    1.0f / AUTOREPORT_IRMS_DIVISOR,
+    1.0f / AUTOREPORT_WATTS_DIVISOR,
+    1.0f / AUTOREPORT_PAVG_DIVISOR,
+    1.0f / AUTOREPORT_PF_DIVISOR,
+    1.0f / AUTOREPORT_FREQ_DIVISOR,
+    1.0f / AUTOREPORT_KWH_DIVISOR,
+};
+
+typedef void (*ConvertBatchFn)(const uint8_t * payloads, size_t count, const AutoReportBatch * values);
+
+static inline int32_t LoadInt24(const uint8_t * ptr)
+{
+    uint32_t value = (uint32_t)ptr[0] | ((uint32_t)ptr[1] << 8) | ((uint32_t)ptr[2] << 16);
+
+    return (int32_t)(value & 0x800000 ? value | 0xff000000 : value);
+}
+
+static inline void ConvertOne(const uint8_t * payload, size_t index, const AutoReportBatch * values)
+{
+    values->Vrms[index]  = (float)LoadInt24(payload + FieldOffset[0]) * FieldScale[0];
+    values->Irms[index]  = (float)LoadInt24(payload + FieldOffset[1]) * FieldScale[1];
+    values->Watts[index] = (float)LoadInt24(payload + FieldOffset[2]) * FieldScale[2];
+    values->Pavg[index]  = (float)LoadInt24(payload + FieldOffset[3]) * FieldScale[3];
+    values->PF[index]    = (float)LoadInt24(payload + FieldOffset[4]) * FieldScale[4];
+    values->Freq[index]  = (float)LoadInt24(payload + FieldOffset[5]) * FieldScale[5];
+    values->KwH[index]   = (float)LoadInt24(payload + FieldOffset[6]) * FieldScale[6];
+}
+
+void ConvertAutoReportBatchScalar(const uint8_t * payloads, size_t count, const AutoReportBatch * values)
+{
+    size_t i = 0;
+
+    for(i = 0; i < count; i++)
+    {
+        ConvertOne(payloads + i * AUTOREPORT_PAYLOAD_SIZE, i, values);
+    }
+}
+
+#ifdef BATCH_X86
+
+/*
+ * Two 16 byte loads per payload cover every field: "low" starts at Vrms
+ * (Vrms, Irms, Watts, Pavg) and "high" at Watts (PF, Freq, KwH). The shuffle
+ * moves each 24-bit field into the top three bytes of a 32-bit lane so an
+ * arithmetic shift right by 8 sign extends it.
+ */
+#define LOW_OFFSET  AUTOREPORT_VRMS_OFFSET
+#define HIGH_OFFSET AUTOREPORT_WATTS_OFFSET
+
+#define SHUFFLE_LOW  0x0b0a0980, 0x08070680, 0x05040380, 0x02010080
+#define SHUFFLE_HIGH 0x80808080, 0x0e0d0c80, 0x0b0a0980, 0x08070680
+
+__attribute__((target("ssse3")))
+static inline __m128 DecodeLane128(const uint8_t * ptr, __m128i shuffle, __m128 scale)
+{
+    __m128i raw = _mm_loadu_si128((const __m128i *)ptr);
+
+    raw = _mm_srai_epi32(_mm_shuffle_epi8(raw, shuffle), 8);
+
+    return _mm_mul_ps(_mm_cvtepi32_ps(raw), scale);
+}
+
+__attribute__((target("ssse3")))
+void ConvertAutoReportBatchSSSE3(const uint8_t * payloads, size_t count, const AutoReportBatch * values)
+{
+    const __m128i shuffleLow = _mm_set_epi32(SHUFFLE_LOW);
+    const __m128i shuffleHigh = _mm_set_epi32(SHUFFLE_HIGH);
+    const __m128 scaleLow = _mm_setr_ps(FieldScale[0], FieldScale[1], FieldScale[2], FieldScale[3]);
+    const __m128 scaleHigh = _mm_setr_ps(FieldScale[4], FieldScale[5], FieldScale[6], 0.0f);
+    size_t i = 0;
+
+    for(; i + 4 <= count; i += 4)
+    {
+        const uint8_t * ptr = payloads + i * AUTOREPORT_PAYLOAD_SIZE;
+        __m128 a0 = DecodeLane128(ptr + 0 * AUTOREPORT_PAYLOAD_SIZE + LOW_OFFSET, shuffleLow, scaleLow);
+        __m128 a1 = DecodeLane128(ptr + 1 * AUTOREPORT_PAYLOAD_SIZE + LOW_OFFSET, shuffleLow, scaleLow);
+        __m128 a2 = DecodeLane128(ptr + 2 * AUTOREPORT_PAYLOAD_SIZE + LOW_OFFSET, shuffleLow, scaleLow);
+        __m128 a3 = DecodeLane128(ptr + 3 * AUTOREPORT_PAYLOAD_SIZE + LOW_OFFSET, shuffleLow, scaleLow);
+        __m128 b0 = DecodeLane128(ptr + 0 * AUTOREPORT_PAYLOAD_SIZE + HIGH_OFFSET, shuffleHigh, scaleHigh);
+        __m128 b1 = DecodeLane128(ptr + 1 * AUTOREPORT_PAYLOAD_SIZE + HIGH_OFFSET, shuffleHigh, scaleHigh);
+        __m128 b2 = DecodeLane128(ptr + 2 * AUTOREPORT_PAYLOAD_SIZE + HIGH_OFFSET, shuffleHigh, scaleHigh);
+        __m128 b3 = DecodeLane128(ptr + 3 * AUTOREPORT_PAYLOAD_SIZE + HIGH_OFFSET, shuffleHigh, scaleHigh);
+
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+
+        _mm_storeu_ps(values->Vrms + i, a0);
+        _mm_storeu_ps(values->Irms + i, a1);
+        _mm_storeu_ps(values->Watts + i, a2);
+        _mm_storeu_ps(values->Pavg + i, a3);
+        _mm_storeu_ps(values->PF + i, b0);
+        _mm_storeu_ps(values->Freq + i, b1);
+        _mm_storeu_ps(values->KwH + i, b2);
+    }
+
+    for(; i < count; i++)
+    {
+        ConvertOne(payloads + i * AUTOREPORT_PAYLOAD_SIZE, i, values);
+    }
+}
+
+/* payload n in the low 128-bit lane, payload n + 4 in the high lane */
+__attribute__((target("avx2")))
+static inline __m256 DecodeLane256(const uint8_t * ptr, __m256i shuffle, __m256 scale)
+{
+    __m256i raw = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)ptr)),
+        _mm_loadu_si128((const __m128i *)(ptr + 4 * AUTOREPORT_PAYLOAD_SIZE)), 1);
+
+    raw = _mm256_srai_epi32(_mm256_shuffle_epi8(raw, shuffle), 8);
+
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(raw), scale);
+}
+
+/* in-lane 4x4 transpose, leaving one field of 8 payloads per register */
+#define TRANSPOSE4_256(r0, r1, r2, r3) do { \
+    __m256 t0 = _mm256_unpacklo_ps((r0), (r1)); \
+    __m256 t1 = _mm256_unpackhi_ps((r0), (r1)); \
+    __m256 t2 = _mm256_unpacklo_ps((r2), (r3)); \
+    __m256 t3 = _mm256_unpackhi_ps((r2), (r3)); \
+    (r0) = _mm256_shuffle_ps(t0, t2, 0x44); \
+    (r1) = _mm256_shuffle_ps(t0, t2, 0xee); \
+    (r2) = _mm256_shuffle_ps(t1, t3, 0x44); \
+    (r3) = _mm256_shuffle_ps(t1, t3, 0xee); \
+} while(0)
+
+__attribute__((target("avx2")))
+static void ConvertAutoReportBatchAVX2(const uint8_t * payloads, size_t count, const AutoReportBatch * values)
+{
+    const __m256i shuffleLow = _mm256_set_epi32(SHUFFLE_LOW, SHUFFLE_LOW);
+    const __m256i shuffleHigh = _mm256_set_epi32(SHUFFLE_HIGH, SHUFFLE_HIGH);
+    const __m256 scaleLow = _mm256_setr_ps(FieldScale[0], FieldScale[1], FieldScale[2], FieldScale[3],
+                                           FieldScale[0], FieldScale[1], FieldScale[2], FieldScale[3]);
+    const __m256 scaleHigh = _mm256_setr_ps(FieldScale[4], FieldScale[5], FieldScale[6], 0.0f,
+                                            FieldScale[4], FieldScale[5], FieldScale[6], 0.0f);
+    size_t i = 0;
+
+    for(; i + 8 <= count; i += 8)
+    {
+        const uint8_t * ptr = payloads + i * AUTOREPORT_PAYLOAD_SIZE;
+        __m256 a0 = DecodeLane256(ptr + 0 * AUTOREPORT_PAYLOAD_SIZE + LOW_OFFSET, shuffleLow, scaleLow);
+        __m256 a1 = DecodeLane256(ptr + 1 * AUTOREPORT_PAYLOAD_SIZE + LOW_OFFSET, shuffleLow, scaleLow);
+        __m256 a2 = DecodeLane256(ptr + 2 * AUTOREPORT_PAYLOAD_SIZE + LOW_OFFSET, shuffleLow, scaleLow);
+        __m256 a3 = DecodeLane256(ptr + 3 * AUTOREPORT_PAYLOAD_SIZE + LOW_OFFSET, shuffleLow, scaleLow);
+        __m256 b0 = DecodeLane256(ptr + 0 * AUTOREPORT_PAYLOAD_SIZE + HIGH_OFFSET, shuffleHigh, scaleHigh);
+        __m256 b1 = DecodeLane256(ptr + 1 * AUTOREPORT_PAYLOAD_SIZE + HIGH_OFFSET, shuffleHigh, scaleHigh);
+        __m256 b2 = DecodeLane256(ptr + 2 * AUTOREPORT_PAYLOAD_SIZE + HIGH_OFFSET, shuffleHigh, scaleHigh);
+        __m256 b3 = DecodeLane256(ptr + 3 * AUTOREPORT_PAYLOAD_SIZE + HIGH_OFFSET, shuffleHigh, scaleHigh);
+
+        TRANSPOSE4_256(a0, a1, a2, a3);
+        TRANSPOSE4_256(b0, b1, b2, b3);
+
+        _mm256_storeu_ps(values->Vrms + i, a0);
+        _mm256_storeu_ps(values->Irms + i, a1);
+        _mm256_storeu_ps(values->Watts + i, a2);
+        _mm256_storeu_ps(values->Pavg + i, a3);
+        _mm256_storeu_ps(values->PF + i, b0);
+        _mm256_storeu_ps(values->Freq + i, b1);
+        _mm256_storeu_ps(values->KwH + i, b2);
+    }
+
+    if(i < count)
+    {
+        ConvertAutoReportBatchSSSE3(payloads + i * AUTOREPORT_PAYLOAD_SIZE, count - i,
+            &(AutoReportBatch){ values->Vrms + i, values->Irms + i, values->Watts + i, values->Pavg + i,
+                                values->PF + i, values->Freq + i, values->KwH + i });
+    }
+}
+
+#endif /* BATCH_X86 */
+
+/* Resolved on first use, the CPU does not change under us */
+static ConvertBatchFn Implementation = NULL;
+static const char * ImplementationName = NULL;
+
+static ConvertBatchFn SelectImplementation(const char ** name)
+{
+    ConvertBatchFn Result = __atomic_load_n(&Implementation, __ATOMIC_ACQUIRE);
+    const char * Name = "scalar";
+
+    if(Result == NULL)
+    {
+        Result = ConvertAutoReportBatchScalar;
+
+#ifdef BATCH_X86
+        __builtin_cpu_init();
+
+        if(__builtin_cpu_supports("avx2"))
+        {
+            Result = ConvertAutoReportBatchAVX2;
+            Name = "avx2";
+        }
+        else if(__builtin_cpu_supports("ssse3"))
+        {
+            Result = ConvertAutoReportBatchSSSE3;
+            Name = "ssse3";
+        }
+#endif
+
+        /* racing threads resolve the same answer */
+        __atomic_store_n(&ImplementationName, Name, __ATOMIC_RELAXED);
+        __atomic_store_n(&Implementation, Result, __ATOMIC_RELEASE);
+    }
+
+    if(name != NULL)
+    {
+        *name = __atomic_load_n(&ImplementationName, __ATOMIC_RELAXED);
+    }
+
+    return Result;
+}
+
+void ConvertAutoReportBatch(const uint8_t * payloads, size_t count, const AutoReportBatch * values)
+{
+    if(payloads != NULL && values != NULL)
+    {
+        SelectImplementation(NULL)(payloads, count, values);
+    }
+}
+
+const char * ConvertAutoReportBatchImplementation(void)
+{
+    const char * Name = NULL;
+
+    SelectImplementation(&Name);
+
+    return Name;
+}
@@ -0,0 +1,94 @@
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "78m6610.h"
+#include "jsonbuffer.h"
+#include "framelayout.hpp"
+
+/* C entry points over the generated AutoReport decoder, serializers and checksum test */
+
+using monip::AutoReportFrame;
+
+static_assert(AutoReportFrame::DecodedJSONMax() < AUTOREPORT_JSON_MAX, "AUTOREPORT_JSON_MAX too small");
+static_assert(AutoReportFrame::DecodedCSVMax() < AUTOREPORT_JSON_MAX, "AUTOREPORT_JSON_MAX too small");
+
+extern "C" void ConvertAutoReport(const AutoReportMessage * message, AutoReportValues * values)
+{
+    AutoReportFrame::Decode(reinterpret_cast<const uint8_t *>(message), values);
+}
+
+/* Straight into buffer when the longest text fits, else through scratch */
+template<size_t Max, size_t (*Format)(char *, const AutoReportValues &)>
+static int FormatInto(const AutoReportMessage * message, char * buffer, size_t size)
+{
+    AutoReportValues values;
+    char scratch[Max + 1];
+    size_t length = 0;
+
+    if(message == NULL || buffer == NULL)
+    {
+        return -EINVAL;
+    }
+
+    ConvertAutoReport(message, &values);
+
+    if(size > Max)
+    {
+        length = Format(buffer, values);
+        buffer[length] = '\0';
+
+        return (int)length;
+    }
+
+    length = Format(scratch, values);
+
+    if(length >= size)
+    {
+        return -ENOSPC;
+    }
+
+    memcpy(buffer, scratch, length);
+    buffer[length] = '\0';
+
+    return (int)length;
+}
+
+extern "C" int AutoReportToJSON(const AutoReportMessage * message, char * buffer, size_t size)
+{
+    return FormatInto<AutoReportFrame::DecodedJSONMax(), AutoReportFrame::FormatJSON>(message, buffer, size);
+}
+
+extern "C" int AutoReportToCSV(const AutoReportMessage * message, char * buffer, size_t size)
+{
+    return FormatInto<AutoReportFrame::DecodedCSVMax(), AutoReportFrame::FormatCSV>(message, buffer, size);
+}
+
+extern "C" int JSONBuffer_AppendAutoReport(JSONBuffer * buffer, const AutoReportMessage * message)
+{
+    char text[AutoReportFrame::DecodedJSONMax() + 1];
+    int length = AutoReportToJSON(message, text, sizeof(text));
+
+    return (length < 0) ? length : JSONBuffer_AppendRecord(buffer, text, (size_t)length);
+}
+
+extern "C" int ValidateMessage(uint8_t header, uint8_t length, const uint8_t * payload, uint8_t count)
+{
+    uint8_t sum = 0;
+    uint8_t pos = 0;
+
+    if(header == AUTOREPORT_HEADER && length == AUTOREPORT_LENGTH && count == AUTOREPORT_PAYLOAD_SIZE)
+    {
+        return AutoReportFrame::Validate(header, length, payload) ? 0 : -EIO;
+    }
+
+    /* other frames and short reads, the same sum over what is there */
+    sum = (uint8_t)(header + length);
+
+    for(pos = 0; pos < count; pos++)
+    {
+        sum += payload[pos];
+    }
+
+    return (sum != 0) ? -EIO : 0;
+}
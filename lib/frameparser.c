@@ -0,0 +1,364 @@
+#include "frameparser.h"
+#include "serialstats.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define RING_MASK (FRAMEPARSER_RING_SIZE - 1)
+
+#if (FRAMEPARSER_RING_SIZE & RING_MASK) != 0 || FRAMEPARSER_RING_SIZE <= FRAME_MAX_LENGTH
+#error "FRAMEPARSER_RING_SIZE must be a power of two larger than FRAME_MAX_LENGTH"
+#endif
+
+struct _FrameParser
+{
+    size_t head;                        /* free running write index */
+    size_t tail;                        /* free running read index */
+    uint8_t minLength[256];             /* per header */
+    uint8_t maxLength[256];             /* per header, 0 = not accepted */
+    uint8_t token[256];                 /* single byte messages */
+    Serial * serial;                    /* statistics, see FrameParser_SetSerial() */
+    int resync;                         /* skipping bytes since the last frame */
+    int expectTokens;                   /* see FrameParser_ExpectTokens() */
+    uint8_t ring[FRAMEPARSER_RING_SIZE];
+};
+
+#define RING_AT(parser, index) ((parser)->ring[(index) & RING_MASK])
+
+_Static_assert(sizeof(struct _FrameParser) <= FRAMEPARSER_STORAGE_SIZE, "FRAMEPARSER_STORAGE_SIZE too small");
+
+size_t FrameParser_Size(void)
+{
+    return sizeof(struct _FrameParser);
+}
+
+void FrameParser_Init(FrameParser * parser, uint8_t header, uint8_t length)
+{
+    if(parser != NULL)
+    {
+        memset(parser->minLength, 0, sizeof(parser->minLength));
+        memset(parser->maxLength, 0, sizeof(parser->maxLength));
+        memset(parser->token, 0, sizeof(parser->token));
+        parser->serial = NULL;
+        parser->expectTokens = 1;
+        FrameParser_Reset(parser);
+        FrameParser_AddHeader(parser, header, length, length);
+    }
+}
+
+#ifndef MONIP_STATIC_ALLOCATION
+FrameParser * FrameParser_New(uint8_t header, uint8_t length)
+{
+    FrameParser * parser = malloc(sizeof(*parser));
+
+    FrameParser_Init(parser, header, length);
+
+    return parser;
+}
+#endif
+
+void FrameParser_AddHeader(FrameParser * parser, uint8_t header, uint8_t minLength, uint8_t maxLength)
+{
+    if(parser != NULL)
+    {
+        /* header, length and checksum are the minimum */
+        parser->minLength[header] = (minLength >= 3) ? minLength : 3;
+        parser->maxLength[header] = (maxLength >= parser->minLength[header]) ? maxLength : 0;
+    }
+}
+
+void FrameParser_AddToken(FrameParser * parser, uint8_t token)
+{
+    if(parser != NULL)
+    {
+        parser->token[token] = 1;
+    }
+}
+
+void FrameParser_ExpectTokens(FrameParser * parser, int expect)
+{
+    if(parser != NULL)
+    {
+        parser->expectTokens = expect;
+    }
+}
+
+void FrameParser_Reset(FrameParser * parser)
+{
+    if(parser != NULL)
+    {
+        parser->head = 0;
+        parser->tail = 0;
+        parser->resync = 0;
+    }
+}
+
+void FrameParser_SetSerial(FrameParser * parser, Serial * serial)
+{
+    if(parser != NULL)
+    {
+        parser->serial = serial;
+    }
+}
+
+size_t FrameParser_Available(FrameParser * parser)
+{
+    return (parser != NULL) ? parser->head - parser->tail : 0;
+}
+
+size_t FrameParser_Push(FrameParser * parser, const uint8_t * data, size_t size)
+{
+    size_t space = 0;
+    size_t first = 0;
+    size_t offset = 0;
+
+    if(parser == NULL || data == NULL)
+    {
+        return 0;
+    }
+
+    space = FRAMEPARSER_RING_SIZE - (parser->head - parser->tail);
+
+    if(size > space)
+    {
+        size = space;
+    }
+
+    offset = parser->head & RING_MASK;
+    first = FRAMEPARSER_RING_SIZE - offset;
+
+    if(first > size)
+    {
+        first = size;
+    }
+
+    if(parser->serial != NULL)
+    {
+        SerialStats_Received(parser->serial, size, parser->head == parser->tail);
+    }
+
+    memcpy(&parser->ring[offset], data, first);
+    memcpy(&parser->ring[0], data + first, size - first);
+    parser->head += size;
+
+    return size;
+}
+
+size_t FrameParser_Discard(FrameParser * parser, size_t count)
+{
+    if(parser == NULL)
+    {
+        return 0;
+    }
+
+    if(count > parser->head - parser->tail)
+    {
+        count = parser->head - parser->tail;
+    }
+
+    if(count != 0)
+    {
+        parser->tail += count;
+        parser->resync = 1;
+
+        if(parser->serial != NULL)
+        {
+            SerialStats_Parsed(parser->serial, -EAGAIN, count, 0, 0, parser->head != parser->tail);
+        }
+    }
+
+    return count;
+}
+
+int FrameParser_Fill(FrameParser * parser, int fd)
+{
+    struct iovec iov[2];
+    size_t space = 0;
+    size_t offset = 0;
+    size_t first = 0;
+    ssize_t ret = 0;
+
+    if(parser == NULL || fd < 0)
+    {
+        return -EINVAL;
+    }
+
+    space = FRAMEPARSER_RING_SIZE - (parser->head - parser->tail);
+
+    if(space == 0)
+    {
+        return -ENOBUFS;
+    }
+
+    offset = parser->head & RING_MASK;
+    first = FRAMEPARSER_RING_SIZE - offset;
+
+    if(first > space)
+    {
+        first = space;
+    }
+
+    iov[0].iov_base = &parser->ring[offset];
+    iov[0].iov_len = first;
+    iov[1].iov_base = &parser->ring[0];
+    iov[1].iov_len = space - first;
+
+    ret = readv(fd, iov, (space > first) ? 2 : 1);
+
+    if(ret < 0)
+    {
+        ret = -errno;
+    }
+
+    if(parser->serial != NULL)
+    {
+        SerialStats_Read(parser->serial, ret, parser->head == parser->tail);
+    }
+
+    if(ret < 0)
+    {
+        return (int)ret;
+    }
+
+    parser->head += ret;
+
+    return (int)ret;
+}
+
+int FrameParser_Next(FrameParser * parser, uint8_t * header, uint8_t * buffer)
+{
+    int Result = -EAGAIN;
+    size_t skipped = 0;
+    size_t checksumErrors = 0;
+    size_t headerMismatches = 0;
+
+    if(parser == NULL || buffer == NULL)
+    {
+        return -EINVAL;
+    }
+
+    while(parser->head - parser->tail >= 1)
+    {
+        uint8_t PacketHeader = RING_AT(parser, parser->tail);
+        uint8_t PacketLength = 0;
+
+        if(parser->token[PacketHeader] && parser->expectTokens && !parser->resync)
+        {
+            if(header != NULL)
+            {
+                *header = PacketHeader;
+            }
+
+            parser->tail++;
+            Result = 0;
+            break;
+        }
+
+        if(parser->head - parser->tail < 2)
+        {
+            /* a header on its own, wait for the length */
+            break;
+        }
+
+        PacketLength = RING_AT(parser, parser->tail + 1);
+
+        if(parser->maxLength[PacketHeader] != 0
+           && PacketLength >= parser->minLength[PacketHeader]
+           && PacketLength <= parser->maxLength[PacketHeader])
+        {
+            uint8_t sum = 0;
+            size_t pos = 0;
+
+            if(parser->head - parser->tail < PacketLength)
+            {
+                /* plausible frame, wait for the rest of it */
+                break;
+            }
+
+            for(pos = 0; pos < PacketLength; pos++)
+            {
+                sum += RING_AT(parser, parser->tail + pos);
+            }
+
+            if(sum == 0)
+            {
+                for(pos = 2; pos < PacketLength; pos++)
+                {
+                    buffer[pos - 2] = RING_AT(parser, parser->tail + pos);
+                }
+
+                if(header != NULL)
+                {
+                    *header = PacketHeader;
+                }
+
+                parser->tail += PacketLength;
+                Result = PacketLength - 2;
+                break;
+            }
+
+            checksumErrors += !parser->resync;
+        }
+        else
+        {
+            headerMismatches += !parser->resync;
+        }
+
+        /* not the start of a valid frame, slide forward one byte */
+        parser->resync = 1;
+        parser->tail++;
+        skipped++;
+    }
+
+    if(Result >= 0)
+    {
+        parser->resync = 0;
+    }
+
+    if(parser->serial != NULL && (Result >= 0 || skipped != 0))
+    {
+        SerialStats_Parsed(parser->serial, Result, skipped, checksumErrors, headerMismatches, parser->head != parser->tail);
+    }
+
+    return Result;
+}
+
+int FrameParser_Read(FrameParser * parser, Serial * serial, uint8_t * buffer)
+{
+    int Result = -EAGAIN;
+
+    if(parser == NULL || serial == NULL)
+    {
+        return -EINVAL;
+    }
+
+    parser->serial = serial;
+
+    while((Result = FrameParser_Next(parser, NULL, buffer)) == -EAGAIN)
+    {
+        Result = FrameParser_Fill(parser, Serial_GetFD(serial));
+
+        if(Result <= 0)
+        {
+            /* VTIME expired without data */
+            Result = (Result == 0) ? -EAGAIN : Result;
+            if(Result == -EAGAIN)
+            {
+                SerialStats_Timeout(serial);
+            }
+            break;
+        }
+    }
+
+    return Result;
+}
+
+#ifndef MONIP_STATIC_ALLOCATION
+void FrameParser_Free(FrameParser * parser)
+{
+    free(parser);
+}
+#endif
@@ -0,0 +1,255 @@
+#include "framequeue.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define QUEUE_CACHE_LINE 64
+
+/* spins before a blocked side starts sleeping */
+#define QUEUE_SPINS 64
+#define QUEUE_SLEEP_NS 20000
+
+struct _FrameQueue
+{
+    /* written by the producer */
+    size_t head __attribute__((aligned(QUEUE_CACHE_LINE)));
+    size_t cachedTail;
+    uint64_t pushed;
+    uint64_t droppedNewest;
+    uint64_t droppedOldest;
+    uint64_t blocked;
+
+    /* written by the consumer (and the producer for DROP_OLDEST) */
+    size_t tail __attribute__((aligned(QUEUE_CACHE_LINE)));
+    size_t cachedHead;
+    uint64_t popped;
+
+    /* read only after New() */
+    size_t mask __attribute__((aligned(QUEUE_CACHE_LINE)));
+    size_t elementSize;
+    FrameQueuePolicy policy;
+    uint8_t * slots;
+};
+
+#define SLOT(queue, index) ((queue)->slots + ((index) & (queue)->mask) * (queue)->elementSize)
+
+#define LOAD(ptr, order) __atomic_load_n((ptr), (order))
+#define STORE(ptr, value, order) __atomic_store_n((ptr), (value), (order))
+#define BUMP(ptr) STORE((ptr), *(ptr) + 1, __ATOMIC_RELAXED)
+
+uint64_t FrameQueue_Now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void Backoff(unsigned * spins)
+{
+    if(*spins < QUEUE_SPINS)
+    {
+        (*spins)++;
+        sched_yield();
+    }
+    else
+    {
+        struct timespec delay = { 0, QUEUE_SLEEP_NS };
+        nanosleep(&delay, NULL);
+    }
+}
+
+FrameQueue * FrameQueue_New(size_t capacity, size_t elementSize, FrameQueuePolicy policy)
+{
+    FrameQueue * queue = NULL;
+    size_t size = 2;
+
+    if(capacity == 0 || elementSize == 0)
+    {
+        return NULL;
+    }
+
+    while(size < capacity)
+    {
+        size <<= 1;
+    }
+
+    if(posix_memalign((void **)&queue, QUEUE_CACHE_LINE, sizeof(*queue)) != 0)
+    {
+        return NULL;
+    }
+
+    memset(queue, 0, sizeof(*queue));
+    queue->mask = size - 1;
+    queue->elementSize = elementSize;
+    queue->policy = policy;
+
+    if(posix_memalign((void **)&queue->slots, QUEUE_CACHE_LINE, size * elementSize) != 0)
+    {
+        free(queue);
+        return NULL;
+    }
+
+    return queue;
+}
+
+int FrameQueue_Push(FrameQueue * queue, const void * element)
+{
+    size_t head = 0;
+    unsigned spins = 0;
+
+    if(queue == NULL || element == NULL)
+    {
+        return -EINVAL;
+    }
+
+    head = queue->head;
+
+    while(head - queue->cachedTail > queue->mask)
+    {
+        size_t tail = LOAD(&queue->tail, __ATOMIC_ACQUIRE);
+
+        queue->cachedTail = tail;
+
+        if(head - tail <= queue->mask)
+        {
+            break;
+        }
+
+        if(queue->policy == FRAMEQUEUE_DROP_NEWEST)
+        {
+            BUMP(&queue->droppedNewest);
+            return -ENOBUFS;
+        }
+        else if(queue->policy == FRAMEQUEUE_DROP_OLDEST)
+        {
+            /* take the oldest slot away from the consumer, see Pop() */
+            if(__atomic_compare_exchange_n(&queue->tail, &tail, tail + 1, 0,
+                                           __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                BUMP(&queue->droppedOldest);
+                queue->cachedTail = tail + 1;
+            }
+        }
+        else
+        {
+            if(spins == 0)
+            {
+                BUMP(&queue->blocked);
+            }
+            Backoff(&spins);
+        }
+    }
+
+    memcpy(SLOT(queue, head), element, queue->elementSize);
+    STORE(&queue->head, head + 1, __ATOMIC_RELEASE);
+    BUMP(&queue->pushed);
+
+    return 0;
+}
+
+int FrameQueue_Pop(FrameQueue * queue, void * element)
+{
+    if(queue == NULL || element == NULL)
+    {
+        return -EINVAL;
+    }
+
+    for(;;)
+    {
+        size_t tail = LOAD(&queue->tail, __ATOMIC_ACQUIRE);
+
+        /* cachedHead can trail a tail the producer moved for DROP_OLDEST */
+        if(queue->cachedHead - tail == 0 || queue->cachedHead - tail > queue->mask + 1)
+        {
+            queue->cachedHead = LOAD(&queue->head, __ATOMIC_ACQUIRE);
+
+            if(tail == queue->cachedHead)
+            {
+                return -EAGAIN;
+            }
+        }
+
+        memcpy(element, SLOT(queue, tail), queue->elementSize);
+
+        if(queue->policy != FRAMEQUEUE_DROP_OLDEST)
+        {
+            STORE(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+            break;
+        }
+
+        /*
+         * The producer may have dropped this entry and be rewriting the slot
+         * while we copied it. The copy only counts if tail did not move.
+         */
+        if(__atomic_compare_exchange_n(&queue->tail, &tail, tail + 1, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            break;
+        }
+    }
+
+    BUMP(&queue->popped);
+
+    return 0;
+}
+
+int FrameQueue_PopWait(FrameQueue * queue, void * element, uint32_t timeoutUs)
+{
+    uint64_t deadline = FrameQueue_Now() + (uint64_t)timeoutUs * 1000;
+    unsigned spins = 0;
+    int Result = 0;
+
+    while((Result = FrameQueue_Pop(queue, element)) == -EAGAIN
+          && FrameQueue_Now() < deadline)
+    {
+        Backoff(&spins);
+    }
+
+    return Result;
+}
+
+size_t FrameQueue_Size(FrameQueue * queue)
+{
+    if(queue == NULL)
+    {
+        return 0;
+    }
+
+    {
+        /* tail first, so head can only be ahead of it */
+        size_t tail = LOAD(&queue->tail, __ATOMIC_ACQUIRE);
+
+        return LOAD(&queue->head, __ATOMIC_ACQUIRE) - tail;
+    }
+}
+
+size_t FrameQueue_Capacity(FrameQueue * queue)
+{
+    return (queue != NULL) ? queue->mask + 1 : 0;
+}
+
+void FrameQueue_GetStats(FrameQueue * queue, FrameQueueStats * stats)
+{
+    if(queue != NULL && stats != NULL)
+    {
+        stats->Pushed = LOAD(&queue->pushed, __ATOMIC_RELAXED);
+        stats->Popped = LOAD(&queue->popped, __ATOMIC_RELAXED);
+        stats->DroppedNewest = LOAD(&queue->droppedNewest, __ATOMIC_RELAXED);
+        stats->DroppedOldest = LOAD(&queue->droppedOldest, __ATOMIC_RELAXED);
+        stats->Blocked = LOAD(&queue->blocked, __ATOMIC_RELAXED);
+    }
+}
+
+void FrameQueue_Free(FrameQueue * queue)
+{
+    if(queue != NULL)
+    {
+        free(queue->slots);
+        free(queue);
+    }
+}
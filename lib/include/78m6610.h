@@ -5,6 +5,12 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "serial.h"
+#include "jsonbuffer.h"
+
 typedef struct 
 {
     float Vrms;
@@ -16,13 +22,116 @@ typedef struct
     float KwH;
 } AutoReportValues;
 
+/*
+ * Integer counterpart of AutoReportValues for cores without an FPU, decoded
+ * with integer multiply and shift only. Every field but Irms is exact.
+ */
+typedef struct
+{
+    int32_t Vrms;       /* mV */
+    int32_t Irms;       /* uA, within 1 uA */
+    int32_t Watts;      /* mW */
+    int32_t Pavg;       /* mW */
+    int32_t PF;         /* thousandths */
+    int32_t Freq;       /* mHz */
+    int32_t KwH;        /* Wh */
+} AutoReportValuesFixed;
+
 typedef struct _AutoReportMessage AutoReportMessage;
 
+/* Structure-of-arrays output for ConvertAutoReportBatch() */
+typedef struct
+{
+    float * Vrms;
+    float * Irms;
+    float * Watts;
+    float * Pavg;
+    float * PF;
+    float * Freq;
+    float * KwH;
+} AutoReportBatch;
+
 void ConvertAutoReport(const AutoReportMessage * message, AutoReportValues * values);
+
+#ifndef MONIP_STATIC_ALLOCATION
+/* Heap allocated text, free() it; AutoReportToJSON() is the allocation free form */
 char * ConvertAutoReportToJSON(const AutoReportMessage * message);
+#endif
+
+/*
+ * Allocation free serializers producing the same text as
+ * ConvertAutoReportToJSON(). AutoReportToJSON() returns the length written
+ * (NUL terminated) or -ENOSPC, AUTOREPORT_JSON_MAX always suffices.
+ */
+#define AUTOREPORT_JSON_MAX     128
+int AutoReportToJSON(const AutoReportMessage * message, char * buffer, size_t size);
+int JSONBuffer_AppendAutoReport(JSONBuffer * buffer, const AutoReportMessage * message);
+
+/* The values alone, comma separated in field order, same return convention */
+int AutoReportToCSV(const AutoReportMessage * message, char * buffer, size_t size);
+
+/*
+ * Float free decode and serialization. AutoReportFixedToJSON() writes the
+ * text AutoReportToJSON() would for the same frame (Irms may differ in the
+ * last digit when it lies within 1 uA of a rounding boundary), same return
+ * convention.
+ */
+void ConvertAutoReportFixed(const AutoReportMessage * message, AutoReportValuesFixed * values);
+int AutoReportFixedToJSON(const AutoReportValuesFixed * values, char * buffer, size_t size);
+
+/*
+ * Decode count contiguous AutoReport payloads, each AUTOREPORT_PAYLOAD_SIZE
+ * bytes as returned by ReadMessage(), into the arrays of values. Uses
+ * AVX2/SSSE3 when the CPU supports it, results match the scalar version
+ * exactly and ConvertAutoReport() to within float rounding.
+ */
+void ConvertAutoReportBatch(const uint8_t * payloads, size_t count, const AutoReportBatch * values);
+void ConvertAutoReportBatchScalar(const uint8_t * payloads, size_t count, const AutoReportBatch * values);
+const char * ConvertAutoReportBatchImplementation(void);
+
+#if defined(__x86_64__) || defined(__i386__)
+/* The SSSE3 path on its own, only for CPUs that have it (tests, benchmarks) */
+void ConvertAutoReportBatchSSSE3(const uint8_t * payloads, size_t count, const AutoReportBatch * values);
+#endif
+
 int ReadMessage(Serial * serial, uint8_t expectedHeader, uint8_t * buffer);
 
+/* The checksum test ReadMessage() applies, returns 0 or -EIO */
+int ValidateMessage(uint8_t header, uint8_t length, const uint8_t * payload, uint8_t count);
+
 #define AUTOREPORT_HEADER       0xAE
+#define AUTOREPORT_LENGTH       0x1E
+#define AUTOREPORT_PAYLOAD_SIZE (AUTOREPORT_LENGTH - 2)
+
+/* Raw frame bytes a recording or journal record keeps, an AutoReport frame is 30 */
+#define FRAME_RECORD_SIZE       32
+
+/*
+ * AutoReport payload layout: AUTOREPORT_FIELD_COUNT signed 24 bit little
+ * endian fields back to back, in AutoReportValues order, raw / divisor
+ * giving the unit value. Offsets 0 and 3 hold two fields of unknown
+ * meaning, 27 the checksum. The field table in framelayout.hpp is built
+ * from these; C code reading or writing payloads directly uses them too.
+ */
+#define AUTOREPORT_FIELD_COUNT      7
+#define AUTOREPORT_FIELD_WIDTH      3
+#define AUTOREPORT_FIELD_OFFSET(i)  (6 + (i) * AUTOREPORT_FIELD_WIDTH)
+
+#define AUTOREPORT_VRMS_OFFSET      AUTOREPORT_FIELD_OFFSET(0)
+#define AUTOREPORT_IRMS_OFFSET      AUTOREPORT_FIELD_OFFSET(1)
+#define AUTOREPORT_WATTS_OFFSET     AUTOREPORT_FIELD_OFFSET(2)
+#define AUTOREPORT_PAVG_OFFSET      AUTOREPORT_FIELD_OFFSET(3)
+#define AUTOREPORT_PF_OFFSET        AUTOREPORT_FIELD_OFFSET(4)
+#define AUTOREPORT_FREQ_OFFSET      AUTOREPORT_FIELD_OFFSET(5)
+#define AUTOREPORT_KWH_OFFSET       AUTOREPORT_FIELD_OFFSET(6)
+
+#define AUTOREPORT_VRMS_DIVISOR     1000.0f         /* V */
+#define AUTOREPORT_IRMS_DIVISOR     128700.1287f    /* A */
+#define AUTOREPORT_WATTS_DIVISOR    200.0f          /* W */
+#define AUTOREPORT_PAVG_DIVISOR     200.0f          /* W */
+#define AUTOREPORT_PF_DIVISOR       1000.0f
+#define AUTOREPORT_FREQ_DIVISOR     1000.0f         /* Hz */
+#define AUTOREPORT_KWH_DIVISOR      1000.0f         /* kWh */
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,700 @@
+#ifndef COROUTINE_HPP_
+#define COROUTINE_HPP_
+
+/*
+ * C++20 coroutine API over non-blocking Serial devices.
+ *
+ * A monip::Executor is a single threaded epoll loop. Sessions are written as
+ * monip::Task coroutines, spawned on an executor, and wait for frames with
+ *
+ *     int length = co_await port.NextFrame(buffer, &view, &deadline);
+ *
+ * where port is a monip::AsyncPort bound to that executor. A waiting session
+ * is resumed only once a whole valid frame sits in its buffer, when the
+ * deadline passes (-ETIMEDOUT) or the device fails (-errno); frames that are
+ * already buffered complete without suspending. Run one executor per thread
+ * to spread thousands of sessions over a few cores.
+ *
+ * Executors, ports and tasks are not thread safe, except Executor::Stop().
+ * A port must be used from the executor's thread and by one waiter at a
+ * time. Allocation happens when tasks are spawned (the coroutine frame) and
+ * when the executor's tables grow, not per frame.
+ */
+
+#if __cplusplus < 202002L
+#error "coroutine.hpp needs C++20, e.g. target_compile_features(<target> PRIVATE cxx_std_20)"
+#endif
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <vector>
+
+#include "serial.h"
+#include "78m6610.h"
+#include "frameparser.h"
+#include "serialport.hpp"
+
+namespace monip
+{
+
+    class Executor;
+
+    namespace detail
+    {
+
+        inline int64_t MonotonicNs()
+        {
+            struct timespec now;
+
+            clock_gettime(CLOCK_MONOTONIC, &now);
+
+            return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+        }
+
+        inline int64_t DeadlineNs(const struct timespec * deadline)
+        {
+            return (deadline == nullptr) ? INT64_MAX : (int64_t)deadline->tv_sec * 1000000000 + deadline->tv_nsec;
+        }
+
+        /* Something an executor can wake: a timer entry and, for fds, readiness */
+        class Waiter
+        {
+        public:
+            virtual ~Waiter() = default;
+
+        protected:
+            friend class monip::Executor;
+
+            virtual void OnTimer() = 0;
+            virtual void OnEvents(uint32_t /* events */) {}
+
+            int64_t deadline_ = 0;
+            size_t heapIndex_ = SIZE_MAX;       /* position in the timer heap, SIZE_MAX when idle */
+        };
+
+    } // namespace detail
+
+    /*
+     * Fire and forget coroutine. Nothing runs until Executor::Spawn(), the
+     * frame is freed when the coroutine returns or with the executor.
+     */
+    class Task
+    {
+    public:
+        struct promise_type
+        {
+            Executor * executor = nullptr;
+            promise_type * prev = nullptr;      /* live tasks of the executor */
+            promise_type * next = nullptr;
+
+            Task get_return_object()
+            {
+                return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept { std::terminate(); }
+
+            inline ~promise_type();
+        };
+
+        Task(Task && other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+        Task(const Task &) = delete;
+        Task & operator=(const Task &) = delete;
+
+        ~Task()
+        {
+            if(handle_)
+            {
+                handle_.destroy();
+            }
+        }
+
+    private:
+        friend class Executor;
+
+        explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+        std::coroutine_handle<promise_type> handle_;
+    };
+
+    class Executor
+    {
+    public:
+        Executor() :
+            epollfd_(epoll_create1(EPOLL_CLOEXEC)),
+            wakefd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+            stop_(0)
+        {
+            struct epoll_event event;
+
+            memset(&event, 0, sizeof(event));
+            event.events = EPOLLIN;
+            event.data.ptr = nullptr;
+
+            if(epollfd_ >= 0 && wakefd_ >= 0)
+            {
+                epoll_ctl(epollfd_, EPOLL_CTL_ADD, wakefd_, &event);
+            }
+        }
+
+        Executor(const Executor &) = delete;
+        Executor & operator=(const Executor &) = delete;
+
+        /* Suspended tasks are destroyed first, so their ports unregister */
+        ~Executor()
+        {
+            while(tasks_ != nullptr)
+            {
+                std::coroutine_handle<Task::promise_type>::from_promise(*tasks_).destroy();
+            }
+
+            if(wakefd_ >= 0)
+            {
+                close(wakefd_);
+            }
+
+            if(epollfd_ >= 0)
+            {
+                close(epollfd_);
+            }
+        }
+
+        bool IsValid() const { return epollfd_ >= 0 && wakefd_ >= 0; }
+
+        /* Start task, it runs until its first suspension before Spawn() returns */
+        void Spawn(Task task)
+        {
+            std::coroutine_handle<Task::promise_type> handle = std::exchange(task.handle_, nullptr);
+            Task::promise_type & promise = handle.promise();
+
+            promise.executor = this;
+            promise.next = tasks_;
+
+            if(tasks_ != nullptr)
+            {
+                tasks_->prev = &promise;
+            }
+
+            tasks_ = &promise;
+            count_++;
+
+            handle.resume();
+        }
+
+        size_t Tasks() const { return count_; }
+
+        /*
+         * Wait up to timeoutMs (-1 forever, shortened to the next deadline),
+         * then resume every task whose wait completed. Returns the number
+         * resumed or -errno.
+         */
+        int RunOnce(int timeoutMs)
+        {
+            struct epoll_event events[64];
+            int timeout = ClampTimeout(timeoutMs);
+            int count = epoll_wait(epollfd_, events, 64, timeout);
+            int i = 0;
+
+            if(count < 0)
+            {
+                return (errno == EINTR) ? 0 : -errno;
+            }
+
+            for(i = 0; i < count; i++)
+            {
+                if(events[i].data.ptr == nullptr)
+                {
+                    uint64_t value = 0;
+                    ssize_t ret = read(wakefd_, &value, sizeof(value));
+                    (void)ret;
+                }
+                else
+                {
+                    static_cast<detail::Waiter *>(events[i].data.ptr)->OnEvents(events[i].events);
+                }
+            }
+
+            ExpireTimers(detail::MonotonicNs());
+
+            return ResumeReady();
+        }
+
+        /* Loop until every task has finished or Stop(), returns 0 or -errno */
+        int Run()
+        {
+            int Result = 0;
+
+            while(count_ > 0 && !__atomic_load_n(&stop_, __ATOMIC_ACQUIRE) && Result >= 0)
+            {
+                Result = RunOnce(-1);
+            }
+
+            /* a Stop() is used up by the Run() it ended */
+            __atomic_store_n(&stop_, 0, __ATOMIC_RELAXED);
+
+            return (Result < 0) ? Result : 0;
+        }
+
+        /* Safe from any thread, also before Run() */
+        void Stop()
+        {
+            uint64_t one = 1;
+            ssize_t ret = 0;
+
+            __atomic_store_n(&stop_, 1, __ATOMIC_RELEASE);
+            ret = write(wakefd_, &one, sizeof(one));
+            (void)ret;
+        }
+
+        /* co_await executor.Sleep(us) */
+        class SleepAwaiter : public detail::Waiter
+        {
+        public:
+            SleepAwaiter(Executor & executor, uint32_t timeoutUs) :
+                executor_(executor), timeoutUs_(timeoutUs) {}
+
+            bool await_ready() const noexcept { return timeoutUs_ == 0; }
+
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                handle_ = handle;
+                executor_.AddTimer(this, detail::MonotonicNs() + (int64_t)timeoutUs_ * 1000);
+            }
+
+            void await_resume() const noexcept {}
+
+            ~SleepAwaiter()
+            {
+                executor_.CancelTimer(this);
+            }
+
+        protected:
+            void OnTimer() override
+            {
+                executor_.Ready(handle_);
+            }
+
+        private:
+            Executor & executor_;
+            uint32_t timeoutUs_;
+            std::coroutine_handle<> handle_;
+        };
+
+        SleepAwaiter Sleep(uint32_t timeoutUs)
+        {
+            return SleepAwaiter(*this, timeoutUs);
+        }
+
+    private:
+        friend class AsyncPort;
+        friend struct Task::promise_type;
+
+        void TaskDone(Task::promise_type * promise)
+        {
+            if(promise->prev != nullptr)
+            {
+                promise->prev->next = promise->next;
+            }
+            else
+            {
+                tasks_ = promise->next;
+            }
+
+            if(promise->next != nullptr)
+            {
+                promise->next->prev = promise->prev;
+            }
+
+            count_--;
+        }
+
+        int Watch(int fd, detail::Waiter * waiter)
+        {
+            struct epoll_event event;
+
+            memset(&event, 0, sizeof(event));
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.ptr = waiter;
+
+            return (epoll_ctl(epollfd_, EPOLL_CTL_ADD, fd, &event) == 0) ? 0 : -errno;
+        }
+
+        void Unwatch(int fd)
+        {
+            epoll_ctl(epollfd_, EPOLL_CTL_DEL, fd, nullptr);
+        }
+
+        void Ready(std::coroutine_handle<> handle)
+        {
+            ready_.push_back(handle);
+        }
+
+        int ResumeReady()
+        {
+            int resumed = 0;
+
+            /* resumed tasks may queue more, they run next round */
+            running_.swap(ready_);
+
+            for(size_t i = 0; i < running_.size(); i++)
+            {
+                running_[i].resume();
+                resumed++;
+            }
+
+            running_.clear();
+
+            return resumed;
+        }
+
+        /* Timers: binary min-heap on deadline, entries know their index */
+        void AddTimer(detail::Waiter * waiter, int64_t deadline)
+        {
+            CancelTimer(waiter);
+
+            waiter->deadline_ = deadline;
+            waiter->heapIndex_ = timers_.size();
+            timers_.push_back(waiter);
+            SiftUp(waiter->heapIndex_);
+        }
+
+        void CancelTimer(detail::Waiter * waiter)
+        {
+            size_t index = waiter->heapIndex_;
+
+            if(index == SIZE_MAX)
+            {
+                return;
+            }
+
+            waiter->heapIndex_ = SIZE_MAX;
+
+            if(index != timers_.size() - 1)
+            {
+                timers_[index] = timers_.back();
+                timers_[index]->heapIndex_ = index;
+                timers_.pop_back();
+                SiftDown(SiftUp(index));
+            }
+            else
+            {
+                timers_.pop_back();
+            }
+        }
+
+        size_t SiftUp(size_t index)
+        {
+            while(index > 0 && timers_[(index - 1) / 2]->deadline_ > timers_[index]->deadline_)
+            {
+                Swap(index, (index - 1) / 2);
+                index = (index - 1) / 2;
+            }
+
+            return index;
+        }
+
+        void SiftDown(size_t index)
+        {
+            for(;;)
+            {
+                size_t smallest = index;
+                size_t left = 2 * index + 1;
+                size_t right = left + 1;
+
+                if(left < timers_.size() && timers_[left]->deadline_ < timers_[smallest]->deadline_)
+                {
+                    smallest = left;
+                }
+
+                if(right < timers_.size() && timers_[right]->deadline_ < timers_[smallest]->deadline_)
+                {
+                    smallest = right;
+                }
+
+                if(smallest == index)
+                {
+                    return;
+                }
+
+                Swap(index, smallest);
+                index = smallest;
+            }
+        }
+
+        void Swap(size_t a, size_t b)
+        {
+            std::swap(timers_[a], timers_[b]);
+            timers_[a]->heapIndex_ = a;
+            timers_[b]->heapIndex_ = b;
+        }
+
+        void ExpireTimers(int64_t now)
+        {
+            while(!timers_.empty() && timers_[0]->deadline_ <= now)
+            {
+                detail::Waiter * waiter = timers_[0];
+
+                CancelTimer(waiter);
+                waiter->OnTimer();
+            }
+        }
+
+        /* Round the next deadline up to whole milliseconds for epoll_wait() */
+        int ClampTimeout(int timeoutMs) const
+        {
+            int64_t wait = 0;
+
+            if(!ready_.empty())
+            {
+                return 0;
+            }
+
+            if(timers_.empty())
+            {
+                return timeoutMs;
+            }
+
+            wait = (timers_[0]->deadline_ - detail::MonotonicNs() + 999999) / 1000000;
+            wait = (wait < 0) ? 0 : wait;
+
+            return (timeoutMs >= 0 && timeoutMs < wait) ? timeoutMs : (int)((wait > INT32_MAX) ? INT32_MAX : wait);
+        }
+
+        int epollfd_;
+        int wakefd_;
+        int stop_;
+        Task::promise_type * tasks_ = nullptr;
+        size_t count_ = 0;
+        std::vector<detail::Waiter *> timers_;
+        std::vector<std::coroutine_handle<>> ready_;
+        std::vector<std::coroutine_handle<>> running_;
+    };
+
+    inline Task::promise_type::~promise_type()
+    {
+        if(executor != nullptr)
+        {
+            executor->TaskDone(this);
+        }
+    }
+
+    /*
+     * A Serial bound to an executor. The port switches serial to
+     * non-blocking I/O, keeps its own FrameParser and flushes the write
+     * queue when the fd turns writable. It does not own serial.
+     */
+    class AsyncPort : private detail::Waiter
+    {
+    public:
+        AsyncPort(Executor & executor, Serial * serial) :
+            executor_(executor),
+            serial_(serial),
+            parser_(reinterpret_cast<FrameParser *>(&parserStorage_)),
+            status_(0)
+        {
+            FrameParser_Init(parser_, AUTOREPORT_HEADER, AUTOREPORT_LENGTH);
+            FrameParser_SetSerial(parser_, serial_);
+
+            status_ = (serial_ == nullptr) ? -EINVAL : Serial_SetNonBlocking(serial_, 1);
+
+            if(status_ == 0)
+            {
+                status_ = executor_.Watch(Serial_GetFD(serial_), this);
+            }
+        }
+
+        AsyncPort(const AsyncPort &) = delete;
+        AsyncPort & operator=(const AsyncPort &) = delete;
+
+        ~AsyncPort()
+        {
+            executor_.CancelTimer(this);
+
+            if(status_ == 0)
+            {
+                executor_.Unwatch(Serial_GetFD(serial_));
+            }
+        }
+
+        /* 0 once registered with the executor, -errno otherwise */
+        int Status() const { return status_; }
+        Serial * Get() const { return serial_; }
+
+        /* For extra headers or tokens, see RegisterClient_SetupParser() */
+        FrameParser * Parser() const { return parser_; }
+
+        /* Queue and flush what the fd takes now, the rest goes when it is writable */
+        int Write(const uint8_t * buffer, size_t size)
+        {
+            int Result = Serial_Queue(serial_, buffer, size);
+
+            return (Result == 0) ? Serial_Flush(serial_) : Result;
+        }
+
+        class FrameAwaiter
+        {
+        public:
+            FrameAwaiter(AsyncPort & port, uint8_t * buffer, FrameView * view, int64_t deadline) :
+                port_(port), buffer_(buffer), view_(view), deadline_(deadline) {}
+
+            bool await_ready()
+            {
+                if(port_.status_ != 0)
+                {
+                    port_.result_ = port_.status_;
+                    return true;
+                }
+
+                if(port_.waiting_)
+                {
+                    port_.result_ = -EBUSY;
+                    return true;
+                }
+
+                port_.result_ = port_.TryFrame(buffer_, view_);
+
+                if(port_.result_ == -EAGAIN && deadline_ <= detail::MonotonicNs())
+                {
+                    port_.result_ = -ETIMEDOUT;
+                }
+
+                return port_.result_ != -EAGAIN;
+            }
+
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                port_.Suspend(handle, buffer_, view_, deadline_);
+            }
+
+            int await_resume() const noexcept
+            {
+                return port_.result_;
+            }
+
+        private:
+            AsyncPort & port_;
+            uint8_t * buffer_;
+            FrameView * view_;
+            int64_t deadline_;
+        };
+
+        /*
+         * Await the next valid frame. Its payload goes to buffer (which
+         * must hold FRAME_MAX_LENGTH bytes) and view describes it. deadline
+         * is absolute CLOCK_MONOTONIC (Serial_Deadline()), nullptr waits
+         * forever. Resolves to the payload length, -ETIMEDOUT, -EBUSY when
+         * another wait is in progress, -EPIPE on hangup or -errno.
+         */
+        FrameAwaiter NextFrame(uint8_t (&buffer)[FRAME_MAX_LENGTH], FrameView * view, const struct timespec * deadline = nullptr)
+        {
+            return FrameAwaiter(*this, buffer, view, detail::DeadlineNs(deadline));
+        }
+
+    private:
+        /* Drain the fd until a frame is complete, the edge triggered contract */
+        int TryFrame(uint8_t * buffer, FrameView * view)
+        {
+            uint8_t header = 0;
+            int Result = 0;
+
+            for(;;)
+            {
+                Result = FrameParser_Next(parser_, &header, buffer);
+
+                if(Result >= 0)
+                {
+                    *view = FrameView(header, buffer, (size_t)Result);
+                    return Result;
+                }
+
+                Result = FrameParser_Fill(parser_, Serial_GetFD(serial_));
+
+                if(Result <= 0)
+                {
+                    return (Result == 0) ? -EPIPE : Result;
+                }
+            }
+        }
+
+        void Suspend(std::coroutine_handle<> handle, uint8_t * buffer, FrameView * view, int64_t deadline)
+        {
+            waiting_ = true;
+            handle_ = handle;
+            buffer_ = buffer;
+            view_ = view;
+
+            if(deadline != INT64_MAX)
+            {
+                executor_.AddTimer(this, deadline);
+            }
+        }
+
+        void Complete(int result)
+        {
+            waiting_ = false;
+            result_ = result;
+            executor_.CancelTimer(this);
+            executor_.Ready(handle_);
+        }
+
+        void OnEvents(uint32_t events) override
+        {
+            if((events & EPOLLOUT) && Serial_Pending(serial_) > 0)
+            {
+                Serial_Flush(serial_);
+            }
+
+            if(waiting_)
+            {
+                int Result = TryFrame(buffer_, view_);
+
+                if(Result == -EAGAIN && (events & (EPOLLHUP | EPOLLERR)))
+                {
+                    Result = -EPIPE;
+                }
+
+                if(Result != -EAGAIN)
+                {
+                    Complete(Result);
+                }
+            }
+        }
+
+        void OnTimer() override
+        {
+            if(waiting_)
+            {
+                Complete(-ETIMEDOUT);
+            }
+        }
+
+        Executor & executor_;
+        Serial * serial_;
+        FrameParserStorage parserStorage_;
+        FrameParser * parser_;
+        int status_;
+
+        /* the one wait in progress */
+        bool waiting_ = false;
+        int result_ = 0;
+        std::coroutine_handle<> handle_;
+        uint8_t * buffer_ = nullptr;
+        FrameView * view_ = nullptr;
+    };
+
+} // namespace monip
+
+#endif /* COROUTINE_HPP_ */
@@ -0,0 +1,332 @@
+#ifndef FRAMELAYOUT_HPP_
+#define FRAMELAYOUT_HPP_
+
+/*
+ * Compile time frame layouts.
+ *
+ * A layout describes one frame type: its header and length bytes and a
+ * constexpr table of fields (payload offset, width in bytes, signedness,
+ * divisor and destination member). The templates below expand that table
+ * into straight line code per frame type, no loops over the table and no
+ * dependence on how the compiler lays out bitfields. Fields are little
+ * endian, like everything the 78M6610 sends.
+ *
+ * Adding a frame type means adding a values struct, a field table and a
+ * layout struct; decoding, JSON/CSV output and checksum validation follow.
+ *
+ * Requires C++11, usable from C++ only. The C API (ConvertAutoReport() and
+ * friends) is implemented on top of this.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "78m6610.h"
+#include "jsonbuffer.h"
+
+/* Keep the expansion flat in unoptimised builds too */
+#if defined(__GNUC__)
+#define FRAMELAYOUT_INLINE inline __attribute__((always_inline))
+#else
+#define FRAMELAYOUT_INLINE inline
+#endif
+
+namespace monip
+{
+
+    template<typename Values>
+    struct FieldSpec
+    {
+        const char * Name;          /* JSON key */
+        uint8_t Offset;             /* from the first payload byte */
+        uint8_t Width;              /* bytes, 1 to 4 */
+        bool Signed;
+        float Divisor;              /* raw / Divisor gives the unit value */
+        float Values::*Member;
+    };
+
+    /* Payload offsets and divisors as 78m6610.h gives them to C code */
+    constexpr FieldSpec<AutoReportValues> AutoReportFields[] =
+    {
+        { "Vrms",  AUTOREPORT_VRMS_OFFSET,  AUTOREPORT_FIELD_WIDTH, true, AUTOREPORT_VRMS_DIVISOR,  &AutoReportValues::Vrms },
+        { "Irms",  AUTOREPORT_IRMS_OFFSET,  AUTOREPORT_FIELD_WIDTH, true, AUTOREPORT_IRMS_DIVISOR,  &AutoReportValues::Irms },
+        { "Watts", AUTOREPORT_WATTS_OFFSET, AUTOREPORT_FIELD_WIDTH, true, AUTOREPORT_WATTS_DIVISOR, &AutoReportValues::Watts },
+        { "Pavg",  AUTOREPORT_PAVG_OFFSET,  AUTOREPORT_FIELD_WIDTH, true, AUTOREPORT_PAVG_DIVISOR,  &AutoReportValues::Pavg },
+        { "PF",    AUTOREPORT_PF_OFFSET,    AUTOREPORT_FIELD_WIDTH, true, AUTOREPORT_PF_DIVISOR,    &AutoReportValues::PF },
+        { "Freq",  AUTOREPORT_FREQ_OFFSET,  AUTOREPORT_FIELD_WIDTH, true, AUTOREPORT_FREQ_DIVISOR,  &AutoReportValues::Freq },
+        { "kWh",   AUTOREPORT_KWH_OFFSET,   AUTOREPORT_FIELD_WIDTH, true, AUTOREPORT_KWH_DIVISOR,   &AutoReportValues::KwH },
+    };
+
+    static_assert(sizeof(AutoReportFields) / sizeof(AutoReportFields[0]) == AUTOREPORT_FIELD_COUNT, "AUTOREPORT_FIELD_COUNT");
+
+    struct AutoReportLayout
+    {
+        typedef AutoReportValues Values;
+
+        enum
+        {
+            Header = AUTOREPORT_HEADER,
+            Length = AUTOREPORT_LENGTH,
+            PayloadSize = AUTOREPORT_PAYLOAD_SIZE,
+            Count = sizeof(AutoReportFields) / sizeof(AutoReportFields[0]),
+        };
+
+        static constexpr FieldSpec<Values> Field(size_t index)
+        {
+            return AutoReportFields[index];
+        }
+    };
+
+    namespace detail
+    {
+
+        template<size_t... I>
+        struct IndexSequence {};
+
+        template<size_t N, size_t... I>
+        struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, I...> {};
+
+        template<size_t... I>
+        struct MakeIndexSequence<0, I...>
+        {
+            typedef IndexSequence<I...> Type;
+        };
+
+        /* Swallows a pack expansion in order, C++11 has no fold expressions */
+        typedef int Expand[];
+
+        constexpr size_t Length(const char * text)
+        {
+            return (*text == '\0') ? 0 : 1 + Length(text + 1);
+        }
+
+        template<typename Layout>
+        constexpr bool FieldsFit(size_t index = 0)
+        {
+            return index >= (size_t)Layout::Count
+                   || (Layout::Field(index).Width >= 1
+                       && Layout::Field(index).Width <= 4
+                       && Layout::Field(index).Offset + Layout::Field(index).Width <= (size_t)Layout::PayloadSize - 1
+                       && FieldsFit<Layout>(index + 1));
+        }
+
+        template<typename Layout>
+        constexpr size_t NamesLength(size_t index = 0)
+        {
+            return index >= (size_t)Layout::Count ? 0 : Length(Layout::Field(index).Name) + NamesLength<Layout>(index + 1);
+        }
+
+        constexpr size_t IntegerDigits(double value)
+        {
+            return (value < 10.0) ? 1 : 1 + IntegerDigits(value / 10.0);
+        }
+
+        /* Largest magnitude a field decodes to, plus what rounding to 2 places may add */
+        template<typename Layout>
+        constexpr double DecodedMax(size_t index)
+        {
+            return (Layout::Field(index).Signed ? (double)((uint64_t)1 << (Layout::Field(index).Width * 8 - 1))
+                                                : (double)(((uint64_t)1 << (Layout::Field(index).Width * 8)) - 1))
+                   / Layout::Field(index).Divisor + 0.005;
+        }
+
+        /* Longest JSON_FormatFixed2() text of a decoded field: sign, digits, '.', 2 digits */
+        template<typename Layout>
+        constexpr size_t DecodedTextMax(size_t index)
+        {
+            return (Layout::Field(index).Signed ? 1 : 0) + IntegerDigits(DecodedMax<Layout>(index)) + 3;
+        }
+
+        template<typename Layout>
+        constexpr size_t DecodedTextLength(size_t index = 0)
+        {
+            return index >= (size_t)Layout::Count ? 0 : DecodedTextMax<Layout>(index) + DecodedTextLength<Layout>(index + 1);
+        }
+
+        template<unsigned Width>
+        struct LoadLE
+        {
+            static FRAMELAYOUT_INLINE uint32_t Get(const uint8_t * ptr)
+            {
+                return (uint32_t)ptr[0] | (LoadLE<Width - 1>::Get(ptr + 1) << 8);
+            }
+        };
+
+        template<>
+        struct LoadLE<1>
+        {
+            static FRAMELAYOUT_INLINE uint32_t Get(const uint8_t * ptr)
+            {
+                return ptr[0];
+            }
+        };
+
+        template<unsigned Width, bool Signed>
+        FRAMELAYOUT_INLINE int64_t LoadRaw(const uint8_t * ptr)
+        {
+            uint32_t value = LoadLE<Width>::Get(ptr);
+            const uint32_t sign = (uint32_t)1 << (Width * 8 - 1);
+
+            /* sign extend through the top bit of the field */
+            return Signed ? (int64_t)(int32_t)((value ^ sign) - sign) : (int64_t)value;
+        }
+
+        template<unsigned Count>
+        struct Sum
+        {
+            static FRAMELAYOUT_INLINE uint8_t Get(const uint8_t * ptr)
+            {
+                return (uint8_t)(ptr[0] + Sum<Count - 1>::Get(ptr + 1));
+            }
+        };
+
+        template<>
+        struct Sum<0>
+        {
+            static FRAMELAYOUT_INLINE uint8_t Get(const uint8_t *)
+            {
+                return 0;
+            }
+        };
+
+        template<typename Layout, size_t I>
+        FRAMELAYOUT_INLINE float DecodeField(const uint8_t * payload)
+        {
+            constexpr FieldSpec<typename Layout::Values> field = Layout::Field(I);
+
+            return (float)LoadRaw<field.Width, field.Signed>(payload + field.Offset) / field.Divisor;
+        }
+
+        template<typename Layout, size_t I>
+        FRAMELAYOUT_INLINE void DecodeInto(const uint8_t * payload, typename Layout::Values * values)
+        {
+            constexpr FieldSpec<typename Layout::Values> field = Layout::Field(I);
+
+            values->*field.Member = DecodeField<Layout, I>(payload);
+        }
+
+        template<typename Layout, size_t... I>
+        FRAMELAYOUT_INLINE void Decode(const uint8_t * payload, typename Layout::Values * values, IndexSequence<I...>)
+        {
+            (void)Expand{ 0, (DecodeInto<Layout, I>(payload, values), 0)... };
+        }
+
+        FRAMELAYOUT_INLINE char * Append(char * ptr, const char * text, size_t length)
+        {
+            memcpy(ptr, text, length);
+            return ptr + length;
+        }
+
+        template<typename Layout, size_t I>
+        FRAMELAYOUT_INLINE char * AppendJSONField(char * ptr, const typename Layout::Values & values)
+        {
+            constexpr FieldSpec<typename Layout::Values> field = Layout::Field(I);
+            constexpr size_t nameLength = Length(field.Name);
+
+            *ptr++ = (I == 0) ? '{' : ',';
+            *ptr++ = '"';
+            ptr = Append(ptr, field.Name, nameLength);
+            *ptr++ = '"';
+            *ptr++ = ':';
+
+            return ptr + JSON_FormatFixed2(ptr, values.*field.Member);
+        }
+
+        template<typename Layout, size_t I>
+        FRAMELAYOUT_INLINE char * AppendCSVField(char * ptr, const typename Layout::Values & values)
+        {
+            constexpr FieldSpec<typename Layout::Values> field = Layout::Field(I);
+
+            if(I != 0)
+            {
+                *ptr++ = ',';
+            }
+
+            return ptr + JSON_FormatFixed2(ptr, values.*field.Member);
+        }
+
+        template<typename Layout, size_t... I>
+        FRAMELAYOUT_INLINE char * FormatJSON(char * ptr, const typename Layout::Values & values, IndexSequence<I...>)
+        {
+            (void)Expand{ 0, ((ptr = AppendJSONField<Layout, I>(ptr, values)), 0)... };
+            *ptr++ = '}';
+
+            return ptr;
+        }
+
+        template<typename Layout, size_t... I>
+        FRAMELAYOUT_INLINE char * FormatCSV(char * ptr, const typename Layout::Values & values, IndexSequence<I...>)
+        {
+            (void)Expand{ 0, ((ptr = AppendCSVField<Layout, I>(ptr, values)), 0)... };
+
+            return ptr;
+        }
+
+    } // namespace detail
+
+    template<typename Layout>
+    struct Frame
+    {
+        static_assert(detail::FieldsFit<Layout>(), "field runs past the payload or has an unsupported width");
+
+        typedef typename Layout::Values Values;
+        typedef typename detail::MakeIndexSequence<Layout::Count>::Type Fields;
+
+        /* Longest Format*() output: keys, four punctuation bytes and JSON_FIXED2_MAX per field, closing brace */
+        static constexpr size_t TextMax()
+        {
+            return detail::NamesLength<Layout>() + Layout::Count * (JSON_FIXED2_MAX + 4) + 1;
+        }
+
+        /* Longest FormatJSON() / FormatCSV() output for values Decode() produced */
+        static constexpr size_t DecodedJSONMax()
+        {
+            return detail::NamesLength<Layout>() + Layout::Count * 4 + detail::DecodedTextLength<Layout>() + 1;
+        }
+
+        static constexpr size_t DecodedCSVMax()
+        {
+            return detail::DecodedTextLength<Layout>() + Layout::Count - 1;
+        }
+
+        /* payload is what ReadMessage() returns, header and length stripped */
+        static FRAMELAYOUT_INLINE void Decode(const uint8_t * payload, Values * values)
+        {
+            detail::Decode<Layout>(payload, values, Fields());
+        }
+
+        /* Whole frame: header and length match and the bytes sum to zero */
+        static FRAMELAYOUT_INLINE bool Validate(const uint8_t * frame)
+        {
+            return frame[0] == (uint8_t)Layout::Header
+                   && frame[1] == (uint8_t)Layout::Length
+                   && detail::Sum<Layout::Length>::Get(frame) == 0;
+        }
+
+        /* The same with the payload apart, as ReadMessage() reads it */
+        static FRAMELAYOUT_INLINE bool Validate(uint8_t header, uint8_t length, const uint8_t * payload)
+        {
+            return header == (uint8_t)Layout::Header
+                   && length == (uint8_t)Layout::Length
+                   && (uint8_t)(header + length + detail::Sum<Layout::Length - 2>::Get(payload)) == 0;
+        }
+
+        /* {"Name":value,...} as ConvertAutoReportToJSON() writes it, not NUL terminated */
+        static FRAMELAYOUT_INLINE size_t FormatJSON(char * out, const Values & values)
+        {
+            return detail::FormatJSON<Layout>(out, values, Fields()) - out;
+        }
+
+        /* value,value,... in field order, no newline */
+        static FRAMELAYOUT_INLINE size_t FormatCSV(char * out, const Values & values)
+        {
+            return detail::FormatCSV<Layout>(out, values, Fields()) - out;
+        }
+    };
+
+    typedef Frame<AutoReportLayout> AutoReportFrame;
+
+} // namespace monip
+
+#endif /* FRAMELAYOUT_HPP_ */
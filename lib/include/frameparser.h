@@ -0,0 +1,108 @@
+#ifndef FRAMEPARSER_H_
+#define FRAMEPARSER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "serial.h"
+
+/* Ring size must be a power of two and larger than the longest frame */
+#define FRAMEPARSER_RING_SIZE   1024
+#define FRAME_MAX_LENGTH        255
+
+typedef struct _FrameParser FrameParser;
+
+/*
+ * A FrameParser accumulates bytes from a serial line in a ring buffer and
+ * emits every checksum-valid frame it finds. Frames are laid out as
+ * [header, length, payload..., checksum] where length counts the whole
+ * frame. On a bad header, implausible length or checksum failure the parser
+ * slides forward one byte, so it resynchronises within a few bytes of noise.
+ *
+ * FrameParser_New() accepts frames with the given header and exactly the
+ * given length, AddHeader() registers further headers with a length range.
+ * AddToken() registers single byte messages such as ACK/NACK replies, which
+ * Next() returns with a payload length of 0.
+ */
+#ifndef MONIP_STATIC_ALLOCATION
+FrameParser * FrameParser_New(uint8_t header, uint8_t length);
+#endif
+
+/*
+ * Same as FrameParser_New() in caller provided storage (see SerialStorage),
+ * a parser owns nothing else so there is no matching Deinit.
+ */
+#define FRAMEPARSER_STORAGE_SIZE (FRAMEPARSER_RING_SIZE + 3 * 256 + 64)
+
+typedef union
+{
+    uint8_t bytes[FRAMEPARSER_STORAGE_SIZE];
+    uint64_t align;
+    void * alignPointer;
+} FrameParserStorage;
+
+size_t FrameParser_Size(void);
+void FrameParser_Init(FrameParser * parser, uint8_t header, uint8_t length);
+
+void FrameParser_AddHeader(FrameParser * parser, uint8_t header, uint8_t minLength, uint8_t maxLength);
+void FrameParser_AddToken(FrameParser * parser, uint8_t token);
+
+/*
+ * A token is a single byte, as likely to be noise as a message, so Next()
+ * only takes one in sync (where a frame would start, not while sliding
+ * over bad bytes) and while tokens are expected, as they are after Init().
+ * RegisterClient_NextFrame() expects them while a request is outstanding.
+ */
+void FrameParser_ExpectTokens(FrameParser * parser, int expect);
+void FrameParser_Reset(FrameParser * parser);
+
+/*
+ * Count Fill() reads, the bytes Push() takes and Next() into serial's
+ * statistics, see Serial_GetStats(). Push() is no read call, whoever read
+ * the bytes counts that. NULL detaches. FrameParser_Read() attaches the
+ * Serial it reads from.
+ */
+void FrameParser_SetSerial(FrameParser * parser, Serial * serial);
+
+/* Copy bytes into the ring, returns the number of bytes accepted */
+size_t FrameParser_Push(FrameParser * parser, const uint8_t * data, size_t size);
+
+/*
+ * Drop up to count of the oldest buffered bytes, making room when Push()
+ * takes nothing. They count as skipped in the statistics, as bytes Next()
+ * slides over do. Returns the number dropped.
+ */
+size_t FrameParser_Discard(FrameParser * parser, size_t count);
+
+/* One read() of everything available on fd, returns bytes read or -errno */
+int FrameParser_Fill(FrameParser * parser, int fd);
+
+/*
+ * Extract the next valid frame. The payload (including the trailing checksum
+ * byte, as ReadMessage() does) is copied to buffer, which must hold
+ * FRAME_MAX_LENGTH bytes. Returns the payload length (0 for a token), or
+ * -EAGAIN when no complete frame is buffered. header may be NULL.
+ */
+int FrameParser_Next(FrameParser * parser, uint8_t * header, uint8_t * buffer);
+
+/*
+ * Drop-in replacement for ReadMessage(): returns the next buffered frame,
+ * reading from serial as needed. Returns -EAGAIN when the line goes quiet.
+ */
+int FrameParser_Read(FrameParser * parser, Serial * serial, uint8_t * buffer);
+
+size_t FrameParser_Available(FrameParser * parser);
+
+#ifndef MONIP_STATIC_ALLOCATION
+void FrameParser_Free(FrameParser * parser);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FRAMEPARSER_H_ */
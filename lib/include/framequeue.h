@@ -0,0 +1,69 @@
+#ifndef FRAMEQUEUE_H_
+#define FRAMEQUEUE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frameparser.h"
+
+typedef struct _FrameQueue FrameQueue;
+
+typedef enum
+{
+    FRAMEQUEUE_DROP_NEWEST,     /* Push() fails when full */
+    FRAMEQUEUE_DROP_OLDEST,     /* Push() overwrites the oldest entry */
+    FRAMEQUEUE_BLOCK,           /* Push() waits for the consumer */
+} FrameQueuePolicy;
+
+/* A raw frame as handed from a reader to its consumers */
+typedef struct
+{
+    uint64_t Timestamp;         /* CLOCK_MONOTONIC nanoseconds */
+    uint32_t Device;
+    uint8_t Header;
+    uint8_t Length;             /* bytes used in Payload */
+    uint8_t Payload[FRAME_MAX_LENGTH];
+} QueuedFrame;
+
+typedef struct
+{
+    uint64_t Pushed;
+    uint64_t Popped;
+    uint64_t DroppedNewest;
+    uint64_t DroppedOldest;
+    uint64_t Blocked;           /* pushes that had to wait */
+} FrameQueueStats;
+
+/*
+ * Bounded single-producer/single-consumer ring of fixed size elements, e.g.
+ * QueuedFrame or AutoReportValues. Producer and consumer indices live on
+ * separate cache lines. capacity is rounded up to a power of two (min 2).
+ */
+FrameQueue * FrameQueue_New(size_t capacity, size_t elementSize, FrameQueuePolicy policy);
+
+/* Producer side, returns 0 or -ENOBUFS when the entry was dropped */
+int FrameQueue_Push(FrameQueue * queue, const void * element);
+
+/* Consumer side, returns 0 or -EAGAIN when empty */
+int FrameQueue_Pop(FrameQueue * queue, void * element);
+int FrameQueue_PopWait(FrameQueue * queue, void * element, uint32_t timeoutUs);
+
+size_t FrameQueue_Size(FrameQueue * queue);
+size_t FrameQueue_Capacity(FrameQueue * queue);
+
+/* Safe from any thread */
+void FrameQueue_GetStats(FrameQueue * queue, FrameQueueStats * stats);
+
+uint64_t FrameQueue_Now(void);
+
+void FrameQueue_Free(FrameQueue * queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FRAMEQUEUE_H_ */
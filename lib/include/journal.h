@@ -0,0 +1,105 @@
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "78m6610.h"
+
+#define JOURNAL_MAGIC "MONIPJNL"
+#define JOURNAL_VERSION 1
+
+/*
+ * File layout: one JournalHeader followed by Capacity JournalRecords used
+ * as a ring, in host byte order. Record n (sequence numbers start at 1)
+ * lives in slot n % Capacity and is valid when its Sequence is n and its
+ * Checksum matches, so a record torn by a crash is recognised and skipped.
+ * The file never changes size once created.
+ */
+typedef struct
+{
+    char Magic[8];              /* JOURNAL_MAGIC, not terminated */
+    uint32_t Version;
+    uint32_t RecordSize;        /* sizeof(JournalRecord) */
+    uint64_t Capacity;          /* records in the ring */
+    uint32_t Device;
+    uint32_t Reserved0;
+    uint64_t CreatedRealtime;   /* CLOCK_REALTIME ns when the file was created */
+    uint64_t Next;              /* sequence of the next record, published after each append */
+    uint8_t Reserved[16];
+} JournalHeader;
+
+typedef struct
+{
+    uint64_t Sequence;          /* 0 while the slot is empty or being written */
+    uint64_t Timestamp;         /* ns, CLOCK_REALTIME from ReadMessage() */
+    uint32_t Device;
+    uint32_t Checksum;          /* over the record with this field 0 */
+    uint8_t Length;             /* bytes used in Frame */
+    uint8_t Reserved[7];
+    uint8_t Frame[FRAME_RECORD_SIZE];       /* header, length, payload, checksum */
+} JournalRecord;
+
+typedef struct _Journal Journal;
+typedef struct _JournalReader JournalReader;
+
+/*
+ * Open path as the single writer of a device's journal, creating it with
+ * room for capacity records, or recovering an existing one: the record
+ * with the highest valid sequence is the tail, whatever the header says.
+ * capacity 0 takes an existing file as it is. Returns NULL with errno set,
+ * EBUSY when another writer has it open, EINVAL for a bad file or a
+ * device or capacity that does not match it.
+ */
+Journal * Journal_Open(const char * path, uint32_t device, size_t capacity);
+
+/*
+ * Append a validated frame: header plus payloadLength bytes of payload
+ * (including the checksum). Plain stores to the shared mapping, no system
+ * call; the page cache keeps them when the process dies. Returns 0,
+ * -EMSGSIZE when the frame does not fit a record or -EINVAL.
+ */
+int Journal_Append(Journal * journal, uint64_t timestamp, uint8_t header, const uint8_t * payload, uint8_t payloadLength);
+
+/* Sequence the next append gets, one past the tail found on open */
+uint64_t Journal_Next(Journal * journal);
+
+/* Write the mapping back to disk, for surviving power loss as well. 0 or -errno */
+int Journal_Sync(Journal * journal);
+
+void Journal_Close(Journal * journal);
+
+/* Map a journal read only, from any process. NULL on error (errno is set) */
+JournalReader * JournalReader_Open(const char * path);
+
+const JournalHeader * JournalReader_Header(JournalReader * reader);
+
+/* Sequence the writer will use next, records before it are readable */
+uint64_t JournalReader_Next(JournalReader * reader);
+
+/*
+ * Copy record sequence. Returns 0, -EAGAIN when it is not written yet or
+ * is being written, -ENOENT when it has been overwritten, or -EIO when
+ * it fails its checksum (torn by a crash).
+ */
+int JournalReader_Read(JournalReader * reader, uint64_t sequence, JournalRecord * record);
+
+/*
+ * Tail the journal: copy up to count records from *sequence on, advancing
+ * *sequence past them. Records overwritten before they were read or torn
+ * are skipped, the Sequence of each record shows any gap. Start from 0
+ * for the oldest record held. Returns the number of records copied.
+ */
+size_t JournalReader_Poll(JournalReader * reader, uint64_t * sequence, JournalRecord * records, size_t count);
+
+void JournalReader_Close(JournalReader * reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JOURNAL_H_ */
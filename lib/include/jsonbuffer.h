@@ -0,0 +1,73 @@
+#ifndef JSONBUFFER_H_
+#define JSONBUFFER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+    JSON_MODE_NDJSON,       /* one object per line */
+    JSON_MODE_ARRAY,        /* [obj,obj,...] closed by JSONBuffer_Finish() */
+} JSONMode;
+
+/*
+ * Output buffer for serializers. Either growable (heap, reused across
+ * Reset() calls) or bound to caller storage, in which case appends that do
+ * not fit fail with -ENOSPC and leave the buffer unchanged. data is always
+ * NUL terminated.
+ */
+typedef struct
+{
+    char * data;
+    size_t length;
+    size_t capacity;        /* excluding the NUL terminator */
+    size_t count;           /* records appended since Reset() */
+    JSONMode mode;
+    int growable;
+    int finished;           /* Finish() closed the array, until Reset() */
+} JSONBuffer;
+
+#ifndef MONIP_STATIC_ALLOCATION
+void JSONBuffer_Init(JSONBuffer * buffer, JSONMode mode);
+void JSONBuffer_Free(JSONBuffer * buffer);
+#endif
+void JSONBuffer_InitStatic(JSONBuffer * buffer, JSONMode mode, char * storage, size_t size);
+void JSONBuffer_Reset(JSONBuffer * buffer);
+
+/* Ensure room for extra more characters, returns 0 or -ENOSPC/-ENOMEM */
+int JSONBuffer_Reserve(JSONBuffer * buffer, size_t extra);
+
+/* Append one serialized object with the separator the mode needs */
+int JSONBuffer_AppendRecord(JSONBuffer * buffer, const char * text, size_t length);
+
+/*
+ * Close the array (JSON_MODE_ARRAY) and return the text, NULL on failure.
+ * Calling it again returns the same text; appends fail with -EINVAL until
+ * Reset().
+ */
+const char * JSONBuffer_Finish(JSONBuffer * buffer);
+
+/*
+ * Format value as printf("%.2f") would, without printf or locale lookups.
+ * out must hold JSON_FIXED2_MAX characters, returns the length written
+ * (not NUL terminated).
+ */
+#define JSON_FIXED2_MAX 64
+size_t JSON_FormatFixed2(char * out, float value);
+
+/*
+ * Format value / 10^scaleDigits exactly as JSON_FormatFixed2() formats that
+ * quotient computed in float, using integer arithmetic only. scaleDigits is
+ * 3 to 9, other values give 0.
+ */
+size_t JSON_FormatScaled2(char * out, int32_t value, unsigned scaleDigits);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JSONBUFFER_H_ */
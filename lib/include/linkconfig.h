@@ -0,0 +1,55 @@
+#ifndef LINKCONFIG_H_
+#define LINKCONFIG_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "serial.h"
+#include "frameparser.h"
+#include "registerclient.h"
+
+/*
+ * Meter registers used for negotiation. The addresses and encodings (baud
+ * in bits per second, interval in milliseconds) are assumed from the
+ * 78M6610+PSU documentation and can be overridden in LinkParameters.
+ */
+#define LINK_REGISTER_BAUD          0x0052
+#define LINK_REGISTER_INTERVAL      0x0055
+
+typedef struct
+{
+    uint16_t BaudRegister;
+    uint16_t IntervalRegister;
+    uint32_t IntervalMs;        /* auto-report interval to set, 0 leaves it */
+    unsigned VerifyFrames;      /* valid AutoReports that prove a link */
+    uint32_t VerifyTimeoutUs;
+    uint32_t CommandTimeoutUs;
+} LinkParameters;
+
+void Link_DefaultParameters(LinkParameters * parameters);
+
+/* Wait for frames valid AutoReports, returns 0 or -ETIMEDOUT */
+int Link_Verify(Serial * serial, FrameParser * parser, unsigned frames, uint32_t timeoutUs);
+
+/*
+ * Move meter and host to the first of rates (fastest first) that carries
+ * valid AutoReports. For each rate the meter is told to switch, the host
+ * follows and the link is verified; on failure both go back to the
+ * starting rate and the next one is tried. Then the auto-report interval
+ * is applied if one is given, the caller should make sure the chosen rate
+ * can carry it. Use before handing serial to a Reactor.
+ *
+ * Returns the baud rate in use, the starting one when no faster rate
+ * worked, or -EIO when the meter could not be reached at all afterwards.
+ */
+int Link_Negotiate(Serial * serial, RegisterClient * client, FrameParser * parser, const uint32_t * rates, size_t count, const LinkParameters * parameters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LINKCONFIG_H_ */
@@ -0,0 +1,73 @@
+#ifndef QUANTILE_H_
+#define QUANTILE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* t-digest compression, about compression + 1 centroids are kept */
+#define QUANTILE_DEFAULT_COMPRESSION    100
+#define QUANTILE_MAX_COMPRESSION        1000
+
+/* Bytes QuantileSketch_Serialize() needs at most for a compression */
+#define QUANTILE_SERIALIZED_SIZE(compression)   (24 + 8 * ((compression) + 2))
+
+typedef struct _QuantileSketch QuantileSketch;
+
+/*
+ * A merging t-digest: a bounded set of (mean, weight) centroids, small near
+ * the ends of the distribution and large in the middle, so p99 stays
+ * accurate while memory is fixed by compression alone, about 24 bytes per
+ * unit (2.4 kB at the default) no matter how many values went in. Keep
+ * one per device and field, e.g. Watts and Irms of ConvertAutoReport().
+ * Min and max are exact. Not thread safe.
+ *
+ * compression is 10 to QUANTILE_MAX_COMPRESSION, 0 for the default.
+ */
+QuantileSketch * QuantileSketch_New(unsigned int compression);
+
+/* Add one value, NaN is ignored. Amortised constant time. */
+void QuantileSketch_Add(QuantileSketch * sketch, float value);
+
+/*
+ * Estimate the value at fraction q (0 to 1) of the values added, e.g.
+ * 0.99 for p99. NaN when the sketch is empty.
+ */
+float QuantileSketch_Quantile(QuantileSketch * sketch, double q);
+
+/*
+ * Fold from into sketch, as if sketch had been given every value added to
+ * from as well. The two may differ in compression. Returns 0 or -EINVAL.
+ */
+int QuantileSketch_Merge(QuantileSketch * sketch, const QuantileSketch * from);
+
+/*
+ * Write sketch to buffer in a portable little endian form for merging
+ * elsewhere. Returns the bytes written, at most
+ * QUANTILE_SERIALIZED_SIZE(compression), or -ENOSPC.
+ */
+int QuantileSketch_Serialize(QuantileSketch * sketch, uint8_t * buffer, size_t size);
+
+/*
+ * Replace the contents of sketch with a serialized one. Returns 0, or
+ * -EINVAL for a malformed buffer or one with more centroids than the
+ * compression of sketch holds.
+ */
+int QuantileSketch_Deserialize(QuantileSketch * sketch, const uint8_t * buffer, size_t size);
+
+uint64_t QuantileSketch_Count(QuantileSketch * sketch);
+float QuantileSketch_Min(QuantileSketch * sketch);
+float QuantileSketch_Max(QuantileSketch * sketch);
+
+void QuantileSketch_Reset(QuantileSketch * sketch);
+
+void QuantileSketch_Free(QuantileSketch * sketch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QUANTILE_H_ */
@@ -0,0 +1,95 @@
+#ifndef REACTOR_H_
+#define REACTOR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "serial.h"
+#include "78m6610.h"
+#include "frameparser.h"
+#include "registerclient.h"
+
+typedef struct _Reactor Reactor;
+
+/*
+ * Called from Reactor_RunOnce() for every valid AutoReport frame. message
+ * and values are only valid for the duration of the call. When the device
+ * hangs up or fails the callback is invoked once with message and values
+ * NULL and the device is removed from the reactor.
+ */
+typedef void (*ReactorCallback)(void * context, Serial * serial, const AutoReportMessage * message, const AutoReportValues * values);
+
+typedef enum
+{
+    REACTOR_BACKEND_AUTO = 0,       /* io_uring when the kernel allows it, else epoll */
+    REACTOR_BACKEND_EPOLL,
+    REACTOR_BACKEND_URING,
+} ReactorBackend;
+
+/*
+ * Single threaded epoll loop over many Serial devices. Each registered
+ * device is switched to non-blocking I/O and gets its own FrameParser, so
+ * one wakeup costs one read() however many frames it carries. Bytes left
+ * in a device's write queue (Serial_Queue()) are flushed when its fd
+ * becomes writable.
+ */
+Reactor * Reactor_New(void);
+
+/*
+ * Reactor_New() with a choice of read path. The io_uring backend keeps a
+ * read outstanding on every device and reaps all completions with one
+ * system call per loop, rather than an epoll_wait() plus a read() per
+ * ready device. On Linux 6.7 and later these are multishot reads into a
+ * shared pool of provided buffers, armed once per device. Older kernels
+ * get a read re-posted per completion into a registered per device
+ * buffer, which limits the reactor to REACTOR_URING_DEVICES devices
+ * (Reactor_Add() fails with -ENOSPC beyond). Write readiness still goes
+ * through epoll. REACTOR_BACKEND_URING fails with NULL and errno set when
+ * io_uring is unavailable, AUTO falls back to epoll.
+ */
+#define REACTOR_URING_DEVICES 4096
+
+Reactor * Reactor_NewWithBackend(ReactorBackend backend);
+ReactorBackend Reactor_GetBackend(Reactor * reactor);
+
+/* The reactor does not take ownership of serial */
+int Reactor_Add(Reactor * reactor, Serial * serial, ReactorCallback callback, void * context);
+int Reactor_Remove(Reactor * reactor, Serial * serial);
+size_t Reactor_Count(Reactor * reactor);
+
+/*
+ * Move a device between reactors without losing a frame split across
+ * reads: Detach() is Reactor_Remove() copying the device's FrameParser,
+ * partial frame included, to parser; Attach() is Reactor_Add() resuming
+ * from it.
+ */
+int Reactor_Detach(Reactor * reactor, Serial * serial, FrameParserStorage * parser);
+int Reactor_Attach(Reactor * reactor, Serial * serial, ReactorCallback callback, void * context, const FrameParserStorage * parser);
+
+/*
+ * Route register replies on serial to client (NULL to detach) while
+ * AutoReports keep flowing to the callback. The reactor wakes up for the
+ * client's request deadlines and expires them. Returns 0 or -ENOENT.
+ */
+int Reactor_SetRegisterClient(Reactor * reactor, Serial * serial, RegisterClient * client);
+
+/* Wait up to timeoutMs (-1 forever), returns frames dispatched or -errno */
+int Reactor_RunOnce(Reactor * reactor, int timeoutMs);
+
+/* Loop until Reactor_Stop(), returns 0 or -errno */
+int Reactor_Run(Reactor * reactor);
+
+/* Safe to call from any thread or from a callback */
+void Reactor_Stop(Reactor * reactor);
+void Reactor_Wake(Reactor * reactor);
+
+void Reactor_Free(Reactor * reactor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REACTOR_H_ */
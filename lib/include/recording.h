@@ -0,0 +1,86 @@
+#ifndef RECORDING_H_
+#define RECORDING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "78m6610.h"
+
+#define RECORDING_MAGIC "MONIPREC"
+#define RECORDING_VERSION 1
+
+/* records buffered by the Recorder before a write() */
+#define RECORDER_BUFFER_RECORDS 256
+
+/*
+ * File layout: one RecordingHeader followed by fixed size RecordingRecords,
+ * in host byte order. Records are appended whole, a trailing partial record
+ * left by a crash is ignored by the reader and cut off by the next Recorder.
+ */
+typedef struct
+{
+    char Magic[8];              /* RECORDING_MAGIC, not terminated */
+    uint32_t Version;
+    uint32_t RecordSize;        /* sizeof(RecordingRecord) */
+    uint64_t CreatedRealtime;   /* CLOCK_REALTIME ns when the file was created */
+    uint64_t CreatedMonotonic;  /* CLOCK_MONOTONIC ns at the same instant */
+    uint8_t Reserved[32];
+} RecordingHeader;
+
+typedef struct
+{
+    uint64_t Timestamp;         /* CLOCK_MONOTONIC ns, see FrameQueue_Now() */
+    uint32_t Device;
+    uint8_t Length;             /* bytes used in Frame */
+    uint8_t Reserved[3];
+    uint8_t Frame[FRAME_RECORD_SIZE];       /* header, length, payload, checksum */
+} RecordingRecord;
+
+typedef struct _Recorder Recorder;
+typedef struct _Recording Recording;
+
+/* Open path for appending, creating it with a fresh header if needed */
+Recorder * Recorder_Open(const char * path);
+
+/*
+ * Append a validated frame as returned by FrameParser_Next(): header plus
+ * payloadLength bytes of payload (including the checksum). Returns 0,
+ * -EMSGSIZE when the frame does not fit a record or -errno from write().
+ */
+int Recorder_Write(Recorder * recorder, uint64_t timestamp, uint32_t device, uint8_t header, const uint8_t * payload, uint8_t payloadLength);
+
+/* Append prebuilt records after any buffered ones, returns 0 or -errno */
+int Recorder_WriteRecords(Recorder * recorder, const RecordingRecord * records, size_t count);
+
+/* Write out buffered records, returns 0 or -errno */
+int Recorder_Flush(Recorder * recorder);
+
+/* Number of records in the file, including buffered ones */
+size_t Recorder_Count(Recorder * recorder);
+
+/* Flush and close, returns the result of the final flush */
+int Recorder_Close(Recorder * recorder);
+
+/* Map a recording read only, NULL on error or a bad header (errno is set) */
+Recording * Recording_Open(const char * path);
+
+const RecordingHeader * Recording_Header(Recording * recording);
+
+/* Complete records in the file when it was opened */
+size_t Recording_Count(Recording * recording);
+
+/* Records are contiguous, Recording_Records(r)[i] for i < Recording_Count(r) */
+const RecordingRecord * Recording_Records(Recording * recording);
+const RecordingRecord * Recording_At(Recording * recording, size_t index);
+
+void Recording_Close(Recording * recording);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RECORDING_H_ */
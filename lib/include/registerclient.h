@@ -0,0 +1,114 @@
+#ifndef REGISTERCLIENT_H_
+#define REGISTERCLIENT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "serial.h"
+#include "frameparser.h"
+
+/*
+ * 78M6610 serial interface. A host packet is [0xA5, length, commands...,
+ * checksum] with the checksum making the byte sum zero, like AutoReport
+ * frames. Commands select a register (0xA3 lo hi) and read (0xE3) or
+ * write (0xD3 b0 b1 b2) its three bytes. Several commands may share one
+ * packet, the device answers with one 0xAA frame carrying the data of every
+ * read in order, a bare 0xAD when there is nothing to return, or a single
+ * NACK byte.
+ */
+#define REGISTER_PACKET_HEADER      0xA5
+#define REGISTER_CMD_SELECT         0xA3
+#define REGISTER_CMD_READ           0xE3
+#define REGISTER_CMD_WRITE          0xD3
+
+#define REGISTER_REPLY_DATA         0xAA
+#define REGISTER_REPLY_ACK          0xAD
+#define REGISTER_REPLY_NACK         0xB0
+#define REGISTER_REPLY_UNSUPPORTED  0xBC
+#define REGISTER_REPLY_CHECKSUM     0xBD
+#define REGISTER_REPLY_OVERFLOW     0xBF
+
+/* reads per request, keeps packet and reply well under FRAME_MAX_LENGTH */
+#define REGISTER_BATCH_MAX          16
+
+/* requests in flight per client */
+#define REGISTER_CLIENT_MAX_PENDING 32
+
+typedef struct _RegisterClient RegisterClient;
+
+/*
+ * Completion of a request. status is 0, -ETIMEDOUT, -EIO (NACK), -ENOSYS,
+ * -EBADMSG (device saw a bad checksum), -EOVERFLOW or -ECANCELED when the
+ * client is freed first. For successful reads
+ * values holds the 24-bit register contents in the order requested, for
+ * writes and failures it is NULL.
+ */
+typedef void (*RegisterCallback)(void * context, int status, const uint16_t * addresses, const uint32_t * values, size_t count);
+
+/* Frames that are not replies, e.g. AutoReports, seen by RegisterClient_Run() */
+typedef void (*RegisterFrameCallback)(void * context, uint8_t header, const uint8_t * payload, int length);
+
+/*
+ * Tracks outstanding requests on one device. The device answers in order,
+ * so replies are matched to the oldest request, and only when their shape
+ * fits it (data length for reads, ACK for writes). A late reply to a
+ * request that already timed out is dropped for the same reason.
+ * Not thread safe: issue requests from the thread driving the device.
+ */
+RegisterClient * RegisterClient_New(Serial * serial);
+
+/* Let parser recognise replies alongside whatever it already accepts */
+void RegisterClient_SetupParser(FrameParser * parser);
+
+/*
+ * Queue a read of count (<= REGISTER_BATCH_MAX) registers as one packet.
+ * The packet goes through Serial_Queue(), so requests issued together leave
+ * in one write. Returns 0, -EBUSY when REGISTER_CLIENT_MAX_PENDING requests
+ * are in flight or -errno.
+ */
+int RegisterClient_Read(RegisterClient * client, const uint16_t * addresses, size_t count, uint32_t timeoutUs, RegisterCallback callback, void * context);
+int RegisterClient_Write(RegisterClient * client, uint16_t address, uint32_t value, uint32_t timeoutUs, RegisterCallback callback, void * context);
+
+/*
+ * FrameParser_Next() for a parser set up by RegisterClient_SetupParser():
+ * reply tokens (ACK, NACK...) are only taken while a request is
+ * outstanding, a stray 0xAD in the AutoReport stream is not an ACK.
+ */
+int RegisterClient_NextFrame(RegisterClient * client, FrameParser * parser, uint8_t * header, uint8_t * buffer);
+
+/*
+ * Offer a frame from FrameParser_Next(). Returns 1 when it was a reply to
+ * (or a stray reply for) this client, 0 when the caller should handle it.
+ */
+int RegisterClient_HandleFrame(RegisterClient * client, uint8_t header, const uint8_t * payload, int length);
+
+/* Fail requests past their deadline, returns how many expired */
+int RegisterClient_Expire(RegisterClient * client);
+
+/* Milliseconds until the next deadline (rounded up), -1 when idle */
+int RegisterClient_NextTimeout(RegisterClient * client);
+size_t RegisterClient_Outstanding(RegisterClient * client);
+
+/*
+ * Standalone pump for use without a Reactor: flush queued packets, read
+ * and dispatch until no request is outstanding or timeoutUs passes. Other
+ * frames go to frameCallback (may be NULL), so the AutoReport stream keeps
+ * flowing while registers are polled. Returns 0, -ETIMEDOUT or -errno.
+ */
+int RegisterClient_Run(RegisterClient * client, FrameParser * parser, uint32_t timeoutUs, RegisterFrameCallback frameCallback, void * context);
+
+/* Blocking batched read, returns 0 or the request status */
+int RegisterClient_ReadSync(RegisterClient * client, FrameParser * parser, const uint16_t * addresses, uint32_t * values, size_t count, uint32_t timeoutUs);
+int RegisterClient_WriteSync(RegisterClient * client, FrameParser * parser, uint16_t address, uint32_t value, uint32_t timeoutUs);
+
+void RegisterClient_Free(RegisterClient * client);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REGISTERCLIENT_H_ */
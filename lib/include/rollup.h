@@ -0,0 +1,86 @@
+#ifndef ROLLUP_H_
+#define ROLLUP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "78m6610.h"
+
+/* window lengths per Rollup, e.g. 1 s, 1 min and 15 min */
+#define ROLLUP_MAX_WINDOWS      4
+
+typedef struct _Rollup Rollup;
+
+typedef struct
+{
+    float Min;
+    float Max;
+    float Mean;
+    double Sum;
+} RollupStat;
+
+/*
+ * One closed window of one device. Windows are aligned to multiples of
+ * their length on the caller's clock, so with CLOCK_REALTIME timestamps a
+ * 1 min window runs from one wall clock minute to the next.
+ */
+typedef struct
+{
+    uint32_t Device;
+    uint32_t WindowMs;
+    uint64_t Start;             /* ns, inclusive */
+    uint64_t End;               /* ns, exclusive */
+    uint32_t Count;             /* samples in the window */
+    RollupStat Vrms;
+    RollupStat Irms;
+    RollupStat Watts;
+    RollupStat Pavg;
+    RollupStat PF;
+    RollupStat Freq;
+    float KwH;                  /* energy counter at the last sample */
+    uint32_t EnergyWh;          /* counter increase since the previous sample before the window */
+} RollupWindow;
+
+/* Called for each window as it closes, oldest first per device */
+typedef void (*RollupCallback)(void * context, const RollupWindow * window);
+
+/*
+ * Running min/max/mean/sum of every AutoReport field per device at each of
+ * count window lengths (1 ms to 1 day). Each sample costs a fixed amount
+ * of work per window. KwH is a 24 bit Wh counter: windows report how much
+ * it grew, across wraparounds, rather than its average. A step backwards
+ * (a meter reset) counts as no energy. Not thread safe, feed it from the
+ * thread that reads the devices.
+ */
+Rollup * Rollup_New(const uint32_t * windowsMs, size_t count, RollupCallback callback, void * context);
+
+/*
+ * Add a sample decoded by ConvertAutoReport() at timestamp ns, which must
+ * not go backwards per device. Windows the sample is past are emitted
+ * first. Returns 0, -ERANGE for a timestamp before the device's open
+ * window (the sample is dropped) or -ENOMEM.
+ */
+int Rollup_Add(Rollup * rollup, uint32_t device, uint64_t timestamp, const AutoReportValues * values);
+
+/*
+ * Emit every window that ends at or before now, for devices that went
+ * quiet. Call it from a timer. Returns the number of windows emitted.
+ */
+int Rollup_Advance(Rollup * rollup, uint64_t now);
+
+/* Emit the open windows as they are (shutdown), returns the number emitted */
+int Rollup_Flush(Rollup * rollup);
+
+size_t Rollup_DeviceCount(Rollup * rollup);
+
+void Rollup_Free(Rollup * rollup);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ROLLUP_H_ */
@@ -5,19 +5,177 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
+#include <time.h>
 
 //#include "pfc_types.h"
 
 typedef struct _Serial Serial;
 
+/* journal.h */
+struct _Journal;
+
+typedef enum
+{
+    SERIAL_PARITY_NONE,
+    SERIAL_PARITY_EVEN,
+    SERIAL_PARITY_ODD,
+} SerialParity;
+
+/* 8 data bits always, no flow control */
+typedef struct
+{
+    uint32_t Baud;              /* 1200 .. 921600 */
+    SerialParity Parity;
+    uint8_t StopBits;           /* 1 or 2 */
+    uint8_t VTime;              /* Serial_Read() inter-byte timeout, 0.1 s units */
+} SerialOptions;
+
+/* 19200 8E1, VTime 1: what Serial_New() applies */
+void Serial_DefaultOptions(SerialOptions * options);
+
+#ifndef MONIP_STATIC_ALLOCATION
 Serial * Serial_New(const char * path);
+
+/* NULL options means the defaults, NULL with errno EINVAL for bad options */
+Serial * Serial_NewWithOptions(const char * path, const SerialOptions * options);
+#endif
+
+/*
+ * Change line settings once the tty has sent what it holds, returns 0 or
+ * -errno. Bytes still in the write queue go at the new rate, Serial_Drain()
+ * first to avoid that.
+ */
+int Serial_SetOptions(Serial * serial, const SerialOptions * options);
+int Serial_GetOptions(Serial * serial, SerialOptions * options);
 void Serial_Reset(Serial * serial);
 uint8_t Serial_Read(Serial * serial, uint8_t * buffer, uint8_t size);
+
+/*
+ * Poll based reads that leave termios alone. Bytes are accumulated until
+ * size bytes have arrived or the absolute CLOCK_MONOTONIC deadline passes.
+ * Returns the number of bytes read (short on timeout) or -errno.
+ */
+void Serial_Deadline(struct timespec * deadline, uint32_t timeoutUs);
+int Serial_ReadUntil(Serial * serial, uint8_t * buffer, size_t size, const struct timespec * deadline);
+int Serial_ReadTimeout(Serial * serial, uint8_t * buffer, size_t size, uint32_t timeoutUs);
+
+/* Queue and flush, returns size once the bytes are accepted (see Serial_Queue) */
 uint8_t Serial_Write(Serial * serial, uint8_t * buffer, uint8_t size);
+
+/*
+ * Write queue. Serial_Queue() only copies into the queue, so commands queued
+ * back to back leave in a single writev(). Bytes are sent by Serial_Flush(),
+ * by a Reactor when the fd becomes writable, or by Serial_Drain(), the only
+ * call that waits for the line. Safe to use from several threads.
+ */
+#define SERIAL_QUEUE_SIZE 4096
+
+/* Returns 0 or -ENOBUFS (nothing queued) when size bytes do not fit */
+int Serial_Queue(Serial * serial, const uint8_t * buffer, size_t size);
+
+/* Write what the fd accepts, returns the bytes still queued or -errno */
+int Serial_Flush(Serial * serial);
+size_t Serial_Pending(Serial * serial);
+
+/* Flush everything and wait for transmission, returns 0, -ETIMEDOUT or -errno */
+int Serial_Drain(Serial * serial, uint32_t timeoutUs);
+
+/*
+ * Called with the queue lock held when the queue goes from empty to
+ * non-empty, so an event loop can start waiting for the fd to be writable.
+ */
+typedef void (*SerialWriteNotify)(void * context, Serial * serial);
+void Serial_SetWriteNotify(Serial * serial, SerialWriteNotify notify, void * context);
+
+/*
+ * Append every frame ReadMessage() validates on serial to journal (see
+ * journal.h), timestamped with CLOCK_REALTIME; NULL stops. Set it before
+ * reading, from the reading thread.
+ */
+void Serial_SetJournal(Serial * serial, struct _Journal * journal);
+
+/*
+ * Read path statistics, always on. The thread reading a Serial (ReadMessage(),
+ * FrameParser_Read(), a Reactor or a FrameParser attached with
+ * FrameParser_SetSerial()) updates them with relaxed atomic stores and no
+ * locks; Serial_GetStats() copies a snapshot from any thread. Each field is
+ * read atomically, the snapshot as a whole is not a single instant.
+ *
+ * Histograms are HDR style in microseconds: exact below 16 us, then 16
+ * buckets per power of two, so a value is known to within 1/16 up to 71
+ * minutes. Longer values land in the last bucket.
+ */
+#define SERIAL_HISTOGRAM_SUB_BITS   4
+#define SERIAL_HISTOGRAM_BUCKETS    ((32 - SERIAL_HISTOGRAM_SUB_BITS + 1) << SERIAL_HISTOGRAM_SUB_BITS)
+
+typedef struct
+{
+    uint64_t Count;
+    uint64_t Sum;               /* us */
+    uint64_t Max;               /* us */
+    uint32_t Buckets[SERIAL_HISTOGRAM_BUCKETS];
+} SerialHistogram;
+
+typedef struct
+{
+    uint64_t BytesRead;
+    uint64_t ReadCalls;         /* read() and completed reads, empty ones too */
+    uint64_t FramesOk;
+    uint64_t ChecksumErrors;    /* plausible frames with a bad checksum */
+    uint64_t HeaderMismatches;  /* a frame expected, another byte found */
+    uint64_t ResyncBytes;       /* skipped while looking for the next frame */
+    uint64_t Timeouts;          /* frame reads that ended with nothing */
+    SerialHistogram Latency;    /* read of a frame's first byte to frame decoded */
+    SerialHistogram Gap;        /* between decoded frames */
+} SerialStats;
+
+void Serial_GetStats(Serial * serial, SerialStats * stats);
+
+/*
+ * Smallest value at or above the given fraction (0 to 1) of the recorded
+ * values, rounded up to its bucket's upper edge and capped at Max. 0 for an
+ * empty histogram.
+ */
+uint64_t SerialHistogram_Percentile(const SerialHistogram * histogram, double fraction);
+
+/*
+ * Caller provided storage, for gateways that must not touch the heap after
+ * startup: declare a SerialStorage (static or inside another object) and
+ * pass it cast to Serial *. Serial_Size() is the exact size for carving
+ * handles out of a pool. Serial_Init() opens path like
+ * Serial_NewWithOptions() and returns 0 or -errno, Serial_Deinit() closes
+ * it and leaves the storage to the caller.
+ */
+#define SERIAL_STORAGE_SIZE (SERIAL_QUEUE_SIZE + sizeof(SerialStats) + 256)
+
+typedef union
+{
+    uint8_t bytes[SERIAL_STORAGE_SIZE];
+    uint64_t align;
+    void * alignPointer;
+} SerialStorage;
+
+size_t Serial_Size(void);
+int Serial_Init(Serial * serial, const char * path, const SerialOptions * options);
+void Serial_Deinit(Serial * serial);
+
 void Serial_FlushInput(Serial * serial);
 int Serial_GetFD(Serial * serial);
+
+/* O_NONBLOCK reads return at once instead of waiting for VMIN/VTIME */
+int Serial_SetNonBlocking(Serial * serial, int nonblocking);
+
+#ifndef MONIP_STATIC_ALLOCATION
 void Serial_Free(Serial * serial);
+#endif
+
+/* 0xFF minus the byte sum of buffer */
+uint8_t CheckSum(uint8_t * buffer, uint8_t length);
+
+/* The trailing byte that brings the byte sum of a frame to zero (CheckSum() + 1) */
+uint8_t FrameCheckSum(const uint8_t * buffer, uint8_t length);
 
 //pfc_error Serial_ReadPFCMessage(Serial * serial, PFC_ID * ID, uint8_t * data, pfc_size * size);
 //pfc_error Serial_WritePFCMessage(Serial * serial, PFC_ID ID, uint8_t * data, pfc_size size);
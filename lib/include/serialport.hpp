@@ -0,0 +1,241 @@
+#ifndef SERIALPORT_HPP_
+#define SERIALPORT_HPP_
+
+/*
+ * Header only C++ layer over the C API.
+ *
+ * monip::SerialPort owns a Serial and its FrameParser and frees them on
+ * destruction; it can be moved but not copied. Reads go into buffers the
+ * caller owns, and each frame comes back as a monip::FrameView: a header,
+ * pointer and length into that buffer, decoded field by field on access
+ * through the layouts in framelayout.hpp. A view is only valid while its
+ * buffer is unchanged.
+ *
+ * Calls return what the C functions return (byte counts or -errno), the
+ * layer adds no exceptions, copies or allocations of its own.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "serial.h"
+#include "78m6610.h"
+#include "frameparser.h"
+#include "framelayout.hpp"
+
+namespace monip
+{
+
+    class FrameView
+    {
+    public:
+        FrameView() : header_(0), payload_(nullptr), length_(0) {}
+
+        /* payload as FrameParser_Next() writes it, checksum byte included */
+        FrameView(uint8_t header, const uint8_t * payload, size_t length) :
+            header_(header), payload_(payload), length_(length) {}
+
+        uint8_t Header() const { return header_; }
+        const uint8_t * Payload() const { return payload_; }
+        size_t Size() const { return length_; }
+        bool Empty() const { return payload_ == nullptr; }
+
+        const uint8_t * begin() const { return payload_; }
+        const uint8_t * end() const { return payload_ + length_; }
+
+        bool IsAutoReport() const
+        {
+            return header_ == AUTOREPORT_HEADER && length_ == AUTOREPORT_PAYLOAD_SIZE;
+        }
+
+        /* For the C functions, nullptr unless IsAutoReport() */
+        const AutoReportMessage * Message() const
+        {
+            return IsAutoReport() ? reinterpret_cast<const AutoReportMessage *>(payload_) : nullptr;
+        }
+
+        /* Field I of the AutoReport layout, only this field is decoded; check IsAutoReport() first */
+        template<size_t I>
+        float Field() const
+        {
+            return detail::DecodeField<AutoReportLayout, I>(payload_);
+        }
+
+        float Vrms() const  { return Field<0>(); }
+        float Irms() const  { return Field<1>(); }
+        float Watts() const { return Field<2>(); }
+        float Pavg() const  { return Field<3>(); }
+        float PF() const    { return Field<4>(); }
+        float Freq() const  { return Field<5>(); }
+        float KwH() const   { return Field<6>(); }
+
+        /* All fields at once, returns false for frames that are not AutoReports */
+        bool Decode(AutoReportValues * values) const
+        {
+            if(!IsAutoReport())
+            {
+                return false;
+            }
+
+            AutoReportFrame::Decode(payload_, values);
+            return true;
+        }
+
+        /* AutoReportToJSON() of this frame: length written or -errno */
+        int ToJSON(char * buffer, size_t size) const
+        {
+            return IsAutoReport() ? AutoReportToJSON(Message(), buffer, size) : -EINVAL;
+        }
+
+    private:
+        uint8_t header_;
+        const uint8_t * payload_;
+        size_t length_;
+    };
+
+#ifndef MONIP_STATIC_ALLOCATION
+
+    class SerialPort
+    {
+    public:
+        SerialPort() : serial_(nullptr), parser_(nullptr) {}
+
+        /* Check IsOpen(), errno tells why on failure */
+        explicit SerialPort(const char * path, const SerialOptions * options = nullptr) :
+            serial_(Serial_NewWithOptions(path, options)),
+            parser_(nullptr)
+        {
+            if(serial_ != nullptr)
+            {
+                parser_ = FrameParser_New(AUTOREPORT_HEADER, AUTOREPORT_LENGTH);
+
+                if(parser_ == nullptr)
+                {
+                    Close();
+                    errno = ENOMEM;
+                }
+                else
+                {
+                    FrameParser_SetSerial(parser_, serial_);
+                }
+            }
+        }
+
+        SerialPort(SerialPort && other) noexcept :
+            serial_(other.serial_),
+            parser_(other.parser_)
+        {
+            other.serial_ = nullptr;
+            other.parser_ = nullptr;
+        }
+
+        SerialPort & operator=(SerialPort && other) noexcept
+        {
+            if(this != &other)
+            {
+                Close();
+                serial_ = other.serial_;
+                parser_ = other.parser_;
+                other.serial_ = nullptr;
+                other.parser_ = nullptr;
+            }
+
+            return *this;
+        }
+
+        SerialPort(const SerialPort &) = delete;
+        SerialPort & operator=(const SerialPort &) = delete;
+
+        ~SerialPort()
+        {
+            Close();
+        }
+
+        void Close()
+        {
+            FrameParser_Free(parser_);
+            Serial_Free(serial_);
+            parser_ = nullptr;
+            serial_ = nullptr;
+        }
+
+        bool IsOpen() const { return serial_ != nullptr; }
+        explicit operator bool() const { return IsOpen(); }
+
+        /* Borrowed handles for the C API, e.g. Reactor_Add() */
+        Serial * Get() const { return serial_; }
+        FrameParser * Parser() const { return parser_; }
+        int FD() const { return Serial_GetFD(serial_); }
+
+        int SetOptions(const SerialOptions & options) { return Serial_SetOptions(serial_, &options); }
+        int GetOptions(SerialOptions * options) const { return Serial_GetOptions(serial_, options); }
+        void GetStats(SerialStats * stats) const { Serial_GetStats(serial_, stats); }
+
+        int Read(uint8_t * buffer, size_t size, uint32_t timeoutUs)
+        {
+            return Serial_ReadTimeout(serial_, buffer, size, timeoutUs);
+        }
+
+        /* Queue and flush, returns bytes still queued or -errno (see Serial_Flush) */
+        int Write(const uint8_t * buffer, size_t size)
+        {
+            int Result = Serial_Queue(serial_, buffer, size);
+
+            return (Result == 0) ? Serial_Flush(serial_) : Result;
+        }
+
+        int Drain(uint32_t timeoutUs) { return Serial_Drain(serial_, timeoutUs); }
+
+        /*
+         * Next valid frame into buffer, reading as FrameParser_Read() does.
+         * view points into buffer. Returns the payload length or -EAGAIN
+         * when the line goes quiet.
+         */
+        int ReadFrame(uint8_t (&buffer)[FRAME_MAX_LENGTH], FrameView * view)
+        {
+            uint8_t header = 0;
+            int Result = -EINVAL;
+
+            if(serial_ == nullptr || view == nullptr)
+            {
+                return -EINVAL;
+            }
+
+            while((Result = FrameParser_Next(parser_, &header, buffer)) == -EAGAIN)
+            {
+                Result = FrameParser_Fill(parser_, Serial_GetFD(serial_));
+
+                if(Result <= 0)
+                {
+                    return (Result == 0) ? -EAGAIN : Result;
+                }
+            }
+
+            *view = FrameView(header, buffer, (size_t)Result);
+
+            return Result;
+        }
+
+        /* Give up the Serial, the caller frees it; bytes buffered in the parser are dropped */
+        Serial * Release()
+        {
+            Serial * serial = serial_;
+
+            FrameParser_Free(parser_);
+            parser_ = nullptr;
+            serial_ = nullptr;
+
+            return serial;
+        }
+
+    private:
+        Serial * serial_;
+        FrameParser * parser_;
+    };
+
+#endif /* MONIP_STATIC_ALLOCATION */
+
+} // namespace monip
+
+#endif /* SERIALPORT_HPP_ */
@@ -0,0 +1,56 @@
+#ifndef SHARDEDREACTOR_H_
+#define SHARDEDREACTOR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "serial.h"
+#include "reactor.h"
+
+typedef struct _ShardedReactor ShardedReactor;
+
+/*
+ * N worker threads, optionally pinned to CPUs, each running its own Reactor
+ * over a subset of the devices. Callbacks run on the owning shard's thread.
+ * Adding, removing and moving devices goes through a per-shard command
+ * queue; the per-frame path takes no locks.
+ *
+ * shards == 0 uses one shard per online CPU.
+ */
+ShardedReactor * ShardedReactor_New(unsigned shards, int pin);
+
+/* Assigns serial to the shard with the fewest devices, returns the shard */
+int ShardedReactor_Add(ShardedReactor * sharded, Serial * serial, ReactorCallback callback, void * context);
+
+/* Synchronous, serial may be freed once this returns */
+int ShardedReactor_Remove(ShardedReactor * sharded, Serial * serial);
+
+/*
+ * Move one device from the busiest shard to the quietest if their frame
+ * counts since the last call differ by more than 25%. Call periodically
+ * from a management thread. The device keeps its buffered partial frame;
+ * if the new shard cannot take it, it goes back to the old one, and if
+ * that fails too it hangs up there, on the old shard's thread. Returns
+ * the number of devices moved or -errno.
+ *
+ * Devices that hung up (callback with NULL message) are forgotten here
+ * and in Add() and Remove().
+ */
+int ShardedReactor_Rebalance(ShardedReactor * sharded);
+
+unsigned ShardedReactor_ShardCount(ShardedReactor * sharded);
+int ShardedReactor_ShardOf(ShardedReactor * sharded, Serial * serial);
+uint64_t ShardedReactor_Frames(ShardedReactor * sharded, unsigned shard);
+
+/* Stops and joins the workers, devices are released but not freed */
+void ShardedReactor_Free(ShardedReactor * sharded);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHARDEDREACTOR_H_ */
@@ -0,0 +1,102 @@
+#ifndef SIMULATOR_H_
+#define SIMULATOR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "78m6610.h"
+
+typedef struct _Simulator Simulator;
+
+/*
+ * Nominal + Amplitude * sin(2 pi t / Period + phase) plus uniform jitter of
+ * up to +-Noise, t being the meter's simulated time. Period 0 holds the
+ * value steady; a long period on Freq gives a slow frequency drift.
+ */
+typedef struct
+{
+    float Nominal;
+    float Amplitude;
+    float Period;               /* seconds */
+    float Noise;
+} SimulatorWaveform;
+
+typedef struct
+{
+    SimulatorWaveform Vrms;     /* V */
+    SimulatorWaveform Irms;     /* A */
+    SimulatorWaveform PF;
+    SimulatorWaveform Freq;     /* Hz */
+    uint32_t IntervalUs;        /* between frames of one meter */
+
+    /* Fault rates, the chance per frame from 0 to 1 */
+    float NoiseRate;            /* 1 to 8 random bytes ahead of the frame */
+    float CorruptRate;          /* one payload bit flipped, fails the checksum */
+    float TruncateRate;         /* frame cut short at a random byte */
+
+    uint32_t Seed;
+} SimulatorOptions;
+
+typedef struct
+{
+    uint64_t Frames;            /* frames generated, faulty or not */
+    uint64_t Noise;
+    uint64_t Corrupted;
+    uint64_t Truncated;
+    uint64_t Dropped;           /* pty buffer full, the reader is behind */
+    uint64_t MaxLateUs;         /* worst delay of a frame past its slot */
+} SimulatorStats;
+
+/* 230 V, 5 A, PF 0.95, 50 Hz with slow swings, a frame every 100 ms, no faults */
+void Simulator_DefaultOptions(SimulatorOptions * options);
+
+/*
+ * Build a checksummed AUTOREPORT_LENGTH byte frame from values. Fields
+ * outside the 24 bit range are clamped, KwH wraps as the meter's counter
+ * does.
+ */
+void Simulator_EncodeAutoReport(const AutoReportValues * values, uint8_t * frame);
+
+/*
+ * Open count raw pty pairs, each a meter generating frames per options
+ * (NULL for the defaults). Open Simulator_Path() with Serial_New().
+ * Meters start at different points of their waveforms.
+ */
+Simulator * Simulator_New(size_t count, const SimulatorOptions * options);
+
+/* Stops the simulator and closes the ptys */
+void Simulator_Free(Simulator * simulator);
+
+size_t Simulator_Count(Simulator * simulator);
+const char * Simulator_Path(Simulator * simulator, size_t meter);
+
+/* Replace one meter's options, only while the simulator is stopped */
+int Simulator_Configure(Simulator * simulator, size_t meter, const SimulatorOptions * options);
+
+/*
+ * Generate the meter's next frame, apply the faults drawn for it and write
+ * the bytes. values, when not NULL, receives what the frame encodes. Returns
+ * 0, -EAGAIN when the pty buffer is full (the frame is dropped) or -errno.
+ * Only while the simulator is stopped.
+ */
+int Simulator_Emit(Simulator * simulator, size_t meter, AutoReportValues * values);
+
+/*
+ * Emit from a background thread, each meter every IntervalUs with the
+ * meters' slots spread evenly over the interval. 0 or -errno.
+ */
+int Simulator_Start(Simulator * simulator);
+void Simulator_Stop(Simulator * simulator);
+
+/* Totals over all meters, safe while running */
+void Simulator_GetStats(Simulator * simulator, SimulatorStats * stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIMULATOR_H_ */
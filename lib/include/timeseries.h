@@ -0,0 +1,72 @@
+#ifndef TIMESERIES_H_
+#define TIMESERIES_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "78m6610.h"
+
+#define TIMESERIES_DEFAULT_RESOLUTION_NS    1000000u    /* 1 ms */
+#define TIMESERIES_DEFAULT_BLOCK_SIZE       4096u
+#define TIMESERIES_MIN_BLOCK_SIZE           256u
+
+typedef struct _TimeSeries TimeSeries;
+
+/* Called for each sample a query finds, oldest first */
+typedef void (*TimeSeriesCallback)(void * context, uint64_t timestamp, const AutoReportValues * values);
+
+/*
+ * Compressed history of one meter. Samples are kept as the raw 24 bit
+ * fields of the AutoReport payload, not as floats, in append only blocks
+ * of blockSize bytes, Gorilla style:
+ *
+ * - timestamps as the difference between successive intervals, 1 bit
+ *   while the meter keeps its pace
+ * - each field as its difference from the previous sample, in a bit
+ *   width carried over from sample to sample, 1 bit when unchanged
+ *
+ * A noisy meter sample takes 7 to 8 bytes against 36 for an
+ * AutoReportValues and its timestamp. Timestamps are stored in units of
+ * resolutionNs (1 ns to 1 s), coarser units absorb the jitter of the
+ * serial line and compress better. 0 selects either default. Not thread
+ * safe.
+ */
+TimeSeries * TimeSeries_New(uint32_t resolutionNs, size_t blockSize);
+
+/*
+ * Append the fields of a payload as returned by ReadMessage(), at
+ * timestamp ns. Returns 0, -ERANGE when timestamp is before the last
+ * sample's or -ENOMEM.
+ */
+int TimeSeries_Append(TimeSeries * series, uint64_t timestamp, const AutoReportMessage * message);
+
+/*
+ * Decode the samples with from <= timestamp < to, timestamps rounded down
+ * to the resolution. Values are exactly what ConvertAutoReport() gives for
+ * the appended payload. Blocks outside the range are skipped without
+ * decoding. Returns the number of samples passed to callback.
+ */
+int TimeSeries_Query(TimeSeries * series, uint64_t from, uint64_t to, TimeSeriesCallback callback, void * context);
+
+/*
+ * Release the blocks holding only samples before timestamp, e.g. to keep
+ * the last 24 h. Returns the number of samples dropped.
+ */
+int TimeSeries_DropBefore(TimeSeries * series, uint64_t timestamp);
+
+size_t TimeSeries_Count(TimeSeries * series);
+
+/* Bytes allocated for blocks and their index */
+size_t TimeSeries_MemoryUsage(TimeSeries * series);
+
+void TimeSeries_Free(TimeSeries * series);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIMESERIES_H_ */
@@ -0,0 +1,437 @@
+#define _GNU_SOURCE
+#include "journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(JournalHeader) == 64, "JournalHeader layout changed");
+_Static_assert(sizeof(JournalRecord) == 64, "JournalRecord layout changed");
+
+#define LOAD(ptr, order) __atomic_load_n((ptr), (order))
+#define STORE(ptr, value, order) __atomic_store_n((ptr), (value), (order))
+
+struct _Journal
+{
+    int fd;                     /* held for its flock() */
+    void * map;
+    size_t size;
+    JournalHeader * header;
+    JournalRecord * records;
+    uint64_t capacity;
+    uint32_t device;
+    uint64_t next;
+};
+
+struct _JournalReader
+{
+    void * map;
+    size_t size;
+    const JournalHeader * header;
+    const JournalRecord * records;
+    uint64_t capacity;
+};
+
+static uint64_t Now(clockid_t clock)
+{
+    struct timespec now;
+
+    clock_gettime(clock, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static int ValidHeader(const JournalHeader * header, size_t size)
+{
+    return memcmp(header->Magic, JOURNAL_MAGIC, sizeof(header->Magic)) == 0
+           && header->Version == JOURNAL_VERSION
+           && header->RecordSize == sizeof(JournalRecord)
+           && header->Capacity != 0
+           && size == sizeof(JournalHeader) + header->Capacity * sizeof(JournalRecord);
+}
+
+/* Multiply and rotate over the 8 words of a record, Checksum taken as 0 */
+static uint32_t RecordChecksum(const JournalRecord * record)
+{
+    uint64_t words[sizeof(JournalRecord) / sizeof(uint64_t)];
+    uint64_t hash = 0x9e3779b97f4a7c15ULL;
+    size_t i = 0;
+
+    memcpy(words, record, sizeof(words));
+    words[offsetof(JournalRecord, Device) / sizeof(uint64_t)] &= ~((uint64_t)UINT32_MAX << 32);
+
+    for(i = 0; i < sizeof(words) / sizeof(words[0]); i++)
+    {
+        hash = (hash ^ words[i]) * 0xff51afd7ed558ccdULL;
+        hash = (hash << 29) | (hash >> 35);
+    }
+
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+/* The tail is the highest valid sequence in any slot, torn records are ignored */
+static uint64_t Recover(Journal * journal)
+{
+    uint64_t last = 0;
+    uint64_t slot = 0;
+
+    for(slot = 0; slot < journal->capacity; slot++)
+    {
+        const JournalRecord * record = &journal->records[slot];
+        uint64_t sequence = record->Sequence;
+
+        if(sequence > last && sequence % journal->capacity == slot
+           && record->Length <= FRAME_RECORD_SIZE && record->Checksum == RecordChecksum(record))
+        {
+            last = sequence;
+        }
+    }
+
+    return last + 1;
+}
+
+/* Size and map a new file, or check the existing one, with fd locked */
+static int Prepare(Journal * journal, uint32_t device, size_t capacity)
+{
+    JournalHeader header;
+    struct stat st;
+    int fresh = 0;
+
+    if(fstat(journal->fd, &st) < 0)
+    {
+        return -errno;
+    }
+
+    /* a file cut short before its magic went in is as good as empty */
+    memset(&header, 0, sizeof(header));
+    if(st.st_size >= (off_t)sizeof(header) && pread(journal->fd, &header, sizeof(header), 0) != sizeof(header))
+    {
+        return -errno;
+    }
+    fresh = (st.st_size == 0 || header.Magic[0] == '\0');
+
+    if(fresh)
+    {
+        if(capacity == 0 || capacity > (SIZE_MAX - sizeof(header)) / sizeof(JournalRecord))
+        {
+            return -EINVAL;
+        }
+        journal->size = sizeof(header) + capacity * sizeof(JournalRecord);
+
+        /* zeroed slots, none valid */
+        if(ftruncate(journal->fd, 0) < 0 || ftruncate(journal->fd, journal->size) < 0)
+        {
+            return -errno;
+        }
+    }
+    else
+    {
+        if(!ValidHeader(&header, st.st_size) || header.Device != device
+           || (capacity != 0 && capacity != header.Capacity))
+        {
+            return -EINVAL;
+        }
+        journal->size = st.st_size;
+    }
+
+    journal->map = mmap(NULL, journal->size, PROT_READ | PROT_WRITE, MAP_SHARED, journal->fd, 0);
+    if(journal->map == MAP_FAILED)
+    {
+        journal->map = NULL;
+        return -errno;
+    }
+
+    journal->header = journal->map;
+    journal->records = (JournalRecord *)(journal->header + 1);
+
+    if(fresh)
+    {
+        journal->header->Version = JOURNAL_VERSION;
+        journal->header->RecordSize = sizeof(JournalRecord);
+        journal->header->Capacity = capacity;
+        journal->header->Device = device;
+        journal->header->CreatedRealtime = Now(CLOCK_REALTIME);
+        journal->header->Next = 1;
+        /* readers check the magic first, it goes in last */
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        memcpy(journal->header->Magic, JOURNAL_MAGIC, sizeof(journal->header->Magic));
+    }
+
+    journal->capacity = journal->header->Capacity;
+    journal->device = device;
+    journal->next = Recover(journal);
+    STORE(&journal->header->Next, journal->next, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+Journal * Journal_Open(const char * path, uint32_t device, size_t capacity)
+{
+    Journal * journal = NULL;
+    int Result = 0;
+
+    if(path == NULL)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    journal = calloc(1, sizeof(*journal));
+    if(journal == NULL)
+    {
+        return NULL;
+    }
+
+    journal->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(journal->fd < 0)
+    {
+        free(journal);
+        return NULL;
+    }
+
+    if(flock(journal->fd, LOCK_EX | LOCK_NB) < 0)
+    {
+        Result = (errno == EWOULDBLOCK) ? -EBUSY : -errno;
+    }
+    else
+    {
+        Result = Prepare(journal, device, capacity);
+    }
+
+    if(Result < 0)
+    {
+        Journal_Close(journal);
+        errno = -Result;
+        return NULL;
+    }
+
+    return journal;
+}
+
+int Journal_Append(Journal * journal, uint64_t timestamp, uint8_t header, const uint8_t * payload, uint8_t payloadLength)
+{
+    JournalRecord * record = NULL;
+    JournalRecord local;
+
+    if(journal == NULL || (payload == NULL && payloadLength > 0))
+    {
+        return -EINVAL;
+    }
+
+    if(payloadLength + 2 > FRAME_RECORD_SIZE)
+    {
+        return -EMSGSIZE;
+    }
+
+    /* built aside, the checksum covers the sequence it is published with */
+    memset(&local, 0, sizeof(local));
+    local.Sequence = journal->next;
+    local.Timestamp = timestamp;
+    local.Device = journal->device;
+    local.Length = payloadLength + 2;
+    local.Frame[0] = header;
+    local.Frame[1] = payloadLength + 2;
+    memcpy(&local.Frame[2], payload, payloadLength);
+    local.Checksum = RecordChecksum(&local);
+
+    record = &journal->records[journal->next % journal->capacity];
+
+    /* seqlock: the slot reads as empty while it changes */
+    STORE(&record->Sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy((uint8_t *)record + sizeof(record->Sequence), (const uint8_t *)&local + sizeof(local.Sequence), sizeof(local) - sizeof(local.Sequence));
+
+    STORE(&record->Sequence, journal->next, __ATOMIC_RELEASE);
+    journal->next++;
+    STORE(&journal->header->Next, journal->next, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+uint64_t Journal_Next(Journal * journal)
+{
+    return (journal != NULL) ? journal->next : 0;
+}
+
+int Journal_Sync(Journal * journal)
+{
+    if(journal == NULL)
+    {
+        return -EINVAL;
+    }
+
+    return (msync(journal->map, journal->size, MS_SYNC) < 0) ? -errno : 0;
+}
+
+void Journal_Close(Journal * journal)
+{
+    if(journal != NULL)
+    {
+        if(journal->map != NULL)
+        {
+            munmap(journal->map, journal->size);
+        }
+        /* closing drops the lock */
+        close(journal->fd);
+        free(journal);
+    }
+}
+
+JournalReader * JournalReader_Open(const char * path)
+{
+    JournalReader * reader = NULL;
+    struct stat st;
+    int fd = -1;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if(fd < 0)
+    {
+        return NULL;
+    }
+
+    if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(JournalHeader))
+    {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    reader = malloc(sizeof(*reader));
+
+    if(reader == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    reader->size = st.st_size;
+    reader->map = mmap(NULL, reader->size, PROT_READ, MAP_SHARED, fd, 0);
+
+    /* the mapping keeps the file referenced */
+    close(fd);
+
+    if(reader->map == MAP_FAILED)
+    {
+        free(reader);
+        return NULL;
+    }
+
+    reader->header = reader->map;
+    if(!ValidHeader(reader->header, reader->size))
+    {
+        munmap(reader->map, reader->size);
+        free(reader);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    reader->records = (const JournalRecord *)(reader->header + 1);
+    reader->capacity = reader->header->Capacity;
+
+    return reader;
+}
+
+const JournalHeader * JournalReader_Header(JournalReader * reader)
+{
+    return (reader != NULL) ? reader->header : NULL;
+}
+
+uint64_t JournalReader_Next(JournalReader * reader)
+{
+    return (reader != NULL) ? LOAD(&reader->header->Next, __ATOMIC_ACQUIRE) : 0;
+}
+
+int JournalReader_Read(JournalReader * reader, uint64_t sequence, JournalRecord * record)
+{
+    const JournalRecord * slot = NULL;
+    uint64_t before = 0;
+    uint64_t after = 0;
+
+    if(reader == NULL || record == NULL || sequence == 0)
+    {
+        return -EINVAL;
+    }
+
+    slot = &reader->records[sequence % reader->capacity];
+
+    before = LOAD(&slot->Sequence, __ATOMIC_ACQUIRE);
+    if(before != sequence)
+    {
+        return (before > sequence) ? -ENOENT : -EAGAIN;
+    }
+
+    memcpy(record, slot, sizeof(*record));
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    after = LOAD(&slot->Sequence, __ATOMIC_RELAXED);
+    if(after != sequence)
+    {
+        /* the writer came round again while we copied */
+        return -ENOENT;
+    }
+
+    if(record->Length > FRAME_RECORD_SIZE || record->Checksum != RecordChecksum(record))
+    {
+        return -EIO;
+    }
+
+    return 0;
+}
+
+size_t JournalReader_Poll(JournalReader * reader, uint64_t * sequence, JournalRecord * records, size_t count)
+{
+    uint64_t next = 0;
+    size_t copied = 0;
+
+    if(reader == NULL || sequence == NULL || records == NULL)
+    {
+        return 0;
+    }
+
+    next = JournalReader_Next(reader);
+
+    while(copied < count && *sequence < next)
+    {
+        /* the oldest record held shares its slot with next */
+        uint64_t oldest = (next > reader->capacity) ? next - reader->capacity : 1;
+        int Result = 0;
+
+        if(*sequence < oldest)
+        {
+            *sequence = oldest;
+            continue;
+        }
+
+        Result = JournalReader_Read(reader, *sequence, &records[copied]);
+        if(Result == -EAGAIN)
+        {
+            break;
+        }
+
+        copied += (Result == 0);
+        (*sequence)++;
+
+        if(Result == -ENOENT)
+        {
+            next = JournalReader_Next(reader);
+        }
+    }
+
+    return copied;
+}
+
+void JournalReader_Close(JournalReader * reader)
+{
+    if(reader != NULL)
+    {
+        munmap(reader->map, reader->size);
+        free(reader);
+    }
+}
@@ -0,0 +1,342 @@
+#include "jsonbuffer.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JSON_INITIAL_CAPACITY 256
+
+static char EmptyString[1] = "";
+
+static void InitBuffer(JSONBuffer * buffer, JSONMode mode, int growable)
+{
+    buffer->data = EmptyString;
+    buffer->length = 0;
+    buffer->capacity = 0;
+    buffer->count = 0;
+    buffer->mode = mode;
+    buffer->growable = growable;
+    buffer->finished = 0;
+}
+
+#ifndef MONIP_STATIC_ALLOCATION
+void JSONBuffer_Init(JSONBuffer * buffer, JSONMode mode)
+{
+    if(buffer != NULL)
+    {
+        InitBuffer(buffer, mode, 1);
+    }
+}
+#endif
+
+void JSONBuffer_InitStatic(JSONBuffer * buffer, JSONMode mode, char * storage, size_t size)
+{
+    if(buffer != NULL)
+    {
+        InitBuffer(buffer, mode, 0);
+
+        if(storage != NULL && size > 0)
+        {
+            buffer->data = storage;
+            buffer->capacity = size - 1;
+            buffer->data[0] = '\0';
+        }
+    }
+}
+
+void JSONBuffer_Reset(JSONBuffer * buffer)
+{
+    if(buffer != NULL)
+    {
+        buffer->length = 0;
+        buffer->count = 0;
+        buffer->finished = 0;
+
+        if(buffer->capacity > 0)
+        {
+            buffer->data[0] = '\0';
+        }
+    }
+}
+
+#ifndef MONIP_STATIC_ALLOCATION
+void JSONBuffer_Free(JSONBuffer * buffer)
+{
+    if(buffer != NULL)
+    {
+        if(buffer->growable && buffer->capacity > 0)
+        {
+            free(buffer->data);
+        }
+
+        InitBuffer(buffer, buffer->mode, 1);
+    }
+}
+#endif
+
+int JSONBuffer_Reserve(JSONBuffer * buffer, size_t extra)
+{
+#ifndef MONIP_STATIC_ALLOCATION
+    size_t capacity = 0;
+    char * data = NULL;
+#endif
+
+    if(buffer == NULL)
+    {
+        return -EINVAL;
+    }
+
+    if(buffer->length + extra <= buffer->capacity)
+    {
+        return 0;
+    }
+
+    if(!buffer->growable)
+    {
+        return -ENOSPC;
+    }
+
+#ifdef MONIP_STATIC_ALLOCATION
+    return -ENOSPC;
+#else
+    capacity = (buffer->capacity > 0) ? buffer->capacity : JSON_INITIAL_CAPACITY;
+
+    while(capacity < buffer->length + extra)
+    {
+        capacity *= 2;
+    }
+
+    data = realloc((buffer->capacity > 0) ? buffer->data : NULL, capacity + 1);
+
+    if(data == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    if(buffer->capacity == 0)
+    {
+        data[0] = '\0';
+    }
+
+    buffer->data = data;
+    buffer->capacity = capacity;
+
+    return 0;
+#endif
+}
+
+int JSONBuffer_AppendRecord(JSONBuffer * buffer, const char * text, size_t length)
+{
+    int Result = 0;
+
+    if(buffer == NULL || text == NULL || buffer->finished)
+    {
+        return -EINVAL;
+    }
+
+    /* separator or opening bracket, text, newline or closing bracket */
+    Result = JSONBuffer_Reserve(buffer, length + 2);
+
+    if(Result == 0)
+    {
+        char * ptr = buffer->data + buffer->length;
+
+        if(buffer->mode == JSON_MODE_ARRAY)
+        {
+            *ptr++ = (buffer->count == 0) ? '[' : ',';
+        }
+
+        memcpy(ptr, text, length);
+        ptr += length;
+
+        if(buffer->mode == JSON_MODE_NDJSON)
+        {
+            *ptr++ = '\n';
+        }
+
+        *ptr = '\0';
+        buffer->length = ptr - buffer->data;
+        buffer->count++;
+    }
+
+    return Result;
+}
+
+const char * JSONBuffer_Finish(JSONBuffer * buffer)
+{
+    if(buffer == NULL)
+    {
+        return NULL;
+    }
+
+    if(buffer->mode == JSON_MODE_ARRAY && !buffer->finished)
+    {
+        const char * close = (buffer->count == 0) ? "[]" : "]";
+        size_t length = strlen(close);
+
+        if(JSONBuffer_Reserve(buffer, length) != 0)
+        {
+            return NULL;
+        }
+
+        memcpy(buffer->data + buffer->length, close, length + 1);
+        buffer->length += length;
+    }
+
+    buffer->finished = 1;
+
+    return buffer->data;
+}
+
+/*
+ * Exact round-half-even of |value| * 100, as glibc printf rounds the binary
+ * value. A finite float is m * 2^e with m < 2^24, so m * 100 < 2^31 and the
+ * shifts below are exact. Returns -1 for values that need the slow path.
+ */
+static int64_t ScaleFixed2(uint32_t bits)
+{
+    uint32_t biased = (bits >> 23) & 0xff;
+    uint64_t scaled = bits & 0x7fffff;
+    int exponent = -149;
+
+    if(biased == 0xff)
+    {
+        /* inf or nan */
+        return -1;
+    }
+    else if(biased != 0)
+    {
+        scaled |= 0x800000;
+        exponent = (int)biased - 150;
+    }
+
+    scaled *= 100;
+
+    if(exponent >= 0)
+    {
+        return (exponent <= 32) ? (int64_t)(scaled << exponent) : -1;
+    }
+    else if(exponent <= -32)
+    {
+        /* scaled < 2^31, anything shifted this far is below one half */
+        return 0;
+    }
+    else
+    {
+        unsigned shift = -exponent;
+        uint64_t quotient = scaled >> shift;
+        uint64_t remainder = scaled & ((1ULL << shift) - 1);
+        uint64_t half = 1ULL << (shift - 1);
+
+        if(remainder > half || (remainder == half && (quotient & 1)))
+        {
+            quotient++;
+        }
+
+        return (int64_t)quotient;
+    }
+}
+
+/* Digits of scaled / 100 with two decimals, after an optional sign */
+static size_t FormatScaled(char * out, int negative, uint64_t scaled)
+{
+    char digits[24];
+    char * ptr = out;
+    uint64_t whole = scaled / 100;
+    size_t count = 0;
+
+    if(negative)
+    {
+        *ptr++ = '-';
+    }
+
+    do
+    {
+        digits[count++] = '0' + (whole % 10);
+        whole /= 10;
+    } while(whole > 0);
+
+    while(count > 0)
+    {
+        *ptr++ = digits[--count];
+    }
+
+    *ptr++ = '.';
+    *ptr++ = '0' + (scaled / 10) % 10;
+    *ptr++ = '0' + scaled % 10;
+
+    return ptr - out;
+}
+
+size_t JSON_FormatFixed2(char * out, float value)
+{
+    uint32_t bits = 0;
+    int64_t scaled = 0;
+
+    memcpy(&bits, &value, sizeof(bits));
+
+    if((scaled = ScaleFixed2(bits)) < 0)
+    {
+        return (size_t)snprintf(out, JSON_FIXED2_MAX, "%.2f", value);
+    }
+
+    return FormatScaled(out, (bits & 0x80000000) != 0, (uint64_t)scaled);
+}
+
+/*
+ * Bits of the float nearest to magnitude / divisor (round half even, as
+ * the FPU divides). divisor >= 1000 keeps the quotient below 2^22, so the
+ * mantissa is found by shifting magnitude left and one 64-bit division.
+ */
+static uint32_t FloatQuotientBits(uint32_t magnitude, uint32_t divisor)
+{
+    uint64_t target = (uint64_t)divisor << 23;
+    uint64_t numerator = 0;
+    uint64_t mantissa = 0;
+    uint64_t remainder = 0;
+    int shift = 0;
+
+    if(magnitude == 0)
+    {
+        return 0;
+    }
+
+    /* same bit length as target, one more if that is still short */
+    shift = (64 - __builtin_clzll(target)) - (32 - __builtin_clz(magnitude));
+    if(((uint64_t)magnitude << shift) < target)
+    {
+        shift++;
+    }
+
+    numerator = (uint64_t)magnitude << shift;
+    mantissa = numerator / divisor;
+    remainder = numerator % divisor;
+
+    if(2 * remainder > divisor || (2 * remainder == divisor && (mantissa & 1)))
+    {
+        mantissa++;
+    }
+
+    if(mantissa == (1ULL << 24))
+    {
+        mantissa >>= 1;
+        shift--;
+    }
+
+    return ((uint32_t)(150 - shift) << 23) | (uint32_t)(mantissa & 0x7fffff);
+}
+
+size_t JSON_FormatScaled2(char * out, int32_t value, unsigned scaleDigits)
+{
+    static const uint32_t Powers[] = { 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+    uint32_t magnitude = (value < 0) ? -(uint32_t)value : (uint32_t)value;
+
+    if(scaleDigits < 3 || scaleDigits > 9)
+    {
+        return 0;
+    }
+
+    return FormatScaled(out, value < 0, (uint64_t)ScaleFixed2(FloatQuotientBits(magnitude, Powers[scaleDigits - 3])));
+}
@@ -0,0 +1,139 @@
+#include "linkconfig.h"
+
+#include <errno.h>
+#include <time.h>
+
+#include "78m6610.h"
+
+void Link_DefaultParameters(LinkParameters * parameters)
+{
+    if(parameters != NULL)
+    {
+        parameters->BaudRegister = LINK_REGISTER_BAUD;
+        parameters->IntervalRegister = LINK_REGISTER_INTERVAL;
+        parameters->IntervalMs = 0;
+        parameters->VerifyFrames = 3;
+        parameters->VerifyTimeoutUs = 2000000;
+        parameters->CommandTimeoutUs = 200000;
+    }
+}
+
+int Link_Verify(Serial * serial, FrameParser * parser, unsigned frames, uint32_t timeoutUs)
+{
+    struct timespec deadline;
+    uint8_t chunk[AUTOREPORT_LENGTH];
+    uint8_t buffer[FRAME_MAX_LENGTH];
+    unsigned valid = 0;
+    int expired = 0;
+    int Result = 0;
+
+    if(serial == NULL || parser == NULL)
+    {
+        return -EINVAL;
+    }
+
+    Serial_Deadline(&deadline, timeoutUs);
+
+    for(;;)
+    {
+        uint8_t header = 0;
+
+        while(valid < frames && (Result = FrameParser_Next(parser, &header, buffer)) >= 0)
+        {
+            valid += (header == AUTOREPORT_HEADER && Result == AUTOREPORT_PAYLOAD_SIZE);
+        }
+
+        if(valid >= frames || expired)
+        {
+            break;
+        }
+
+        /* a frame's worth at a time, short only once the deadline passed */
+        Result = Serial_ReadUntil(serial, chunk, sizeof(chunk), &deadline);
+
+        if(Result < 0)
+        {
+            return Result;
+        }
+
+        FrameParser_Push(parser, chunk, Result);
+        expired = (Result < (int)sizeof(chunk));
+    }
+
+    return (valid >= frames) ? 0 : -ETIMEDOUT;
+}
+
+/* Host side of a rate change, stale bytes from the old rate are dropped */
+static void Follow(Serial * serial, FrameParser * parser, const SerialOptions * options, uint32_t timeoutUs)
+{
+    Serial_Drain(serial, timeoutUs);
+    Serial_SetOptions(serial, options);
+    Serial_FlushInput(serial);
+    FrameParser_Reset(parser);
+}
+
+int Link_Negotiate(Serial * serial, RegisterClient * client, FrameParser * parser, const uint32_t * rates, size_t count, const LinkParameters * parameters)
+{
+    LinkParameters defaults;
+    SerialOptions original;
+    SerialOptions current;
+    size_t i = 0;
+    int Result = 0;
+
+    if(serial == NULL || client == NULL || parser == NULL || (rates == NULL && count > 0))
+    {
+        return -EINVAL;
+    }
+
+    if(parameters == NULL)
+    {
+        Link_DefaultParameters(&defaults);
+        parameters = &defaults;
+    }
+
+    Serial_GetOptions(serial, &original);
+    current = original;
+
+    /* rates from the starting one down are not worth trying */
+    for(i = 0; i < count && rates[i] != original.Baud; i++)
+    {
+        SerialOptions trial = original;
+
+        trial.Baud = rates[i];
+
+        /* the meter acknowledges at the old rate before it switches */
+        if(RegisterClient_WriteSync(client, parser, parameters->BaudRegister, trial.Baud, parameters->CommandTimeoutUs) != 0)
+        {
+            continue;
+        }
+
+        Follow(serial, parser, &trial, parameters->CommandTimeoutUs);
+
+        if(Link_Verify(serial, parser, parameters->VerifyFrames, parameters->VerifyTimeoutUs) == 0)
+        {
+            current = trial;
+            break;
+        }
+
+        /* checksums fail at this rate, both sides go back, the ACK may be garbled */
+        RegisterClient_WriteSync(client, parser, parameters->BaudRegister, original.Baud, parameters->CommandTimeoutUs);
+        Follow(serial, parser, &original, parameters->CommandTimeoutUs);
+
+        if(Link_Verify(serial, parser, parameters->VerifyFrames, parameters->VerifyTimeoutUs) != 0)
+        {
+            return -EIO;
+        }
+    }
+
+    if(parameters->IntervalMs > 0)
+    {
+        Result = RegisterClient_WriteSync(client, parser, parameters->IntervalRegister, parameters->IntervalMs, parameters->CommandTimeoutUs);
+
+        if(Result != 0)
+        {
+            return Result;
+        }
+    }
+
+    return (int)current.Baud;
+}
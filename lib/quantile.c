@@ -0,0 +1,428 @@
+#include "quantile.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QUANTILE_MIN_COMPRESSION    10
+#define QUANTILE_MAGIC_0            'Q'
+#define QUANTILE_MAGIC_1            'S'
+#define QUANTILE_VERSION            1
+#define QUANTILE_HEADER_SIZE        24
+
+typedef struct
+{
+    float mean;
+    uint32_t weight;
+} Centroid;
+
+struct _QuantileSketch
+{
+    unsigned int compression;
+    size_t capacity;            /* merged centroids the scale function allows */
+    size_t size;                /* capacity plus room for buffered values */
+    size_t merged;              /* sorted centroids at the front */
+    size_t used;                /* merged plus values added since */
+    uint64_t count;
+    float min;
+    float max;
+    Centroid centroids[];
+};
+
+static int CompareCentroids(const void * a, const void * b)
+{
+    float left = ((const Centroid *)a)->mean;
+    float right = ((const Centroid *)b)->mean;
+
+    return (left > right) - (left < right);
+}
+
+/*
+ * Scale function k1 of the t-digest paper: k(q) = d / 2pi * asin(2q - 1).
+ * A centroid starting at q may grow until k has gone up by one, which
+ * keeps them tiny near q = 0 and q = 1.
+ */
+static double Limit(unsigned int compression, double q)
+{
+    double k = compression / (2.0 * M_PI) * asin(2.0 * q - 1.0) + 1.0;
+
+    if(k >= compression / 4.0)
+    {
+        return 1.0;
+    }
+
+    return (sin(k * 2.0 * M_PI / compression) + 1.0) / 2.0;
+}
+
+static void Compress(QuantileSketch * sketch)
+{
+    Centroid * centroids = sketch->centroids;
+    double total = 0;
+    double sofar = 0;
+    double limit = 0;
+    double mean = 0;
+    uint64_t weight = 0;
+    size_t out = 0;
+    size_t i = 0;
+
+    if(sketch->used == sketch->merged)
+    {
+        return;
+    }
+
+    qsort(centroids, sketch->used, sizeof(*centroids), CompareCentroids);
+
+    for(i = 0; i < sketch->used; i++)
+    {
+        total += centroids[i].weight;
+    }
+
+    /* merge in place, out never passes i */
+    mean = centroids[0].mean;
+    weight = centroids[0].weight;
+    limit = total * Limit(sketch->compression, 0);
+
+    for(i = 1; i < sketch->used; i++)
+    {
+        uint64_t proposed = weight + centroids[i].weight;
+
+        if((sofar + proposed <= limit && proposed <= UINT32_MAX) || out + 1 == sketch->capacity)
+        {
+            mean += (centroids[i].mean - mean) * centroids[i].weight / proposed;
+            weight = proposed;
+        }
+        else
+        {
+            centroids[out].mean = (float)mean;
+            centroids[out].weight = (uint32_t)weight;
+            out++;
+
+            sofar += weight;
+            limit = total * Limit(sketch->compression, sofar / total);
+            mean = centroids[i].mean;
+            weight = centroids[i].weight;
+        }
+    }
+
+    centroids[out].mean = (float)mean;
+    centroids[out].weight = (uint32_t)weight;
+    out++;
+
+    sketch->merged = out;
+    sketch->used = out;
+}
+
+static void Append(QuantileSketch * sketch, float mean, uint32_t weight)
+{
+    if(sketch->used == sketch->size)
+    {
+        Compress(sketch);
+    }
+
+    sketch->centroids[sketch->used].mean = mean;
+    sketch->centroids[sketch->used].weight = weight;
+    sketch->used++;
+}
+
+static void Put32(uint8_t * buffer, uint32_t value)
+{
+    buffer[0] = (uint8_t)value;
+    buffer[1] = (uint8_t)(value >> 8);
+    buffer[2] = (uint8_t)(value >> 16);
+    buffer[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t Get32(const uint8_t * buffer)
+{
+    return (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) | ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+static void PutFloat(uint8_t * buffer, float value)
+{
+    uint32_t bits = 0;
+
+    memcpy(&bits, &value, sizeof(bits));
+    Put32(buffer, bits);
+}
+
+static float GetFloat(const uint8_t * buffer)
+{
+    uint32_t bits = Get32(buffer);
+    float value = 0;
+
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+QuantileSketch * QuantileSketch_New(unsigned int compression)
+{
+    QuantileSketch * sketch = NULL;
+    size_t size = 0;
+
+    if(compression == 0)
+    {
+        compression = QUANTILE_DEFAULT_COMPRESSION;
+    }
+    if(compression < QUANTILE_MIN_COMPRESSION || compression > QUANTILE_MAX_COMPRESSION)
+    {
+        return NULL;
+    }
+
+    /* pairs of neighbours span more than one unit of k, k spans compression / 2 */
+    size = (compression + 2) + 2 * compression;
+
+    sketch = calloc(1, sizeof(*sketch) + size * sizeof(Centroid));
+    if(sketch == NULL)
+    {
+        return NULL;
+    }
+
+    sketch->compression = compression;
+    sketch->capacity = compression + 2;
+    sketch->size = size;
+    QuantileSketch_Reset(sketch);
+
+    return sketch;
+}
+
+void QuantileSketch_Add(QuantileSketch * sketch, float value)
+{
+    if(sketch == NULL || isnan(value))
+    {
+        return;
+    }
+
+    Append(sketch, value, 1);
+    sketch->count++;
+    sketch->min = (value < sketch->min) ? value : sketch->min;
+    sketch->max = (value > sketch->max) ? value : sketch->max;
+}
+
+float QuantileSketch_Quantile(QuantileSketch * sketch, double q)
+{
+    const Centroid * centroids = NULL;
+    double total = 0;
+    double index = 0;
+    double sofar = 0;
+    double value = 0;
+    size_t last = 0;
+    size_t i = 0;
+
+    if(sketch == NULL || sketch->count == 0 || isnan(q))
+    {
+        return NAN;
+    }
+    if(q <= 0)
+    {
+        return sketch->min;
+    }
+    if(q >= 1)
+    {
+        return sketch->max;
+    }
+
+    Compress(sketch);
+    centroids = sketch->centroids;
+    last = sketch->merged - 1;
+
+    for(i = 0; i < sketch->merged; i++)
+    {
+        total += centroids[i].weight;
+    }
+    index = q * total;
+
+    if(sketch->merged == 1)
+    {
+        return (float)(sketch->min + (sketch->max - sketch->min) * q);
+    }
+
+    /* the ends interpolate to the exact min and max, a single value is itself */
+    sofar = centroids[0].weight / 2.0;
+    if(index < sofar)
+    {
+        if(centroids[0].weight == 1)
+        {
+            return sketch->min;
+        }
+        return (float)(sketch->min + (centroids[0].mean - sketch->min) * index / sofar);
+    }
+
+    if(index > total - centroids[last].weight / 2.0)
+    {
+        double half = centroids[last].weight / 2.0;
+
+        if(centroids[last].weight == 1)
+        {
+            return sketch->max;
+        }
+        return (float)(sketch->max - (sketch->max - centroids[last].mean) * (total - index) / half);
+    }
+
+    /* otherwise between the centres of two neighbours */
+    value = centroids[last].mean;
+    for(i = 0; i < last; i++)
+    {
+        double step = (centroids[i].weight + centroids[i + 1].weight) / 2.0;
+
+        if(sofar + step > index)
+        {
+            value = centroids[i].mean + (centroids[i + 1].mean - centroids[i].mean) * (index - sofar) / step;
+            break;
+        }
+        sofar += step;
+    }
+
+    value = (value < sketch->min) ? sketch->min : value;
+    value = (value > sketch->max) ? sketch->max : value;
+
+    return (float)value;
+}
+
+int QuantileSketch_Merge(QuantileSketch * sketch, const QuantileSketch * from)
+{
+    size_t i = 0;
+
+    if(sketch == NULL || from == NULL || sketch == from)
+    {
+        return -EINVAL;
+    }
+
+    for(i = 0; i < from->used; i++)
+    {
+        Append(sketch, from->centroids[i].mean, from->centroids[i].weight);
+    }
+
+    if(from->count != 0)
+    {
+        sketch->count += from->count;
+        sketch->min = (from->min < sketch->min) ? from->min : sketch->min;
+        sketch->max = (from->max > sketch->max) ? from->max : sketch->max;
+    }
+
+    return 0;
+}
+
+int QuantileSketch_Serialize(QuantileSketch * sketch, uint8_t * buffer, size_t size)
+{
+    size_t i = 0;
+
+    if(sketch == NULL || buffer == NULL)
+    {
+        return -EINVAL;
+    }
+
+    Compress(sketch);
+    if(size < QUANTILE_HEADER_SIZE + 8 * sketch->merged)
+    {
+        return -ENOSPC;
+    }
+
+    buffer[0] = QUANTILE_MAGIC_0;
+    buffer[1] = QUANTILE_MAGIC_1;
+    buffer[2] = QUANTILE_VERSION;
+    buffer[3] = 0;
+    Put32(&buffer[4], (uint32_t)sketch->compression | ((uint32_t)sketch->merged << 16));
+    Put32(&buffer[8], (uint32_t)sketch->count);
+    Put32(&buffer[12], (uint32_t)(sketch->count >> 32));
+    PutFloat(&buffer[16], sketch->min);
+    PutFloat(&buffer[20], sketch->max);
+
+    for(i = 0; i < sketch->merged; i++)
+    {
+        PutFloat(&buffer[QUANTILE_HEADER_SIZE + 8 * i], sketch->centroids[i].mean);
+        Put32(&buffer[QUANTILE_HEADER_SIZE + 8 * i + 4], sketch->centroids[i].weight);
+    }
+
+    return (int)(QUANTILE_HEADER_SIZE + 8 * sketch->merged);
+}
+
+int QuantileSketch_Deserialize(QuantileSketch * sketch, const uint8_t * buffer, size_t size)
+{
+    uint64_t count = 0;
+    uint64_t total = 0;
+    size_t merged = 0;
+    size_t i = 0;
+
+    if(sketch == NULL || buffer == NULL || size < QUANTILE_HEADER_SIZE)
+    {
+        return -EINVAL;
+    }
+    if(buffer[0] != QUANTILE_MAGIC_0 || buffer[1] != QUANTILE_MAGIC_1 || buffer[2] != QUANTILE_VERSION)
+    {
+        return -EINVAL;
+    }
+
+    merged = Get32(&buffer[4]) >> 16;
+    count = Get32(&buffer[8]) | ((uint64_t)Get32(&buffer[12]) << 32);
+    if(merged > sketch->capacity || size < QUANTILE_HEADER_SIZE + 8 * merged || (merged == 0) != (count == 0))
+    {
+        return -EINVAL;
+    }
+
+    /* check everything before touching the sketch */
+    for(i = 0; i < merged; i++)
+    {
+        float mean = GetFloat(&buffer[QUANTILE_HEADER_SIZE + 8 * i]);
+        uint32_t weight = Get32(&buffer[QUANTILE_HEADER_SIZE + 8 * i + 4]);
+
+        if(isnan(mean) || weight == 0 || (i > 0 && mean < GetFloat(&buffer[QUANTILE_HEADER_SIZE + 8 * (i - 1)])))
+        {
+            return -EINVAL;
+        }
+        total += weight;
+    }
+    if(total != count)
+    {
+        return -EINVAL;
+    }
+
+    QuantileSketch_Reset(sketch);
+    for(i = 0; i < merged; i++)
+    {
+        sketch->centroids[i].mean = GetFloat(&buffer[QUANTILE_HEADER_SIZE + 8 * i]);
+        sketch->centroids[i].weight = Get32(&buffer[QUANTILE_HEADER_SIZE + 8 * i + 4]);
+    }
+    sketch->merged = merged;
+    sketch->used = merged;
+    sketch->count = count;
+    if(count != 0)
+    {
+        sketch->min = GetFloat(&buffer[16]);
+        sketch->max = GetFloat(&buffer[20]);
+    }
+
+    return 0;
+}
+
+uint64_t QuantileSketch_Count(QuantileSketch * sketch)
+{
+    return (sketch != NULL) ? sketch->count : 0;
+}
+
+float QuantileSketch_Min(QuantileSketch * sketch)
+{
+    return (sketch != NULL && sketch->count != 0) ? sketch->min : NAN;
+}
+
+float QuantileSketch_Max(QuantileSketch * sketch)
+{
+    return (sketch != NULL && sketch->count != 0) ? sketch->max : NAN;
+}
+
+void QuantileSketch_Reset(QuantileSketch * sketch)
+{
+    if(sketch != NULL)
+    {
+        sketch->merged = 0;
+        sketch->used = 0;
+        sketch->count = 0;
+        sketch->min = INFINITY;
+        sketch->max = -INFINITY;
+    }
+}
+
+void QuantileSketch_Free(QuantileSketch * sketch)
+{
+    free(sketch);
+}
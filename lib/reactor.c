@@ -0,0 +1,891 @@
+#include "reactor.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "frameparser.h"
+#include "registerclient.h"
+#include "serialstats.h"
+#include "uring.h"
+
+#define REACTOR_MAX_EVENTS 64
+
+/* io_uring backend read chunks: a pool for multishot reads, else one per device */
+#define URING_CHUNK_SIZE    256
+#define URING_SQ_ENTRIES    256
+#define URING_NO_CHUNK      UINT32_MAX
+
+/* user_data of the non device requests, device requests carry the pointer */
+#define URING_TAG_CANCEL    0
+#define URING_TAG_EPOLL     1
+
+typedef enum
+{
+    URING_IDLE = 0,
+    URING_READ,
+    URING_POLL,                 /* waiting for POLLIN after a read saw -EAGAIN */
+} UringState;
+
+typedef struct _ReactorDevice ReactorDevice;
+
+struct _ReactorDevice
+{
+    Reactor * reactor;
+    Serial * serial;
+    FrameParser * parser;           /* points into parserStorage */
+    FrameParserStorage parserStorage;
+    ReactorCallback callback;
+    void * context;
+    RegisterClient * client;        /* optional, gets the non AutoReport frames */
+    ReactorDevice * next;           /* removed while dispatching, or draining */
+    uint32_t chunk;                 /* io_uring read buffer */
+    uint8_t inflight;               /* UringState of the outstanding request */
+    uint8_t pollNext;               /* arm a poll rather than a read */
+};
+
+struct _Reactor
+{
+    int epollfd;
+    int wakefd;
+    volatile int stop;
+    int dispatching;
+    ReactorDevice ** devices;
+    size_t count;
+    size_t capacity;
+    ReactorDevice * removed;
+    size_t clients;                 /* devices with a RegisterClient */
+
+    ReactorBackend backend;
+    Uring ring;                     /* the rest is REACTOR_BACKEND_URING only */
+    uint8_t * chunks;               /* REACTOR_URING_DEVICES * URING_CHUNK_SIZE */
+    uint32_t * freeChunks;
+    size_t freeCount;
+    int multishot;                  /* chunks are a shared pool for multishot reads */
+    int fixed;                      /* else one chunk per device, READ_FIXED when registered */
+    int epollMultishot;             /* cleared when the kernel refuses it */
+    int epollReady;                 /* harvest epollfd on the next loop */
+    int started;                    /* reads armed, the running thread owns the ring */
+    ReactorDevice * draining;       /* removed, request still in flight */
+};
+
+/* epollfd turns readable for wakeups and write readiness */
+static int ArmEpoll(Reactor * reactor)
+{
+    return Uring_Poll(&reactor->ring, reactor->epollfd, POLLIN, reactor->epollMultishot, URING_TAG_EPOLL);
+}
+
+static int StartUring(Reactor * reactor)
+{
+    size_t i = 0;
+    int Result = Uring_Init(&reactor->ring, URING_SQ_ENTRIES, 2 * REACTOR_URING_DEVICES);
+
+    if(Result != 0)
+    {
+        return Result;
+    }
+
+    reactor->chunks = calloc(REACTOR_URING_DEVICES, URING_CHUNK_SIZE);
+    reactor->freeChunks = calloc(REACTOR_URING_DEVICES, sizeof(*reactor->freeChunks));
+
+    if(reactor->chunks == NULL || reactor->freeChunks == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    for(i = 0; i < REACTOR_URING_DEVICES; i++)
+    {
+        reactor->freeChunks[i] = REACTOR_URING_DEVICES - 1 - i;
+    }
+
+    reactor->freeCount = REACTOR_URING_DEVICES;
+
+    /* pinning can fail under a small RLIMIT_MEMLOCK, plain reads still work */
+    reactor->multishot = (Uring_SetupMultishot(&reactor->ring, reactor->chunks, REACTOR_URING_DEVICES, URING_CHUNK_SIZE) == 0);
+    reactor->fixed = !reactor->multishot
+                     && (Uring_RegisterBuffer(&reactor->ring, reactor->chunks, REACTOR_URING_DEVICES * URING_CHUNK_SIZE) == 0);
+    reactor->epollMultishot = 1;
+
+    return ArmEpoll(reactor);
+}
+
+Reactor * Reactor_NewWithBackend(ReactorBackend backend)
+{
+    Reactor * reactor = calloc(1, sizeof(*reactor));
+    int Result = 0;
+
+    if(reactor != NULL)
+    {
+        struct epoll_event event;
+
+        reactor->ring.fd = -1;
+        reactor->backend = REACTOR_BACKEND_EPOLL;
+        reactor->epollfd = epoll_create1(EPOLL_CLOEXEC);
+        reactor->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+
+        if(reactor->epollfd < 0 || reactor->wakefd < 0
+           || epoll_ctl(reactor->epollfd, EPOLL_CTL_ADD, reactor->wakefd, &event) != 0)
+        {
+            Result = -errno;
+        }
+        else if(backend != REACTOR_BACKEND_EPOLL)
+        {
+            Result = StartUring(reactor);
+
+            if(Result == 0)
+            {
+                reactor->backend = REACTOR_BACKEND_URING;
+            }
+            else if(backend == REACTOR_BACKEND_AUTO)
+            {
+                /* plain epoll, none of the io_uring state stays */
+                Uring_Deinit(&reactor->ring);
+                free(reactor->chunks);
+                free(reactor->freeChunks);
+                reactor->chunks = NULL;
+                reactor->freeChunks = NULL;
+                reactor->freeCount = 0;
+                reactor->multishot = 0;
+                reactor->fixed = 0;
+                Result = 0;
+            }
+        }
+
+        if(Result != 0)
+        {
+            Reactor_Free(reactor);
+            reactor = NULL;
+            errno = -Result;
+        }
+    }
+
+    return reactor;
+}
+
+Reactor * Reactor_New(void)
+{
+    return Reactor_NewWithBackend(REACTOR_BACKEND_EPOLL);
+}
+
+ReactorBackend Reactor_GetBackend(Reactor * reactor)
+{
+    return (reactor != NULL) ? reactor->backend : REACTOR_BACKEND_EPOLL;
+}
+
+/* With io_uring reading, epoll only watches for write readiness */
+static int WatchDevice(Reactor * reactor, ReactorDevice * device, int op, int writable)
+{
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof(event));
+    event.events = (reactor->backend == REACTOR_BACKEND_URING ? 0 : EPOLLIN) | (writable ? EPOLLOUT : 0);
+    event.data.ptr = device;
+
+    return (epoll_ctl(reactor->epollfd, op, Serial_GetFD(device->serial), &event) != 0) ? -errno : 0;
+}
+
+static int ArmRead(Reactor * reactor, ReactorDevice * device)
+{
+    int fd = Serial_GetFD(device->serial);
+    uint64_t tag = (uint64_t)(uintptr_t)device;
+    int Result = 0;
+
+    if(device->pollNext)
+    {
+        Result = Uring_Poll(&reactor->ring, fd, POLLIN, 0, tag);
+        device->inflight = (Result == 0) ? URING_POLL : URING_IDLE;
+    }
+    else if(reactor->multishot)
+    {
+        Result = Uring_ReadMultishot(&reactor->ring, fd, tag);
+        device->inflight = (Result == 0) ? URING_READ : URING_IDLE;
+    }
+    else
+    {
+        Result = Uring_Read(&reactor->ring, fd, &reactor->chunks[(size_t)device->chunk * URING_CHUNK_SIZE],
+                            URING_CHUNK_SIZE, reactor->fixed, tag);
+        device->inflight = (Result == 0) ? URING_READ : URING_IDLE;
+    }
+
+    return Result;
+}
+
+/* Serial_Queue() on an empty queue, possibly from another thread */
+static void DeviceWritable(void * context, Serial * serial)
+{
+    ReactorDevice * device = context;
+
+    (void)serial;
+
+    WatchDevice(device->reactor, device, EPOLL_CTL_MOD, 1);
+}
+
+static void FreeDevice(ReactorDevice * device)
+{
+    Reactor * reactor = device->reactor;
+
+    if(device->chunk != URING_NO_CHUNK)
+    {
+        reactor->freeChunks[reactor->freeCount++] = device->chunk;
+    }
+
+    free(device);
+}
+
+int Reactor_Add(Reactor * reactor, Serial * serial, ReactorCallback callback, void * context)
+{
+    return Reactor_Attach(reactor, serial, callback, context, NULL);
+}
+
+int Reactor_Attach(Reactor * reactor, Serial * serial, ReactorCallback callback, void * context, const FrameParserStorage * parser)
+{
+    ReactorDevice * device = NULL;
+    int Result = 0;
+
+    if(reactor == NULL || serial == NULL || callback == NULL)
+    {
+        return -EINVAL;
+    }
+
+    if(reactor->count == reactor->capacity)
+    {
+        size_t capacity = (reactor->capacity > 0) ? reactor->capacity * 2 : 16;
+        ReactorDevice ** devices = realloc(reactor->devices, capacity * sizeof(*devices));
+
+        if(devices == NULL)
+        {
+            return -ENOMEM;
+        }
+
+        reactor->devices = devices;
+        reactor->capacity = capacity;
+    }
+
+    device = calloc(1, sizeof(*device));
+
+    if(device == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    device->reactor = reactor;
+    device->serial = serial;
+    device->callback = callback;
+    device->context = context;
+    device->parser = (FrameParser *)&device->parserStorage;
+    device->chunk = URING_NO_CHUNK;
+
+    if(parser != NULL)
+    {
+        memcpy(&device->parserStorage, parser, sizeof(device->parserStorage));
+    }
+    else
+    {
+        FrameParser_Init(device->parser, AUTOREPORT_HEADER, AUTOREPORT_LENGTH);
+    }
+    FrameParser_SetSerial(device->parser, serial);
+
+    if(reactor->backend == REACTOR_BACKEND_URING && !reactor->multishot)
+    {
+        if(reactor->freeCount == 0)
+        {
+            FreeDevice(device);
+            return -ENOSPC;
+        }
+
+        device->chunk = reactor->freeChunks[--reactor->freeCount];
+    }
+
+    Result = Serial_SetNonBlocking(serial, 1);
+
+    if(Result == 0)
+    {
+        Result = WatchDevice(reactor, device, EPOLL_CTL_ADD, 0);
+    }
+
+    if(Result == 0 && reactor->backend == REACTOR_BACKEND_URING && reactor->started)
+    {
+        Result = ArmRead(reactor, device);
+
+        if(Result != 0)
+        {
+            epoll_ctl(reactor->epollfd, EPOLL_CTL_DEL, Serial_GetFD(serial), NULL);
+        }
+    }
+
+    if(Result != 0)
+    {
+        FreeDevice(device);
+        return Result;
+    }
+
+    /* from here on queued writes are flushed when the fd is writable */
+    Serial_SetWriteNotify(serial, DeviceWritable, device);
+
+    if(Serial_Pending(serial) > 0)
+    {
+        WatchDevice(reactor, device, EPOLL_CTL_MOD, 1);
+    }
+
+    reactor->devices[reactor->count++] = device;
+
+    return 0;
+}
+
+static void RemoveDevice(Reactor * reactor, size_t index)
+{
+    ReactorDevice * device = reactor->devices[index];
+
+    reactor->clients -= (device->client != NULL);
+    Serial_SetWriteNotify(device->serial, NULL, NULL);
+    epoll_ctl(reactor->epollfd, EPOLL_CTL_DEL, Serial_GetFD(device->serial), NULL);
+
+    reactor->devices[index] = reactor->devices[--reactor->count];
+
+    if(device->inflight != URING_IDLE)
+    {
+        /* the kernel may still write to its chunk, free it on completion */
+        Uring_Cancel(&reactor->ring, (uint64_t)(uintptr_t)device, URING_TAG_CANCEL);
+
+        device->serial = NULL;
+        device->next = reactor->draining;
+        reactor->draining = device;
+    }
+    else if(reactor->dispatching)
+    {
+        /* events for it may still be queued in this batch */
+        device->serial = NULL;
+        device->next = reactor->removed;
+        reactor->removed = device;
+    }
+    else
+    {
+        FreeDevice(device);
+    }
+}
+
+int Reactor_Remove(Reactor * reactor, Serial * serial)
+{
+    return Reactor_Detach(reactor, serial, NULL);
+}
+
+int Reactor_Detach(Reactor * reactor, Serial * serial, FrameParserStorage * parser)
+{
+    size_t i = 0;
+
+    if(reactor == NULL || serial == NULL)
+    {
+        return -EINVAL;
+    }
+
+    for(i = 0; i < reactor->count; i++)
+    {
+        if(reactor->devices[i]->serial == serial)
+        {
+            if(parser != NULL)
+            {
+                memcpy(parser, &reactor->devices[i]->parserStorage, sizeof(*parser));
+            }
+
+            RemoveDevice(reactor, i);
+            return 0;
+        }
+    }
+
+    return -ENOENT;
+}
+
+int Reactor_SetRegisterClient(Reactor * reactor, Serial * serial, RegisterClient * client)
+{
+    size_t i = 0;
+
+    if(reactor == NULL || serial == NULL)
+    {
+        return -EINVAL;
+    }
+
+    for(i = 0; i < reactor->count; i++)
+    {
+        ReactorDevice * device = reactor->devices[i];
+
+        if(device->serial == serial)
+        {
+            reactor->clients += (client != NULL) - (device->client != NULL);
+            device->client = client;
+
+            if(client != NULL)
+            {
+                RegisterClient_SetupParser(device->parser);
+            }
+            else
+            {
+                /* no one left to take replies */
+                FrameParser_ExpectTokens(device->parser, 0);
+            }
+
+            return 0;
+        }
+    }
+
+    return -ENOENT;
+}
+
+size_t Reactor_Count(Reactor * reactor)
+{
+    return (reactor != NULL) ? reactor->count : 0;
+}
+
+static int DispatchFrames(ReactorDevice * device)
+{
+    uint8_t buffer[FRAME_MAX_LENGTH];
+    uint8_t header = 0;
+    int frames = 0;
+    int Result = 0;
+
+    while(device->serial != NULL
+          && (Result = (device->client != NULL)
+                       ? RegisterClient_NextFrame(device->client, device->parser, &header, buffer)
+                       : FrameParser_Next(device->parser, &header, buffer)) >= 0)
+    {
+        if(header == AUTOREPORT_HEADER && Result == AUTOREPORT_PAYLOAD_SIZE)
+        {
+            AutoReportValues values;
+
+            ConvertAutoReport((const AutoReportMessage *)buffer, &values);
+            device->callback(device->context, device->serial, (const AutoReportMessage *)buffer, &values);
+            frames++;
+        }
+        else if(device->client != NULL)
+        {
+            RegisterClient_HandleFrame(device->client, header, buffer, Result);
+        }
+    }
+
+    return frames;
+}
+
+/* Remove the device and tell its callback, outside a batch the device is freed first */
+static void FailDevice(Reactor * reactor, ReactorDevice * device)
+{
+    ReactorCallback callback = device->callback;
+    void * context = device->context;
+    Serial * serial = device->serial;
+    size_t i = 0;
+
+    for(i = 0; i < reactor->count; i++)
+    {
+        if(reactor->devices[i] == device)
+        {
+            RemoveDevice(reactor, i);
+            break;
+        }
+    }
+
+    callback(context, serial, NULL, NULL);
+}
+
+static int DispatchDevice(Reactor * reactor, ReactorDevice * device, uint32_t events)
+{
+    int frames = 0;
+    int failed = 0;
+    int Result = 0;
+
+    if(events & EPOLLOUT)
+    {
+        Result = Serial_Flush(device->serial);
+
+        if(Result == 0)
+        {
+            WatchDevice(reactor, device, EPOLL_CTL_MOD, 0);
+
+            /* queued by another thread after the flush, keep watching */
+            if(Serial_Pending(device->serial) > 0)
+            {
+                WatchDevice(reactor, device, EPOLL_CTL_MOD, 1);
+            }
+        }
+
+        failed = (Result < 0);
+    }
+
+    if(events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+    {
+        Result = FrameParser_Fill(device->parser, Serial_GetFD(device->serial));
+        failed = failed || (events & (EPOLLERR | EPOLLHUP))
+                 || (Result < 0 && Result != -EAGAIN && Result != -EINTR);
+    }
+
+    frames = DispatchFrames(device);
+
+    if(device->serial != NULL && failed)
+    {
+        FailDevice(reactor, device);
+    }
+
+    return frames;
+}
+
+/*
+ * A read, or the poll standing in for one, completed. more is set while a
+ * multishot read stays armed, buffer is the pool chunk it filled or -1.
+ */
+static int CompleteRead(Reactor * reactor, ReactorDevice * device, int res, int more, int buffer)
+{
+    const uint8_t * chunk = NULL;
+    UringState state = device->inflight;
+    size_t done = 0;
+    int frames = 0;
+    int failed = 0;
+
+    if(buffer >= 0)
+    {
+        chunk = Uring_Buffer(&reactor->ring, buffer);
+    }
+    else if(device->chunk != URING_NO_CHUNK)
+    {
+        chunk = &reactor->chunks[(size_t)device->chunk * URING_CHUNK_SIZE];
+    }
+
+    if(!more)
+    {
+        device->inflight = URING_IDLE;
+    }
+
+    if(device->serial == NULL)
+    {
+        ReactorDevice ** link = &reactor->draining;
+
+        if(buffer >= 0)
+        {
+            Uring_ReturnBuffer(&reactor->ring, buffer);
+        }
+
+        if(more)
+        {
+            return 0;
+        }
+
+        while(*link != device)
+        {
+            link = &(*link)->next;
+        }
+
+        *link = device->next;
+        FreeDevice(device);
+
+        return 0;
+    }
+
+    if(state == URING_READ)
+    {
+        /* one read call, its bytes are counted as Push() takes them */
+        SerialStats_Read(device->serial, (res < 0) ? res : 0, 0);
+    }
+
+    if(state == URING_READ && res > 0 && chunk != NULL)
+    {
+        while(done < (size_t)res && device->serial != NULL)
+        {
+            size_t pushed = FrameParser_Push(device->parser, chunk + done, res - done);
+
+            frames += DispatchFrames(device);
+            done += pushed;
+
+            if(pushed == 0 && device->serial != NULL)
+            {
+                /*
+                 * No frame in a full ring. The chunk is read already and
+                 * cannot wait in the kernel as with epoll, so drop the
+                 * oldest bytes as noise (counted) and keep feeding.
+                 */
+                FrameParser_Discard(device->parser, res - done);
+            }
+        }
+    }
+    else if(state == URING_READ && res == -EAGAIN)
+    {
+        /* the file does not wait for data by itself */
+        device->pollNext = 1;
+    }
+    else if(state == URING_READ && res == -ENOBUFS)
+    {
+        /* the pool ran dry and ended the multishot read, chunks are back by now */
+    }
+    else if(state == URING_POLL && res >= 0)
+    {
+        device->pollNext = 0;
+        failed = (res & (POLLERR | POLLHUP)) && !(res & POLLIN);
+    }
+    else
+    {
+        /* 0 is end of file: a non-blocking tty without data says -EAGAIN */
+        failed = (res == 0 && state == URING_READ) || (res < 0 && res != -EINTR);
+    }
+
+    if(buffer >= 0)
+    {
+        Uring_ReturnBuffer(&reactor->ring, buffer);
+    }
+
+    if(device->serial != NULL && !failed && !more && ArmRead(reactor, device) != 0)
+    {
+        failed = 1;
+    }
+
+    if(device->serial != NULL && failed)
+    {
+        FailDevice(reactor, device);
+    }
+
+    return frames;
+}
+
+static int DispatchEvents(Reactor * reactor, const struct epoll_event * events, int count)
+{
+    int frames = 0;
+    int i = 0;
+
+    for(i = 0; i < count; i++)
+    {
+        ReactorDevice * device = events[i].data.ptr;
+
+        if(device == NULL)
+        {
+            uint64_t value = 0;
+
+            if(read(reactor->wakefd, &value, sizeof(value)) < 0)
+            {
+                /* already drained */
+            }
+        }
+        else if(device->serial != NULL)
+        {
+            /* with io_uring, hangups and errors come back on the reads */
+            uint32_t mask = (reactor->backend == REACTOR_BACKEND_URING) ? EPOLLOUT : UINT32_MAX;
+
+            frames += DispatchDevice(reactor, device, events[i].events & mask);
+        }
+    }
+
+    return frames;
+}
+
+static void FinishDispatch(Reactor * reactor)
+{
+    size_t i = 0;
+
+    for(i = 0; reactor->clients > 0 && i < reactor->count; i++)
+    {
+        RegisterClient_Expire(reactor->devices[i]->client);
+    }
+
+    reactor->dispatching = 0;
+
+    while(reactor->removed != NULL)
+    {
+        ReactorDevice * device = reactor->removed;
+
+        reactor->removed = device->next;
+        FreeDevice(device);
+    }
+}
+
+static int RunUring(Reactor * reactor, int timeoutMs)
+{
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    uint64_t tag = 0;
+    int res = 0;
+    int more = 0;
+    int buffer = -1;
+    int frames = 0;
+    int Result = reactor->started ? 0 : Uring_Enable(&reactor->ring);
+    size_t i = 0;
+
+    if(Result != 0)
+    {
+        return Result;
+    }
+
+    /* devices added before the first run are armed from this thread */
+    for(i = reactor->count; !reactor->started && i > 0; i--)
+    {
+        if(ArmRead(reactor, reactor->devices[i - 1]) != 0)
+        {
+            FailDevice(reactor, reactor->devices[i - 1]);
+        }
+    }
+
+    reactor->started = 1;
+    Result = Uring_Wait(&reactor->ring, reactor->epollReady ? 0 : timeoutMs);
+
+    if(Result < 0 && Result != -ETIME && Result != -EINTR)
+    {
+        return Result;
+    }
+
+    reactor->dispatching = 1;
+
+    while(Uring_Reap(&reactor->ring, &tag, &res, &more, &buffer))
+    {
+        if(tag == URING_TAG_EPOLL)
+        {
+            reactor->epollReady = 1;
+
+            if(!more)
+            {
+                /* multishot ended, or is not supported: go one shot */
+                reactor->epollMultishot = reactor->epollMultishot && (res >= 0);
+                ArmEpoll(reactor);
+            }
+        }
+        else if(tag != URING_TAG_CANCEL)
+        {
+            frames += CompleteRead(reactor, (ReactorDevice *)(uintptr_t)tag, res, more, buffer);
+        }
+    }
+
+    /* the poll only fires on new wakeups, drain until epoll runs dry */
+    if(reactor->epollReady)
+    {
+        int count = epoll_wait(reactor->epollfd, events, REACTOR_MAX_EVENTS, 0);
+
+        reactor->epollReady = (count > 0);
+        frames += DispatchEvents(reactor, events, (count > 0) ? count : 0);
+    }
+
+    FinishDispatch(reactor);
+
+    return frames;
+}
+
+int Reactor_RunOnce(Reactor * reactor, int timeoutMs)
+{
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    int frames = 0;
+    int count = 0;
+    int i = 0;
+
+    if(reactor == NULL)
+    {
+        return -EINVAL;
+    }
+
+    /* wake up for the earliest register request deadline */
+    for(i = 0; reactor->clients > 0 && i < (int)reactor->count; i++)
+    {
+        int next = RegisterClient_NextTimeout(reactor->devices[i]->client);
+
+        if(next >= 0 && (timeoutMs < 0 || next < timeoutMs))
+        {
+            timeoutMs = next;
+        }
+    }
+
+    if(reactor->backend == REACTOR_BACKEND_URING)
+    {
+        return RunUring(reactor, timeoutMs);
+    }
+
+    count = epoll_wait(reactor->epollfd, events, REACTOR_MAX_EVENTS, timeoutMs);
+
+    if(count < 0)
+    {
+        return (errno == EINTR) ? 0 : -errno;
+    }
+
+    reactor->dispatching = 1;
+    frames = DispatchEvents(reactor, events, count);
+    FinishDispatch(reactor);
+
+    return frames;
+}
+
+int Reactor_Run(Reactor * reactor)
+{
+    int Result = 0;
+
+    if(reactor == NULL)
+    {
+        return -EINVAL;
+    }
+
+    reactor->stop = 0;
+
+    while(!reactor->stop && Result >= 0)
+    {
+        Result = Reactor_RunOnce(reactor, -1);
+    }
+
+    return (Result < 0) ? Result : 0;
+}
+
+void Reactor_Wake(Reactor * reactor)
+{
+    if(reactor != NULL)
+    {
+        uint64_t value = 1;
+
+        if(write(reactor->wakefd, &value, sizeof(value)) < 0)
+        {
+            /* counter saturated, a wakeup is pending anyway */
+        }
+    }
+}
+
+void Reactor_Stop(Reactor * reactor)
+{
+    if(reactor != NULL)
+    {
+        reactor->stop = 1;
+        Reactor_Wake(reactor);
+    }
+}
+
+void Reactor_Free(Reactor * reactor)
+{
+    if(reactor != NULL)
+    {
+        while(reactor->count > 0)
+        {
+            RemoveDevice(reactor, reactor->count - 1);
+        }
+
+        /* closing the ring cancels the reads, their devices can go */
+        if(reactor->ring.fd >= 0)
+        {
+            Uring_Deinit(&reactor->ring);
+        }
+
+        while(reactor->draining != NULL)
+        {
+            ReactorDevice * device = reactor->draining;
+
+            reactor->draining = device->next;
+            FreeDevice(device);
+        }
+
+        if(reactor->wakefd >= 0)
+        {
+            close(reactor->wakefd);
+        }
+
+        if(reactor->epollfd >= 0)
+        {
+            close(reactor->epollfd);
+        }
+
+        free(reactor->chunks);
+        free(reactor->freeChunks);
+        free(reactor->devices);
+        free(reactor);
+    }
+}
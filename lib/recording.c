@@ -0,0 +1,358 @@
+#define _GNU_SOURCE
+#include "recording.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(RecordingHeader) == 64, "RecordingHeader layout changed");
+_Static_assert(sizeof(RecordingRecord) == 48, "RecordingRecord layout changed");
+
+struct _Recorder
+{
+    int fd;
+    size_t written;             /* complete records in the file */
+    size_t pending;             /* records in buffer */
+    RecordingRecord buffer[RECORDER_BUFFER_RECORDS];
+};
+
+struct _Recording
+{
+    void * map;
+    size_t size;
+    size_t count;
+};
+
+static uint64_t Now(clockid_t clock)
+{
+    struct timespec now;
+
+    clock_gettime(clock, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static int ValidHeader(const RecordingHeader * header)
+{
+    return memcmp(header->Magic, RECORDING_MAGIC, sizeof(header->Magic)) == 0
+           && header->Version == RECORDING_VERSION
+           && header->RecordSize == sizeof(RecordingRecord);
+}
+
+static int WriteAll(int fd, const void * data, size_t size)
+{
+    const uint8_t * pos = data;
+
+    while(size > 0)
+    {
+        ssize_t ret = write(fd, pos, size);
+
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -errno;
+        }
+
+        pos += ret;
+        size -= ret;
+    }
+
+    return 0;
+}
+
+/* Write a header to an empty file, or check the existing one and drop a torn tail */
+static int PrepareFile(Recorder * recorder)
+{
+    RecordingHeader header;
+    struct stat st;
+    off_t end = 0;
+
+    if(fstat(recorder->fd, &st) < 0)
+    {
+        return -errno;
+    }
+
+    if(st.st_size == 0)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.Magic, RECORDING_MAGIC, sizeof(header.Magic));
+        header.Version = RECORDING_VERSION;
+        header.RecordSize = sizeof(RecordingRecord);
+        header.CreatedRealtime = Now(CLOCK_REALTIME);
+        header.CreatedMonotonic = Now(CLOCK_MONOTONIC);
+
+        recorder->written = 0;
+
+        return WriteAll(recorder->fd, &header, sizeof(header));
+    }
+
+    if(st.st_size < (off_t)sizeof(header)
+       || pread(recorder->fd, &header, sizeof(header), 0) != sizeof(header)
+       || !ValidHeader(&header))
+    {
+        return -EINVAL;
+    }
+
+    recorder->written = (st.st_size - sizeof(header)) / sizeof(RecordingRecord);
+    end = sizeof(header) + recorder->written * sizeof(RecordingRecord);
+
+    if(end != st.st_size && ftruncate(recorder->fd, end) < 0)
+    {
+        return -errno;
+    }
+
+    return (lseek(recorder->fd, end, SEEK_SET) < 0) ? -errno : 0;
+}
+
+Recorder * Recorder_Open(const char * path)
+{
+    Recorder * recorder = NULL;
+    int Result = 0;
+
+    if(path == NULL)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    recorder = malloc(sizeof(*recorder));
+
+    if(recorder == NULL)
+    {
+        return NULL;
+    }
+
+    recorder->pending = 0;
+    recorder->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if(recorder->fd < 0)
+    {
+        free(recorder);
+        return NULL;
+    }
+
+    Result = PrepareFile(recorder);
+
+    if(Result < 0)
+    {
+        close(recorder->fd);
+        free(recorder);
+        errno = -Result;
+        return NULL;
+    }
+
+    return recorder;
+}
+
+int Recorder_Write(Recorder * recorder, uint64_t timestamp, uint32_t device, uint8_t header, const uint8_t * payload, uint8_t payloadLength)
+{
+    RecordingRecord * record = NULL;
+    int Result = 0;
+
+    if(recorder == NULL || (payload == NULL && payloadLength > 0))
+    {
+        return -EINVAL;
+    }
+
+    if(payloadLength + 2 > FRAME_RECORD_SIZE)
+    {
+        return -EMSGSIZE;
+    }
+
+    if(recorder->pending == RECORDER_BUFFER_RECORDS)
+    {
+        Result = Recorder_Flush(recorder);
+
+        if(Result < 0)
+        {
+            return Result;
+        }
+    }
+
+    record = &recorder->buffer[recorder->pending];
+    memset(record, 0, sizeof(*record));
+    record->Timestamp = timestamp;
+    record->Device = device;
+    record->Length = payloadLength + 2;
+    record->Frame[0] = header;
+    record->Frame[1] = payloadLength + 2;
+    memcpy(&record->Frame[2], payload, payloadLength);
+
+    recorder->pending++;
+
+    return 0;
+}
+
+int Recorder_WriteRecords(Recorder * recorder, const RecordingRecord * records, size_t count)
+{
+    int Result = 0;
+
+    if(recorder == NULL || (records == NULL && count > 0))
+    {
+        return -EINVAL;
+    }
+
+    Result = Recorder_Flush(recorder);
+
+    if(Result == 0)
+    {
+        Result = WriteAll(recorder->fd, records, count * sizeof(RecordingRecord));
+    }
+
+    if(Result == 0)
+    {
+        recorder->written += count;
+    }
+
+    return Result;
+}
+
+int Recorder_Flush(Recorder * recorder)
+{
+    int Result = 0;
+
+    if(recorder == NULL)
+    {
+        return -EINVAL;
+    }
+
+    if(recorder->pending == 0)
+    {
+        return 0;
+    }
+
+    Result = WriteAll(recorder->fd, recorder->buffer, recorder->pending * sizeof(RecordingRecord));
+
+    if(Result == 0)
+    {
+        recorder->written += recorder->pending;
+        recorder->pending = 0;
+    }
+
+    return Result;
+}
+
+size_t Recorder_Count(Recorder * recorder)
+{
+    return (recorder != NULL) ? recorder->written + recorder->pending : 0;
+}
+
+int Recorder_Close(Recorder * recorder)
+{
+    int Result = 0;
+
+    if(recorder == NULL)
+    {
+        return -EINVAL;
+    }
+
+    Result = Recorder_Flush(recorder);
+
+    close(recorder->fd);
+    free(recorder);
+
+    return Result;
+}
+
+Recording * Recording_Open(const char * path)
+{
+    Recording * recording = NULL;
+    struct stat st;
+    int fd = -1;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if(fd < 0)
+    {
+        return NULL;
+    }
+
+    if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(RecordingHeader))
+    {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    recording = malloc(sizeof(*recording));
+
+    if(recording == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    recording->size = st.st_size;
+    recording->map = mmap(NULL, recording->size, PROT_READ, MAP_SHARED, fd, 0);
+
+    /* the mapping keeps the file referenced */
+    close(fd);
+
+    if(recording->map == MAP_FAILED)
+    {
+        free(recording);
+        return NULL;
+    }
+
+    if(!ValidHeader(recording->map))
+    {
+        munmap(recording->map, recording->size);
+        free(recording);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /* replay is a front to back scan */
+    madvise(recording->map, recording->size, MADV_SEQUENTIAL);
+
+    recording->count = (recording->size - sizeof(RecordingHeader)) / sizeof(RecordingRecord);
+
+    return recording;
+}
+
+const RecordingHeader * Recording_Header(Recording * recording)
+{
+    return (recording != NULL) ? recording->map : NULL;
+}
+
+size_t Recording_Count(Recording * recording)
+{
+    return (recording != NULL) ? recording->count : 0;
+}
+
+const RecordingRecord * Recording_Records(Recording * recording)
+{
+    if(recording == NULL)
+    {
+        return NULL;
+    }
+
+    return (const RecordingRecord *)((const uint8_t *)recording->map + sizeof(RecordingHeader));
+}
+
+const RecordingRecord * Recording_At(Recording * recording, size_t index)
+{
+    if(recording == NULL || index >= recording->count)
+    {
+        return NULL;
+    }
+
+    return &Recording_Records(recording)[index];
+}
+
+void Recording_Close(Recording * recording)
+{
+    if(recording != NULL)
+    {
+        munmap(recording->map, recording->size);
+        free(recording);
+    }
+}
@@ -0,0 +1,495 @@
+#define _GNU_SOURCE
+#include "registerclient.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "78m6610.h"
+
+#define REGISTER_READ_BYTES 4       /* select lo hi read */
+#define REGISTER_WRITE_BYTES 7      /* select lo hi write b0 b1 b2 */
+
+typedef struct
+{
+    int write;
+    int done;                       /* timed out, kept to absorb its reply */
+    size_t count;
+    uint16_t addresses[REGISTER_BATCH_MAX];
+    uint64_t deadline;              /* CLOCK_MONOTONIC ns */
+    RegisterCallback callback;
+    void * context;
+} Request;
+
+struct _RegisterClient
+{
+    Serial * serial;
+    size_t head;                    /* free running, next free slot */
+    size_t tail;                    /* free running, oldest request */
+    Request requests[REGISTER_CLIENT_MAX_PENDING];
+};
+
+typedef struct
+{
+    int done;
+    int status;
+    uint32_t * values;
+} SyncResult;
+
+static uint64_t Now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+RegisterClient * RegisterClient_New(Serial * serial)
+{
+    RegisterClient * client = NULL;
+
+    if(serial == NULL)
+    {
+        return NULL;
+    }
+
+    client = calloc(1, sizeof(*client));
+
+    if(client != NULL)
+    {
+        client->serial = serial;
+    }
+
+    return client;
+}
+
+void RegisterClient_SetupParser(FrameParser * parser)
+{
+    /* header, length, at least one data byte, checksum */
+    FrameParser_AddHeader(parser, REGISTER_REPLY_DATA, 4, FRAME_MAX_LENGTH);
+    FrameParser_AddToken(parser, REGISTER_REPLY_ACK);
+    FrameParser_AddToken(parser, REGISTER_REPLY_NACK);
+    FrameParser_AddToken(parser, REGISTER_REPLY_UNSUPPORTED);
+    FrameParser_AddToken(parser, REGISTER_REPLY_CHECKSUM);
+    FrameParser_AddToken(parser, REGISTER_REPLY_OVERFLOW);
+}
+
+int RegisterClient_NextFrame(RegisterClient * client, FrameParser * parser, uint8_t * header, uint8_t * buffer)
+{
+    FrameParser_ExpectTokens(parser, client != NULL && client->head != client->tail);
+
+    return FrameParser_Next(parser, header, buffer);
+}
+
+/* Frame the commands, append the checksum and queue the packet */
+static int SendPacket(RegisterClient * client, uint8_t * packet, size_t length)
+{
+    packet[0] = REGISTER_PACKET_HEADER;
+    packet[1] = (uint8_t)(length + 1);
+
+    packet[length] = FrameCheckSum(packet, (uint8_t)length);
+
+    return Serial_Queue(client->serial, packet, length + 1);
+}
+
+static Request * NewRequest(RegisterClient * client, int write, uint32_t timeoutUs, RegisterCallback callback, void * context)
+{
+    Request * request = NULL;
+
+    if(client->head - client->tail == REGISTER_CLIENT_MAX_PENDING)
+    {
+        return NULL;
+    }
+
+    request = &client->requests[client->head % REGISTER_CLIENT_MAX_PENDING];
+    request->write = write;
+    request->done = 0;
+    request->deadline = Now() + (uint64_t)timeoutUs * 1000;
+    request->callback = callback;
+    request->context = context;
+
+    return request;
+}
+
+int RegisterClient_Read(RegisterClient * client, const uint16_t * addresses, size_t count, uint32_t timeoutUs, RegisterCallback callback, void * context)
+{
+    uint8_t packet[2 + REGISTER_BATCH_MAX * REGISTER_READ_BYTES + 1];
+    Request * request = NULL;
+    size_t length = 2;
+    size_t i = 0;
+    int Result = 0;
+
+    if(client == NULL || addresses == NULL || count == 0 || count > REGISTER_BATCH_MAX)
+    {
+        return -EINVAL;
+    }
+
+    request = NewRequest(client, 0, timeoutUs, callback, context);
+
+    if(request == NULL)
+    {
+        return -EBUSY;
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        request->addresses[i] = addresses[i];
+
+        packet[length++] = REGISTER_CMD_SELECT;
+        packet[length++] = addresses[i] & 0xFF;
+        packet[length++] = addresses[i] >> 8;
+        packet[length++] = REGISTER_CMD_READ;
+    }
+
+    request->count = count;
+
+    Result = SendPacket(client, packet, length);
+
+    if(Result == 0)
+    {
+        client->head++;
+    }
+
+    return Result;
+}
+
+int RegisterClient_Write(RegisterClient * client, uint16_t address, uint32_t value, uint32_t timeoutUs, RegisterCallback callback, void * context)
+{
+    uint8_t packet[2 + REGISTER_WRITE_BYTES + 1];
+    Request * request = NULL;
+    int Result = 0;
+
+    if(client == NULL)
+    {
+        return -EINVAL;
+    }
+
+    request = NewRequest(client, 1, timeoutUs, callback, context);
+
+    if(request == NULL)
+    {
+        return -EBUSY;
+    }
+
+    request->addresses[0] = address;
+    request->count = 1;
+
+    packet[2] = REGISTER_CMD_SELECT;
+    packet[3] = address & 0xFF;
+    packet[4] = address >> 8;
+    packet[5] = REGISTER_CMD_WRITE;
+    packet[6] = value & 0xFF;
+    packet[7] = (value >> 8) & 0xFF;
+    packet[8] = (value >> 16) & 0xFF;
+
+    Result = SendPacket(client, packet, 2 + REGISTER_WRITE_BYTES);
+
+    if(Result == 0)
+    {
+        client->head++;
+    }
+
+    return Result;
+}
+
+/* Retire the oldest request, values NULL unless it succeeded */
+static void Complete(RegisterClient * client, int status, const uint32_t * values)
+{
+    Request request = client->requests[client->tail % REGISTER_CLIENT_MAX_PENDING];
+
+    /* the callback may issue new requests */
+    client->tail++;
+
+    if(!request.done && request.callback != NULL)
+    {
+        request.callback(request.context, status, request.addresses, values, request.count);
+    }
+}
+
+static int NackStatus(uint8_t token)
+{
+    switch(token)
+    {
+    case REGISTER_REPLY_UNSUPPORTED:
+        return -ENOSYS;
+    case REGISTER_REPLY_CHECKSUM:
+        return -EBADMSG;
+    case REGISTER_REPLY_OVERFLOW:
+        return -EOVERFLOW;
+    default:
+        return -EIO;
+    }
+}
+
+int RegisterClient_HandleFrame(RegisterClient * client, uint8_t header, const uint8_t * payload, int length)
+{
+    Request * oldest = NULL;
+
+    if(client == NULL || length < 0)
+    {
+        return 0;
+    }
+
+    if(header != REGISTER_REPLY_DATA && header != REGISTER_REPLY_ACK
+       && header != REGISTER_REPLY_NACK && header != REGISTER_REPLY_UNSUPPORTED
+       && header != REGISTER_REPLY_CHECKSUM && header != REGISTER_REPLY_OVERFLOW)
+    {
+        return 0;
+    }
+
+    if(client->head == client->tail)
+    {
+        /* nothing asked, a late reply or a token value in line noise */
+        return 1;
+    }
+
+    oldest = &client->requests[client->tail % REGISTER_CLIENT_MAX_PENDING];
+
+    if(header == REGISTER_REPLY_DATA)
+    {
+        /* payload is the register data followed by the checksum */
+        if(!oldest->write && (size_t)length == oldest->count * 3 + 1)
+        {
+            uint32_t values[REGISTER_BATCH_MAX];
+            size_t i = 0;
+
+            for(i = 0; i < oldest->count; i++)
+            {
+                values[i] = payload[3 * i] | (payload[3 * i + 1] << 8) | ((uint32_t)payload[3 * i + 2] << 16);
+            }
+
+            Complete(client, 0, values);
+        }
+    }
+    else if(header == REGISTER_REPLY_ACK)
+    {
+        if(oldest->write)
+        {
+            Complete(client, 0, NULL);
+        }
+    }
+    else
+    {
+        Complete(client, NackStatus(header), NULL);
+    }
+
+    return 1;
+}
+
+int RegisterClient_Expire(RegisterClient * client)
+{
+    uint64_t now = Now();
+    int expired = 0;
+    size_t i = 0;
+
+    if(client == NULL)
+    {
+        return 0;
+    }
+
+    for(i = client->tail; i != client->head; i++)
+    {
+        Request * request = &client->requests[i % REGISTER_CLIENT_MAX_PENDING];
+
+        if(!request->done && request->deadline <= now)
+        {
+            request->done = 1;
+            expired++;
+
+            if(request->callback != NULL)
+            {
+                request->callback(request->context, -ETIMEDOUT, request->addresses, NULL, request->count);
+            }
+        }
+    }
+
+    /*
+     * A timed out request behind a pending one stays queued so its reply,
+     * if it comes, is not taken for the next request. Once it is the
+     * oldest nothing can be ahead of it anymore.
+     */
+    while(client->head != client->tail
+          && client->requests[client->tail % REGISTER_CLIENT_MAX_PENDING].done)
+    {
+        client->tail++;
+    }
+
+    return expired;
+}
+
+int RegisterClient_NextTimeout(RegisterClient * client)
+{
+    uint64_t deadline = UINT64_MAX;
+    uint64_t now = Now();
+    size_t i = 0;
+
+    if(client == NULL)
+    {
+        return -1;
+    }
+
+    for(i = client->tail; i != client->head; i++)
+    {
+        const Request * request = &client->requests[i % REGISTER_CLIENT_MAX_PENDING];
+
+        if(!request->done && request->deadline < deadline)
+        {
+            deadline = request->deadline;
+        }
+    }
+
+    if(deadline == UINT64_MAX)
+    {
+        return -1;
+    }
+
+    return (deadline > now) ? (int)((deadline - now + 999999) / 1000000) : 0;
+}
+
+size_t RegisterClient_Outstanding(RegisterClient * client)
+{
+    return (client != NULL) ? client->head - client->tail : 0;
+}
+
+int RegisterClient_Run(RegisterClient * client, FrameParser * parser, uint32_t timeoutUs, RegisterFrameCallback frameCallback, void * context)
+{
+    uint64_t deadline = Now() + (uint64_t)timeoutUs * 1000;
+    uint8_t buffer[FRAME_MAX_LENGTH];
+    struct timespec expired = { 0, 0 };
+    struct pollfd pfd;
+    uint8_t dummy = 0;
+    int Result = 0;
+
+    if(client == NULL || parser == NULL)
+    {
+        return -EINVAL;
+    }
+
+    /* puts the tty back to VMIN 0 if Serial_Read() left it otherwise */
+    Serial_ReadUntil(client->serial, &dummy, 0, &expired);
+
+    pfd.fd = Serial_GetFD(client->serial);
+
+    while(client->head != client->tail)
+    {
+        uint8_t header = 0;
+        uint64_t now = 0;
+        int wait = 0;
+
+        Result = Serial_Flush(client->serial);
+
+        if(Result < 0)
+        {
+            return Result;
+        }
+
+        pfd.events = POLLIN | ((Result > 0) ? POLLOUT : 0);
+
+        while(client->head != client->tail
+              && (Result = RegisterClient_NextFrame(client, parser, &header, buffer)) >= 0)
+        {
+            if(!RegisterClient_HandleFrame(client, header, buffer, Result) && frameCallback != NULL)
+            {
+                frameCallback(context, header, buffer, Result);
+            }
+        }
+
+        RegisterClient_Expire(client);
+        now = Now();
+
+        if(client->head == client->tail)
+        {
+            break;
+        }
+
+        if(now >= deadline)
+        {
+            return -ETIMEDOUT;
+        }
+
+        wait = RegisterClient_NextTimeout(client);
+
+        if(wait < 0 || (uint64_t)wait * 1000000 > deadline - now)
+        {
+            wait = (int)((deadline - now + 999999) / 1000000);
+        }
+
+        Result = poll(&pfd, 1, wait);
+
+        if(Result < 0 && errno != EINTR)
+        {
+            return -errno;
+        }
+
+        if(Result > 0 && (pfd.revents & (POLLIN | POLLERR | POLLHUP)))
+        {
+            Result = FrameParser_Fill(parser, pfd.fd);
+
+            if(Result < 0 && Result != -EAGAIN && Result != -EINTR)
+            {
+                return Result;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void SyncDone(void * context, int status, const uint16_t * addresses, const uint32_t * values, size_t count)
+{
+    SyncResult * result = context;
+
+    (void)addresses;
+
+    result->done = 1;
+    result->status = status;
+
+    if(status == 0 && values != NULL && result->values != NULL)
+    {
+        memcpy(result->values, values, count * sizeof(*values));
+    }
+}
+
+static int WaitSync(RegisterClient * client, FrameParser * parser, SyncResult * result, uint32_t timeoutUs)
+{
+    int Result = 0;
+
+    while(!result->done && Result == 0)
+    {
+        Result = RegisterClient_Run(client, parser, timeoutUs, NULL, NULL);
+    }
+
+    return result->done ? result->status : Result;
+}
+
+int RegisterClient_ReadSync(RegisterClient * client, FrameParser * parser, const uint16_t * addresses, uint32_t * values, size_t count, uint32_t timeoutUs)
+{
+    SyncResult result = { 0, 0, values };
+    int Result = RegisterClient_Read(client, addresses, count, timeoutUs, SyncDone, &result);
+
+    return (Result == 0) ? WaitSync(client, parser, &result, timeoutUs) : Result;
+}
+
+int RegisterClient_WriteSync(RegisterClient * client, FrameParser * parser, uint16_t address, uint32_t value, uint32_t timeoutUs)
+{
+    SyncResult result = { 0, 0, NULL };
+    int Result = RegisterClient_Write(client, address, value, timeoutUs, SyncDone, &result);
+
+    return (Result == 0) ? WaitSync(client, parser, &result, timeoutUs) : Result;
+}
+
+void RegisterClient_Free(RegisterClient * client)
+{
+    if(client != NULL)
+    {
+        while(client->head != client->tail)
+        {
+            Complete(client, -ECANCELED, NULL);
+        }
+
+        free(client);
+    }
+}
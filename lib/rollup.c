@@ -0,0 +1,384 @@
+#include "rollup.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROLLUP_FIELDS           6
+#define ROLLUP_MAX_WINDOW_MS    (24u * 3600u * 1000u)
+
+/* KwH is a 24 bit Wh counter, a step of half the range or more is a reset */
+#define COUNTER_MASK            0xffffffu
+#define COUNTER_HALF            0x800000u
+
+static const size_t ValueOffsets[ROLLUP_FIELDS] =
+{
+    offsetof(AutoReportValues, Vrms),
+    offsetof(AutoReportValues, Irms),
+    offsetof(AutoReportValues, Watts),
+    offsetof(AutoReportValues, Pavg),
+    offsetof(AutoReportValues, PF),
+    offsetof(AutoReportValues, Freq),
+};
+
+static const size_t WindowOffsets[ROLLUP_FIELDS] =
+{
+    offsetof(RollupWindow, Vrms),
+    offsetof(RollupWindow, Irms),
+    offsetof(RollupWindow, Watts),
+    offsetof(RollupWindow, Pavg),
+    offsetof(RollupWindow, PF),
+    offsetof(RollupWindow, Freq),
+};
+
+typedef struct
+{
+    uint64_t index;             /* window number, timestamp / length */
+    uint32_t count;
+    uint32_t energy;            /* Wh */
+    float min[ROLLUP_FIELDS];
+    float max[ROLLUP_FIELDS];
+    double sum[ROLLUP_FIELDS];
+} RollupAccumulator;
+
+typedef struct
+{
+    uint32_t device;
+    int haveCounter;
+    uint32_t counter;           /* raw KwH of the last sample */
+    float kwh;
+    RollupAccumulator windows[ROLLUP_MAX_WINDOWS];
+} RollupDevice;
+
+struct _Rollup
+{
+    uint64_t lengths[ROLLUP_MAX_WINDOWS];   /* ns */
+    uint32_t windowsMs[ROLLUP_MAX_WINDOWS];
+    size_t windowCount;
+    RollupCallback callback;
+    void * context;
+
+    RollupDevice * devices;
+    size_t deviceCount;
+    size_t deviceCapacity;
+
+    /* open addressing from device number to index + 1, 0 is free */
+    uint32_t * slots;
+    size_t slotCount;           /* power of two */
+};
+
+static size_t Slot(Rollup * rollup, uint32_t device)
+{
+    size_t mask = rollup->slotCount - 1;
+    size_t slot = (size_t)(device * 2654435761u) & mask;
+
+    while(rollup->slots[slot] != 0 && rollup->devices[rollup->slots[slot] - 1].device != device)
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+static int Rehash(Rollup * rollup, size_t slotCount)
+{
+    uint32_t * slots = calloc(slotCount, sizeof(*slots));
+    size_t i = 0;
+
+    if(slots == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    free(rollup->slots);
+    rollup->slots = slots;
+    rollup->slotCount = slotCount;
+
+    for(i = 0; i < rollup->deviceCount; i++)
+    {
+        rollup->slots[Slot(rollup, rollup->devices[i].device)] = (uint32_t)(i + 1);
+    }
+
+    return 0;
+}
+
+static void ResetWindow(RollupAccumulator * window, uint64_t index)
+{
+    size_t i = 0;
+
+    window->index = index;
+    window->count = 0;
+    window->energy = 0;
+
+    for(i = 0; i < ROLLUP_FIELDS; i++)
+    {
+        window->min[i] = INFINITY;
+        window->max[i] = -INFINITY;
+        window->sum[i] = 0;
+    }
+}
+
+static RollupDevice * FindDevice(Rollup * rollup, uint32_t device)
+{
+    size_t slot = Slot(rollup, device);
+    RollupDevice * state = NULL;
+    size_t i = 0;
+
+    if(rollup->slots[slot] != 0)
+    {
+        return &rollup->devices[rollup->slots[slot] - 1];
+    }
+
+    if(rollup->deviceCount == rollup->deviceCapacity)
+    {
+        size_t capacity = rollup->deviceCapacity * 2;
+        RollupDevice * devices = realloc(rollup->devices, capacity * sizeof(*devices));
+
+        if(devices == NULL)
+        {
+            return NULL;
+        }
+        rollup->devices = devices;
+        rollup->deviceCapacity = capacity;
+    }
+
+    /* keep the table at most half full */
+    if((rollup->deviceCount + 1) * 2 > rollup->slotCount)
+    {
+        if(Rehash(rollup, rollup->slotCount * 2) != 0)
+        {
+            return NULL;
+        }
+        slot = Slot(rollup, device);
+    }
+
+    state = &rollup->devices[rollup->deviceCount];
+    memset(state, 0, sizeof(*state));
+    state->device = device;
+    for(i = 0; i < rollup->windowCount; i++)
+    {
+        ResetWindow(&state->windows[i], 0);
+    }
+
+    rollup->deviceCount++;
+    rollup->slots[slot] = (uint32_t)rollup->deviceCount;
+
+    return state;
+}
+
+static void Emit(Rollup * rollup, RollupDevice * device, size_t w)
+{
+    RollupAccumulator * window = &device->windows[w];
+    RollupWindow out;
+    size_t i = 0;
+
+    out.Device = device->device;
+    out.WindowMs = rollup->windowsMs[w];
+    out.Start = window->index * rollup->lengths[w];
+    out.End = out.Start + rollup->lengths[w];
+    out.Count = window->count;
+    out.KwH = device->kwh;
+    out.EnergyWh = window->energy;
+
+    for(i = 0; i < ROLLUP_FIELDS; i++)
+    {
+        RollupStat * stat = (RollupStat *)((uint8_t *)&out + WindowOffsets[i]);
+
+        stat->Min = window->min[i];
+        stat->Max = window->max[i];
+        stat->Sum = window->sum[i];
+        stat->Mean = (float)(window->sum[i] / window->count);
+    }
+
+    rollup->callback(rollup->context, &out);
+}
+
+Rollup * Rollup_New(const uint32_t * windowsMs, size_t count, RollupCallback callback, void * context)
+{
+    Rollup * rollup = NULL;
+    size_t i = 0;
+
+    if(windowsMs == NULL || count == 0 || count > ROLLUP_MAX_WINDOWS || callback == NULL)
+    {
+        return NULL;
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        if(windowsMs[i] == 0 || windowsMs[i] > ROLLUP_MAX_WINDOW_MS)
+        {
+            return NULL;
+        }
+    }
+
+    rollup = calloc(1, sizeof(*rollup));
+    if(rollup == NULL)
+    {
+        return NULL;
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        rollup->windowsMs[i] = windowsMs[i];
+        rollup->lengths[i] = (uint64_t)windowsMs[i] * 1000000u;
+    }
+    rollup->windowCount = count;
+    rollup->callback = callback;
+    rollup->context = context;
+
+    rollup->deviceCapacity = 16;
+    rollup->devices = malloc(rollup->deviceCapacity * sizeof(*rollup->devices));
+    if(rollup->devices == NULL || Rehash(rollup, 32) != 0)
+    {
+        Rollup_Free(rollup);
+        return NULL;
+    }
+
+    return rollup;
+}
+
+int Rollup_Add(Rollup * rollup, uint32_t device, uint64_t timestamp, const AutoReportValues * values)
+{
+    RollupDevice * state = NULL;
+    uint32_t counter = 0;
+    uint32_t energy = 0;
+    size_t w = 0;
+    size_t i = 0;
+
+    if(rollup == NULL || values == NULL)
+    {
+        return -EINVAL;
+    }
+
+    state = FindDevice(rollup, device);
+    if(state == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    for(w = 0; w < rollup->windowCount; w++)
+    {
+        if(timestamp / rollup->lengths[w] < state->windows[w].index)
+        {
+            return -ERANGE;
+        }
+    }
+
+    /* the float decode of a 24 bit field is exact, rounding gets the raw counter back */
+    counter = (uint32_t)lrint((double)values->KwH * 1000.0) & COUNTER_MASK;
+    if(state->haveCounter)
+    {
+        energy = (counter - state->counter) & COUNTER_MASK;
+        energy = (energy < COUNTER_HALF) ? energy : 0;
+    }
+
+    for(w = 0; w < rollup->windowCount; w++)
+    {
+        RollupAccumulator * window = &state->windows[w];
+        uint64_t index = timestamp / rollup->lengths[w];
+
+        if(index != window->index)
+        {
+            if(window->count != 0)
+            {
+                Emit(rollup, state, w);
+            }
+            ResetWindow(window, index);
+        }
+
+        for(i = 0; i < ROLLUP_FIELDS; i++)
+        {
+            float value = *(const float *)((const uint8_t *)values + ValueOffsets[i]);
+
+            window->min[i] = (value < window->min[i]) ? value : window->min[i];
+            window->max[i] = (value > window->max[i]) ? value : window->max[i];
+            window->sum[i] += value;
+        }
+        window->count++;
+        window->energy += energy;
+    }
+
+    state->counter = counter;
+    state->haveCounter = 1;
+    state->kwh = values->KwH;
+
+    return 0;
+}
+
+int Rollup_Advance(Rollup * rollup, uint64_t now)
+{
+    int emitted = 0;
+    size_t d = 0;
+    size_t w = 0;
+
+    if(rollup == NULL)
+    {
+        return -EINVAL;
+    }
+
+    for(d = 0; d < rollup->deviceCount; d++)
+    {
+        RollupDevice * state = &rollup->devices[d];
+
+        for(w = 0; w < rollup->windowCount; w++)
+        {
+            RollupAccumulator * window = &state->windows[w];
+
+            if(window->count != 0 && (window->index + 1) * rollup->lengths[w] <= now)
+            {
+                Emit(rollup, state, w);
+                /* a late sample must not reopen the window just sent */
+                ResetWindow(window, window->index + 1);
+                emitted++;
+            }
+        }
+    }
+
+    return emitted;
+}
+
+int Rollup_Flush(Rollup * rollup)
+{
+    int emitted = 0;
+    size_t d = 0;
+    size_t w = 0;
+
+    if(rollup == NULL)
+    {
+        return -EINVAL;
+    }
+
+    for(d = 0; d < rollup->deviceCount; d++)
+    {
+        RollupDevice * state = &rollup->devices[d];
+
+        for(w = 0; w < rollup->windowCount; w++)
+        {
+            if(state->windows[w].count != 0)
+            {
+                Emit(rollup, state, w);
+                ResetWindow(&state->windows[w], state->windows[w].index);
+                emitted++;
+            }
+        }
+    }
+
+    return emitted;
+}
+
+size_t Rollup_DeviceCount(Rollup * rollup)
+{
+    return (rollup != NULL) ? rollup->deviceCount : 0;
+}
+
+void Rollup_Free(Rollup * rollup)
+{
+    if(rollup != NULL)
+    {
+        free(rollup->slots);
+        free(rollup->devices);
+        free(rollup);
+    }
+}
@@ -1,16 +1,47 @@
+#define _GNU_SOURCE
+
 #include "serial.h"
+#include "serialstats.h"
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
+#define QUEUE_MASK (SERIAL_QUEUE_SIZE - 1)
+
+#if (SERIAL_QUEUE_SIZE & QUEUE_MASK) != 0
+#error "SERIAL_QUEUE_SIZE must be a power of two"
+#endif
+
 struct _Serial
 {
 	int serialfd;
+	int vmin;		/* VMIN currently applied to the tty, -1 if unknown */
+	SerialOptions options;
+
+	/* write queue, free running indices guarded by lock */
+	pthread_mutex_t lock;
+	size_t qhead;
+	size_t qtail;
+	SerialWriteNotify notify;
+	void * notifyContext;
+	uint8_t queue[SERIAL_QUEUE_SIZE];
+
+	/* read path statistics, written by the reading thread only */
+	SerialStats stats;
+	uint64_t frameStart;	/* CLOCK_MONOTONIC ns of the current frame's first read, 0 if none */
+	uint64_t lastRead;
+	uint64_t lastFrame;
+
+	struct _Journal * journal;	/* frames ReadMessage() validates go here */
 };
 
 typedef struct __attribute__((__packed__))
@@ -38,25 +69,97 @@ uint8_t CheckSum(uint8_t * buffer, uint8_t length)
     return sum;
 }
 
-int SetInterfaceAttributes(int fd, int speed)
+uint8_t FrameCheckSum(const uint8_t * buffer, uint8_t length)
+{
+    const uint8_t * ptr = buffer;
+    uint8_t sum = 0;
+
+    for(; ptr < (buffer+length); ptr++)
+        sum -= *ptr;
+
+    return sum;
+}
+
+static const struct
+{
+    uint32_t baud;
+    speed_t speed;
+} BaudRates[] =
+{
+    { 1200, B1200 }, { 2400, B2400 }, { 4800, B4800 }, { 9600, B9600 },
+    { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+    { 115200, B115200 }, { 230400, B230400 }, { 460800, B460800 },
+    { 921600, B921600 },
+};
+
+static int BaudToSpeed(uint32_t baud, speed_t * speed)
+{
+    size_t i = 0;
+
+    for(i = 0; i < sizeof(BaudRates) / sizeof(BaudRates[0]); i++)
+    {
+        if(BaudRates[i].baud == baud)
+        {
+            *speed = BaudRates[i].speed;
+            return 0;
+        }
+    }
+
+    return -EINVAL;
+}
+
+static int ValidOptions(const SerialOptions * options)
+{
+    speed_t speed;
+
+    return BaudToSpeed(options->Baud, &speed) == 0
+           && options->Parity <= SERIAL_PARITY_ODD
+           && (options->StopBits == 1 || options->StopBits == 2);
+}
+
+void Serial_DefaultOptions(SerialOptions * options)
+{
+    if(options != NULL)
+    {
+        options->Baud = 19200;
+        options->Parity = SERIAL_PARITY_EVEN;
+        options->StopBits = 1;
+        options->VTime = 1;
+    }
+}
+
+int SetInterfaceAttributes(int fd, const SerialOptions * options, int when)
 {
     struct termios tty;
+    speed_t speed = B19200;
 
     if (tcgetattr(fd, &tty) < 0) {
         printf("Error from tcgetattr [%d]: %s\n", fd, strerror(errno));
         return -1;
     }
 
-    cfsetospeed(&tty, (speed_t)speed);
-    cfsetispeed(&tty, (speed_t)speed);
+    BaudToSpeed(options->Baud, &speed);
+    cfsetospeed(&tty, speed);
+    cfsetispeed(&tty, speed);
 
     tty.c_cflag |= (CLOCAL | CREAD);    /* ignore modem controls */
     tty.c_cflag &= ~CSIZE;
     tty.c_cflag |= CS8;         /* 8-bit characters */
-    //tty.c_cflag &= ~PARENB;     /* no parity bit */
-    tty.c_cflag |= PARENB;     /* no parity bit */
-    tty.c_cflag &= ~CSTOPB;     /* only need 1 stop bit */
-    //tty.c_cflag |= CSTOPB;     /* only need 1 stop bit */
+
+    tty.c_cflag &= ~(PARENB | PARODD);
+    if (options->Parity != SERIAL_PARITY_NONE) {
+        tty.c_cflag |= PARENB;
+    }
+    if (options->Parity == SERIAL_PARITY_ODD) {
+        tty.c_cflag |= PARODD;
+    }
+
+    if (options->StopBits == 2) {
+        tty.c_cflag |= CSTOPB;
+    } else {
+        tty.c_cflag &= ~CSTOPB;
+    }
+
     tty.c_cflag &= ~CRTSCTS;    /* no hardware flowcontrol */
 
 
@@ -67,21 +170,18 @@ int SetInterfaceAttributes(int fd, int speed)
 
 
     /* fetch bytes as they become available */
-    //tty.c_cc[VMIN] = 0;
-    //tty.c_cc[VTIME] = 2;
-
     tty.c_cc[VMIN] = 0;
-    tty.c_cc[VTIME] = 1;
+    tty.c_cc[VTIME] = options->VTime;
 
 
-    if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+    if (tcsetattr(fd, when, &tty) != 0) {
         printf("Error from tcsetattr [%d]: %s\n", fd, strerror(errno));
         return -1;
     }
     return 0;
 }
 
-int SetInterfaceVMIN(int fd, uint8_t vmin)
+int SetInterfaceVMIN(int fd, uint8_t vmin, uint8_t vtime)
 {
     struct termios tty;
 
@@ -91,7 +191,7 @@ int SetInterfaceVMIN(int fd, uint8_t vmin)
     }
 
     tty.c_cc[VMIN] = vmin;
-    tty.c_cc[VTIME] = 1;
+    tty.c_cc[VTIME] = vtime;
 
     if (tcsetattr(fd, TCSANOW, &tty) != 0) {
         printf("Error from tcsetattr [%d]: %s\n", fd, strerror(errno));
@@ -100,35 +200,134 @@ int SetInterfaceVMIN(int fd, uint8_t vmin)
     return 0;
 }
 
+_Static_assert(sizeof(struct _Serial) <= SERIAL_STORAGE_SIZE, "SERIAL_STORAGE_SIZE too small");
+
+size_t Serial_Size(void)
+{
+	return sizeof(struct _Serial);
+}
+
+int Serial_Init(Serial * serial, const char * path, const SerialOptions * options)
+{
+	if(serial == NULL || path == NULL || (options != NULL && !ValidOptions(options)))
+	{
+		return -EINVAL;
+	}
+
+	serial->serialfd = open(path, O_RDWR | O_NOCTTY);
+
+	if(serial->serialfd < 0)
+	{
+		int Result = -errno;
+
+		printf("Error opening %s: %s\n", path, strerror(errno));
+		return Result;
+	}
+
+	if(options != NULL)
+	{
+		serial->options = *options;
+	}
+	else
+	{
+		Serial_DefaultOptions(&serial->options);
+	}
+
+	SetInterfaceAttributes(serial->serialfd, &serial->options, TCSANOW);
+	serial->vmin = 0;
+	serial->qhead = 0;
+	serial->qtail = 0;
+	serial->notify = NULL;
+	serial->notifyContext = NULL;
+	memset(&serial->stats, 0, sizeof(serial->stats));
+	serial->frameStart = 0;
+	serial->lastRead = 0;
+	serial->lastFrame = 0;
+	serial->journal = NULL;
+	pthread_mutex_init(&serial->lock, NULL);
+	lseek(serial->serialfd, 0, SEEK_END);
+	printf("Serial [%p:%d]: %s\n", (void *)serial, serial->serialfd, path);
+
+	return 0;
+}
+
+void Serial_Deinit(Serial * serial)
+{
+	if(serial != NULL)
+	{
+		if(serial->serialfd >= 0)
+		{
+			close(serial->serialfd);
+			serial->serialfd = -1;
+		}
+
+		pthread_mutex_destroy(&serial->lock);
+	}
+}
+
+#ifndef MONIP_STATIC_ALLOCATION
 Serial * Serial_New(const char * path)
+{
+	return Serial_NewWithOptions(path, NULL);
+}
+
+Serial * Serial_NewWithOptions(const char * path, const SerialOptions * options)
 {
 	Serial * serial = NULL;
+	int Result = 0;
+
+	if(options != NULL && !ValidOptions(options))
+	{
+		errno = EINVAL;
+		return NULL;
+	}
 
 	if(path != NULL)
 	{
 		serial = malloc(sizeof(*serial));
 
-		if(serial != NULL)
+		if(serial != NULL && (Result = Serial_Init(serial, path, options)) != 0)
 		{
-			serial->serialfd = open(path, O_RDWR | O_NOCTTY | O_SYNC);
-
-			if (serial->serialfd >= 0)
-			{
-				SetInterfaceAttributes(serial->serialfd, B19200);
-				lseek(serial->serialfd, 0, SEEK_END);
-				printf("Serial [%p:%d]: %s\n", (void *)serial, serial->serialfd, path);
-			}
-			else
-			{
-				printf("Error opening %s: %s\n", path, strerror(errno));
-				free(serial);
-				serial = NULL;
-			}
+			free(serial);
+			serial = NULL;
+			errno = -Result;
 		}
 	}
 
 	return serial;
 }
+#endif
+
+int Serial_SetOptions(Serial * serial, const SerialOptions * options)
+{
+	if(serial == NULL || options == NULL || !ValidOptions(options))
+	{
+		return -EINVAL;
+	}
+
+	/* let bytes already handed to the tty go out at the old rate */
+	if(SetInterfaceAttributes(serial->serialfd, options, TCSADRAIN) != 0)
+	{
+		return -EIO;
+	}
+
+	serial->options = *options;
+	serial->vmin = 0;
+
+	return 0;
+}
+
+int Serial_GetOptions(Serial * serial, SerialOptions * options)
+{
+	if(serial == NULL || options == NULL)
+	{
+		return -EINVAL;
+	}
+
+	*options = serial->options;
+
+	return 0;
+}
 
 void Serial_Reset(Serial * serial)
 {
@@ -136,21 +335,27 @@ void Serial_Reset(Serial * serial)
 	{
 		if (serial->serialfd >= 0)
 		{
-			SetInterfaceVMIN(serial->serialfd, 0);
+			SetInterfaceVMIN(serial->serialfd, 0, serial->options.VTime);
+			serial->vmin = 0;
 		}
 	}
 }
 
 uint8_t Serial_Read(Serial * serial, uint8_t * buffer, uint8_t size)
 {
-    size_t ret = 0;
+    ssize_t ret = 0;
 
     if(serial != NULL)
     {
-        ret = SetInterfaceVMIN(serial->serialfd, size);
+        if(serial->vmin != size)
+        {
+            ret = SetInterfaceVMIN(serial->serialfd, size, serial->options.VTime);
+            serial->vmin = (ret == 0) ? size : -1;
+        }
         if(ret >= 0)
         {
             ret = read(serial->serialfd, buffer, size);
+            SerialStats_Read(serial, ret < 0 ? -errno : ret, 0);
         }
     }
 
@@ -165,18 +370,338 @@ uint8_t Serial_Read(Serial * serial, uint8_t * buffer, uint8_t size)
     return ((ret < 0) | (ret != size)) ? 0 : size;
 }
 
+void Serial_Deadline(struct timespec * deadline, uint32_t timeoutUs)
+{
+    if(deadline != NULL)
+    {
+        clock_gettime(CLOCK_MONOTONIC, deadline);
+
+        deadline->tv_sec += timeoutUs / 1000000;
+        deadline->tv_nsec += (long)(timeoutUs % 1000000) * 1000;
+
+        if(deadline->tv_nsec >= 1000000000L)
+        {
+            deadline->tv_sec++;
+            deadline->tv_nsec -= 1000000000L;
+        }
+    }
+}
+
+int Serial_ReadUntil(Serial * serial, uint8_t * buffer, size_t size, const struct timespec * deadline)
+{
+    struct pollfd pfd;
+    size_t total = 0;
+
+    if(serial == NULL || buffer == NULL || deadline == NULL)
+    {
+        return -EINVAL;
+    }
+
+    /* a read() after poll() must not wait for VMIN bytes, fix it up once */
+    if(serial->vmin != 0)
+    {
+        if(SetInterfaceVMIN(serial->serialfd, 0, serial->options.VTime) != 0)
+        {
+            return -EIO;
+        }
+        serial->vmin = 0;
+    }
+
+    pfd.fd = serial->serialfd;
+    pfd.events = POLLIN;
+
+    while(total < size)
+    {
+        struct timespec now;
+        struct timespec remaining;
+        ssize_t ret = 0;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        remaining.tv_sec = deadline->tv_sec - now.tv_sec;
+        remaining.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+
+        if(remaining.tv_nsec < 0)
+        {
+            remaining.tv_sec--;
+            remaining.tv_nsec += 1000000000L;
+        }
+
+        if(remaining.tv_sec < 0)
+        {
+            break;
+        }
+
+        ret = ppoll(&pfd, 1, &remaining, NULL);
+
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -errno;
+        }
+        else if(ret == 0)
+        {
+            break;
+        }
+
+        ret = read(serial->serialfd, buffer + total, size - total);
+        SerialStats_Read(serial, ret < 0 ? -errno : ret, 0);
+
+        if(ret < 0)
+        {
+            if(errno == EINTR || errno == EAGAIN)
+            {
+                continue;
+            }
+            return -errno;
+        }
+        else if(ret == 0)
+        {
+            /* readable but empty: hangup */
+            break;
+        }
+
+        total += ret;
+    }
+
+    return (int)total;
+}
+
+int Serial_ReadTimeout(Serial * serial, uint8_t * buffer, size_t size, uint32_t timeoutUs)
+{
+    struct timespec deadline;
+
+    Serial_Deadline(&deadline, timeoutUs);
+
+    return Serial_ReadUntil(serial, buffer, size, &deadline);
+}
+
 uint8_t Serial_Write(Serial * serial, uint8_t * buffer, uint8_t size)
 {
-    size_t ret = 0;
+    int ret = Serial_Queue(serial, buffer, size);
+
+    if(ret == 0)
+    {
+        /* anything a non-blocking fd refuses now goes out from the event loop */
+        ret = Serial_Flush(serial);
+    }
+
+    return (ret < 0) ? 0 : size;
+}
+
+int Serial_Queue(Serial * serial, const uint8_t * buffer, size_t size)
+{
+    size_t offset = 0;
+    size_t first = 0;
+    int wasEmpty = 0;
+
+    if(serial == NULL || (buffer == NULL && size > 0))
+    {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&serial->lock);
+
+    if(size > SERIAL_QUEUE_SIZE - (serial->qhead - serial->qtail))
+    {
+        pthread_mutex_unlock(&serial->lock);
+        return -ENOBUFS;
+    }
+
+    wasEmpty = (serial->qhead == serial->qtail);
+
+    offset = serial->qhead & QUEUE_MASK;
+    first = SERIAL_QUEUE_SIZE - offset;
+
+    if(first > size)
+    {
+        first = size;
+    }
+
+    memcpy(&serial->queue[offset], buffer, first);
+    memcpy(&serial->queue[0], buffer + first, size - first);
+    serial->qhead += size;
+
+    if(wasEmpty && size > 0 && serial->notify != NULL)
+    {
+        serial->notify(serial->notifyContext, serial);
+    }
+
+    pthread_mutex_unlock(&serial->lock);
+
+    return 0;
+}
+
+int Serial_Flush(Serial * serial)
+{
+    int Result = 0;
+
+    if(serial == NULL)
+    {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&serial->lock);
+
+    while(serial->qhead != serial->qtail)
+    {
+        struct iovec iov[2];
+        size_t pending = serial->qhead - serial->qtail;
+        size_t offset = serial->qtail & QUEUE_MASK;
+        size_t first = SERIAL_QUEUE_SIZE - offset;
+        ssize_t ret = 0;
+
+        if(first > pending)
+        {
+            first = pending;
+        }
+
+        /* everything queued goes out in one call, two pieces when it wraps */
+        iov[0].iov_base = &serial->queue[offset];
+        iov[0].iov_len = first;
+        iov[1].iov_base = &serial->queue[0];
+        iov[1].iov_len = pending - first;
+
+        ret = writev(serial->serialfd, iov, (pending > first) ? 2 : 1);
+
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            if(errno != EAGAIN)
+            {
+                Result = -errno;
+            }
+            break;
+        }
+
+        serial->qtail += ret;
+    }
+
+    if(Result == 0)
+    {
+        Result = (int)(serial->qhead - serial->qtail);
+    }
+
+    pthread_mutex_unlock(&serial->lock);
+
+    return Result;
+}
+
+size_t Serial_Pending(Serial * serial)
+{
+    size_t pending = 0;
 
     if(serial != NULL)
     {
-    	ret = write(serial->serialfd, buffer, size);
-    	fsync(serial->serialfd);
-		tcdrain(serial->serialfd);
+        pthread_mutex_lock(&serial->lock);
+        pending = serial->qhead - serial->qtail;
+        pthread_mutex_unlock(&serial->lock);
     }
 
-    return ((ret < 0) | (ret != size)) ? 0 : size;
+    return pending;
+}
+
+int Serial_Drain(Serial * serial, uint32_t timeoutUs)
+{
+    struct timespec deadline;
+    struct pollfd pfd;
+    int Result = 0;
+
+    if(serial == NULL)
+    {
+        return -EINVAL;
+    }
+
+    Serial_Deadline(&deadline, timeoutUs);
+
+    pfd.fd = serial->serialfd;
+    pfd.events = POLLOUT;
+
+    while((Result = Serial_Flush(serial)) > 0)
+    {
+        struct timespec now;
+        struct timespec remaining;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        remaining.tv_sec = deadline.tv_sec - now.tv_sec;
+        remaining.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+
+        if(remaining.tv_nsec < 0)
+        {
+            remaining.tv_sec--;
+            remaining.tv_nsec += 1000000000L;
+        }
+
+        if(remaining.tv_sec < 0
+           || (ppoll(&pfd, 1, &remaining, NULL) == 0))
+        {
+            return -ETIMEDOUT;
+        }
+    }
+
+    if(Result < 0)
+    {
+        return Result;
+    }
+
+    return (tcdrain(serial->serialfd) < 0) ? -errno : 0;
+}
+
+void Serial_SetWriteNotify(Serial * serial, SerialWriteNotify notify, void * context)
+{
+    if(serial != NULL)
+    {
+        pthread_mutex_lock(&serial->lock);
+        serial->notify = notify;
+        serial->notifyContext = context;
+        pthread_mutex_unlock(&serial->lock);
+    }
+}
+
+void Serial_SetJournal(Serial * serial, struct _Journal * journal)
+{
+	if(serial != NULL)
+	{
+		serial->journal = journal;
+	}
+}
+
+struct _Journal * Serial_Journal(Serial * serial)
+{
+	return serial->journal;
+}
+
+int Serial_SetNonBlocking(Serial * serial, int nonblocking)
+{
+	int flags = 0;
+
+	if(serial == NULL || serial->serialfd < 0)
+	{
+		return -EINVAL;
+	}
+
+	flags = fcntl(serial->serialfd, F_GETFL);
+
+	if(flags < 0)
+	{
+		return -errno;
+	}
+
+	flags = nonblocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+
+	if(fcntl(serial->serialfd, F_SETFL, flags) < 0)
+	{
+		return -errno;
+	}
+
+	return 0;
 }
 
 int Serial_GetFD(Serial * serial)
@@ -191,19 +716,216 @@ int Serial_GetFD(Serial * serial)
 	return result;
 }
 
-void Serial_Free(Serial * serial)
+#define HISTOGRAM_SUB_COUNT (1u << SERIAL_HISTOGRAM_SUB_BITS)
+
+static uint64_t StatsNow(void)
 {
+	struct timespec now;
 
-	if(serial != NULL)
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+/* single writer: a relaxed load and store, no locked instruction */
+static void StatsAdd(uint64_t * counter, uint64_t amount)
+{
+	__atomic_store_n(counter, *counter + amount, __ATOMIC_RELAXED);
+}
+
+static unsigned HistogramIndex(uint64_t value)
+{
+	unsigned exponent = 0;
+
+	if(value < HISTOGRAM_SUB_COUNT)
 	{
-		if(serial->serialfd >= 0)
+		return (unsigned)value;
+	}
+
+	if(value > 0xffffffffull)
+	{
+		value = 0xffffffffull;
+	}
+
+	exponent = 63 - __builtin_clzll(value);
+
+	return ((exponent - SERIAL_HISTOGRAM_SUB_BITS + 1) << SERIAL_HISTOGRAM_SUB_BITS)
+	       + (unsigned)(value >> (exponent - SERIAL_HISTOGRAM_SUB_BITS)) - HISTOGRAM_SUB_COUNT;
+}
+
+/* Largest value counted in bucket index */
+static uint64_t HistogramUpper(unsigned index)
+{
+	unsigned shift = 0;
+	uint64_t sub = 0;
+
+	if(index < HISTOGRAM_SUB_COUNT)
+	{
+		return index;
+	}
+
+	shift = (index >> SERIAL_HISTOGRAM_SUB_BITS) - 1;
+	sub = (index & (HISTOGRAM_SUB_COUNT - 1)) + HISTOGRAM_SUB_COUNT;
+
+	return ((sub + 1) << shift) - 1;
+}
+
+static void HistogramRecord(SerialHistogram * histogram, uint64_t ns)
+{
+	uint64_t value = ns / 1000;
+	uint32_t * bucket = &histogram->Buckets[HistogramIndex(value)];
+
+	StatsAdd(&histogram->Count, 1);
+	StatsAdd(&histogram->Sum, value);
+	if(value > histogram->Max)
+	{
+		__atomic_store_n(&histogram->Max, value, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(bucket, *bucket + 1, __ATOMIC_RELAXED);
+}
+
+static void HistogramCopy(SerialHistogram * to, const SerialHistogram * from)
+{
+	unsigned i = 0;
+
+	to->Count = __atomic_load_n(&from->Count, __ATOMIC_RELAXED);
+	to->Sum = __atomic_load_n(&from->Sum, __ATOMIC_RELAXED);
+	to->Max = __atomic_load_n(&from->Max, __ATOMIC_RELAXED);
+
+	for(i = 0; i < SERIAL_HISTOGRAM_BUCKETS; i++)
+	{
+		to->Buckets[i] = __atomic_load_n(&from->Buckets[i], __ATOMIC_RELAXED);
+	}
+}
+
+void SerialStats_Read(Serial * serial, ssize_t result, int fresh)
+{
+	StatsAdd(&serial->stats.ReadCalls, 1);
+
+	if(result > 0)
+	{
+		SerialStats_Received(serial, (size_t)result, fresh);
+	}
+}
+
+void SerialStats_Received(Serial * serial, size_t bytes, int fresh)
+{
+	if(bytes > 0)
+	{
+		serial->lastRead = StatsNow();
+		if(fresh || serial->frameStart == 0)
 		{
-			close(serial->serialfd);
+			serial->frameStart = serial->lastRead;
 		}
+		StatsAdd(&serial->stats.BytesRead, (uint64_t)bytes);
+	}
+}
 
+void SerialStats_Parsed(Serial * serial, int result, size_t skipped, size_t checksumErrors, size_t headerMismatches, int pending)
+{
+	if(result >= 0)
+	{
+		/* decoded right after the read that completed it, whose timestamp will do */
+		uint64_t now = serial->lastRead;
+
+		if(serial->frameStart != 0)
+		{
+			HistogramRecord(&serial->stats.Latency, now - serial->frameStart);
+		}
+		if(serial->lastFrame != 0)
+		{
+			HistogramRecord(&serial->stats.Gap, now - serial->lastFrame);
+		}
+		serial->lastFrame = now;
+		StatsAdd(&serial->stats.FramesOk, 1);
+	}
+
+	if(skipped != 0)
+	{
+		StatsAdd(&serial->stats.ResyncBytes, skipped);
+	}
+	if(checksumErrors != 0)
+	{
+		StatsAdd(&serial->stats.ChecksumErrors, checksumErrors);
+	}
+	if(headerMismatches != 0)
+	{
+		StatsAdd(&serial->stats.HeaderMismatches, headerMismatches);
+	}
+
+	/* what is left arrived by the last read at the latest */
+	if(!pending)
+	{
+		serial->frameStart = 0;
+	}
+	else if(result >= 0 || skipped != 0)
+	{
+		serial->frameStart = serial->lastRead;
+	}
+}
+
+void SerialStats_Timeout(Serial * serial)
+{
+	StatsAdd(&serial->stats.Timeouts, 1);
+}
+
+void Serial_GetStats(Serial * serial, SerialStats * stats)
+{
+	if(serial == NULL || stats == NULL)
+	{
+		return;
+	}
+
+	stats->BytesRead = __atomic_load_n(&serial->stats.BytesRead, __ATOMIC_RELAXED);
+	stats->ReadCalls = __atomic_load_n(&serial->stats.ReadCalls, __ATOMIC_RELAXED);
+	stats->FramesOk = __atomic_load_n(&serial->stats.FramesOk, __ATOMIC_RELAXED);
+	stats->ChecksumErrors = __atomic_load_n(&serial->stats.ChecksumErrors, __ATOMIC_RELAXED);
+	stats->HeaderMismatches = __atomic_load_n(&serial->stats.HeaderMismatches, __ATOMIC_RELAXED);
+	stats->ResyncBytes = __atomic_load_n(&serial->stats.ResyncBytes, __ATOMIC_RELAXED);
+	stats->Timeouts = __atomic_load_n(&serial->stats.Timeouts, __ATOMIC_RELAXED);
+	HistogramCopy(&stats->Latency, &serial->stats.Latency);
+	HistogramCopy(&stats->Gap, &serial->stats.Gap);
+}
+
+uint64_t SerialHistogram_Percentile(const SerialHistogram * histogram, double fraction)
+{
+	uint64_t rank = 0;
+	uint64_t seen = 0;
+	unsigned i = 0;
+
+	if(histogram == NULL || histogram->Count == 0)
+	{
+		return 0;
+	}
+
+	fraction = fraction < 0 ? 0 : (fraction > 1 ? 1 : fraction);
+	rank = (uint64_t)(fraction * histogram->Count + 0.5);
+	rank = rank == 0 ? 1 : rank;
+
+	for(i = 0; i < SERIAL_HISTOGRAM_BUCKETS; i++)
+	{
+		seen += histogram->Buckets[i];
+		if(seen >= rank)
+		{
+			uint64_t upper = HistogramUpper(i);
+
+			return upper < histogram->Max ? upper : histogram->Max;
+		}
+	}
+
+	return histogram->Max;
+}
+
+#ifndef MONIP_STATIC_ALLOCATION
+void Serial_Free(Serial * serial)
+{
+	if(serial != NULL)
+	{
+		Serial_Deinit(serial);
 		free(serial);
 	}
 }
+#endif
 
 /*
 pfc_error Serial_ReadPFCMessage(Serial * serial, PFC_ID * ID, uint8_t * data, pfc_size * size)
@@ -0,0 +1,46 @@
+#ifndef SERIALSTATS_H_
+#define SERIALSTATS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "serial.h"
+
+/*
+ * Read path hooks behind Serial_GetStats() and Serial_SetJournal(), private
+ * to the library and called only by the thread reading serial.
+ */
+
+/*
+ * A read of the fd returned result, bytes or -errno. fresh when nothing of
+ * a frame was buffered before it: its first byte starts the latency clock.
+ */
+void SerialStats_Read(Serial * serial, ssize_t result, int fresh);
+
+/*
+ * bytes read elsewhere, by an io_uring completion the reactor counted with
+ * SerialStats_Read(), handed to the parser. No read call of its own.
+ */
+void SerialStats_Received(Serial * serial, size_t bytes, int fresh);
+
+/*
+ * One parse step: result is a payload length for a decoded frame, -errno
+ * otherwise. pending says whether bytes are left buffered after it.
+ */
+void SerialStats_Parsed(Serial * serial, int result, size_t skipped, size_t checksumErrors, size_t headerMismatches, int pending);
+
+/* A frame read gave up with nothing to show */
+void SerialStats_Timeout(Serial * serial);
+
+/* The journal set with Serial_SetJournal(), NULL if none */
+struct _Journal * Serial_Journal(Serial * serial);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERIALSTATS_H_ */
@@ -0,0 +1,604 @@
+#define _GNU_SOURCE
+
+#include "shardedreactor.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SHARD_CACHE_LINE 64
+
+typedef struct _Shard Shard;
+
+typedef struct
+{
+    Serial * serial;
+    ReactorCallback callback;
+    void * context;
+    Shard * shard;              /* owner, changed only while detached */
+    uint64_t frames;            /* written by the owning shard thread only */
+    uint64_t lastFrames;        /* control path bookkeeping */
+    int hungUp;                 /* the reactor dropped it, set by the shard thread */
+    FrameParserStorage parser;  /* parser state while moving between shards */
+} ShardDevice;
+
+typedef enum
+{
+    SHARD_COMMAND_ADD,
+    SHARD_COMMAND_REMOVE,
+    SHARD_COMMAND_DETACH,       /* remove, keeping the parser state in device->parser */
+    SHARD_COMMAND_ATTACH,       /* add, resuming from device->parser */
+    SHARD_COMMAND_FAIL,         /* hang up a detached device on its shard's thread */
+} ShardCommandType;
+
+typedef struct _ShardCommand ShardCommand;
+
+struct _ShardCommand
+{
+    ShardCommandType type;
+    ShardDevice * device;
+    int result;
+    int done;
+    ShardCommand * next;
+};
+
+struct _Shard
+{
+    ShardedReactor * owner;
+    Reactor * reactor;
+    pthread_t thread;
+    unsigned index;
+    int started;
+    size_t devices;             /* control path */
+    ShardCommand * commands;    /* protected by owner->lock */
+    int pending;
+    /* hot counter on its own line */
+    uint64_t frames __attribute__((aligned(SHARD_CACHE_LINE)));
+} __attribute__((aligned(SHARD_CACHE_LINE)));
+
+struct _ShardedReactor
+{
+    pthread_mutex_t control;    /* serialises Add/Remove/Rebalance */
+    pthread_mutex_t lock;       /* command queues */
+    pthread_cond_t done;
+    Shard * shards;
+    unsigned count;
+    int pin;
+    int stop;
+    ShardDevice ** devices;
+    size_t deviceCount;
+    size_t deviceCapacity;
+};
+
+static void ShardCallback(void * context, Serial * serial, const AutoReportMessage * message, const AutoReportValues * values)
+{
+    ShardDevice * device = context;
+
+    if(message != NULL)
+    {
+        /* single writer, relaxed is enough for the readers in Rebalance() */
+        __atomic_store_n(&device->frames, device->frames + 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&device->shard->frames, device->shard->frames + 1, __ATOMIC_RELAXED);
+    }
+
+    device->callback(device->context, serial, message, values);
+
+    if(message == NULL)
+    {
+        /* last use of device on this thread, the control path frees it */
+        __atomic_store_n(&device->hungUp, 1, __ATOMIC_RELEASE);
+    }
+}
+
+static void ProcessCommands(Shard * shard)
+{
+    ShardedReactor * sharded = shard->owner;
+    ShardCommand * command = NULL;
+
+    pthread_mutex_lock(&sharded->lock);
+    command = shard->commands;
+    shard->commands = NULL;
+    __atomic_store_n(&shard->pending, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&sharded->lock);
+
+    while(command != NULL)
+    {
+        ShardCommand * next = command->next;
+        int result = 0;
+
+        switch(command->type)
+        {
+        case SHARD_COMMAND_ADD:
+            result = Reactor_Add(shard->reactor, command->device->serial, ShardCallback, command->device);
+            break;
+        case SHARD_COMMAND_REMOVE:
+            result = Reactor_Remove(shard->reactor, command->device->serial);
+            break;
+        case SHARD_COMMAND_DETACH:
+            result = Reactor_Detach(shard->reactor, command->device->serial, &command->device->parser);
+            break;
+        case SHARD_COMMAND_ATTACH:
+            result = Reactor_Attach(shard->reactor, command->device->serial, ShardCallback, command->device, &command->device->parser);
+            break;
+        case SHARD_COMMAND_FAIL:
+            ShardCallback(command->device, command->device->serial, NULL, NULL);
+            break;
+        }
+
+        pthread_mutex_lock(&sharded->lock);
+        command->result = result;
+        command->done = 1;
+        pthread_cond_broadcast(&sharded->done);
+        pthread_mutex_unlock(&sharded->lock);
+
+        command = next;
+    }
+}
+
+static void * ShardThread(void * arg)
+{
+    Shard * shard = arg;
+    ShardedReactor * sharded = shard->owner;
+
+    if(sharded->pin)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(shard->index % (cpus > 0 ? cpus : 1), &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    while(!__atomic_load_n(&sharded->stop, __ATOMIC_ACQUIRE))
+    {
+        Reactor_RunOnce(shard->reactor, -1);
+
+        if(__atomic_load_n(&shard->pending, __ATOMIC_ACQUIRE))
+        {
+            ProcessCommands(shard);
+        }
+    }
+
+    /* complete anything queued after the last pass */
+    ProcessCommands(shard);
+
+    return NULL;
+}
+
+static int SubmitCommand(ShardedReactor * sharded, Shard * shard, ShardCommandType type, ShardDevice * device)
+{
+    ShardCommand command;
+    ShardCommand ** tail = NULL;
+
+    memset(&command, 0, sizeof(command));
+    command.type = type;
+    command.device = device;
+
+    pthread_mutex_lock(&sharded->lock);
+
+    for(tail = &shard->commands; *tail != NULL; tail = &(*tail)->next)
+    {
+    }
+    *tail = &command;
+    __atomic_store_n(&shard->pending, 1, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&sharded->lock);
+
+    Reactor_Wake(shard->reactor);
+
+    pthread_mutex_lock(&sharded->lock);
+    while(!command.done)
+    {
+        pthread_cond_wait(&sharded->done, &sharded->lock);
+    }
+    pthread_mutex_unlock(&sharded->lock);
+
+    return command.result;
+}
+
+ShardedReactor * ShardedReactor_New(unsigned shards, int pin)
+{
+    ShardedReactor * sharded = NULL;
+    unsigned i = 0;
+
+    if(shards == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        shards = (cpus > 0) ? (unsigned)cpus : 1;
+    }
+
+    sharded = calloc(1, sizeof(*sharded));
+
+    if(sharded == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_init(&sharded->control, NULL);
+    pthread_mutex_init(&sharded->lock, NULL);
+    pthread_cond_init(&sharded->done, NULL);
+    sharded->pin = pin;
+
+    if(posix_memalign((void **)&sharded->shards, SHARD_CACHE_LINE, shards * sizeof(Shard)) != 0)
+    {
+        sharded->shards = NULL;
+        ShardedReactor_Free(sharded);
+        return NULL;
+    }
+
+    memset(sharded->shards, 0, shards * sizeof(Shard));
+
+    for(i = 0; i < shards; i++)
+    {
+        Shard * shard = &sharded->shards[i];
+
+        shard->owner = sharded;
+        shard->index = i;
+        shard->reactor = Reactor_New();
+        sharded->count++;
+
+        if(shard->reactor == NULL
+           || pthread_create(&shard->thread, NULL, ShardThread, shard) != 0)
+        {
+            ShardedReactor_Free(sharded);
+            return NULL;
+        }
+
+        shard->started = 1;
+    }
+
+    return sharded;
+}
+
+static ShardDevice * FindDevice(ShardedReactor * sharded, Serial * serial, size_t * index)
+{
+    size_t i = 0;
+
+    for(i = 0; i < sharded->deviceCount; i++)
+    {
+        if(sharded->devices[i]->serial == serial)
+        {
+            if(index != NULL)
+            {
+                *index = i;
+            }
+            return sharded->devices[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void DropDevice(ShardedReactor * sharded, size_t index)
+{
+    ShardDevice * device = sharded->devices[index];
+
+    device->shard->devices--;
+    sharded->devices[index] = sharded->devices[--sharded->deviceCount];
+    free(device);
+}
+
+/* Forget the devices the shard reactors dropped on hangup, with control held */
+static void PruneDevices(ShardedReactor * sharded)
+{
+    size_t j = 0;
+
+    while(j < sharded->deviceCount)
+    {
+        if(__atomic_load_n(&sharded->devices[j]->hungUp, __ATOMIC_ACQUIRE))
+        {
+            DropDevice(sharded, j);
+        }
+        else
+        {
+            j++;
+        }
+    }
+}
+
+int ShardedReactor_Add(ShardedReactor * sharded, Serial * serial, ReactorCallback callback, void * context)
+{
+    ShardDevice * device = NULL;
+    Shard * shard = NULL;
+    unsigned i = 0;
+    int Result = 0;
+
+    if(sharded == NULL || serial == NULL || callback == NULL)
+    {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&sharded->control);
+
+    PruneDevices(sharded);
+
+    if(FindDevice(sharded, serial, NULL) != NULL)
+    {
+        Result = -EEXIST;
+    }
+    else if(sharded->deviceCount == sharded->deviceCapacity)
+    {
+        size_t capacity = (sharded->deviceCapacity > 0) ? sharded->deviceCapacity * 2 : 16;
+        ShardDevice ** devices = realloc(sharded->devices, capacity * sizeof(*devices));
+
+        if(devices != NULL)
+        {
+            sharded->devices = devices;
+            sharded->deviceCapacity = capacity;
+        }
+        else
+        {
+            Result = -ENOMEM;
+        }
+    }
+
+    if(Result == 0)
+    {
+        device = calloc(1, sizeof(*device));
+        Result = (device != NULL) ? 0 : -ENOMEM;
+    }
+
+    if(Result == 0)
+    {
+        shard = &sharded->shards[0];
+
+        for(i = 1; i < sharded->count; i++)
+        {
+            if(sharded->shards[i].devices < shard->devices)
+            {
+                shard = &sharded->shards[i];
+            }
+        }
+
+        device->serial = serial;
+        device->callback = callback;
+        device->context = context;
+        device->shard = shard;
+
+        Result = SubmitCommand(sharded, shard, SHARD_COMMAND_ADD, device);
+    }
+
+    if(Result == 0)
+    {
+        shard->devices++;
+        sharded->devices[sharded->deviceCount++] = device;
+        Result = (int)shard->index;
+    }
+    else
+    {
+        free(device);
+    }
+
+    pthread_mutex_unlock(&sharded->control);
+
+    return Result;
+}
+
+int ShardedReactor_Remove(ShardedReactor * sharded, Serial * serial)
+{
+    ShardDevice * device = NULL;
+    size_t index = 0;
+    int Result = -ENOENT;
+
+    if(sharded == NULL || serial == NULL)
+    {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&sharded->control);
+
+    device = FindDevice(sharded, serial, &index);
+
+    if(device != NULL)
+    {
+        /* -ENOENT here means the reactor already dropped it on hangup */
+        Result = SubmitCommand(sharded, device->shard, SHARD_COMMAND_REMOVE, device);
+        Result = (Result == -ENOENT) ? 0 : Result;
+
+        DropDevice(sharded, index);
+    }
+
+    PruneDevices(sharded);
+
+    pthread_mutex_unlock(&sharded->control);
+
+    return Result;
+}
+
+int ShardedReactor_Rebalance(ShardedReactor * sharded)
+{
+    uint64_t * load = NULL;
+    ShardDevice * best = NULL;
+    unsigned hot = 0;
+    unsigned cold = 0;
+    unsigned i = 0;
+    size_t j = 0;
+    int Result = 0;
+
+    if(sharded == NULL)
+    {
+        return -EINVAL;
+    }
+
+    load = calloc(sharded->count, sizeof(*load));
+
+    if(load == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    pthread_mutex_lock(&sharded->control);
+
+    PruneDevices(sharded);
+
+    for(j = 0; j < sharded->deviceCount; j++)
+    {
+        ShardDevice * device = sharded->devices[j];
+        uint64_t frames = __atomic_load_n(&device->frames, __ATOMIC_RELAXED);
+
+        load[device->shard->index] += frames - device->lastFrames;
+    }
+
+    for(i = 1; i < sharded->count; i++)
+    {
+        hot = (load[i] > load[hot]) ? i : hot;
+        cold = (load[i] < load[cold]) ? i : cold;
+    }
+
+    if(hot != cold
+       && sharded->shards[hot].devices > 1
+       && load[hot] - load[cold] > load[cold] / 4)
+    {
+        uint64_t gap = load[hot] - load[cold];
+        uint64_t bestError = gap;
+
+        /* the device whose rate best halves the gap */
+        for(j = 0; j < sharded->deviceCount; j++)
+        {
+            ShardDevice * device = sharded->devices[j];
+            uint64_t delta = __atomic_load_n(&device->frames, __ATOMIC_RELAXED) - device->lastFrames;
+            uint64_t error = (2 * delta > gap) ? 2 * delta - gap : gap - 2 * delta;
+
+            if(device->shard == &sharded->shards[hot] && delta > 0 && delta < gap && error < bestError)
+            {
+                best = device;
+                bestError = error;
+            }
+        }
+    }
+
+    if(best != NULL)
+    {
+        Shard * source = best->shard;
+
+        /* the parser goes along, a frame split across reads survives the move */
+        Result = SubmitCommand(sharded, source, SHARD_COMMAND_DETACH, best);
+
+        if(Result == 0)
+        {
+            best->shard = &sharded->shards[cold];
+            Result = SubmitCommand(sharded, best->shard, SHARD_COMMAND_ATTACH, best);
+
+            if(Result == 0)
+            {
+                source->devices--;
+                best->shard->devices++;
+                Result = 1;
+            }
+            else
+            {
+                /* stay where it was, or fail it as a hangup would */
+                best->shard = source;
+
+                if(SubmitCommand(sharded, source, SHARD_COMMAND_ATTACH, best) != 0)
+                {
+                    /* callbacks only ever run on the owning shard's thread */
+                    SubmitCommand(sharded, source, SHARD_COMMAND_FAIL, best);
+                }
+            }
+        }
+        else if(Result == -ENOENT)
+        {
+            /* hung up since the prune above */
+            Result = 0;
+        }
+
+        PruneDevices(sharded);
+    }
+
+    for(j = 0; j < sharded->deviceCount; j++)
+    {
+        ShardDevice * device = sharded->devices[j];
+
+        device->lastFrames = __atomic_load_n(&device->frames, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&sharded->control);
+
+    free(load);
+
+    return Result;
+}
+
+unsigned ShardedReactor_ShardCount(ShardedReactor * sharded)
+{
+    return (sharded != NULL) ? sharded->count : 0;
+}
+
+int ShardedReactor_ShardOf(ShardedReactor * sharded, Serial * serial)
+{
+    ShardDevice * device = NULL;
+    int Result = -ENOENT;
+
+    if(sharded == NULL)
+    {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&sharded->control);
+
+    device = FindDevice(sharded, serial, NULL);
+
+    if(device != NULL)
+    {
+        Result = (int)device->shard->index;
+    }
+
+    pthread_mutex_unlock(&sharded->control);
+
+    return Result;
+}
+
+uint64_t ShardedReactor_Frames(ShardedReactor * sharded, unsigned shard)
+{
+    if(sharded == NULL || shard >= sharded->count)
+    {
+        return 0;
+    }
+
+    return __atomic_load_n(&sharded->shards[shard].frames, __ATOMIC_RELAXED);
+}
+
+void ShardedReactor_Free(ShardedReactor * sharded)
+{
+    unsigned i = 0;
+    size_t j = 0;
+
+    if(sharded == NULL)
+    {
+        return;
+    }
+
+    __atomic_store_n(&sharded->stop, 1, __ATOMIC_RELEASE);
+
+    for(i = 0; i < sharded->count; i++)
+    {
+        Shard * shard = &sharded->shards[i];
+
+        if(shard->started)
+        {
+            Reactor_Wake(shard->reactor);
+            pthread_join(shard->thread, NULL);
+        }
+
+        Reactor_Free(shard->reactor);
+    }
+
+    for(j = 0; j < sharded->deviceCount; j++)
+    {
+        free(sharded->devices[j]);
+    }
+
+    free(sharded->devices);
+    free(sharded->shards);
+
+    pthread_cond_destroy(&sharded->done);
+    pthread_mutex_destroy(&sharded->lock);
+    pthread_mutex_destroy(&sharded->control);
+
+    free(sharded);
+}
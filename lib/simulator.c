@@ -0,0 +1,548 @@
+#define _GNU_SOURCE
+
+#include "simulator.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <pty.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "serial.h"
+
+#define SIMULATOR_PATH_MAX      64
+#define SIMULATOR_NOISE_MAX     8
+
+/* Pavg follows Watts as a running average over about this many frames */
+#define SIMULATOR_PAVG_FRAMES   8
+
+#define INT24_MAX               0x7fffff
+#define INT24_MIN               (-0x800000)
+
+
+typedef struct
+{
+    SimulatorOptions options;
+    int master;
+    int slave;                  /* held open so the line stays up between readers */
+    char path[SIMULATOR_PATH_MAX];
+    uint64_t rng;
+    double phase;               /* fraction of a period */
+    uint64_t sequence;          /* frames generated */
+    double pavg;
+    double wattHours;
+    uint64_t deadline;          /* next slot, CLOCK_MONOTONIC ns */
+    SimulatorStats stats;       /* single writer, read with relaxed loads */
+} SimulatorMeter;
+
+struct _Simulator
+{
+    SimulatorMeter * meters;
+    size_t count;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int running;
+    int stop;
+};
+
+static uint64_t Now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+/* xorshift64*, plenty for picking faults and jitter */
+static uint32_t Random(SimulatorMeter * meter)
+{
+    meter->rng ^= meter->rng >> 12;
+    meter->rng ^= meter->rng << 25;
+    meter->rng ^= meter->rng >> 27;
+
+    return (uint32_t)((meter->rng * 0x2545f4914f6cdd1dull) >> 32);
+}
+
+/* [0, 1) */
+static float Uniform(SimulatorMeter * meter)
+{
+    return (Random(meter) >> 8) * (1.0f / 16777216.0f);
+}
+
+static int Chance(SimulatorMeter * meter, float rate)
+{
+    return rate > 0 && Uniform(meter) < rate;
+}
+
+static void Count(uint64_t * counter, uint64_t amount)
+{
+    __atomic_store_n(counter, *counter + amount, __ATOMIC_RELAXED);
+}
+
+static double Waveform(SimulatorMeter * meter, const SimulatorWaveform * waveform, double t)
+{
+    double value = waveform->Nominal;
+
+    if(waveform->Period > 0)
+    {
+        value += waveform->Amplitude * sin(2 * M_PI * (t / waveform->Period + meter->phase));
+    }
+
+    if(waveform->Noise > 0)
+    {
+        value += waveform->Noise * (2 * Uniform(meter) - 1);
+    }
+
+    return value;
+}
+
+static void NextValues(SimulatorMeter * meter, AutoReportValues * values)
+{
+    double interval = meter->options.IntervalUs / 1e6;
+    double t = meter->sequence * interval;
+    double vrms = Waveform(meter, &meter->options.Vrms, t);
+    double irms = Waveform(meter, &meter->options.Irms, t);
+    double pf = Waveform(meter, &meter->options.PF, t);
+    double freq = Waveform(meter, &meter->options.Freq, t);
+    double watts = 0;
+
+    pf = pf > 1 ? 1 : (pf < -1 ? -1 : pf);
+    watts = vrms * irms * pf;
+
+    meter->pavg = meter->sequence == 0 ? watts : meter->pavg + (watts - meter->pavg) / SIMULATOR_PAVG_FRAMES;
+    meter->wattHours += watts * interval / 3600;
+    meter->sequence++;
+
+    values->Vrms = (float)vrms;
+    values->Irms = (float)irms;
+    values->Watts = (float)watts;
+    values->Pavg = (float)meter->pavg;
+    values->PF = (float)pf;
+    values->Freq = (float)freq;
+    values->KwH = (float)(meter->wattHours / 1000);
+}
+
+static int32_t Scale(float value, float divisor)
+{
+    double raw = floor((double)value * divisor + 0.5);
+
+    if(raw > INT24_MAX)
+    {
+        return INT24_MAX;
+    }
+
+    return raw < INT24_MIN ? INT24_MIN : (int32_t)raw;
+}
+
+static void StoreInt24(uint8_t * ptr, int32_t value)
+{
+    ptr[0] = (uint8_t)value;
+    ptr[1] = (uint8_t)(value >> 8);
+    ptr[2] = (uint8_t)(value >> 16);
+}
+
+void Simulator_DefaultOptions(SimulatorOptions * options)
+{
+    memset(options, 0, sizeof(*options));
+
+    options->Vrms.Nominal = 230.0f;
+    options->Vrms.Amplitude = 4.0f;
+    options->Vrms.Period = 60.0f;
+    options->Vrms.Noise = 0.2f;
+
+    options->Irms.Nominal = 5.0f;
+    options->Irms.Amplitude = 2.0f;
+    options->Irms.Period = 300.0f;
+    options->Irms.Noise = 0.05f;
+
+    options->PF.Nominal = 0.95f;
+    options->PF.Amplitude = 0.03f;
+    options->PF.Period = 300.0f;
+
+    options->Freq.Nominal = 50.0f;
+    options->Freq.Amplitude = 0.05f;
+    options->Freq.Period = 900.0f;
+    options->Freq.Noise = 0.002f;
+
+    options->IntervalUs = 100000;
+    options->Seed = 1;
+}
+
+void Simulator_EncodeAutoReport(const AutoReportValues * values, uint8_t * frame)
+{
+    uint8_t * payload = frame + 2;
+
+    memset(frame, 0, AUTOREPORT_LENGTH);
+    frame[0] = AUTOREPORT_HEADER;
+    frame[1] = AUTOREPORT_LENGTH;
+
+    /* layout from 78m6610.h, the inverse of ConvertAutoReport() */
+    StoreInt24(payload + AUTOREPORT_VRMS_OFFSET, Scale(values->Vrms, AUTOREPORT_VRMS_DIVISOR));
+    StoreInt24(payload + AUTOREPORT_IRMS_OFFSET, Scale(values->Irms, AUTOREPORT_IRMS_DIVISOR));
+    StoreInt24(payload + AUTOREPORT_WATTS_OFFSET, Scale(values->Watts, AUTOREPORT_WATTS_DIVISOR));
+    StoreInt24(payload + AUTOREPORT_PAVG_OFFSET, Scale(values->Pavg, AUTOREPORT_PAVG_DIVISOR));
+    StoreInt24(payload + AUTOREPORT_PF_OFFSET, Scale(values->PF, AUTOREPORT_PF_DIVISOR));
+    StoreInt24(payload + AUTOREPORT_FREQ_OFFSET, Scale(values->Freq, AUTOREPORT_FREQ_DIVISOR));
+    /* the energy counter rolls over, StoreInt24() keeps the low 24 bits */
+    StoreInt24(payload + AUTOREPORT_KWH_OFFSET, (int32_t)(int64_t)floor(values->KwH * (double)AUTOREPORT_KWH_DIVISOR + 0.5));
+
+    frame[AUTOREPORT_LENGTH - 1] = FrameCheckSum(frame, AUTOREPORT_LENGTH - 1);
+}
+
+static int OpenMeter(SimulatorMeter * meter)
+{
+    struct termios tty;
+
+    if(openpty(&meter->master, &meter->slave, NULL, NULL, NULL) != 0)
+    {
+        return -errno;
+    }
+
+    if(ttyname_r(meter->slave, meter->path, sizeof(meter->path)) != 0)
+    {
+        return -ENAMETOOLONG;
+    }
+
+    /* raw, a meter's bytes must arrive untouched */
+    if(tcgetattr(meter->slave, &tty) == 0)
+    {
+        cfmakeraw(&tty);
+        tcsetattr(meter->slave, TCSANOW, &tty);
+    }
+
+    /* a full pty means the reader is behind, drop rather than stall every meter */
+    if(fcntl(meter->master, F_SETFL, fcntl(meter->master, F_GETFL) | O_NONBLOCK) != 0)
+    {
+        return -errno;
+    }
+
+    return 0;
+}
+
+Simulator * Simulator_New(size_t count, const SimulatorOptions * options)
+{
+    Simulator * simulator = NULL;
+    pthread_condattr_t attr;
+    size_t i = 0;
+
+    if(count == 0 || (options != NULL && options->IntervalUs == 0))
+    {
+        return NULL;
+    }
+
+    simulator = calloc(1, sizeof(*simulator));
+    if(simulator == NULL)
+    {
+        return NULL;
+    }
+
+    simulator->meters = calloc(count, sizeof(*simulator->meters));
+    if(simulator->meters == NULL)
+    {
+        free(simulator);
+        return NULL;
+    }
+
+    pthread_mutex_init(&simulator->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&simulator->wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    for(i = 0; i < count; i++)
+    {
+        SimulatorMeter * meter = &simulator->meters[i];
+
+        meter->master = -1;
+        meter->slave = -1;
+    }
+    simulator->count = count;
+
+    for(i = 0; i < count; i++)
+    {
+        SimulatorMeter * meter = &simulator->meters[i];
+
+        if(OpenMeter(meter) != 0)
+        {
+            Simulator_Free(simulator);
+            return NULL;
+        }
+
+        if(options != NULL)
+        {
+            meter->options = *options;
+        }
+        else
+        {
+            Simulator_DefaultOptions(&meter->options);
+        }
+
+        /* golden ratio steps keep the meters' phases apart for any count */
+        meter->phase = fmod(i * 0.6180339887498949, 1.0);
+        meter->rng = (meter->options.Seed + 1) * 0x9e3779b97f4a7c15ull + i;
+        meter->rng = meter->rng != 0 ? meter->rng : 1;
+    }
+
+    return simulator;
+}
+
+void Simulator_Free(Simulator * simulator)
+{
+    size_t i = 0;
+
+    if(simulator == NULL)
+    {
+        return;
+    }
+
+    Simulator_Stop(simulator);
+
+    for(i = 0; i < simulator->count; i++)
+    {
+        if(simulator->meters[i].master >= 0)
+        {
+            close(simulator->meters[i].master);
+        }
+        if(simulator->meters[i].slave >= 0)
+        {
+            close(simulator->meters[i].slave);
+        }
+    }
+
+    pthread_cond_destroy(&simulator->wake);
+    pthread_mutex_destroy(&simulator->lock);
+    free(simulator->meters);
+    free(simulator);
+}
+
+size_t Simulator_Count(Simulator * simulator)
+{
+    return simulator->count;
+}
+
+const char * Simulator_Path(Simulator * simulator, size_t meter)
+{
+    return meter < simulator->count ? simulator->meters[meter].path : NULL;
+}
+
+int Simulator_Configure(Simulator * simulator, size_t meter, const SimulatorOptions * options)
+{
+    if(meter >= simulator->count || options->IntervalUs == 0)
+    {
+        return -EINVAL;
+    }
+
+    if(simulator->running)
+    {
+        return -EBUSY;
+    }
+
+    simulator->meters[meter].options = *options;
+    return 0;
+}
+
+static int EmitFrame(SimulatorMeter * meter, AutoReportValues * values)
+{
+    uint8_t bytes[SIMULATOR_NOISE_MAX + AUTOREPORT_LENGTH];
+    uint8_t * frame = bytes + SIMULATOR_NOISE_MAX;
+    uint8_t * start = frame;
+    size_t length = AUTOREPORT_LENGTH;
+    AutoReportValues generated;
+    ssize_t written = 0;
+
+    NextValues(meter, &generated);
+    Simulator_EncodeAutoReport(&generated, frame);
+    Count(&meter->stats.Frames, 1);
+
+    if(Chance(meter, meter->options.NoiseRate))
+    {
+        size_t noise = 1 + Random(meter) % SIMULATOR_NOISE_MAX;
+
+        while(start > frame - noise)
+        {
+            *--start = (uint8_t)Random(meter);
+        }
+        length += noise;
+        Count(&meter->stats.Noise, 1);
+    }
+
+    if(Chance(meter, meter->options.CorruptRate))
+    {
+        frame[2 + Random(meter) % (AUTOREPORT_LENGTH - 2)] ^= (uint8_t)(1 << (Random(meter) & 7));
+        Count(&meter->stats.Corrupted, 1);
+    }
+
+    if(Chance(meter, meter->options.TruncateRate))
+    {
+        length -= 1 + Random(meter) % (AUTOREPORT_LENGTH - 1);
+        Count(&meter->stats.Truncated, 1);
+    }
+
+    if(values != NULL)
+    {
+        *values = generated;
+    }
+
+    written = write(meter->master, start, length);
+    if(written < 0)
+    {
+        int Result = -errno;
+
+        if(Result == -EAGAIN)
+        {
+            Count(&meter->stats.Dropped, 1);
+        }
+        return Result;
+    }
+
+    /* the tail did not fit, the reader sees a cut frame */
+    if((size_t)written < length)
+    {
+        Count(&meter->stats.Dropped, 1);
+        return -EAGAIN;
+    }
+
+    return 0;
+}
+
+int Simulator_Emit(Simulator * simulator, size_t meter, AutoReportValues * values)
+{
+    if(meter >= simulator->count)
+    {
+        return -EINVAL;
+    }
+
+    if(simulator->running)
+    {
+        return -EBUSY;
+    }
+
+    return EmitFrame(&simulator->meters[meter], values);
+}
+
+static void * SimulatorThread(void * arg)
+{
+    Simulator * simulator = arg;
+    uint64_t start = Now();
+    size_t i = 0;
+
+    for(i = 0; i < simulator->count; i++)
+    {
+        SimulatorMeter * meter = &simulator->meters[i];
+
+        meter->deadline = start + (uint64_t)meter->options.IntervalUs * 1000 * i / simulator->count;
+    }
+
+    pthread_mutex_lock(&simulator->lock);
+    while(!simulator->stop)
+    {
+        uint64_t now = 0;
+        uint64_t next = UINT64_MAX;
+
+        pthread_mutex_unlock(&simulator->lock);
+
+        now = Now();
+        for(i = 0; i < simulator->count; i++)
+        {
+            SimulatorMeter * meter = &simulator->meters[i];
+            uint64_t interval = (uint64_t)meter->options.IntervalUs * 1000;
+
+            if(meter->deadline <= now)
+            {
+                uint64_t late = (now - meter->deadline) / 1000;
+
+                if(late > meter->stats.MaxLateUs)
+                {
+                    __atomic_store_n(&meter->stats.MaxLateUs, late, __ATOMIC_RELAXED);
+                }
+
+                EmitFrame(meter, NULL);
+
+                /* a meter keeps its own clock, slots missed by a stall are skipped */
+                meter->deadline += interval;
+                if(meter->deadline <= now)
+                {
+                    meter->deadline += (now - meter->deadline) / interval * interval + interval;
+                }
+            }
+
+            next = meter->deadline < next ? meter->deadline : next;
+        }
+
+        pthread_mutex_lock(&simulator->lock);
+        if(!simulator->stop && next > Now())
+        {
+            struct timespec deadline;
+
+            deadline.tv_sec = next / 1000000000ull;
+            deadline.tv_nsec = next % 1000000000ull;
+            pthread_cond_timedwait(&simulator->wake, &simulator->lock, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&simulator->lock);
+
+    return NULL;
+}
+
+int Simulator_Start(Simulator * simulator)
+{
+    int Result = 0;
+
+    if(simulator->running)
+    {
+        return -EALREADY;
+    }
+
+    simulator->stop = 0;
+    Result = pthread_create(&simulator->thread, NULL, SimulatorThread, simulator);
+    if(Result != 0)
+    {
+        return -Result;
+    }
+
+    simulator->running = 1;
+    return 0;
+}
+
+void Simulator_Stop(Simulator * simulator)
+{
+    if(!simulator->running)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&simulator->lock);
+    simulator->stop = 1;
+    pthread_cond_signal(&simulator->wake);
+    pthread_mutex_unlock(&simulator->lock);
+
+    pthread_join(simulator->thread, NULL);
+    simulator->running = 0;
+}
+
+void Simulator_GetStats(Simulator * simulator, SimulatorStats * stats)
+{
+    size_t i = 0;
+
+    memset(stats, 0, sizeof(*stats));
+
+    for(i = 0; i < simulator->count; i++)
+    {
+        SimulatorStats * meter = &simulator->meters[i].stats;
+        uint64_t late = __atomic_load_n(&meter->MaxLateUs, __ATOMIC_RELAXED);
+
+        stats->Frames += __atomic_load_n(&meter->Frames, __ATOMIC_RELAXED);
+        stats->Noise += __atomic_load_n(&meter->Noise, __ATOMIC_RELAXED);
+        stats->Corrupted += __atomic_load_n(&meter->Corrupted, __ATOMIC_RELAXED);
+        stats->Truncated += __atomic_load_n(&meter->Truncated, __ATOMIC_RELAXED);
+        stats->Dropped += __atomic_load_n(&meter->Dropped, __ATOMIC_RELAXED);
+        stats->MaxLateUs = late > stats->MaxLateUs ? late : stats->MaxLateUs;
+    }
+}
@@ -0,0 +1,474 @@
+#include "timeseries.h"
+
+#include <endian.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_RESOLUTION_NS       1000000000u
+
+/* Worst case: a raw timestamp and every field with a new 24 bit width */
+#define MAX_SAMPLE_BITS         (4 + 64 + AUTOREPORT_FIELD_COUNT * (2 + 5 + 8 * AUTOREPORT_FIELD_WIDTH))
+
+/* A field narrower than its width by this much resets the width */
+#define WINDOW_SLACK            6
+
+/* The bit reader loads 8 bytes at a time */
+#define BLOCK_PADDING           8
+
+typedef struct
+{
+    uint64_t first;                         /* timestamps in resolution units */
+    uint64_t last;
+    uint32_t count;
+    uint32_t bits;                          /* used of data */
+    int32_t fields[AUTOREPORT_FIELD_COUNT]; /* of the first sample, the rest follow coded */
+    uint8_t data[];
+} TimeSeriesBlock;
+
+/* Where encoder or decoder stand after a sample */
+typedef struct
+{
+    uint64_t timestamp;
+    uint64_t delta;
+    int32_t fields[AUTOREPORT_FIELD_COUNT];
+    uint8_t windows[AUTOREPORT_FIELD_COUNT]; /* bit width of the last field change */
+} TimeSeriesState;
+
+struct _TimeSeries
+{
+    uint64_t resolution;
+    size_t blockSize;
+    TimeSeriesBlock ** blocks;
+    size_t blockCount;
+    size_t blockCapacity;
+    size_t count;
+    int started;
+    TimeSeriesState writer;
+};
+
+static int32_t SignExtend24(uint32_t value)
+{
+    return (int32_t)(value << 8) >> 8;
+}
+
+/* Vrms to KwH, 24 bit little endian fields of the AutoReport layout */
+static void ReadFields(const AutoReportMessage * message, int32_t * fields)
+{
+    size_t i = 0;
+
+    for(i = 0; i < AUTOREPORT_FIELD_COUNT; i++)
+    {
+        const uint8_t * ptr = (const uint8_t *)message + AUTOREPORT_FIELD_OFFSET(i);
+
+        fields[i] = SignExtend24((uint32_t)ptr[0] | ((uint32_t)ptr[1] << 8) | ((uint32_t)ptr[2] << 16));
+    }
+}
+
+static void Convert(const int32_t * fields, AutoReportValues * values)
+{
+    uint8_t payload[AUTOREPORT_PAYLOAD_SIZE] = {0};
+    size_t i = 0;
+
+    for(i = 0; i < AUTOREPORT_FIELD_COUNT; i++)
+    {
+        uint8_t * ptr = payload + AUTOREPORT_FIELD_OFFSET(i);
+
+        ptr[0] = (uint8_t)fields[i];
+        ptr[1] = (uint8_t)(fields[i] >> 8);
+        ptr[2] = (uint8_t)(fields[i] >> 16);
+    }
+
+    ConvertAutoReport((const AutoReportMessage *)payload, values);
+}
+
+/* Bits are packed most significant first, data is zeroed and padded */
+static void PutBits(uint8_t * data, uint32_t * position, uint64_t value, unsigned int count)
+{
+    uint8_t * ptr = data + (*position >> 3);
+    uint64_t word = 0;
+
+    memcpy(&word, ptr, sizeof(word));
+    word = be64toh(word) | (value << (64 - (*position & 7) - count));
+    word = htobe64(word);
+    memcpy(ptr, &word, sizeof(word));
+
+    *position += count;
+}
+
+/* count is 1 to 57 */
+static uint64_t PeekBits(const uint8_t * data, uint32_t position, unsigned int count)
+{
+    uint64_t word = 0;
+
+    memcpy(&word, data + (position >> 3), sizeof(word));
+
+    return (be64toh(word) << (position & 7)) >> (64 - count);
+}
+
+static uint64_t GetBits(const uint8_t * data, uint32_t * position, unsigned int count)
+{
+    uint64_t value = PeekBits(data, *position, count);
+
+    *position += count;
+
+    return value;
+}
+
+static unsigned int Width(uint32_t value)
+{
+    return 32 - (unsigned int)__builtin_clz(value);
+}
+
+/*
+ * Interval changes: 0 is '0', then '10', '110' and '1110' with 4, 8 and 12
+ * bits of zigzag value, anything else '1111' and 64 bits. A few units of
+ * jitter, the common case, take 6 bits.
+ */
+static void PutTimestamp(uint8_t * data, uint32_t * position, int64_t change)
+{
+    uint64_t zigzag = ((uint64_t)change << 1) ^ (uint64_t)(change >> 63);
+
+    if(zigzag == 0)
+    {
+        PutBits(data, position, 0, 1);
+    }
+    else if(zigzag < (1u << 4))
+    {
+        PutBits(data, position, (0x2u << 4) | zigzag, 2 + 4);
+    }
+    else if(zigzag < (1u << 8))
+    {
+        PutBits(data, position, (0x6u << 8) | zigzag, 3 + 8);
+    }
+    else if(zigzag < (1u << 12))
+    {
+        PutBits(data, position, (0xeu << 12) | zigzag, 4 + 12);
+    }
+    else
+    {
+        PutBits(data, position, 0xf, 4);
+        PutBits(data, position, zigzag >> 32, 32);
+        PutBits(data, position, zigzag & 0xffffffffu, 32);
+    }
+}
+
+static int64_t GetTimestamp(const uint8_t * data, uint32_t * position)
+{
+    uint64_t prefix = PeekBits(data, *position, 4);
+    uint64_t zigzag = 0;
+
+    if(prefix < 0x8)
+    {
+        *position += 1;
+        return 0;
+    }
+    else if(prefix < 0xc)
+    {
+        *position += 2;
+        zigzag = GetBits(data, position, 4);
+    }
+    else if(prefix < 0xe)
+    {
+        *position += 3;
+        zigzag = GetBits(data, position, 8);
+    }
+    else if(prefix == 0xe)
+    {
+        *position += 4;
+        zigzag = GetBits(data, position, 12);
+    }
+    else
+    {
+        *position += 4;
+        zigzag = GetBits(data, position, 32) << 32;
+        zigzag |= GetBits(data, position, 32);
+    }
+
+    return (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+}
+
+/*
+ * Field changes, modulo 2^24: 0 is '0', '10' and the zigzag value in the
+ * width of the previous change when it fits without wasting too much,
+ * otherwise '11', the new width less one in 5 bits and the value.
+ */
+static void PutField(uint8_t * data, uint32_t * position, TimeSeriesState * state, size_t i, int32_t field)
+{
+    int32_t change = SignExtend24((uint32_t)field - (uint32_t)state->fields[i]);
+    uint32_t zigzag = ((uint32_t)change << 1) ^ (uint32_t)(change >> 31);
+    unsigned int width = 0;
+
+    state->fields[i] = field;
+
+    if(zigzag == 0)
+    {
+        PutBits(data, position, 0, 1);
+        return;
+    }
+
+    width = Width(zigzag);
+    if(width <= state->windows[i] && state->windows[i] - width < WINDOW_SLACK)
+    {
+        PutBits(data, position, (0x2ull << state->windows[i]) | zigzag, 2 + state->windows[i]);
+    }
+    else
+    {
+        PutBits(data, position, (((0x3ull << 5) | (width - 1)) << width) | zigzag, 2 + 5 + width);
+        state->windows[i] = (uint8_t)width;
+    }
+}
+
+static void GetField(const uint8_t * data, uint32_t * position, TimeSeriesState * state, size_t i)
+{
+    uint64_t prefix = PeekBits(data, *position, 2);
+    uint32_t zigzag = 0;
+
+    if(prefix < 0x2)
+    {
+        *position += 1;
+        return;
+    }
+
+    *position += 2;
+    if(prefix == 0x3)
+    {
+        state->windows[i] = (uint8_t)(GetBits(data, position, 5) + 1);
+    }
+    zigzag = (uint32_t)GetBits(data, position, state->windows[i]);
+
+    state->fields[i] = SignExtend24((uint32_t)state->fields[i] + ((zigzag >> 1) ^ -(zigzag & 1)));
+}
+
+static TimeSeriesBlock * NewBlock(TimeSeries * series, uint64_t timestamp, const int32_t * fields)
+{
+    TimeSeriesBlock * block = NULL;
+
+    if(series->blockCount == series->blockCapacity)
+    {
+        size_t capacity = (series->blockCapacity != 0) ? series->blockCapacity * 2 : 16;
+        TimeSeriesBlock ** blocks = realloc(series->blocks, capacity * sizeof(*blocks));
+
+        if(blocks == NULL)
+        {
+            return NULL;
+        }
+        series->blocks = blocks;
+        series->blockCapacity = capacity;
+    }
+
+    block = calloc(1, sizeof(*block) + series->blockSize + BLOCK_PADDING);
+    if(block == NULL)
+    {
+        return NULL;
+    }
+
+    block->first = timestamp;
+    block->last = timestamp;
+    block->count = 1;
+    memcpy(block->fields, fields, sizeof(block->fields));
+
+    series->blocks[series->blockCount++] = block;
+
+    return block;
+}
+
+TimeSeries * TimeSeries_New(uint32_t resolutionNs, size_t blockSize)
+{
+    TimeSeries * series = NULL;
+
+    resolutionNs = (resolutionNs != 0) ? resolutionNs : TIMESERIES_DEFAULT_RESOLUTION_NS;
+    blockSize = (blockSize != 0) ? blockSize : TIMESERIES_DEFAULT_BLOCK_SIZE;
+
+    if(resolutionNs > MAX_RESOLUTION_NS || blockSize < TIMESERIES_MIN_BLOCK_SIZE || blockSize > UINT32_MAX / 8)
+    {
+        return NULL;
+    }
+
+    series = calloc(1, sizeof(*series));
+    if(series == NULL)
+    {
+        return NULL;
+    }
+
+    series->resolution = resolutionNs;
+    series->blockSize = blockSize;
+
+    return series;
+}
+
+int TimeSeries_Append(TimeSeries * series, uint64_t timestamp, const AutoReportMessage * message)
+{
+    TimeSeriesState * writer = NULL;
+    TimeSeriesBlock * block = NULL;
+    int32_t fields[AUTOREPORT_FIELD_COUNT];
+    uint64_t delta = 0;
+    size_t i = 0;
+
+    if(series == NULL || message == NULL)
+    {
+        return -EINVAL;
+    }
+
+    writer = &series->writer;
+    timestamp /= series->resolution;
+    if(series->started && timestamp < writer->timestamp)
+    {
+        return -ERANGE;
+    }
+
+    ReadFields(message, fields);
+
+    block = (series->blockCount != 0) ? series->blocks[series->blockCount - 1] : NULL;
+    if(block == NULL || block->bits + MAX_SAMPLE_BITS > series->blockSize * 8 || block->count == UINT32_MAX)
+    {
+        if(NewBlock(series, timestamp, fields) == NULL)
+        {
+            return -ENOMEM;
+        }
+
+        /* every block decodes on its own */
+        memset(writer, 0, sizeof(*writer));
+        writer->timestamp = timestamp;
+        memcpy(writer->fields, fields, sizeof(writer->fields));
+    }
+    else
+    {
+        delta = timestamp - writer->timestamp;
+        PutTimestamp(block->data, &block->bits, (int64_t)(delta - writer->delta));
+        writer->timestamp = timestamp;
+        writer->delta = delta;
+
+        for(i = 0; i < AUTOREPORT_FIELD_COUNT; i++)
+        {
+            PutField(block->data, &block->bits, writer, i, fields[i]);
+        }
+
+        block->last = timestamp;
+        block->count++;
+    }
+
+    series->started = 1;
+    series->count++;
+
+    return 0;
+}
+
+int TimeSeries_Query(TimeSeries * series, uint64_t from, uint64_t to, TimeSeriesCallback callback, void * context)
+{
+    AutoReportValues values;
+    int found = 0;
+    size_t b = 0;
+
+    if(series == NULL || callback == NULL)
+    {
+        return -EINVAL;
+    }
+
+    for(b = 0; b < series->blockCount; b++)
+    {
+        const TimeSeriesBlock * block = series->blocks[b];
+        TimeSeriesState state;
+        uint32_t position = 0;
+        uint32_t k = 0;
+        size_t i = 0;
+
+        if(block->last * series->resolution < from)
+        {
+            continue;
+        }
+        if(block->first * series->resolution >= to)
+        {
+            break;
+        }
+
+        memset(&state, 0, sizeof(state));
+        state.timestamp = block->first;
+        memcpy(state.fields, block->fields, sizeof(state.fields));
+
+        for(k = 0; k < block->count; k++)
+        {
+            uint64_t timestamp = 0;
+
+            if(k != 0)
+            {
+                state.delta += (uint64_t)GetTimestamp(block->data, &position);
+                state.timestamp += state.delta;
+
+                for(i = 0; i < AUTOREPORT_FIELD_COUNT; i++)
+                {
+                    GetField(block->data, &position, &state, i);
+                }
+            }
+
+            timestamp = state.timestamp * series->resolution;
+            if(timestamp >= to)
+            {
+                return found;
+            }
+            if(timestamp >= from)
+            {
+                Convert(state.fields, &values);
+                callback(context, timestamp, &values);
+                found++;
+            }
+        }
+    }
+
+    return found;
+}
+
+int TimeSeries_DropBefore(TimeSeries * series, uint64_t timestamp)
+{
+    int dropped = 0;
+    size_t b = 0;
+
+    if(series == NULL)
+    {
+        return -EINVAL;
+    }
+
+    for(b = 0; b < series->blockCount && series->blocks[b]->last * series->resolution < timestamp; b++)
+    {
+        dropped += (int)series->blocks[b]->count;
+        free(series->blocks[b]);
+    }
+
+    /* with the block being written gone, the next sample starts a new one */
+    memmove(series->blocks, series->blocks + b, (series->blockCount - b) * sizeof(*series->blocks));
+    series->blockCount -= b;
+    series->count -= (size_t)dropped;
+
+    return dropped;
+}
+
+size_t TimeSeries_Count(TimeSeries * series)
+{
+    return (series != NULL) ? series->count : 0;
+}
+
+size_t TimeSeries_MemoryUsage(TimeSeries * series)
+{
+    if(series == NULL)
+    {
+        return 0;
+    }
+
+    return sizeof(*series) + series->blockCapacity * sizeof(*series->blocks)
+           + series->blockCount * (sizeof(TimeSeriesBlock) + series->blockSize + BLOCK_PADDING);
+}
+
+void TimeSeries_Free(TimeSeries * series)
+{
+    size_t b = 0;
+
+    if(series != NULL)
+    {
+        for(b = 0; b < series->blockCount; b++)
+        {
+            free(series->blocks[b]);
+        }
+        free(series->blocks);
+        free(series);
+    }
+}
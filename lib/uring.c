@@ -0,0 +1,463 @@
+#define _GNU_SOURCE
+
+#include "uring.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#ifdef MONIP_HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+#if defined(MONIP_HAVE_IO_URING) && defined(__NR_io_uring_setup)
+
+/* Newer than some installed headers */
+#define URING_OP_READ_MULTISHOT     49
+#define URING_REGISTER_PBUF_RING    22
+#define URING_BUFFER_GROUP          0
+
+static int Enter(Uring * ring, unsigned submit, unsigned wait, unsigned flags, const void * arg, size_t argSize)
+{
+    int ret = (int)syscall(__NR_io_uring_enter, ring->fd, submit, wait, flags, arg, argSize);
+
+    if(ret < 0)
+    {
+        return -errno;
+    }
+
+    /* the kernel consumed ret SQEs, the rest stay queued */
+    ring->queued -= ((unsigned)ret < submit) ? (unsigned)ret : submit;
+
+    return 0;
+}
+
+int Uring_Init(Uring * ring, unsigned sqEntries, unsigned cqEntries)
+{
+    struct io_uring_params params;
+    const unsigned needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    size_t sqSize = 0;
+    size_t cqSize = 0;
+    uint8_t * rings = NULL;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+
+    /*
+     * Completions are run when the owner waits rather than interrupting it
+     * (Linux 6.1), which batches them. The owner is whoever enables the ring.
+     */
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED;
+    params.cq_entries = cqEntries;
+
+    ring->fd = (int)syscall(__NR_io_uring_setup, sqEntries, &params);
+
+    if(ring->fd < 0 && errno == EINVAL)
+    {
+        params.flags = IORING_SETUP_CQSIZE;
+        ring->fd = (int)syscall(__NR_io_uring_setup, sqEntries, &params);
+    }
+
+    if(ring->fd < 0)
+    {
+        ring->fd = -1;
+        return -errno;
+    }
+
+    ring->disabled = (params.flags & IORING_SETUP_R_DISABLED) != 0;
+
+    if((params.features & needed) != needed)
+    {
+        Uring_Deinit(ring);
+        return -EOPNOTSUPP;
+    }
+
+    sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ringsSize = (sqSize > cqSize) ? sqSize : cqSize;
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->rings = mmap(NULL, ring->ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+    if(ring->rings == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        int Result = -errno;
+
+        Uring_Deinit(ring);
+        return Result;
+    }
+
+    rings = ring->rings;
+    ring->sqHead = (unsigned *)(rings + params.sq_off.head);
+    ring->sqTail = (unsigned *)(rings + params.sq_off.tail);
+    ring->sqMask = (unsigned *)(rings + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *)(rings + params.sq_off.array);
+    ring->sqEntries = params.sq_entries;
+    ring->cqHead = (unsigned *)(rings + params.cq_off.head);
+    ring->cqTail = (unsigned *)(rings + params.cq_off.tail);
+    ring->cqMask = (unsigned *)(rings + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(rings + params.cq_off.cqes);
+
+    return 0;
+}
+
+void Uring_Deinit(Uring * ring)
+{
+    if(ring->buffers != NULL)
+    {
+        munmap(ring->buffers, ring->buffersSize);
+    }
+
+    if(ring->sqes != NULL && ring->sqes != MAP_FAILED)
+    {
+        munmap(ring->sqes, ring->sqesSize);
+    }
+
+    if(ring->rings != NULL && ring->rings != MAP_FAILED)
+    {
+        munmap(ring->rings, ring->ringsSize);
+    }
+
+    /* closing the ring cancels whatever is still in flight */
+    if(ring->fd >= 0)
+    {
+        close(ring->fd);
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+int Uring_RegisterBuffer(Uring * ring, void * buffer, size_t size)
+{
+    struct iovec iov;
+
+    iov.iov_base = buffer;
+    iov.iov_len = size;
+
+    if(syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+    {
+        return -errno;
+    }
+
+    return 0;
+}
+
+static int Supports(Uring * ring, unsigned op)
+{
+    uint8_t storage[sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op)];
+    struct io_uring_probe * probe = (struct io_uring_probe *)storage;
+
+    memset(storage, 0, sizeof(storage));
+
+    if(syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+    {
+        return 0;
+    }
+
+    return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+}
+
+int Uring_SetupMultishot(Uring * ring, void * base, unsigned count, unsigned length)
+{
+    struct io_uring_buf_reg reg;
+    unsigned i = 0;
+
+    if(!Supports(ring, URING_OP_READ_MULTISHOT) || (count & (count - 1)) != 0 || count > 32768)
+    {
+        return -EOPNOTSUPP;
+    }
+
+    ring->buffersSize = count * sizeof(struct io_uring_buf);
+    ring->buffers = mmap(NULL, ring->buffersSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(ring->buffers == MAP_FAILED)
+    {
+        ring->buffers = NULL;
+        return -ENOMEM;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring->buffers;
+    reg.ring_entries = count;
+    reg.bgid = URING_BUFFER_GROUP;
+
+    if(syscall(__NR_io_uring_register, ring->fd, URING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        int Result = -errno;
+
+        munmap(ring->buffers, ring->buffersSize);
+        ring->buffers = NULL;
+        return Result;
+    }
+
+    ring->bufferBase = base;
+    ring->bufferCount = count;
+    ring->bufferLength = length;
+
+    for(i = 0; i < count; i++)
+    {
+        Uring_ReturnBuffer(ring, (int)i);
+    }
+
+    return 0;
+}
+
+void Uring_ReturnBuffer(Uring * ring, int buffer)
+{
+    /* the tail shares the first entry's reserved field */
+    uint16_t tail = ring->buffers->tail;
+    struct io_uring_buf * entry = &ring->buffers->bufs[tail & (ring->bufferCount - 1)];
+
+    entry->addr = (uint64_t)(uintptr_t)(ring->bufferBase + (size_t)buffer * ring->bufferLength);
+    entry->len = ring->bufferLength;
+    entry->bid = (uint16_t)buffer;
+
+    __atomic_store_n(&ring->buffers->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
+
+uint8_t * Uring_Buffer(Uring * ring, int buffer)
+{
+    return ring->bufferBase + (size_t)buffer * ring->bufferLength;
+}
+
+static struct io_uring_sqe * GetSQE(Uring * ring)
+{
+    unsigned tail = *ring->sqTail;
+    struct io_uring_sqe * sqe = NULL;
+
+    if(tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) >= ring->sqEntries)
+    {
+        if(ring->disabled || Enter(ring, ring->queued, 0, 0, NULL, 0) != 0
+           || tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) >= ring->sqEntries)
+        {
+            return NULL;
+        }
+    }
+
+    sqe = &ring->sqes[tail & *ring->sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+
+    ring->sqArray[tail & *ring->sqMask] = tail & *ring->sqMask;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->queued++;
+
+    return sqe;
+}
+
+int Uring_Read(Uring * ring, int fd, void * buffer, unsigned size, int fixed, uint64_t tag)
+{
+    struct io_uring_sqe * sqe = GetSQE(ring);
+
+    if(sqe == NULL)
+    {
+        return -EBUSY;
+    }
+
+    sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = size;
+    sqe->off = (uint64_t)-1;        /* current position, ttys have none */
+    sqe->user_data = tag;
+
+    return 0;
+}
+
+int Uring_ReadMultishot(Uring * ring, int fd, uint64_t tag)
+{
+    struct io_uring_sqe * sqe = GetSQE(ring);
+
+    if(sqe == NULL)
+    {
+        return -EBUSY;
+    }
+
+    sqe->opcode = URING_OP_READ_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->fd = fd;
+    sqe->off = (uint64_t)-1;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = tag;
+
+    return 0;
+}
+
+int Uring_Poll(Uring * ring, int fd, unsigned events, int multishot, uint64_t tag)
+{
+    struct io_uring_sqe * sqe = GetSQE(ring);
+
+    if(sqe == NULL)
+    {
+        return -EBUSY;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->len = multishot ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = tag;
+
+    return 0;
+}
+
+int Uring_Cancel(Uring * ring, uint64_t target, uint64_t tag)
+{
+    struct io_uring_sqe * sqe = GetSQE(ring);
+
+    if(sqe == NULL)
+    {
+        return -EBUSY;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = tag;
+
+    return 0;
+}
+
+int Uring_Enable(Uring * ring)
+{
+    if(ring->disabled)
+    {
+        if(syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_ENABLE_RINGS, NULL, 0) < 0)
+        {
+            return -errno;
+        }
+
+        ring->disabled = 0;
+    }
+
+    return 0;
+}
+
+int Uring_Wait(Uring * ring, int timeoutMs)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec timeout;
+    unsigned wait = 1;
+
+    int Result = Uring_Enable(ring);
+
+    if(Result != 0)
+    {
+        return Result;
+    }
+
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+
+    if(timeoutMs >= 0)
+    {
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = (long long)(timeoutMs % 1000) * 1000000;
+        arg.ts = (uint64_t)(uintptr_t)&timeout;
+    }
+
+    /* completions already waiting, only submit */
+    if(*ring->cqHead != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE))
+    {
+        wait = 0;
+    }
+
+    return Enter(ring, ring->queued, wait, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+int Uring_Reap(Uring * ring, uint64_t * tag, int * res, int * more, int * buffer)
+{
+    unsigned head = *ring->cqHead;
+    const struct io_uring_cqe * cqe = NULL;
+
+    if(head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE))
+    {
+        return 0;
+    }
+
+    cqe = &ring->cqes[head & *ring->cqMask];
+    *tag = cqe->user_data;
+    *res = cqe->res;
+    *more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+    *buffer = (cqe->flags & IORING_CQE_F_BUFFER) ? (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+
+    __atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+#else
+
+int Uring_Init(Uring * ring, unsigned sqEntries, unsigned cqEntries)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    return -ENOSYS;
+}
+
+void Uring_Deinit(Uring * ring)
+{
+}
+
+int Uring_RegisterBuffer(Uring * ring, void * buffer, size_t size)
+{
+    return -ENOSYS;
+}
+
+int Uring_SetupMultishot(Uring * ring, void * base, unsigned count, unsigned length)
+{
+    return -ENOSYS;
+}
+
+void Uring_ReturnBuffer(Uring * ring, int buffer)
+{
+}
+
+uint8_t * Uring_Buffer(Uring * ring, int buffer)
+{
+    return NULL;
+}
+
+int Uring_Read(Uring * ring, int fd, void * buffer, unsigned size, int fixed, uint64_t tag)
+{
+    return -ENOSYS;
+}
+
+int Uring_ReadMultishot(Uring * ring, int fd, uint64_t tag)
+{
+    return -ENOSYS;
+}
+
+int Uring_Poll(Uring * ring, int fd, unsigned events, int multishot, uint64_t tag)
+{
+    return -ENOSYS;
+}
+
+int Uring_Cancel(Uring * ring, uint64_t target, uint64_t tag)
+{
+    return -ENOSYS;
+}
+
+int Uring_Enable(Uring * ring)
+{
+    return -ENOSYS;
+}
+
+int Uring_Wait(Uring * ring, int timeoutMs)
+{
+    return -ENOSYS;
+}
+
+int Uring_Reap(Uring * ring, uint64_t * tag, int * res, int * more, int * buffer)
+{
+    return 0;
+}
+
+#endif
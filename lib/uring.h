@@ -0,0 +1,110 @@
+#ifndef URING_H_
+#define URING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Minimal io_uring ring on the raw system calls, private to the library.
+ * Only what the reactor needs: one thread submits and reaps, SQEs are
+ * batched and handed to the kernel with the next wait, so a loop iteration
+ * costs one io_uring_enter() however many reads it re-arms.
+ *
+ * Without <linux/io_uring.h> at build time Uring_Init() fails with -ENOSYS
+ * and callers fall back to epoll.
+ */
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define MONIP_HAVE_IO_URING 1
+#endif
+#endif
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+typedef struct
+{
+    int fd;
+    unsigned * sqHead;
+    unsigned * sqTail;
+    unsigned * sqMask;
+    unsigned * sqArray;
+    unsigned sqEntries;
+    unsigned * cqHead;
+    unsigned * cqTail;
+    unsigned * cqMask;
+    struct io_uring_sqe * sqes;
+    struct io_uring_cqe * cqes;
+    void * rings;
+    size_t ringsSize;
+    size_t sqesSize;
+    unsigned queued;                /* SQEs filled in, not yet submitted */
+    int disabled;                   /* until Uring_Enable(), see Uring_Init() */
+    struct io_uring_buf_ring * buffers; /* provided buffers, group 0 */
+    size_t buffersSize;
+    uint8_t * bufferBase;
+    unsigned bufferCount;
+    unsigned bufferLength;
+} Uring;
+
+/*
+ * 0 or -errno. Fails with -EOPNOTSUPP on kernels that lack what the reactor
+ * relies on (single mmap, timed waits, no dropped completions). The thread
+ * that calls Uring_Enable() (or the first Uring_Wait()) owns the ring: only
+ * it may submit and wait from then on. Until then at most sqEntries
+ * requests can be queued.
+ */
+int Uring_Init(Uring * ring, unsigned sqEntries, unsigned cqEntries);
+void Uring_Deinit(Uring * ring);
+
+/* Register [buffer, buffer + size) as fixed buffer 0 for READ_FIXED */
+int Uring_RegisterBuffer(Uring * ring, void * buffer, size_t size);
+
+/*
+ * Multishot reads (Linux 6.7): one request stays armed per fd and every
+ * chunk of input completes into one of count provided buffers of length
+ * bytes carved from base (count a power of two). Fails with -EOPNOTSUPP
+ * when the kernel lacks them. Hand each buffer back with
+ * Uring_ReturnBuffer() once its bytes are consumed.
+ */
+int Uring_SetupMultishot(Uring * ring, void * base, unsigned count, unsigned length);
+void Uring_ReturnBuffer(Uring * ring, int buffer);
+
+/*
+ * Queue requests, sent with the next Uring_Wait(). tag comes back with the
+ * completion. Read uses fixed buffer 0 when fixed is set. Return 0 or
+ * -EBUSY when the submission queue cannot be emptied.
+ */
+int Uring_Read(Uring * ring, int fd, void * buffer, unsigned size, int fixed, uint64_t tag);
+int Uring_ReadMultishot(Uring * ring, int fd, uint64_t tag);
+int Uring_Poll(Uring * ring, int fd, unsigned events, int multishot, uint64_t tag);
+int Uring_Cancel(Uring * ring, uint64_t target, uint64_t tag);
+
+int Uring_Enable(Uring * ring);
+
+/*
+ * Submit what is queued and wait up to timeoutMs (-1 forever) for a
+ * completion. Returns 0, -ETIME on timeout, -EINTR or -errno.
+ */
+int Uring_Wait(Uring * ring, int timeoutMs);
+
+/*
+ * Take the oldest completion, returns 0 when there is none. more is set
+ * while a multishot request stays armed, buffer is the provided buffer
+ * holding the data or -1.
+ */
+int Uring_Reap(Uring * ring, uint64_t * tag, int * res, int * more, int * buffer);
+
+/* Start of a provided buffer */
+uint8_t * Uring_Buffer(Uring * ring, int buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* URING_H_ */
@@ -0,0 +1,52 @@
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "ptypair.h"
+
+namespace PFC
+{
+
+	PtyPair::PtyPair() : master(-1), slave(-1) {}
+
+	PtyPair::~PtyPair()
+	{
+		Close();
+	}
+
+	bool PtyPair::Open()
+	{
+		struct termios tty;
+		char name[256] = {0};
+
+		if (openpty(&master, &slave, name, NULL, NULL) != 0)
+		{
+			return false;
+		}
+
+		// raw, as socat's pty,raw,echo=0 does
+		if (tcgetattr(slave, &tty) == 0)
+		{
+			cfmakeraw(&tty);
+			tcsetattr(slave, TCSANOW, &tty);
+		}
+
+		path = name;
+		return true;
+	}
+
+	void PtyPair::Close()
+	{
+		if (master >= 0)
+		{
+			close(master);
+			master = -1;
+		}
+		if (slave >= 0)
+		{
+			close(slave);
+			slave = -1;
+		}
+	}
+
+} //namespace PFC
@@ -0,0 +1,25 @@
+#ifndef SRC_TESTS_SUPPORT_PTYPAIR_H_
+#define SRC_TESTS_SUPPORT_PTYPAIR_H_
+
+#include <string>
+
+namespace PFC
+{
+
+	// A pseudo terminal pair: tests write to master, the library opens path
+	struct PtyPair
+	{
+		int master;
+		int slave;
+		std::string path;
+
+		PtyPair();
+		~PtyPair();
+
+		bool Open();
+		void Close();
+	};
+
+} //namespace PFC
+
+#endif /* SRC_TESTS_SUPPORT_PTYPAIR_H_ */
@@ -0,0 +1,46 @@
+#include <fstream>
+#include <string>
+#include <cstdlib>
+
+#include "serial_data.h"
+
+namespace PFC
+{
+
+	std::vector<Frame> LoadSerialData(const std::string &path)
+	{
+		std::vector<Frame> frames;
+		std::ifstream file(path.c_str());
+		std::string line;
+
+		while (std::getline(file, line))
+		{
+			Frame frame;
+
+			for (std::size_t pos = 0; pos + 1 < line.size(); pos += 2)
+			{
+				frame.push_back((uint8_t)std::strtoul(line.substr(pos, 2).c_str(), NULL, 16));
+			}
+
+			if (frame.size() > 2)
+			{
+				frames.push_back(frame);
+			}
+		}
+
+		return frames;
+	}
+
+	std::vector<uint8_t> SerialDataPayloads(const std::vector<Frame> &frames)
+	{
+		std::vector<uint8_t> payloads;
+
+		for (auto it = frames.begin(); it != frames.end(); ++it)
+		{
+			payloads.insert(payloads.end(), it->begin() + 2, it->end());
+		}
+
+		return payloads;
+	}
+
+} //namespace PFC
@@ -0,0 +1,21 @@
+#ifndef SRC_TESTS_SUPPORT_SERIAL_DATA_H_
+#define SRC_TESTS_SUPPORT_SERIAL_DATA_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace PFC
+{
+
+	typedef std::vector<uint8_t> Frame;
+
+	// Load the hex-per-line frame log, e.g. tests/serial_data.txt
+	std::vector<Frame> LoadSerialData(const std::string &path);
+
+	// Concatenate the payloads (header and length stripped) of all frames
+	std::vector<uint8_t> SerialDataPayloads(const std::vector<Frame> &frames);
+
+} //namespace PFC
+
+#endif /* SRC_TESTS_SUPPORT_SERIAL_DATA_H_ */
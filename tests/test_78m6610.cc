@@ -0,0 +1,417 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+
+#include <string>
+
+#include <vector>
+
+#include "serial_data.h"
+
+#include "serial.h"
+
+#include "78m6610.h"
+#include "framelayout.hpp"
+
+namespace PFC
+{
+
+	class AutoReportTest : public testing::Test
+	{
+protected:
+		std::vector<Frame> frames;
+		std::vector<uint8_t> payloads;
+
+		void SetUp()
+		{
+			frames = LoadSerialData(MONIP_SERIAL_DATA);
+			ASSERT_FALSE(frames.empty());
+
+			// pad with random payloads to exercise the SIMD blocks and tails
+			srand(1);
+			payloads = SerialDataPayloads(frames);
+			while (payloads.size() < 1003 * AUTOREPORT_PAYLOAD_SIZE)
+			{
+				payloads.push_back((uint8_t)rand());
+			}
+		}
+
+		size_t Count() const
+		{
+			return payloads.size() / AUTOREPORT_PAYLOAD_SIZE;
+		}
+	};
+
+	struct BatchOutput
+	{
+		std::vector<float> Vrms, Irms, Watts, Pavg, PF, Freq, KwH;
+		AutoReportBatch batch;
+
+		explicit BatchOutput(size_t count) :
+			Vrms(count), Irms(count), Watts(count), Pavg(count), PF(count), Freq(count), KwH(count)
+		{
+			AutoReportBatch b = { &Vrms[0], &Irms[0], &Watts[0], &Pavg[0], &PF[0], &Freq[0], &KwH[0] };
+			batch = b;
+		}
+	};
+
+	static void ExpectNear(float expected, float actual)
+	{
+		EXPECT_NEAR(expected, actual, fabsf(expected) * 1e-6f);
+	}
+
+	TEST_F(AutoReportTest, test_ConvertAutoReport_SerialData)
+	{
+		for (auto it = frames.begin(); it != frames.end(); ++it)
+		{
+			AutoReportValues values;
+
+			ASSERT_EQ(it->size(), (size_t)AUTOREPORT_LENGTH);
+			ConvertAutoReport((const AutoReportMessage *)&(*it)[2], &values);
+
+			EXPECT_GT(values.Vrms, 0.0f);
+			EXPECT_NEAR(values.Freq, 49.5f, 0.5f);
+		}
+	}
+
+	TEST_F(AutoReportTest, test_ConvertAutoReportBatch_MatchesConvertAutoReport)
+	{
+		BatchOutput output(Count());
+
+		ConvertAutoReportBatch(&payloads[0], Count(), &output.batch);
+
+		for (size_t i = 0; i < Count(); i++)
+		{
+			AutoReportValues values;
+
+			ConvertAutoReport((const AutoReportMessage *)&payloads[i * AUTOREPORT_PAYLOAD_SIZE], &values);
+
+			ExpectNear(values.Vrms, output.Vrms[i]);
+			ExpectNear(values.Irms, output.Irms[i]);
+			ExpectNear(values.Watts, output.Watts[i]);
+			ExpectNear(values.Pavg, output.Pavg[i]);
+			ExpectNear(values.PF, output.PF[i]);
+			ExpectNear(values.Freq, output.Freq[i]);
+			ExpectNear(values.KwH, output.KwH[i]);
+		}
+	}
+
+	TEST_F(AutoReportTest, test_ConvertAutoReportBatch_MatchesScalar)
+	{
+		BatchOutput simd(Count());
+		BatchOutput scalar(Count());
+
+		ConvertAutoReportBatch(&payloads[0], Count(), &simd.batch);
+		ConvertAutoReportBatchScalar(&payloads[0], Count(), &scalar.batch);
+
+		ASSERT_TRUE(memcmp(&simd.Vrms[0], &scalar.Vrms[0], Count() * sizeof(float)) == 0);
+		ASSERT_TRUE(memcmp(&simd.Irms[0], &scalar.Irms[0], Count() * sizeof(float)) == 0);
+		ASSERT_TRUE(memcmp(&simd.Watts[0], &scalar.Watts[0], Count() * sizeof(float)) == 0);
+		ASSERT_TRUE(memcmp(&simd.Pavg[0], &scalar.Pavg[0], Count() * sizeof(float)) == 0);
+		ASSERT_TRUE(memcmp(&simd.PF[0], &scalar.PF[0], Count() * sizeof(float)) == 0);
+		ASSERT_TRUE(memcmp(&simd.Freq[0], &scalar.Freq[0], Count() * sizeof(float)) == 0);
+		ASSERT_TRUE(memcmp(&simd.KwH[0], &scalar.KwH[0], Count() * sizeof(float)) == 0);
+	}
+
+#if defined(__x86_64__) || defined(__i386__)
+	TEST_F(AutoReportTest, test_ConvertAutoReportBatch_SSSE3)
+	{
+		BatchOutput simd(Count());
+		BatchOutput scalar(Count());
+
+		// on AVX2 hosts the dispatcher only hands SSSE3 the tail, run its vector loop here
+		if (!__builtin_cpu_supports("ssse3"))
+		{
+			return;
+		}
+
+		ConvertAutoReportBatchSSSE3(&payloads[0], Count(), &simd.batch);
+		ConvertAutoReportBatchScalar(&payloads[0], Count(), &scalar.batch);
+
+		ASSERT_GE(Count(), 4u);
+		ASSERT_TRUE(memcmp(&simd.Vrms[0], &scalar.Vrms[0], Count() * sizeof(float)) == 0);
+		ASSERT_TRUE(memcmp(&simd.Irms[0], &scalar.Irms[0], Count() * sizeof(float)) == 0);
+		ASSERT_TRUE(memcmp(&simd.Watts[0], &scalar.Watts[0], Count() * sizeof(float)) == 0);
+		ASSERT_TRUE(memcmp(&simd.Pavg[0], &scalar.Pavg[0], Count() * sizeof(float)) == 0);
+		ASSERT_TRUE(memcmp(&simd.PF[0], &scalar.PF[0], Count() * sizeof(float)) == 0);
+		ASSERT_TRUE(memcmp(&simd.Freq[0], &scalar.Freq[0], Count() * sizeof(float)) == 0);
+		ASSERT_TRUE(memcmp(&simd.KwH[0], &scalar.KwH[0], Count() * sizeof(float)) == 0);
+	}
+#endif
+
+	static std::string ReferenceJSON(const AutoReportMessage * message)
+	{
+		AutoReportValues values;
+		char text[512];
+
+		ConvertAutoReport(message, &values);
+		snprintf(text, sizeof(text),
+			"{\"Vrms\":%3.2f,\"Irms\":%3.2f,\"Watts\":%3.2f,\"Pavg\":%3.2f,\"PF\":%3.2f,\"Freq\":%3.2f,\"kWh\":%3.2f}",
+			values.Vrms, values.Irms, values.Watts, values.Pavg, values.PF, values.Freq, values.KwH);
+
+		return text;
+	}
+
+	TEST_F(AutoReportTest, test_JSON_FormatFixed2_MatchesPrintf)
+	{
+		char expected[64];
+		char actual[JSON_FIXED2_MAX + 1];
+
+		srand(2);
+
+		for (int i = 0; i < 200000; i++)
+		{
+			// 24-bit raw values over the scales used by ConvertAutoReport, plus exact ties
+			int32_t raw = (rand() & 0xffffff) - 0x800000;
+			float value = (i % 4 == 0) ? raw / 1000.0f : (i % 4 == 1) ? raw / 128700.1287f : (i % 4 == 2) ? raw / 200.0f : raw / 8.0f;
+
+			snprintf(expected, sizeof(expected), "%.2f", value);
+			actual[JSON_FormatFixed2(actual, value)] = '\0';
+
+			ASSERT_STREQ(expected, actual) << "raw " << raw;
+		}
+
+		actual[JSON_FormatFixed2(actual, -0.0f)] = '\0';
+		ASSERT_STREQ("-0.00", actual);
+		actual[JSON_FormatFixed2(actual, 1e30f)] = '\0';
+		snprintf(expected, sizeof(expected), "%.2f", 1e30f);
+		ASSERT_STREQ(expected, actual);
+	}
+
+	TEST_F(AutoReportTest, test_AutoReportToJSON_MatchesPrintf)
+	{
+		char text[AUTOREPORT_JSON_MAX];
+
+		for (size_t i = 0; i < Count(); i++)
+		{
+			const AutoReportMessage * message = (const AutoReportMessage *)&payloads[i * AUTOREPORT_PAYLOAD_SIZE];
+			std::string expected = ReferenceJSON(message);
+			char * legacy = ConvertAutoReportToJSON(message);
+
+			ASSERT_EQ(AutoReportToJSON(message, text, sizeof(text)), (int)expected.size());
+			ASSERT_EQ(expected, text);
+			ASSERT_TRUE(legacy != NULL);
+			ASSERT_EQ(expected, legacy);
+			free(legacy);
+		}
+
+		ASSERT_EQ(AutoReportToJSON((const AutoReportMessage *)&payloads[0], text, 10), -ENOSPC);
+	}
+
+	TEST_F(AutoReportTest, test_AutoReportToJSON_FullScale)
+	{
+		uint8_t payload[AUTOREPORT_PAYLOAD_SIZE] = {0};
+		char text[AUTOREPORT_JSON_MAX];
+		char wide[1024];
+
+		// every field at its most negative, the longest text the table allows
+		for (size_t offset = 6; offset < 27; offset += 3)
+		{
+			payload[offset + 2] = 0x80;
+		}
+
+		int length = AutoReportToJSON((const AutoReportMessage *)payload, wide, sizeof(wide));
+		ASSERT_EQ(length, (int)monip::AutoReportFrame::DecodedJSONMax());
+		ASSERT_EQ(AutoReportToJSON((const AutoReportMessage *)payload, text, sizeof(text)), length);
+		ASSERT_STREQ(wide, text);
+		ASSERT_EQ(AutoReportToJSON((const AutoReportMessage *)payload, text, length + 1), length);
+		ASSERT_EQ(AutoReportToJSON((const AutoReportMessage *)payload, text, length), -ENOSPC);
+	}
+
+	TEST_F(AutoReportTest, test_JSONBuffer_Array)
+	{
+		JSONBuffer buffer;
+		std::string expected = "[";
+
+		JSONBuffer_Init(&buffer, JSON_MODE_ARRAY);
+
+		for (size_t i = 0; i < frames.size(); i++)
+		{
+			const AutoReportMessage * message = (const AutoReportMessage *)&frames[i][2];
+
+			expected += (i > 0 ? "," : "") + ReferenceJSON(message);
+			ASSERT_EQ(JSONBuffer_AppendAutoReport(&buffer, message), 0);
+		}
+		expected += "]";
+
+		ASSERT_EQ(expected, JSONBuffer_Finish(&buffer));
+		ASSERT_EQ(expected, JSONBuffer_Finish(&buffer));
+		ASSERT_EQ(JSONBuffer_AppendAutoReport(&buffer, (const AutoReportMessage *)&frames[0][2]), -EINVAL);
+
+		JSONBuffer_Reset(&buffer);
+		ASSERT_STREQ("[]", JSONBuffer_Finish(&buffer));
+
+		JSONBuffer_Free(&buffer);
+	}
+
+	TEST_F(AutoReportTest, test_JSONBuffer_NDJSON_Static)
+	{
+		char storage[200];
+		JSONBuffer buffer;
+		const AutoReportMessage * message = (const AutoReportMessage *)&frames[0][2];
+		std::string line = ReferenceJSON(message) + "\n";
+
+		JSONBuffer_InitStatic(&buffer, JSON_MODE_NDJSON, storage, sizeof(storage));
+
+		ASSERT_EQ(JSONBuffer_AppendAutoReport(&buffer, message), 0);
+		ASSERT_EQ(JSONBuffer_AppendAutoReport(&buffer, message), 0);
+		ASSERT_EQ(JSONBuffer_AppendAutoReport(&buffer, message), -ENOSPC);
+
+		ASSERT_EQ(line + line, JSONBuffer_Finish(&buffer));
+		ASSERT_EQ(buffer.count, 2u);
+	}
+
+	TEST_F(AutoReportTest, test_AutoReportFixed_SerialData)
+	{
+		char expected[AUTOREPORT_JSON_MAX];
+		char actual[AUTOREPORT_JSON_MAX];
+
+		for (size_t i = 0; i < frames.size(); i++)
+		{
+			const AutoReportMessage * message = (const AutoReportMessage *)&frames[i][2];
+			AutoReportValuesFixed fixed;
+			AutoReportValues values;
+
+			ConvertAutoReport(message, &values);
+			ConvertAutoReportFixed(message, &fixed);
+
+			EXPECT_EQ(fixed.Vrms, (int32_t)lrintf(values.Vrms * 1000.0f));
+			EXPECT_NEAR(fixed.Irms, values.Irms * 1e6f, 1.0f);
+			EXPECT_EQ(fixed.Watts, (int32_t)lrintf(values.Watts * 1000.0f));
+			EXPECT_EQ(fixed.Freq, (int32_t)lrintf(values.Freq * 1000.0f));
+
+			ASSERT_EQ(AutoReportFixedToJSON(&fixed, actual, sizeof(actual)), AutoReportToJSON(message, expected, sizeof(expected)));
+			ASSERT_STREQ(expected, actual);
+		}
+
+		ASSERT_EQ(AutoReportFixedToJSON(NULL, actual, sizeof(actual)), -EINVAL);
+	}
+
+	TEST(JSONFormatTest, test_JSON_FormatScaled2_MatchesFloat)
+	{
+		const int32_t edges[] = { 0, 1, -1, 5, -5, 125, -125, 1005, 2147483647, -2147483647 - 1 };
+		char expected[JSON_FIXED2_MAX + 1];
+		char actual[JSON_FIXED2_MAX + 1];
+
+		srand(3);
+
+		for (int i = 0; i < 200000; i++)
+		{
+			// 24-bit raw values as the decoders see them, Watts style ones arrive times 5
+			int32_t raw = (i < 10) ? edges[i] : (rand() & 0xffffff) - 0x800000;
+			unsigned digits = (i % 2 == 0) ? 3 : 6;
+			float value = 0.0f;
+
+			if (i < 10)
+			{
+				value = (float)((double)raw / (digits == 3 ? 1e3 : 1e6));
+			}
+			else if (i % 3 == 0 && digits == 3)
+			{
+				value = raw / 200.0f;
+				raw *= 5;
+			}
+			else
+			{
+				value = raw / (digits == 3 ? 1000.0f : 1000000.0f);
+			}
+
+			expected[JSON_FormatFixed2(expected, value)] = '\0';
+			actual[JSON_FormatScaled2(actual, raw, digits)] = '\0';
+
+			ASSERT_STREQ(expected, actual) << raw << " / 10^" << digits;
+		}
+
+		ASSERT_EQ(JSON_FormatScaled2(actual, 1, 2), 0u);
+	}
+
+	static float ReferenceField(const uint8_t * payload, size_t offset, float divisor)
+	{
+		int32_t raw = payload[offset] | (payload[offset + 1] << 8) | (payload[offset + 2] << 16);
+
+		return (float)(raw & 0x800000 ? raw | (int32_t)0xff000000 : raw) / divisor;
+	}
+
+	TEST_F(AutoReportTest, test_FrameLayout_AutoReport)
+	{
+		char text[monip::AutoReportFrame::TextMax()];
+		char expected[AUTOREPORT_JSON_MAX];
+
+		for (size_t i = 0; i < Count(); i++)
+		{
+			const uint8_t * payload = &payloads[i * AUTOREPORT_PAYLOAD_SIZE];
+			AutoReportValues values;
+
+			// bit exact against the old 24-bit bitfield conversion
+			ConvertAutoReport((const AutoReportMessage *)payload, &values);
+			ASSERT_EQ(values.Vrms, ReferenceField(payload, 6, 1000.0f));
+			ASSERT_EQ(values.Irms, ReferenceField(payload, 9, 128700.1287f));
+			ASSERT_EQ(values.Watts, ReferenceField(payload, 12, 200.0f));
+			ASSERT_EQ(values.KwH, ReferenceField(payload, 24, 1000.0f));
+
+			size_t length = monip::AutoReportFrame::FormatJSON(text, values);
+			ASSERT_EQ(AutoReportToJSON((const AutoReportMessage *)payload, expected, sizeof(expected)), (int)length);
+			ASSERT_EQ(std::string(expected), std::string(text, length));
+
+			length = monip::AutoReportFrame::FormatCSV(text, values);
+			ASSERT_EQ(AutoReportToCSV((const AutoReportMessage *)payload, expected, sizeof(expected)), (int)length);
+			ASSERT_EQ(std::string(expected), std::string(text, length));
+		}
+
+		for (size_t i = 0; i < frames.size(); i++)
+		{
+			Frame frame = frames[i];
+
+			ASSERT_TRUE(monip::AutoReportFrame::Validate(&frame[0]));
+			ASSERT_EQ(ValidateMessage(frame[0], frame[1], &frame[2], AUTOREPORT_PAYLOAD_SIZE), 0);
+			frame[5] ^= 0x10;
+			ASSERT_FALSE(monip::AutoReportFrame::Validate(&frame[0]));
+			ASSERT_EQ(ValidateMessage(frame[0], frame[1], &frame[2], AUTOREPORT_PAYLOAD_SIZE), -EIO);
+		}
+	}
+
+	// A frame type added with nothing but a table: unsigned 32-bit and signed 16-bit fields
+	struct CounterValues
+	{
+		float Count;
+		float Delta;
+	};
+
+	constexpr monip::FieldSpec<CounterValues> CounterFields[] =
+	{
+		{ "count", 0, 4, false, 1.0f, &CounterValues::Count },
+		{ "delta", 4, 2, true, 10.0f, &CounterValues::Delta },
+	};
+
+	struct CounterLayout
+	{
+		typedef CounterValues Values;
+
+		enum { Header = 0xC0, Length = 9, PayloadSize = 7, Count = 2 };
+
+		static constexpr monip::FieldSpec<Values> Field(size_t index)
+		{
+			return CounterFields[index];
+		}
+	};
+
+	TEST(FrameLayoutTest, test_FrameLayout_CustomFrame)
+	{
+		typedef monip::Frame<CounterLayout> CounterFrame;
+		const uint8_t frame[] = { 0xc0, 0x09, 0x00, 0x00, 0x00, 0x80, 0x9c, 0xff, 0x1c };
+		char text[CounterFrame::TextMax()];
+		CounterValues values;
+
+		ASSERT_TRUE(CounterFrame::Validate(frame));
+		CounterFrame::Decode(&frame[2], &values);
+
+		ASSERT_EQ(values.Count, 2147483648.0f);
+		ASSERT_EQ(values.Delta, -10.0f);
+		ASSERT_EQ(std::string(text, CounterFrame::FormatJSON(text, values)), "{\"count\":2147483648.00,\"delta\":-10.00}");
+		ASSERT_EQ(std::string(text, CounterFrame::FormatCSV(text, values)), "2147483648.00,-10.00");
+	}
+
+}
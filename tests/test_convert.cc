@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "process.h"
+#include "serial_data.h"
+
+#include "78m6610.h"
+#include "jsonbuffer.h"
+#include "recording.h"
+
+namespace PFC
+{
+
+	class ConvertTest : public testing::Test
+	{
+protected:
+		std::vector<Frame> frames;
+		std::string base;
+
+		void SetUp()
+		{
+			char name[] = "/tmp/monip_convert_XXXXXX";
+			int fd = mkstemp(name);
+
+			ASSERT_GE(fd, 0);
+			close(fd);
+			base = name;
+
+			// many small chunks with a corrupt and a blank line in between
+			std::ifstream data(MONIP_SERIAL_DATA);
+			std::stringstream text;
+			text << data.rdbuf();
+
+			std::ofstream input((base + ".txt").c_str());
+			std::vector<Frame> once = LoadSerialData(MONIP_SERIAL_DATA);
+
+			for (int i = 0; i < 200; i++)
+			{
+				input << text.str() << "ae1e00\n\n";
+				frames.insert(frames.end(), once.begin(), once.end());
+			}
+		}
+
+		void TearDown()
+		{
+			unlink(base.c_str());
+			unlink((base + ".txt").c_str());
+			unlink((base + ".out").c_str());
+		}
+
+		void Convert(const char * format)
+		{
+			std::string input = base + ".txt";
+			std::string output = base + ".out";
+			std::vector<const char *> command = { MONIP_CONVERT, "-f", format, "-j", "4", "-c", "1", input.c_str(), output.c_str() };
+
+			SpawnProcess(command, true, true);
+		}
+
+		std::string Output()
+		{
+			std::ifstream file((base + ".out").c_str());
+			std::stringstream text;
+			text << file.rdbuf();
+			return text.str();
+		}
+	};
+
+	TEST_F(ConvertTest, test_Convert_NDJSON_InOrder)
+	{
+		JSONBuffer expected;
+
+		JSONBuffer_Init(&expected, JSON_MODE_NDJSON);
+		for (size_t i = 0; i < frames.size(); i++)
+		{
+			JSONBuffer_AppendAutoReport(&expected, (const AutoReportMessage *)&frames[i][2]);
+		}
+
+		Convert("ndjson");
+		ASSERT_EQ(std::string(JSONBuffer_Finish(&expected)), Output());
+
+		JSONBuffer_Free(&expected);
+	}
+
+	TEST_F(ConvertTest, test_Convert_CSV)
+	{
+		Convert("csv");
+
+		std::stringstream csv(Output());
+		std::string line;
+		size_t rows = 0;
+
+		ASSERT_TRUE(std::getline(csv, line));
+		ASSERT_EQ(line, "Vrms,Irms,Watts,Pavg,PF,Freq,kWh");
+
+		while (std::getline(csv, line))
+		{
+			AutoReportValues values;
+			char vrms[JSON_FIXED2_MAX + 1];
+
+			ASSERT_LT(rows, frames.size());
+			ConvertAutoReport((const AutoReportMessage *)&frames[rows][2], &values);
+			vrms[JSON_FormatFixed2(vrms, values.Vrms)] = '\0';
+
+			ASSERT_EQ(std::count(line.begin(), line.end(), ','), 6);
+			ASSERT_EQ(line.substr(0, line.find(',')), vrms);
+			rows++;
+		}
+
+		ASSERT_EQ(rows, frames.size());
+	}
+
+	TEST_F(ConvertTest, test_Convert_Binary)
+	{
+		Convert("binary");
+
+		Recording * recording = Recording_Open((base + ".out").c_str());
+		ASSERT_TRUE(recording != NULL);
+		ASSERT_EQ(Recording_Count(recording), frames.size());
+
+		for (size_t i = 0; i < frames.size(); i++)
+		{
+			const RecordingRecord * record = Recording_At(recording, i);
+
+			ASSERT_EQ(record->Timestamp, i);
+			ASSERT_EQ(record->Length, frames[i].size());
+			ASSERT_EQ(memcmp(record->Frame, &frames[i][0], frames[i].size()), 0);
+		}
+
+		Recording_Close(recording);
+	}
+
+}
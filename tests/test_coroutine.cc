@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "ptypair.h"
+
+#include "serial.h"
+#include "78m6610.h"
+#include "coroutine.hpp"
+
+namespace PFC
+{
+
+	static const uint8_t AutoReportFrame[] = {0xae, 0x1e, 0xdc, 0x4c, 0x00 , 0xc1, 0xac, 0xff , 0xdd, 0xa8, 0x03 , 0x51, 0x11, 0x00 , 0xe9, 0xff, 0xff , 0xec, 0xff, 0xff , 0xf2, 0xff, 0xff , 0x85, 0xc1, 0x00 , 0x00, 0x00, 0x00, 0xaf};
+
+	struct SessionState
+	{
+		int frames;
+		int result;
+		float vrms;
+
+		SessionState() : frames(0), result(0), vrms(0) {}
+	};
+
+	// Read frames until count arrived or a wait fails
+	static monip::Task Session(monip::AsyncPort * port, int count, uint32_t timeoutUs, SessionState * state)
+	{
+		uint8_t buffer[FRAME_MAX_LENGTH];
+		monip::FrameView view;
+		struct timespec deadline;
+
+		while (state->frames < count)
+		{
+			Serial_Deadline(&deadline, timeoutUs);
+
+			state->result = co_await port->NextFrame(buffer, &view, &deadline);
+			if (state->result < 0)
+			{
+				co_return;
+			}
+
+			state->frames++;
+			state->vrms = view.Vrms();
+		}
+	}
+
+	static monip::Task Sleeper(monip::Executor * executor, uint32_t timeoutUs, int * woken)
+	{
+		co_await executor->Sleep(timeoutUs);
+		(*woken)++;
+	}
+
+	class CoroutineTest : public testing::Test
+	{
+protected:
+		static const int DeviceCount = 32;
+
+		monip::Executor executor;
+		std::vector<PtyPair> ptys;
+		std::vector<Serial *> serials;
+		std::vector<monip::AsyncPort *> ports;
+		std::vector<SessionState> states;
+
+		CoroutineTest() : ptys(DeviceCount), serials(DeviceCount), ports(DeviceCount), states(DeviceCount) {}
+
+		void SetUp()
+		{
+			ASSERT_TRUE(executor.IsValid());
+
+			for (int i = 0; i < DeviceCount; i++)
+			{
+				ASSERT_TRUE(ptys[i].Open());
+				serials[i] = Serial_New(ptys[i].path.c_str());
+				ASSERT_TRUE(serials[i] != NULL);
+				ports[i] = new monip::AsyncPort(executor, serials[i]);
+				ASSERT_EQ(ports[i]->Status(), 0);
+			}
+		}
+
+		void TearDown()
+		{
+			for (int i = 0; i < DeviceCount; i++)
+			{
+				delete ports[i];
+				Serial_Free(serials[i]);
+			}
+		}
+	};
+
+	TEST_F(CoroutineTest, test_Coroutine_ManySessions)
+	{
+		const int FramesPerDevice = 4;
+
+		// the first frame is already waiting when the session starts
+		for (int i = 0; i < DeviceCount; i++)
+		{
+			ASSERT_EQ(write(ptys[i].master, AutoReportFrame, sizeof(AutoReportFrame)), (ssize_t)sizeof(AutoReportFrame));
+			executor.Spawn(Session(ports[i], FramesPerDevice, 2000000, &states[i]));
+		}
+		ASSERT_EQ(executor.Tasks(), (size_t)DeviceCount);
+
+		// the rest split across writes to exercise partial frames
+		for (int j = 1; j < FramesPerDevice; j++)
+		{
+			for (int i = 0; i < DeviceCount; i++)
+			{
+				ASSERT_EQ(write(ptys[i].master, AutoReportFrame, 11), 11);
+			}
+			ASSERT_GE(executor.RunOnce(0), 0);
+			for (int i = 0; i < DeviceCount; i++)
+			{
+				ASSERT_EQ(write(ptys[i].master, AutoReportFrame + 11, sizeof(AutoReportFrame) - 11), (ssize_t)sizeof(AutoReportFrame) - 11);
+			}
+		}
+
+		ASSERT_EQ(executor.Run(), 0);
+		ASSERT_EQ(executor.Tasks(), 0u);
+
+		for (int i = 0; i < DeviceCount; i++)
+		{
+			EXPECT_EQ(states[i].frames, FramesPerDevice);
+			EXPECT_EQ(states[i].result, AUTOREPORT_PAYLOAD_SIZE);
+			EXPECT_NEAR(states[i].vrms, 239.837f, 0.001f);
+		}
+	}
+
+	TEST_F(CoroutineTest, test_Coroutine_TimeoutAndHangup)
+	{
+		int woken = 0;
+
+		executor.Spawn(Session(ports[0], 1, 20000, &states[0]));
+		executor.Spawn(Session(ports[1], 1, 5000000, &states[1]));
+		executor.Spawn(Sleeper(&executor, 1000, &woken));
+		ptys[1].Close();
+
+		ASSERT_EQ(executor.Run(), 0);
+
+		ASSERT_EQ(states[0].result, -ETIMEDOUT);
+		ASSERT_LT(states[1].result, 0);
+		ASSERT_NE(states[1].result, -ETIMEDOUT);
+		ASSERT_EQ(woken, 1);
+	}
+
+	TEST_F(CoroutineTest, test_Coroutine_StopAndDestroy)
+	{
+		uint8_t buffer[FRAME_MAX_LENGTH];
+		monip::FrameView view;
+
+		// nothing arrives: Stop() ends Run(), the executor frees what is left
+		executor.Spawn(Session(ports[0], 1, 0xffffffff, &states[0]));
+		executor.Stop();
+		ASSERT_EQ(executor.Run(), 0);
+		ASSERT_EQ(executor.Tasks(), 1u);
+
+		// one waiter per port
+		ASSERT_EQ(ports[0]->NextFrame(buffer, &view).await_ready(), true);
+		ASSERT_EQ(ports[0]->NextFrame(buffer, &view).await_resume(), -EBUSY);
+	}
+
+}
@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <vector>
+
+#include "serial.h"
+#include "78m6610.h"
+#include "frameparser.h"
+
+namespace PFC
+{
+
+	static const uint8_t AutoReportFrame[] = {0xae, 0x1e, 0xdc, 0x4c, 0x00 , 0xc1, 0xac, 0xff , 0xdd, 0xa8, 0x03 , 0x51, 0x11, 0x00 , 0xe9, 0xff, 0xff , 0xec, 0xff, 0xff , 0xf2, 0xff, 0xff , 0x85, 0xc1, 0x00 , 0x00, 0x00, 0x00, 0xaf};
+
+	class FrameParserTest : public testing::Test
+	{
+protected:
+		FrameParser * parser;
+		uint8_t buffer[FRAME_MAX_LENGTH];
+
+		FrameParserTest(): parser(NULL) {}
+
+		void SetUp()
+		{
+			parser = FrameParser_New(AUTOREPORT_HEADER, AUTOREPORT_LENGTH);
+			ASSERT_TRUE(parser != NULL);
+		}
+		void TearDown()
+		{
+			FrameParser_Free(parser);
+		}
+	};
+
+	TEST_F(FrameParserTest, test_FrameParser_Simple)
+	{
+		uint8_t header = 0;
+
+		ASSERT_EQ(FrameParser_Push(parser, AutoReportFrame, sizeof(AutoReportFrame)), sizeof(AutoReportFrame));
+		ASSERT_EQ(FrameParser_Next(parser, &header, buffer), 28);
+		ASSERT_EQ(header, AUTOREPORT_HEADER);
+		ASSERT_TRUE(memcmp(buffer, &AutoReportFrame[2], 28) == 0);
+		ASSERT_EQ(FrameParser_Next(parser, &header, buffer), -EAGAIN);
+		ASSERT_EQ(FrameParser_Available(parser), 0u);
+	}
+
+	TEST_F(FrameParserTest, test_FrameParser_Partial)
+	{
+		ASSERT_EQ(FrameParser_Push(parser, AutoReportFrame, 10), 10u);
+		ASSERT_EQ(FrameParser_Next(parser, NULL, buffer), -EAGAIN);
+		ASSERT_EQ(FrameParser_Push(parser, &AutoReportFrame[10], sizeof(AutoReportFrame) - 10), sizeof(AutoReportFrame) - 10);
+		ASSERT_EQ(FrameParser_Next(parser, NULL, buffer), 28);
+	}
+
+	TEST_F(FrameParserTest, test_FrameParser_Checksum_Fail)
+	{
+		uint8_t corrupt[sizeof(AutoReportFrame)];
+
+		memcpy(corrupt, AutoReportFrame, sizeof(corrupt));
+		corrupt[4] ^= 0x01;
+
+		FrameParser_Push(parser, corrupt, sizeof(corrupt));
+		FrameParser_Push(parser, AutoReportFrame, sizeof(AutoReportFrame));
+
+		ASSERT_EQ(FrameParser_Next(parser, NULL, buffer), 28);
+		ASSERT_TRUE(memcmp(buffer, &AutoReportFrame[2], 28) == 0);
+		ASSERT_EQ(FrameParser_Next(parser, NULL, buffer), -EAGAIN);
+	}
+
+	TEST_F(FrameParserTest, test_FrameParser_BadData)
+	{
+		int frames = 0;
+		int i = 0;
+
+		srand(1);
+
+		for(i = 0; i < 20; i++)
+		{
+			int j = 0;
+
+			for(j = 0; j < 37; j++)
+			{
+				uint8_t random = rand();
+				FrameParser_Push(parser, &random, 1);
+			}
+
+			FrameParser_Push(parser, AutoReportFrame, sizeof(AutoReportFrame));
+
+			while(FrameParser_Next(parser, NULL, buffer) == 28)
+			{
+				ASSERT_TRUE(memcmp(buffer, &AutoReportFrame[2], 28) == 0);
+				frames++;
+			}
+		}
+
+		ASSERT_EQ(frames, 20);
+	}
+
+	TEST_F(FrameParserTest, test_FrameParser_Wrap)
+	{
+		int i = 0;
+
+		for(i = 0; i < 100; i++)
+		{
+			ASSERT_EQ(FrameParser_Push(parser, AutoReportFrame, sizeof(AutoReportFrame)), sizeof(AutoReportFrame));
+			ASSERT_EQ(FrameParser_Next(parser, NULL, buffer), 28);
+			ASSERT_TRUE(memcmp(buffer, &AutoReportFrame[2], 28) == 0);
+		}
+	}
+
+	TEST_F(FrameParserTest, test_FrameParser_Token)
+	{
+		uint8_t header = 0;
+		const uint8_t ack = 0xad;
+
+		FrameParser_AddToken(parser, ack);
+
+		ASSERT_EQ(FrameParser_Push(parser, &ack, 1), 1u);
+		ASSERT_EQ(FrameParser_Push(parser, AutoReportFrame, sizeof(AutoReportFrame)), sizeof(AutoReportFrame));
+		ASSERT_EQ(FrameParser_Push(parser, &ack, 1), 1u);
+
+		ASSERT_EQ(FrameParser_Next(parser, &header, buffer), 0);
+		ASSERT_EQ(header, ack);
+		ASSERT_EQ(FrameParser_Next(parser, &header, buffer), 28);
+		ASSERT_EQ(header, AUTOREPORT_HEADER);
+		ASSERT_EQ(FrameParser_Next(parser, &header, buffer), 0);
+		ASSERT_EQ(header, ack);
+		ASSERT_EQ(FrameParser_Next(parser, &header, buffer), -EAGAIN);
+	}
+
+	TEST_F(FrameParserTest, test_FrameParser_Discard)
+	{
+		std::vector<uint8_t> noise(FRAMEPARSER_RING_SIZE, 0);
+
+		// a full ring takes nothing until the oldest bytes go
+		ASSERT_EQ(FrameParser_Push(parser, &noise[0], noise.size()), noise.size());
+		ASSERT_EQ(FrameParser_Push(parser, AutoReportFrame, sizeof(AutoReportFrame)), 0u);
+		ASSERT_EQ(FrameParser_Discard(parser, sizeof(AutoReportFrame)), sizeof(AutoReportFrame));
+		ASSERT_EQ(FrameParser_Push(parser, AutoReportFrame, sizeof(AutoReportFrame)), sizeof(AutoReportFrame));
+
+		ASSERT_EQ(FrameParser_Next(parser, NULL, buffer), 28);
+		ASSERT_EQ(FrameParser_Available(parser), 0u);
+		ASSERT_EQ(FrameParser_Discard(parser, 10), 0u);
+	}
+
+	TEST_F(FrameParserTest, test_FrameParser_TokenOutOfSync)
+	{
+		uint8_t header = 0;
+		const uint8_t ack = 0xad;
+		const uint8_t noise[] = {0x12, ack, 0x34};
+
+		FrameParser_AddToken(parser, ack);
+
+		// sliding over noise, a token byte is noise too
+		ASSERT_EQ(FrameParser_Push(parser, noise, sizeof(noise)), sizeof(noise));
+		ASSERT_EQ(FrameParser_Push(parser, AutoReportFrame, sizeof(AutoReportFrame)), sizeof(AutoReportFrame));
+		ASSERT_EQ(FrameParser_Next(parser, &header, buffer), 28);
+		ASSERT_EQ(header, AUTOREPORT_HEADER);
+
+		// and in sync only while expected
+		FrameParser_ExpectTokens(parser, 0);
+		ASSERT_EQ(FrameParser_Push(parser, &ack, 1), 1u);
+		ASSERT_EQ(FrameParser_Next(parser, &header, buffer), -EAGAIN);
+		FrameParser_ExpectTokens(parser, 1);
+		ASSERT_EQ(FrameParser_Push(parser, &ack, 1), 1u);
+		ASSERT_EQ(FrameParser_Next(parser, &header, buffer), 0);
+		ASSERT_EQ(header, ack);
+	}
+
+}
@@ -0,0 +1,172 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "78m6610.h"
+#include "framequeue.h"
+
+namespace PFC
+{
+
+	// sequence number written twice so torn copies are detectable
+	struct Item
+	{
+		uint64_t first;
+		uint8_t padding[48];
+		uint64_t second;
+	};
+
+	static Item MakeItem(uint64_t seq)
+	{
+		Item item;
+		memset(&item, 0, sizeof(item));
+		item.first = seq;
+		item.second = seq;
+		return item;
+	}
+
+	TEST(FrameQueueTest, test_FrameQueue_Fifo)
+	{
+		FrameQueue * queue = FrameQueue_New(5, sizeof(QueuedFrame), FRAMEQUEUE_DROP_NEWEST);
+		QueuedFrame frame;
+
+		ASSERT_TRUE(queue != NULL);
+		ASSERT_EQ(FrameQueue_Capacity(queue), 8u);
+		ASSERT_EQ(FrameQueue_Pop(queue, &frame), -EAGAIN);
+
+		for (int i = 0; i < 8; i++)
+		{
+			memset(&frame, 0, sizeof(frame));
+			frame.Timestamp = FrameQueue_Now();
+			frame.Device = i;
+			ASSERT_EQ(FrameQueue_Push(queue, &frame), 0);
+		}
+
+		ASSERT_EQ(FrameQueue_Push(queue, &frame), -ENOBUFS);
+		ASSERT_EQ(FrameQueue_Size(queue), 8u);
+
+		for (int i = 0; i < 8; i++)
+		{
+			ASSERT_EQ(FrameQueue_Pop(queue, &frame), 0);
+			ASSERT_EQ(frame.Device, (uint32_t)i);
+		}
+
+		FrameQueueStats stats;
+		FrameQueue_GetStats(queue, &stats);
+		ASSERT_EQ(stats.Pushed, 8u);
+		ASSERT_EQ(stats.Popped, 8u);
+		ASSERT_EQ(stats.DroppedNewest, 1u);
+
+		FrameQueue_Free(queue);
+	}
+
+	TEST(FrameQueueTest, test_FrameQueue_DropOldest)
+	{
+		FrameQueue * queue = FrameQueue_New(4, sizeof(AutoReportValues), FRAMEQUEUE_DROP_OLDEST);
+		AutoReportValues values;
+
+		ASSERT_TRUE(queue != NULL);
+
+		for (int i = 0; i < 10; i++)
+		{
+			memset(&values, 0, sizeof(values));
+			values.Vrms = (float)i;
+			ASSERT_EQ(FrameQueue_Push(queue, &values), 0);
+		}
+
+		for (int i = 6; i < 10; i++)
+		{
+			ASSERT_EQ(FrameQueue_Pop(queue, &values), 0);
+			ASSERT_EQ(values.Vrms, (float)i);
+		}
+		ASSERT_EQ(FrameQueue_Pop(queue, &values), -EAGAIN);
+
+		FrameQueueStats stats;
+		FrameQueue_GetStats(queue, &stats);
+		ASSERT_EQ(stats.DroppedOldest, 6u);
+
+		FrameQueue_Free(queue);
+	}
+
+	struct ProducerArgs
+	{
+		FrameQueue * queue;
+		uint64_t count;
+	};
+
+	static void * Producer(void * arg)
+	{
+		ProducerArgs * args = (ProducerArgs *)arg;
+
+		for (uint64_t i = 1; i <= args->count; i++)
+		{
+			Item item = MakeItem(i);
+			FrameQueue_Push(args->queue, &item);
+		}
+
+		return NULL;
+	}
+
+	TEST(FrameQueueTest, test_FrameQueue_Threaded_Block)
+	{
+		ProducerArgs args = { FrameQueue_New(64, sizeof(Item), FRAMEQUEUE_BLOCK), 200000 };
+		pthread_t thread;
+		Item item;
+
+		ASSERT_TRUE(args.queue != NULL);
+		ASSERT_EQ(pthread_create(&thread, NULL, Producer, &args), 0);
+
+		for (uint64_t i = 1; i <= args.count; i++)
+		{
+			ASSERT_EQ(FrameQueue_PopWait(args.queue, &item, 5000000), 0);
+			ASSERT_EQ(item.first, i);
+			ASSERT_EQ(item.second, i);
+		}
+
+		pthread_join(thread, NULL);
+
+		FrameQueueStats stats;
+		FrameQueue_GetStats(args.queue, &stats);
+		ASSERT_EQ(stats.Pushed, args.count);
+		ASSERT_EQ(stats.DroppedNewest + stats.DroppedOldest, 0u);
+
+		FrameQueue_Free(args.queue);
+	}
+
+	TEST(FrameQueueTest, test_FrameQueue_Threaded_DropOldest)
+	{
+		ProducerArgs args = { FrameQueue_New(16, sizeof(Item), FRAMEQUEUE_DROP_OLDEST), 200000 };
+		pthread_t thread;
+		Item item;
+		uint64_t last = 0;
+		uint64_t received = 0;
+
+		ASSERT_TRUE(args.queue != NULL);
+		ASSERT_EQ(pthread_create(&thread, NULL, Producer, &args), 0);
+
+		while (last < args.count)
+		{
+			if (FrameQueue_PopWait(args.queue, &item, 5000000) != 0)
+			{
+				break;
+			}
+
+			// never torn, never reordered
+			ASSERT_EQ(item.first, item.second);
+			ASSERT_GT(item.first, last);
+			last = item.first;
+			received++;
+		}
+
+		pthread_join(thread, NULL);
+
+		FrameQueueStats stats;
+		FrameQueue_GetStats(args.queue, &stats);
+		ASSERT_EQ(last, args.count);
+		ASSERT_EQ(received + stats.DroppedOldest, args.count);
+
+		FrameQueue_Free(args.queue);
+	}
+
+}
@@ -0,0 +1,276 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <vector>
+
+#include "ptypair.h"
+#include "serial_data.h"
+
+#include "serial.h"
+#include "78m6610.h"
+#include "frameparser.h"
+#include "journal.h"
+
+namespace PFC
+{
+
+	class JournalTest : public testing::Test
+	{
+protected:
+		std::vector<Frame> frames;
+		std::string path;
+
+		void SetUp()
+		{
+			char name[] = "/tmp/monip_journal_XXXXXX";
+			int fd = mkstemp(name);
+
+			ASSERT_GE(fd, 0);
+			close(fd);
+			unlink(name);
+			path = name;
+
+			frames = LoadSerialData(MONIP_SERIAL_DATA);
+			ASSERT_FALSE(frames.empty());
+		}
+
+		void TearDown()
+		{
+			unlink(path.c_str());
+		}
+
+		// frame k of the sequence cycles through serial_data.txt
+		const Frame &FrameOf(uint64_t sequence)
+		{
+			return frames[(sequence - 1) % frames.size()];
+		}
+
+		void Append(Journal * journal, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				const Frame &frame = FrameOf(Journal_Next(journal));
+
+				ASSERT_EQ(Journal_Append(journal, 1000 + Journal_Next(journal), frame[0], &frame[2], frame.size() - 2), 0);
+			}
+		}
+
+		void ExpectRecord(const JournalRecord &record, uint64_t sequence)
+		{
+			const Frame &frame = FrameOf(sequence);
+
+			ASSERT_EQ(record.Sequence, sequence);
+			ASSERT_EQ(record.Timestamp, 1000 + sequence);
+			ASSERT_EQ(record.Device, 3u);
+			ASSERT_EQ(record.Length, frame.size());
+			ASSERT_EQ(memcmp(record.Frame, &frame[0], frame.size()), 0);
+		}
+	};
+
+	TEST_F(JournalTest, test_Journal_Tail)
+	{
+		Journal * journal = Journal_Open(path.c_str(), 3, 64);
+		ASSERT_TRUE(journal != NULL);
+		ASSERT_EQ(Journal_Next(journal), 1u);
+
+		JournalReader * reader = JournalReader_Open(path.c_str());
+		ASSERT_TRUE(reader != NULL);
+		ASSERT_EQ(JournalReader_Header(reader)->Capacity, 64u);
+		ASSERT_EQ(JournalReader_Header(reader)->Device, 3u);
+
+		JournalRecord records[100];
+		uint64_t sequence = 0;
+		ASSERT_EQ(JournalReader_Poll(reader, &sequence, records, 100), 0u);
+
+		Append(journal, 10);
+		ASSERT_EQ(JournalReader_Poll(reader, &sequence, records, 4), 4u);
+		ASSERT_EQ(JournalReader_Poll(reader, &sequence, records + 4, 100), 6u);
+		ASSERT_EQ(sequence, 11u);
+		for (uint64_t k = 0; k < 10; k++)
+		{
+			ExpectRecord(records[k], k + 1);
+		}
+		ASSERT_EQ(JournalReader_Read(reader, 11, records), -EAGAIN);
+
+		// lapped by the writer, the reader resumes at the oldest record held
+		Append(journal, 100);
+		ASSERT_EQ(JournalReader_Next(reader), 111u);
+		ASSERT_EQ(JournalReader_Read(reader, 20, records), -ENOENT);
+		ASSERT_EQ(JournalReader_Poll(reader, &sequence, records, 100), 64u);
+		for (uint64_t k = 0; k < 64; k++)
+		{
+			ExpectRecord(records[k], 111 - 64 + k);
+		}
+
+		ASSERT_EQ(Journal_Append(journal, 0, 0xae, records[0].Frame, FRAME_RECORD_SIZE - 1), -EMSGSIZE);
+		ASSERT_EQ(Journal_Sync(journal), 0);
+
+		JournalReader_Close(reader);
+		Journal_Close(journal);
+	}
+
+	TEST_F(JournalTest, test_Journal_Recover)
+	{
+		Journal * journal = Journal_Open(path.c_str(), 3, 64);
+		ASSERT_TRUE(journal != NULL);
+		Append(journal, 150);
+
+		// one writer at a time
+		ASSERT_TRUE(Journal_Open(path.c_str(), 3, 64) == NULL);
+		ASSERT_EQ(errno, EBUSY);
+		Journal_Close(journal);
+
+		// tear the last record as a crash mid-write would
+		off_t last = sizeof(JournalHeader) + (150 % 64) * sizeof(JournalRecord) + offsetof(JournalRecord, Frame) + 10;
+		int fd = open(path.c_str(), O_RDWR);
+		ASSERT_GE(fd, 0);
+		ASSERT_EQ(pwrite(fd, "\xff\xff", 2, last), 2);
+		close(fd);
+
+		JournalReader * reader = JournalReader_Open(path.c_str());
+		JournalRecord record;
+		ASSERT_TRUE(reader != NULL);
+		ASSERT_EQ(JournalReader_Read(reader, 150, &record), -EIO);
+		JournalReader_Close(reader);
+
+		// the tail is the last good record, the torn one gets written again
+		journal = Journal_Open(path.c_str(), 3, 0);
+		ASSERT_TRUE(journal != NULL);
+		ASSERT_EQ(Journal_Next(journal), 150u);
+		Append(journal, 1);
+		Journal_Close(journal);
+
+		ASSERT_TRUE(Journal_Open(path.c_str(), 3, 128) == NULL);
+		ASSERT_EQ(errno, EINVAL);
+		ASSERT_TRUE(Journal_Open(path.c_str(), 4, 0) == NULL);
+		ASSERT_EQ(errno, EINVAL);
+
+		reader = JournalReader_Open(path.c_str());
+		ASSERT_TRUE(reader != NULL);
+		uint64_t sequence = 0;
+		JournalRecord records[64];
+		ASSERT_EQ(JournalReader_Poll(reader, &sequence, records, 64), 64u);
+		for (uint64_t k = 0; k < 64; k++)
+		{
+			ExpectRecord(records[k], 151 - 64 + k);
+		}
+		JournalReader_Close(reader);
+	}
+
+	TEST_F(JournalTest, test_Journal_Kill)
+	{
+		// create the file, then let a child write until it is killed
+		Journal * journal = Journal_Open(path.c_str(), 3, 1024);
+		ASSERT_TRUE(journal != NULL);
+		Journal_Close(journal);
+
+		pid_t child = fork();
+		ASSERT_GE(child, 0);
+		if (child == 0)
+		{
+			Journal * writer = Journal_Open(path.c_str(), 3, 0);
+
+			for (uint64_t sequence = 1; writer != NULL; sequence++)
+			{
+				const Frame &frame = FrameOf(sequence);
+
+				Journal_Append(writer, 1000 + sequence, frame[0], &frame[2], frame.size() - 2);
+			}
+			_exit(1);
+		}
+
+		// tail it from this process while it runs
+		JournalReader * reader = JournalReader_Open(path.c_str());
+		ASSERT_TRUE(reader != NULL);
+
+		std::vector<JournalRecord> records(256);
+		uint64_t sequence = 0;
+		uint64_t seen = 0;
+		uint64_t previous = 0;
+		time_t deadline = time(NULL) + 30;
+		while (seen < 20000)
+		{
+			// a writer that could not open the journal exits at once
+			if (waitpid(child, NULL, WNOHANG) == child)
+			{
+				FAIL() << "writer exited after " << seen << " records";
+			}
+			if (time(NULL) > deadline)
+			{
+				kill(child, SIGKILL);
+				waitpid(child, NULL, 0);
+				FAIL() << "writer stalled after " << seen << " records";
+			}
+
+			size_t count = JournalReader_Poll(reader, &sequence, &records[0], records.size());
+
+			for (size_t i = 0; i < count; i++)
+			{
+				ExpectRecord(records[i], records[i].Sequence);
+				ASSERT_GT(records[i].Sequence, previous);
+				previous = records[i].Sequence;
+			}
+			seen += count;
+		}
+		kill(child, SIGKILL);
+		ASSERT_EQ(waitpid(child, NULL, 0), child);
+
+		uint64_t next = JournalReader_Next(reader);
+		JournalReader_Close(reader);
+
+		journal = Journal_Open(path.c_str(), 3, 0);
+		ASSERT_TRUE(journal != NULL);
+		ASSERT_GE(Journal_Next(journal), next);
+		ASSERT_GT(Journal_Next(journal), previous);
+		Journal_Close(journal);
+	}
+
+	TEST_F(JournalTest, test_Journal_ReadMessage)
+	{
+		PtyPair pty;
+		uint8_t buffer[FRAME_MAX_LENGTH];
+		std::vector<uint8_t> stream;
+
+		ASSERT_TRUE(pty.Open());
+		Serial * serial = Serial_New(pty.path.c_str());
+		ASSERT_TRUE(serial != NULL);
+		Journal * journal = Journal_Open(path.c_str(), 3, 16);
+		ASSERT_TRUE(journal != NULL);
+		Serial_SetJournal(serial, journal);
+
+		// a good frame, a corrupted one, a good one, only the good ones go in
+		for (size_t i = 0; i < 3; i++)
+		{
+			stream.insert(stream.end(), frames[i].begin(), frames[i].end());
+		}
+		stream[frames[0].size() + 5] ^= 0x10;
+		ASSERT_EQ(write(pty.master, &stream[0], stream.size()), (ssize_t)stream.size());
+
+		ASSERT_EQ(ReadMessage(serial, AUTOREPORT_HEADER, buffer), AUTOREPORT_PAYLOAD_SIZE);
+		ASSERT_EQ(ReadMessage(serial, AUTOREPORT_HEADER, buffer), -EIO);
+		ASSERT_EQ(ReadMessage(serial, AUTOREPORT_HEADER, buffer), AUTOREPORT_PAYLOAD_SIZE);
+		ASSERT_EQ(Journal_Next(journal), 3u);
+
+		JournalReader * reader = JournalReader_Open(path.c_str());
+		JournalRecord record;
+		ASSERT_TRUE(reader != NULL);
+		ASSERT_EQ(JournalReader_Read(reader, 2, &record), 0);
+		ASSERT_EQ(record.Length, frames[2].size());
+		ASSERT_EQ(memcmp(record.Frame, &frames[2][0], frames[2].size()), 0);
+		ASSERT_GT(record.Timestamp, JournalReader_Header(reader)->CreatedRealtime);
+		JournalReader_Close(reader);
+
+		Serial_Free(serial);
+		Journal_Close(journal);
+	}
+
+}
@@ -0,0 +1,265 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "ptypair.h"
+
+#include "serial.h"
+#include "78m6610.h"
+#include "frameparser.h"
+#include "registerclient.h"
+#include "linkconfig.h"
+
+namespace PFC
+{
+
+	static const uint8_t AutoReportFrame[] = {0xae, 0x1e, 0xdc, 0x4c, 0x00 , 0xc1, 0xac, 0xff , 0xdd, 0xa8, 0x03 , 0x51, 0x11, 0x00 , 0xe9, 0xff, 0xff , 0xec, 0xff, 0xff , 0xf2, 0xff, 0xff , 0x85, 0xc1, 0x00 , 0x00, 0x00, 0x00, 0xaf};
+
+	// Meter end of the pty: answers register packets and streams AutoReports,
+	// corrupted while it runs at one of the broken rates
+	struct MeterSimulator
+	{
+		int fd;
+		volatile bool stop;
+		std::set<uint32_t> broken;
+		std::map<uint16_t, uint32_t> registers;
+		std::vector<uint32_t> baudWrites;
+		pthread_t thread;
+
+		explicit MeterSimulator(int fd_) : fd(fd_), stop(false)
+		{
+			registers[LINK_REGISTER_BAUD] = 19200;
+		}
+
+		void Start()
+		{
+			pthread_create(&thread, NULL, Run, this);
+		}
+
+		void Stop()
+		{
+			stop = true;
+			pthread_join(thread, NULL);
+		}
+
+		void Send(std::vector<uint8_t> bytes)
+		{
+			uint8_t sum = 0;
+
+			if (bytes.size() > 1)
+			{
+				for (size_t i = 0; i < bytes.size(); i++)
+				{
+					sum += bytes[i];
+				}
+				bytes.push_back(-sum);
+			}
+			ssize_t ret = write(fd, &bytes[0], bytes.size());
+			(void)ret;
+		}
+
+		void Handle(const uint8_t * commands, size_t length)
+		{
+			std::vector<uint8_t> reply = { REGISTER_REPLY_DATA, 2 };
+			uint16_t address = 0;
+			uint32_t newBaud = 0;
+
+			for (size_t i = 0; i < length; )
+			{
+				if (commands[i] == REGISTER_CMD_SELECT && i + 2 < length)
+				{
+					address = commands[i + 1] | (commands[i + 2] << 8);
+					i += 3;
+				}
+				else if (commands[i] == REGISTER_CMD_READ)
+				{
+					uint32_t value = registers[address];
+					reply.push_back(value & 0xff);
+					reply.push_back((value >> 8) & 0xff);
+					reply.push_back((value >> 16) & 0xff);
+					i += 1;
+				}
+				else if (commands[i] == REGISTER_CMD_WRITE && i + 3 < length)
+				{
+					uint32_t value = commands[i + 1] | (commands[i + 2] << 8) | (commands[i + 3] << 16);
+					registers[address] = value;
+					if (address == LINK_REGISTER_BAUD)
+					{
+						newBaud = value;
+						baudWrites.push_back(value);
+					}
+					i += 4;
+				}
+				else
+				{
+					Send({ REGISTER_REPLY_NACK });
+					return;
+				}
+			}
+
+			if (reply.size() > 2)
+			{
+				reply[1] = reply.size() + 1;
+				Send(reply);
+			}
+			else
+			{
+				Send({ REGISTER_REPLY_ACK });
+			}
+
+			// the ACK went out at the old rate
+			if (newBaud != 0)
+			{
+				registers[LINK_REGISTER_BAUD] = newBaud;
+			}
+		}
+
+		static void * Run(void * arg)
+		{
+			MeterSimulator * meter = (MeterSimulator *)arg;
+			FrameParser * parser = FrameParser_New(REGISTER_PACKET_HEADER, 4);
+			uint8_t buffer[FRAME_MAX_LENGTH];
+			uint8_t header = 0;
+			int length = 0;
+
+			FrameParser_AddHeader(parser, REGISTER_PACKET_HEADER, 4, FRAME_MAX_LENGTH);
+
+			while (!meter->stop)
+			{
+				struct pollfd pfd = { meter->fd, POLLIN, 0 };
+
+				if (poll(&pfd, 1, 5) > 0)
+				{
+					FrameParser_Fill(parser, meter->fd);
+				}
+
+				while ((length = FrameParser_Next(parser, &header, buffer)) > 0)
+				{
+					meter->Handle(buffer, length - 1);
+				}
+
+				std::vector<uint8_t> frame(AutoReportFrame, AutoReportFrame + sizeof(AutoReportFrame));
+				if (meter->broken.count(meter->registers[LINK_REGISTER_BAUD]))
+				{
+					frame[10] ^= 0x5a;
+				}
+				ssize_t ret = write(meter->fd, &frame[0], frame.size());
+				(void)ret;
+			}
+
+			FrameParser_Free(parser);
+			return NULL;
+		}
+	};
+
+	class LinkTest : public testing::Test
+	{
+protected:
+		PtyPair pty;
+		Serial * serial;
+		FrameParser * parser;
+		RegisterClient * client;
+		LinkParameters parameters;
+
+		LinkTest() : serial(NULL), parser(NULL), client(NULL) {}
+
+		void SetUp()
+		{
+			ASSERT_TRUE(pty.Open());
+			serial = Serial_New(pty.path.c_str());
+			ASSERT_TRUE(serial != NULL);
+			parser = FrameParser_New(AUTOREPORT_HEADER, AUTOREPORT_LENGTH);
+			RegisterClient_SetupParser(parser);
+			client = RegisterClient_New(serial);
+
+			Link_DefaultParameters(&parameters);
+			parameters.VerifyTimeoutUs = 200000;
+			parameters.CommandTimeoutUs = 100000;
+		}
+
+		void TearDown()
+		{
+			RegisterClient_Free(client);
+			FrameParser_Free(parser);
+			Serial_Free(serial);
+		}
+	};
+
+	TEST_F(LinkTest, test_Link_Negotiate_Fallback)
+	{
+		const uint32_t rates[] = { 115200, 57600, 19200, 9600 };
+		MeterSimulator meter(pty.master);
+		SerialOptions options;
+
+		meter.broken.insert(115200);
+		meter.Start();
+
+		parameters.IntervalMs = 50;
+		ASSERT_EQ(Link_Negotiate(serial, client, parser, rates, 4, &parameters), 57600);
+
+		meter.Stop();
+
+		// tried 115200, went back, settled on 57600
+		ASSERT_EQ(meter.baudWrites, std::vector<uint32_t>({ 115200, 19200, 57600 }));
+		ASSERT_EQ(meter.registers[LINK_REGISTER_INTERVAL], 50u);
+		ASSERT_EQ(Serial_GetOptions(serial, &options), 0);
+		ASSERT_EQ(options.Baud, 57600u);
+	}
+
+	TEST_F(LinkTest, test_Link_Negotiate_NothingFaster)
+	{
+		const uint32_t rates[] = { 115200 };
+		MeterSimulator meter(pty.master);
+
+		meter.broken.insert(115200);
+		meter.Start();
+
+		ASSERT_EQ(Link_Negotiate(serial, client, parser, rates, 1, &parameters), 19200);
+		ASSERT_EQ(Link_Verify(serial, parser, 3, 200000), 0);
+
+		meter.Stop();
+	}
+
+	TEST(SerialOptionsTest, test_Serial_Options)
+	{
+		PtyPair pty;
+		SerialOptions options;
+		struct termios tty;
+
+		ASSERT_TRUE(pty.Open());
+
+		Serial_DefaultOptions(&options);
+		options.Baud = 12345;
+		ASSERT_TRUE(Serial_NewWithOptions(pty.path.c_str(), &options) == NULL);
+
+		options.Baud = 115200;
+		options.Parity = SERIAL_PARITY_NONE;
+		options.StopBits = 2;
+
+		Serial * serial = Serial_NewWithOptions(pty.path.c_str(), &options);
+		ASSERT_TRUE(serial != NULL);
+
+		ASSERT_EQ(tcgetattr(Serial_GetFD(serial), &tty), 0);
+		ASSERT_EQ(cfgetospeed(&tty), (speed_t)B115200);
+		ASSERT_EQ(tty.c_cflag & PARENB, 0u);
+		ASSERT_NE(tty.c_cflag & CSTOPB, 0u);
+
+		options.Baud = 57600;
+		options.Parity = SERIAL_PARITY_ODD;
+		ASSERT_EQ(Serial_SetOptions(serial, &options), 0);
+		ASSERT_EQ(tcgetattr(Serial_GetFD(serial), &tty), 0);
+		ASSERT_EQ(cfgetospeed(&tty), (speed_t)B57600);
+		ASSERT_NE(tty.c_cflag & PARODD, 0u);
+
+		Serial_Free(serial);
+	}
+
+}
@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <math.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "quantile.h"
+
+namespace PFC
+{
+
+	static const double Fractions[] = {0.01, 0.05, 0.25, 0.5, 0.75, 0.95, 0.99, 0.999};
+
+	// Loads switching between idle and running, in W
+	static std::vector<float> Watts(size_t count, unsigned int seed)
+	{
+		std::mt19937 random(seed);
+		std::lognormal_distribution<float> idle(3.0f, 0.3f);
+		std::normal_distribution<float> running(1800.0f, 120.0f);
+		std::vector<float> values;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			values.push_back((random() % 4 == 0) ? running(random) : idle(random));
+		}
+
+		return values;
+	}
+
+	// The fraction of sorted values at or below value
+	static double Rank(const std::vector<float> &sorted, float value)
+	{
+		return (double)(std::upper_bound(sorted.begin(), sorted.end(), value) - sorted.begin()) / sorted.size();
+	}
+
+	// Rank error allowed at q, k1 keeps the tails tight
+	static double Tolerance(double q)
+	{
+		return 0.002 + 0.02 * sqrt(q * (1.0 - q));
+	}
+
+	static void ExpectQuantiles(QuantileSketch * sketch, std::vector<float> values)
+	{
+		std::sort(values.begin(), values.end());
+
+		ASSERT_EQ(QuantileSketch_Count(sketch), (uint64_t)values.size());
+		EXPECT_EQ(QuantileSketch_Min(sketch), values.front());
+		EXPECT_EQ(QuantileSketch_Max(sketch), values.back());
+		EXPECT_EQ(QuantileSketch_Quantile(sketch, 0.0), values.front());
+		EXPECT_EQ(QuantileSketch_Quantile(sketch, 1.0), values.back());
+
+		for (size_t i = 0; i < sizeof(Fractions) / sizeof(Fractions[0]); i++)
+		{
+			double q = Fractions[i];
+
+			EXPECT_NEAR(Rank(values, QuantileSketch_Quantile(sketch, q)), q, Tolerance(q)) << "q " << q;
+		}
+	}
+
+	TEST(QuantileTest, test_Quantile_Small)
+	{
+		QuantileSketch * sketch = QuantileSketch_New(0);
+
+		ASSERT_TRUE(sketch != NULL);
+		EXPECT_TRUE(isnan(QuantileSketch_Quantile(sketch, 0.5)));
+		EXPECT_TRUE(isnan(QuantileSketch_Min(sketch)));
+
+		QuantileSketch_Add(sketch, 42.0f);
+		QuantileSketch_Add(sketch, NAN);
+		EXPECT_EQ(QuantileSketch_Count(sketch), 1u);
+		EXPECT_EQ(QuantileSketch_Quantile(sketch, 0.5), 42.0f);
+
+		// below the compression every value is its own centroid
+		QuantileSketch_Reset(sketch);
+		for (int i = 1; i <= 9; i++)
+		{
+			QuantileSketch_Add(sketch, (float)(10 - i));
+		}
+		EXPECT_EQ(QuantileSketch_Quantile(sketch, 0.01), 1.0f);
+		EXPECT_EQ(QuantileSketch_Quantile(sketch, 0.5), 5.0f);
+		EXPECT_EQ(QuantileSketch_Quantile(sketch, 0.99), 9.0f);
+
+		EXPECT_TRUE(QuantileSketch_New(5) == NULL);
+		EXPECT_TRUE(QuantileSketch_New(QUANTILE_MAX_COMPRESSION + 1) == NULL);
+
+		QuantileSketch_Free(sketch);
+	}
+
+	TEST(QuantileTest, test_Quantile_Accuracy)
+	{
+		QuantileSketch * sketch = QuantileSketch_New(0);
+		std::vector<float> values = Watts(200000, 1);
+		uint8_t buffer[QUANTILE_SERIALIZED_SIZE(QUANTILE_DEFAULT_COMPRESSION)];
+
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			QuantileSketch_Add(sketch, values[i]);
+		}
+		ExpectQuantiles(sketch, values);
+
+		// the size is bounded however long it runs
+		int size = QuantileSketch_Serialize(sketch, buffer, sizeof(buffer));
+		ASSERT_GT(size, 0);
+		EXPECT_LE(size, 24 + 8 * (QUANTILE_DEFAULT_COMPRESSION + 2));
+
+		QuantileSketch_Free(sketch);
+	}
+
+	TEST(QuantileTest, test_Quantile_Merge)
+	{
+		const unsigned int compressions[] = {100, 50, 200, 100};
+		std::vector<float> all;
+		QuantileSketch * total = QuantileSketch_New(0);
+		QuantileSketch * received = QuantileSketch_New(QUANTILE_MAX_COMPRESSION);
+		std::vector<uint8_t> buffer(QUANTILE_SERIALIZED_SIZE(QUANTILE_MAX_COMPRESSION));
+
+		// four gateways, the last one idle, shipping their sketches to one place
+		for (unsigned int g = 0; g < 4; g++)
+		{
+			QuantileSketch * gateway = QuantileSketch_New(compressions[g]);
+			std::vector<float> values = Watts((g < 3) ? 50000 * (g + 1) : 0, 10 + g);
+
+			for (size_t i = 0; i < values.size(); i++)
+			{
+				QuantileSketch_Add(gateway, values[i]);
+			}
+			all.insert(all.end(), values.begin(), values.end());
+
+			int size = QuantileSketch_Serialize(gateway, &buffer[0], buffer.size());
+			ASSERT_GT(size, 0);
+			ASSERT_EQ(QuantileSketch_Deserialize(received, &buffer[0], size), 0);
+			ASSERT_EQ(QuantileSketch_Count(received), (uint64_t)values.size());
+			ASSERT_EQ(QuantileSketch_Merge(total, received), 0);
+
+			QuantileSketch_Free(gateway);
+		}
+		ExpectQuantiles(total, all);
+
+		EXPECT_EQ(QuantileSketch_Merge(total, total), -EINVAL);
+
+		QuantileSketch_Free(received);
+		QuantileSketch_Free(total);
+	}
+
+	TEST(QuantileTest, test_Quantile_Deserialize)
+	{
+		QuantileSketch * sketch = QuantileSketch_New(0);
+		QuantileSketch * small = QuantileSketch_New(10);
+		std::vector<float> values = Watts(10000, 2);
+		uint8_t buffer[QUANTILE_SERIALIZED_SIZE(QUANTILE_DEFAULT_COMPRESSION)];
+
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			QuantileSketch_Add(sketch, values[i]);
+		}
+		int size = QuantileSketch_Serialize(sketch, buffer, sizeof(buffer));
+		ASSERT_GT(size, 24);
+		EXPECT_EQ(QuantileSketch_Serialize(sketch, buffer, size - 1), -ENOSPC);
+
+		// a broken buffer leaves the sketch as it was
+		QuantileSketch_Add(small, 1.0f);
+		EXPECT_EQ(QuantileSketch_Deserialize(small, buffer, size), -EINVAL);
+		EXPECT_EQ(QuantileSketch_Deserialize(sketch, buffer, size - 8), -EINVAL);
+		buffer[0] = 'X';
+		EXPECT_EQ(QuantileSketch_Deserialize(sketch, buffer, size), -EINVAL);
+		buffer[0] = 'Q';
+		buffer[24 + 4] ^= 1;
+		EXPECT_EQ(QuantileSketch_Deserialize(sketch, buffer, size), -EINVAL);
+		buffer[24 + 4] ^= 1;
+		EXPECT_EQ(QuantileSketch_Count(small), 1u);
+
+		float p95 = QuantileSketch_Quantile(sketch, 0.95);
+		ASSERT_EQ(QuantileSketch_Deserialize(sketch, buffer, size), 0);
+		EXPECT_EQ(QuantileSketch_Quantile(sketch, 0.95), p95);
+
+		QuantileSketch_Free(small);
+		QuantileSketch_Free(sketch);
+	}
+
+}
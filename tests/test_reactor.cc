@@ -0,0 +1,300 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <errno.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include <vector>
+
+#include "ptypair.h"
+
+#include "serial.h"
+#include "78m6610.h"
+#include "reactor.h"
+
+namespace PFC
+{
+
+	static const uint8_t AutoReportFrame[] = {0xae, 0x1e, 0xdc, 0x4c, 0x00 , 0xc1, 0xac, 0xff , 0xdd, 0xa8, 0x03 , 0x51, 0x11, 0x00 , 0xe9, 0xff, 0xff , 0xec, 0xff, 0xff , 0xf2, 0xff, 0xff , 0x85, 0xc1, 0x00 , 0x00, 0x00, 0x00, 0xaf};
+
+	struct DeviceState
+	{
+		int frames;
+		int hangups;
+		float vrms;
+
+		DeviceState() : frames(0), hangups(0), vrms(0) {}
+	};
+
+	static void OnFrame(void * context, Serial * serial, const AutoReportMessage * message, const AutoReportValues * values)
+	{
+		DeviceState * state = (DeviceState *)context;
+
+		if (message == NULL)
+		{
+			state->hangups++;
+		}
+		else
+		{
+			state->frames++;
+			state->vrms = values->Vrms;
+		}
+	}
+
+	// Every test runs on both read paths, AUTO is io_uring where the kernel has it
+	class ReactorTest : public testing::TestWithParam<ReactorBackend>
+	{
+protected:
+		static const int DeviceCount = 48;
+
+		Reactor * reactor;
+		std::vector<PtyPair> ptys;
+		std::vector<Serial *> serials;
+		std::vector<DeviceState> states;
+
+		ReactorTest() : reactor(NULL), ptys(DeviceCount), serials(DeviceCount), states(DeviceCount) {}
+
+		void SetUp()
+		{
+			reactor = Reactor_NewWithBackend(GetParam());
+			ASSERT_TRUE(reactor != NULL);
+			ASSERT_NE(Reactor_GetBackend(reactor), REACTOR_BACKEND_AUTO);
+
+			for (int i = 0; i < DeviceCount; i++)
+			{
+				ASSERT_TRUE(ptys[i].Open());
+				serials[i] = Serial_New(ptys[i].path.c_str());
+				ASSERT_TRUE(serials[i] != NULL);
+				ASSERT_EQ(Reactor_Add(reactor, serials[i], OnFrame, &states[i]), 0);
+			}
+
+			ASSERT_EQ(Reactor_Count(reactor), (size_t)DeviceCount);
+		}
+		void TearDown()
+		{
+			Reactor_Free(reactor);
+
+			for (int i = 0; i < DeviceCount; i++)
+			{
+				Serial_Free(serials[i]);
+			}
+		}
+
+		int RunUntil(int frames)
+		{
+			int total = 0;
+			int loops = 0;
+
+			while (total < frames && loops++ < 1000)
+			{
+				int ret = Reactor_RunOnce(reactor, 100);
+
+				if (ret < 0)
+				{
+					break;
+				}
+				total += ret;
+			}
+
+			return total;
+		}
+	};
+
+	TEST_P(ReactorTest, test_Reactor_ManyDevices)
+	{
+		const int FramesPerDevice = 5;
+
+		srand(3);
+
+		for (int i = 0; i < DeviceCount; i++)
+		{
+			for (int j = 0; j < FramesPerDevice; j++)
+			{
+				uint8_t noise[7];
+
+				for (size_t k = 0; k < sizeof(noise); k++)
+				{
+					noise[k] = rand();
+				}
+
+				ASSERT_EQ(write(ptys[i].master, noise, sizeof(noise)), (ssize_t)sizeof(noise));
+				ASSERT_EQ(write(ptys[i].master, AutoReportFrame, sizeof(AutoReportFrame)), (ssize_t)sizeof(AutoReportFrame));
+			}
+		}
+
+		ASSERT_EQ(RunUntil(DeviceCount * FramesPerDevice), DeviceCount * FramesPerDevice);
+
+		for (int i = 0; i < DeviceCount; i++)
+		{
+			EXPECT_EQ(states[i].frames, FramesPerDevice);
+			EXPECT_NEAR(states[i].vrms, 239.837f, 0.001f);
+		}
+	}
+
+	TEST_P(ReactorTest, test_Reactor_Hangup)
+	{
+		int loops = 0;
+
+		ptys[0].Close();
+
+		while (states[0].hangups == 0 && loops++ < 10)
+		{
+			ASSERT_GE(Reactor_RunOnce(reactor, 100), 0);
+		}
+
+		ASSERT_EQ(states[0].hangups, 1);
+		ASSERT_EQ(Reactor_Count(reactor), (size_t)DeviceCount - 1);
+		ASSERT_EQ(Reactor_Remove(reactor, serials[0]), -ENOENT);
+	}
+
+	TEST_P(ReactorTest, test_Reactor_WriteQueue)
+	{
+		const uint8_t command[] = {0xa5, 0x08, 0xa3, 0x02, 0x00, 0xe3, 0x00, 0x00};
+		int loops = 0;
+
+		// queued without writing, flushed by the reactor when writable
+		for (int i = 0; i < DeviceCount; i++)
+		{
+			ASSERT_EQ(Serial_Queue(serials[i], command, sizeof(command)), 0);
+			ASSERT_EQ(Serial_Queue(serials[i], command, sizeof(command)), 0);
+			ASSERT_EQ(Serial_Pending(serials[i]), 2 * sizeof(command));
+		}
+
+		for (int i = 0; i < DeviceCount; i++)
+		{
+			while (Serial_Pending(serials[i]) > 0 && loops++ < 100)
+			{
+				ASSERT_GE(Reactor_RunOnce(reactor, 100), 0);
+			}
+			ASSERT_EQ(Serial_Pending(serials[i]), 0u);
+		}
+
+		for (int i = 0; i < DeviceCount; i++)
+		{
+			uint8_t received[2 * sizeof(command)];
+
+			ASSERT_EQ(read(ptys[i].master, received, sizeof(received)), (ssize_t)sizeof(received));
+			ASSERT_EQ(memcmp(received, command, sizeof(command)), 0);
+			ASSERT_EQ(memcmp(&received[sizeof(command)], command, sizeof(command)), 0);
+		}
+
+		// nothing left to write, the reactor goes back to waiting for input
+		ASSERT_EQ(Reactor_RunOnce(reactor, 10), 0);
+	}
+
+	TEST_P(ReactorTest, test_Reactor_Stop)
+	{
+		Reactor_Stop(reactor);
+		ASSERT_EQ(Reactor_RunOnce(reactor, 1000), 0);
+		ASSERT_EQ(Reactor_Remove(reactor, serials[1]), 0);
+		ASSERT_EQ(Reactor_Count(reactor), (size_t)DeviceCount - 1);
+	}
+
+	INSTANTIATE_TEST_CASE_P(Backends, ReactorTest, testing::Values(REACTOR_BACKEND_EPOLL, REACTOR_BACKEND_AUTO));
+
+	TEST(ReactorBackendTest, test_Reactor_Backend)
+	{
+		Reactor * reactor = Reactor_NewWithBackend(REACTOR_BACKEND_URING);
+
+		// either io_uring works here or the request fails outright, never silently epoll
+		if (reactor == NULL)
+		{
+			ASSERT_NE(errno, 0);
+			reactor = Reactor_NewWithBackend(REACTOR_BACKEND_AUTO);
+			ASSERT_EQ(Reactor_GetBackend(reactor), REACTOR_BACKEND_EPOLL);
+		}
+		else
+		{
+			ASSERT_EQ(Reactor_GetBackend(reactor), REACTOR_BACKEND_URING);
+		}
+		Reactor_Free(reactor);
+
+		reactor = Reactor_New();
+		ASSERT_EQ(Reactor_GetBackend(reactor), REACTOR_BACKEND_EPOLL);
+		Reactor_Free(reactor);
+	}
+
+	// Child side of test_Reactor_ArmFails, the exit status is the number of devices unaccounted for
+	static int ArmFailsChild(int count)
+	{
+		std::vector<PtyPair> ptys(count);
+		std::vector<DeviceState> states(count);
+		Reactor * reactor = Reactor_NewWithBackend(REACTOR_BACKEND_URING);
+		struct sock_filter filter[] =
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, __NR_io_uring_enter, 0, 1),
+			BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | EAGAIN),
+			BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+		};
+		struct sock_fprog program = {sizeof(filter) / sizeof(filter[0]), filter};
+		int hangups = 0;
+
+		// freed devices read back as garbage, a callback taken from one crashes
+		mallopt(M_PERTURB, 0xa5);
+
+		for (int i = 0; i < count; i++)
+		{
+			Serial * serial = NULL;
+
+			if (!ptys[i].Open() || (serial = Serial_New(ptys[i].path.c_str())) == NULL
+				|| Reactor_Add(reactor, serial, OnFrame, &states[i]) != 0)
+			{
+				return 100;
+			}
+		}
+
+		// every submission fails, arming the devices past the queue's size fails
+		if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0 || prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) != 0)
+		{
+			return 101;
+		}
+
+		Reactor_RunOnce(reactor, 0);
+
+		for (int i = 0; i < count; i++)
+		{
+			hangups += states[i].hangups;
+		}
+
+		return (hangups > 0) ? count - hangups - (int)Reactor_Count(reactor) : 102;
+	}
+
+	TEST(ReactorBackendTest, test_Reactor_ArmFails)
+	{
+		// more devices than the submission queue holds
+		const int DeviceCount = 300;
+		Reactor * reactor = Reactor_NewWithBackend(REACTOR_BACKEND_URING);
+		int status = 0;
+
+		if (reactor == NULL)
+		{
+			return;
+		}
+		Reactor_Free(reactor);
+
+		fflush(stdout);
+		pid_t child = fork();
+		ASSERT_GE(child, 0);
+		if (child == 0)
+		{
+			int Result = ArmFailsChild(DeviceCount);
+
+			fflush(stdout);
+			_exit(Result);
+		}
+
+		ASSERT_EQ(waitpid(child, &status, 0), child);
+		ASSERT_TRUE(WIFEXITED(status)) << "child killed by signal " << WTERMSIG(status);
+		ASSERT_EQ(WEXITSTATUS(status), 0);
+	}
+
+}
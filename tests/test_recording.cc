@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "serial_data.h"
+
+#include "78m6610.h"
+#include "recording.h"
+
+namespace PFC
+{
+
+	class RecordingTest : public testing::Test
+	{
+protected:
+		std::vector<Frame> frames;
+		std::string path;
+
+		void SetUp()
+		{
+			char name[] = "/tmp/monip_recording_XXXXXX";
+			int fd = mkstemp(name);
+
+			ASSERT_GE(fd, 0);
+			close(fd);
+			unlink(name);
+			path = name;
+
+			frames = LoadSerialData(MONIP_SERIAL_DATA);
+			ASSERT_FALSE(frames.empty());
+		}
+
+		void TearDown()
+		{
+			unlink(path.c_str());
+		}
+
+		// every frame of serial_data.txt, count times over, device = index % 7
+		void Record(size_t count)
+		{
+			Recorder * recorder = Recorder_Open(path.c_str());
+			ASSERT_TRUE(recorder != NULL);
+
+			for (size_t i = 0; i < count * frames.size(); i++)
+			{
+				const Frame &frame = frames[i % frames.size()];
+				ASSERT_EQ(Recorder_Write(recorder, 1000 + i, i % 7, frame[0], &frame[2], frame.size() - 2), 0);
+			}
+
+			ASSERT_EQ(Recorder_Close(recorder), 0);
+		}
+	};
+
+	TEST_F(RecordingTest, test_Recording_RoundTrip)
+	{
+		// more than one Recorder buffer, then append from a second Recorder
+		const size_t rounds = RECORDER_BUFFER_RECORDS / frames.size() + 2;
+
+		Record(rounds);
+		Record(1);
+
+		Recording * recording = Recording_Open(path.c_str());
+		ASSERT_TRUE(recording != NULL);
+		ASSERT_EQ(Recording_Count(recording), (rounds + 1) * frames.size());
+		ASSERT_GT(Recording_Header(recording)->CreatedRealtime, 0u);
+
+		const RecordingRecord * records = Recording_Records(recording);
+
+		for (size_t i = 0; i < Recording_Count(recording); i++)
+		{
+			const Frame &frame = frames[i % frames.size()];
+			size_t seq = (i < rounds * frames.size()) ? i : i - rounds * frames.size();
+
+			ASSERT_EQ(records[i].Timestamp, 1000 + seq);
+			ASSERT_EQ(records[i].Device, seq % 7);
+			ASSERT_EQ(records[i].Length, frame.size());
+			ASSERT_EQ(memcmp(records[i].Frame, &frame[0], frame.size()), 0);
+
+			// the stored frame is still a valid AutoReport
+			ASSERT_EQ(ValidateMessage(records[i].Frame[0], records[i].Frame[1], &records[i].Frame[2], records[i].Length - 2), 0);
+		}
+
+		ASSERT_TRUE(Recording_At(recording, Recording_Count(recording)) == NULL);
+
+		Recording_Close(recording);
+	}
+
+	TEST_F(RecordingTest, test_Recording_TornTail)
+	{
+		Record(1);
+
+		// a crash part way through a record
+		FILE * file = fopen(path.c_str(), "ab");
+		ASSERT_TRUE(file != NULL);
+		fwrite("torn", 1, 4, file);
+		fclose(file);
+
+		Recording * recording = Recording_Open(path.c_str());
+		ASSERT_TRUE(recording != NULL);
+		ASSERT_EQ(Recording_Count(recording), frames.size());
+		Recording_Close(recording);
+
+		// the next Recorder cuts the tail off before appending
+		Record(1);
+
+		recording = Recording_Open(path.c_str());
+		ASSERT_TRUE(recording != NULL);
+		ASSERT_EQ(Recording_Count(recording), 2 * frames.size());
+		ASSERT_EQ(Recording_At(recording, frames.size())->Timestamp, 1000u);
+		Recording_Close(recording);
+	}
+
+	TEST_F(RecordingTest, test_Recording_Invalid)
+	{
+		uint8_t payload[FRAME_RECORD_SIZE] = { 0 };
+
+		Recorder * recorder = Recorder_Open(path.c_str());
+		ASSERT_TRUE(recorder != NULL);
+		ASSERT_EQ(Recorder_Write(recorder, 0, 0, AUTOREPORT_HEADER, payload, FRAME_RECORD_SIZE - 1), -EMSGSIZE);
+		ASSERT_EQ(Recorder_Count(recorder), 0u);
+		ASSERT_EQ(Recorder_Close(recorder), 0);
+
+		FILE * file = fopen(path.c_str(), "r+b");
+		ASSERT_TRUE(file != NULL);
+		fwrite("NOTMONIP", 1, 8, file);
+		fclose(file);
+
+		ASSERT_TRUE(Recording_Open(path.c_str()) == NULL);
+		ASSERT_EQ(errno, EINVAL);
+		ASSERT_TRUE(Recorder_Open(path.c_str()) == NULL);
+		ASSERT_EQ(errno, EINVAL);
+	}
+
+}
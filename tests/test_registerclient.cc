@@ -0,0 +1,258 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "ptypair.h"
+
+#include "serial.h"
+#include "78m6610.h"
+#include "frameparser.h"
+#include "reactor.h"
+#include "registerclient.h"
+
+namespace PFC
+{
+
+	static const uint8_t AutoReportFrame[] = {0xae, 0x1e, 0xdc, 0x4c, 0x00 , 0xc1, 0xac, 0xff , 0xdd, 0xa8, 0x03 , 0x51, 0x11, 0x00 , 0xe9, 0xff, 0xff , 0xec, 0xff, 0xff , 0xf2, 0xff, 0xff , 0x85, 0xc1, 0x00 , 0x00, 0x00, 0x00, 0xaf};
+
+	struct Completion
+	{
+		int status;
+		std::vector<uint32_t> values;
+	};
+
+	static void OnComplete(void * context, int status, const uint16_t * addresses, const uint32_t * values, size_t count)
+	{
+		Completion completion;
+
+		completion.status = status;
+		if (values != NULL)
+		{
+			completion.values.assign(values, values + count);
+		}
+		((std::vector<Completion> *)context)->push_back(completion);
+	}
+
+	static void OnOtherFrame(void * context, uint8_t header, const uint8_t * payload, int length)
+	{
+		(*(int *)context) += (header == AUTOREPORT_HEADER);
+	}
+
+	// Data reply as the meter sends it: 0xAA, length, 3 bytes per value, checksum
+	static std::vector<uint8_t> DataReply(const std::vector<uint32_t> &values)
+	{
+		std::vector<uint8_t> reply = { REGISTER_REPLY_DATA, (uint8_t)(values.size() * 3 + 3) };
+		uint8_t sum = 0;
+
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			reply.push_back(values[i] & 0xff);
+			reply.push_back((values[i] >> 8) & 0xff);
+			reply.push_back((values[i] >> 16) & 0xff);
+		}
+		for (size_t i = 0; i < reply.size(); i++)
+		{
+			sum += reply[i];
+		}
+		reply.push_back(-sum);
+
+		return reply;
+	}
+
+	class RegisterClientTest : public testing::Test
+	{
+protected:
+		PtyPair pty;
+		Serial * serial;
+		FrameParser * parser;
+		RegisterClient * client;
+		std::vector<Completion> completions;
+
+		RegisterClientTest() : serial(NULL), parser(NULL), client(NULL) {}
+
+		void SetUp()
+		{
+			ASSERT_TRUE(pty.Open());
+			serial = Serial_New(pty.path.c_str());
+			ASSERT_TRUE(serial != NULL);
+			parser = FrameParser_New(AUTOREPORT_HEADER, AUTOREPORT_LENGTH);
+			RegisterClient_SetupParser(parser);
+			client = RegisterClient_New(serial);
+			ASSERT_TRUE(client != NULL);
+		}
+
+		void TearDown()
+		{
+			RegisterClient_Free(client);
+			FrameParser_Free(parser);
+			Serial_Free(serial);
+		}
+
+		void Reply(const std::vector<uint8_t> &bytes)
+		{
+			ASSERT_EQ(write(pty.master, &bytes[0], bytes.size()), (ssize_t)bytes.size());
+		}
+
+		std::vector<uint8_t> Sent(size_t size)
+		{
+			std::vector<uint8_t> sent(size);
+
+			Serial_Flush(serial);
+			EXPECT_EQ(read(pty.master, &sent[0], size), (ssize_t)size);
+
+			return sent;
+		}
+	};
+
+	TEST_F(RegisterClientTest, test_RegisterClient_BatchedRead)
+	{
+		const uint16_t addresses[] = { 0x0012, 0x0103, 0x0204 };
+		int autoReports = 0;
+
+		ASSERT_EQ(RegisterClient_Read(client, addresses, 3, 500000, OnComplete, &completions), 0);
+
+		// one packet: header, length, select/read per register, zero sum
+		std::vector<uint8_t> packet = Sent(2 + 3 * 4 + 1);
+		uint8_t sum = 0;
+
+		ASSERT_EQ(packet[0], REGISTER_PACKET_HEADER);
+		ASSERT_EQ(packet[1], packet.size());
+		ASSERT_EQ(packet[6], REGISTER_CMD_SELECT);
+		ASSERT_EQ(packet[7], 0x03);
+		ASSERT_EQ(packet[8], 0x01);
+		ASSERT_EQ(packet[9], REGISTER_CMD_READ);
+		for (size_t i = 0; i < packet.size(); i++)
+		{
+			sum += packet[i];
+		}
+		ASSERT_EQ(sum, 0);
+
+		// the AutoReport stream carries on around the reply
+		Reply(std::vector<uint8_t>(AutoReportFrame, AutoReportFrame + sizeof(AutoReportFrame)));
+		Reply(DataReply({ 0x123456, 0xffffff, 0x000001 }));
+
+		ASSERT_EQ(RegisterClient_Run(client, parser, 500000, OnOtherFrame, &autoReports), 0);
+
+		ASSERT_EQ(autoReports, 1);
+		ASSERT_EQ(completions.size(), 1u);
+		ASSERT_EQ(completions[0].status, 0);
+		ASSERT_EQ(completions[0].values, std::vector<uint32_t>({ 0x123456, 0xffffff, 0x000001 }));
+	}
+
+	TEST_F(RegisterClientTest, test_RegisterClient_Pipelined)
+	{
+		const uint16_t address = 0x0030;
+
+		ASSERT_EQ(RegisterClient_Write(client, address, 0x00abcd, 500000, OnComplete, &completions), 0);
+		ASSERT_EQ(RegisterClient_Read(client, &address, 1, 500000, OnComplete, &completions), 0);
+		ASSERT_EQ(RegisterClient_Read(client, &address, 1, 500000, OnComplete, &completions), 0);
+		ASSERT_EQ(RegisterClient_Outstanding(client), 3u);
+
+		// all three packets leave together
+		ASSERT_EQ(Serial_Pending(serial), 10u + 7u + 7u);
+		Sent(24);
+
+		Reply({ REGISTER_REPLY_ACK });
+		Reply(DataReply({ 0x00abcd }));
+		Reply({ REGISTER_REPLY_CHECKSUM });
+
+		ASSERT_EQ(RegisterClient_Run(client, parser, 500000, NULL, NULL), 0);
+
+		ASSERT_EQ(completions.size(), 3u);
+		ASSERT_EQ(completions[0].status, 0);
+		ASSERT_EQ(completions[1].status, 0);
+		ASSERT_EQ(completions[1].values, std::vector<uint32_t>({ 0x00abcd }));
+		ASSERT_EQ(completions[2].status, -EBADMSG);
+	}
+
+	TEST_F(RegisterClientTest, test_RegisterClient_Timeout)
+	{
+		const uint16_t address = 0x0030;
+		uint32_t value = 0;
+
+		ASSERT_EQ(RegisterClient_ReadSync(client, parser, &address, &value, 1, 20000), -ETIMEDOUT);
+		ASSERT_EQ(RegisterClient_Outstanding(client), 0u);
+
+		// the late reply is not taken for the next request
+		ASSERT_EQ(RegisterClient_Read(client, &address, 1, 200000, OnComplete, &completions), 0);
+		Reply(DataReply({ 0x000bad, 0x000bad }));
+		Reply(DataReply({ 0x000123 }));
+
+		ASSERT_EQ(RegisterClient_Run(client, parser, 500000, NULL, NULL), 0);
+		ASSERT_EQ(completions.size(), 1u);
+		ASSERT_EQ(completions[0].values, std::vector<uint32_t>({ 0x000123 }));
+	}
+
+	TEST_F(RegisterClientTest, test_RegisterClient_AckInTruncatedFrame)
+	{
+		std::vector<uint8_t> stream(AutoReportFrame, AutoReportFrame + 12);
+		int autoReports = 0;
+
+		ASSERT_EQ(RegisterClient_Write(client, 0x0030, 0x00abcd, 500000, OnComplete, &completions), 0);
+
+		// an AutoReport cut short, 0xAD among its bytes, then a whole one
+		stream[5] = REGISTER_REPLY_ACK;
+		stream.insert(stream.end(), AutoReportFrame, AutoReportFrame + sizeof(AutoReportFrame));
+		Reply(stream);
+
+		ASSERT_EQ(RegisterClient_Run(client, parser, 50000, OnOtherFrame, &autoReports), -ETIMEDOUT);
+		ASSERT_EQ(autoReports, 1);
+		ASSERT_EQ(RegisterClient_Outstanding(client), 1u);
+		ASSERT_TRUE(completions.empty());
+
+		Reply({ REGISTER_REPLY_ACK });
+		ASSERT_EQ(RegisterClient_Run(client, parser, 500000, NULL, NULL), 0);
+		ASSERT_EQ(completions.size(), 1u);
+		ASSERT_EQ(completions[0].status, 0);
+	}
+
+	static void CountAutoReport(void * context, Serial * serial, const AutoReportMessage * message, const AutoReportValues * values)
+	{
+		(*(int *)context) += (message != NULL);
+	}
+
+	TEST_F(RegisterClientTest, test_RegisterClient_Reactor)
+	{
+		Reactor * reactor = Reactor_New();
+		const uint16_t address = 0x0030;
+		int autoReports = 0;
+		int loops = 0;
+
+		ASSERT_EQ(Reactor_Add(reactor, serial, CountAutoReport, &autoReports), 0);
+		ASSERT_EQ(Reactor_SetRegisterClient(reactor, serial, client), 0);
+
+		ASSERT_EQ(RegisterClient_Read(client, &address, 1, 500000, OnComplete, &completions), 0);
+		ASSERT_GE(Reactor_RunOnce(reactor, 100), 0);
+		ASSERT_EQ(Serial_Pending(serial), 0u);
+		Sent(7);
+
+		Reply(std::vector<uint8_t>(AutoReportFrame, AutoReportFrame + sizeof(AutoReportFrame)));
+		Reply(DataReply({ 0x000042 }));
+		Reply(std::vector<uint8_t>(AutoReportFrame, AutoReportFrame + sizeof(AutoReportFrame)));
+
+		while ((completions.empty() || autoReports < 2) && loops++ < 20)
+		{
+			ASSERT_GE(Reactor_RunOnce(reactor, 100), 0);
+		}
+
+		ASSERT_EQ(autoReports, 2);
+		ASSERT_EQ(completions.size(), 1u);
+		ASSERT_EQ(completions[0].values, std::vector<uint32_t>({ 0x000042 }));
+
+		// requests expire from the loop too
+		ASSERT_EQ(RegisterClient_Read(client, &address, 1, 10000, OnComplete, &completions), 0);
+		for (loops = 0; completions.size() < 2 && loops < 20; loops++)
+		{
+			ASSERT_GE(Reactor_RunOnce(reactor, 1000), 0);
+		}
+		ASSERT_EQ(completions.size(), 2u);
+		ASSERT_EQ(completions[1].status, -ETIMEDOUT);
+
+		Reactor_Free(reactor);
+	}
+
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <vector>
+
+#include "78m6610.h"
+#include "rollup.h"
+
+namespace PFC
+{
+
+	static const uint64_t Second = 1000000000ull;
+
+	static void OnWindow(void * context, const RollupWindow * window)
+	{
+		((std::vector<RollupWindow> *)context)->push_back(*window);
+	}
+
+	// Counter as the meter sends it: 24 bit Wh, decoded as signed kWh
+	static float KwH(uint32_t counter)
+	{
+		int32_t raw = (int32_t)(counter << 8) >> 8;
+
+		return (float)raw / 1000.0f;
+	}
+
+	static AutoReportValues Sample(float vrms, uint32_t counter)
+	{
+		AutoReportValues values = {vrms, 2.0f, vrms * 2.0f, vrms * 2.0f, 1.0f, 50.0f, KwH(counter)};
+
+		return values;
+	}
+
+	class RollupTest : public testing::Test
+	{
+protected:
+		Rollup * rollup;
+		std::vector<RollupWindow> windows;
+
+		RollupTest() : rollup(NULL) {}
+
+		void SetUp()
+		{
+			const uint32_t lengths[] = {1000, 60000};
+
+			rollup = Rollup_New(lengths, 2, OnWindow, &windows);
+			ASSERT_TRUE(rollup != NULL);
+		}
+		void TearDown()
+		{
+			Rollup_Free(rollup);
+		}
+	};
+
+	TEST_F(RollupTest, test_Rollup_Windows)
+	{
+		// two samples a second for two minutes, Vrms counts up
+		for (int k = 0; k < 240; k++)
+		{
+			AutoReportValues values = Sample(200.0f + k, 1000 + k);
+
+			ASSERT_EQ(Rollup_Add(rollup, 7, 100 * Second + k * Second / 2, &values), 0);
+		}
+
+		// every second but the last closed, and the minutes to 180 s
+		ASSERT_EQ(windows.size(), 119u + 2u);
+
+		const RollupWindow &first = windows[0];
+		EXPECT_EQ(first.Device, 7u);
+		EXPECT_EQ(first.WindowMs, 1000u);
+		EXPECT_EQ(first.Start, 100 * Second);
+		EXPECT_EQ(first.End, 101 * Second);
+		EXPECT_EQ(first.Count, 2u);
+		EXPECT_FLOAT_EQ(first.Vrms.Min, 200.0f);
+		EXPECT_FLOAT_EQ(first.Vrms.Max, 201.0f);
+		EXPECT_FLOAT_EQ(first.Vrms.Mean, 200.5f);
+		EXPECT_DOUBLE_EQ(first.Watts.Sum, 802.0);
+		EXPECT_EQ(first.EnergyWh, 1u);
+
+		// the first minute is aligned to 60 s and holds the samples from 100 s
+		RollupWindow minute = windows[0];
+		for (size_t i = 0; i < windows.size() && minute.WindowMs != 60000; i++)
+		{
+			minute = windows[i];
+		}
+		EXPECT_EQ(minute.Start, 60 * Second);
+		EXPECT_EQ(minute.Count, 40u);
+		EXPECT_FLOAT_EQ(minute.Vrms.Min, 200.0f);
+		EXPECT_FLOAT_EQ(minute.Vrms.Max, 239.0f);
+		EXPECT_EQ(minute.EnergyWh, 39u);
+		EXPECT_NEAR(minute.KwH, (1000 + 39) / 1000.0f, 0.0005f);
+
+		windows.clear();
+		ASSERT_EQ(Rollup_Flush(rollup), 2);
+		ASSERT_EQ(windows.size(), 2u);
+	}
+
+	TEST_F(RollupTest, test_Rollup_CounterWrap)
+	{
+		const uint32_t counters[] = {0xfffff0, 0xfffffa, 0x000004, 0x000010, 0x000008, 0x000009};
+
+		for (size_t k = 0; k < sizeof(counters) / sizeof(counters[0]); k++)
+		{
+			AutoReportValues values = Sample(230.0f, counters[k]);
+
+			ASSERT_EQ(Rollup_Add(rollup, 1, k * Second / 10, &values), 0);
+		}
+		ASSERT_EQ(Rollup_Flush(rollup), 2);
+
+		// 10 + 10 + 12 across the wrap, the step back to 8 is a reset, then 1
+		ASSERT_EQ(windows[0].EnergyWh, 33u);
+		ASSERT_EQ(windows[1].EnergyWh, 33u);
+	}
+
+	TEST_F(RollupTest, test_Rollup_Advance)
+	{
+		AutoReportValues values = Sample(230.0f, 0);
+
+		for (uint32_t device = 0; device < 100; device++)
+		{
+			ASSERT_EQ(Rollup_Add(rollup, device * 7919, 10 * Second, &values), 0);
+		}
+		ASSERT_EQ(Rollup_DeviceCount(rollup), 100u);
+
+		// quiet devices close on time, not on their next sample
+		ASSERT_EQ(Rollup_Advance(rollup, 10 * Second + Second / 2), 0);
+		ASSERT_EQ(Rollup_Advance(rollup, 11 * Second), 100);
+		ASSERT_EQ(windows.size(), 100u);
+		ASSERT_EQ(Rollup_Advance(rollup, 60 * Second), 100);
+
+		// a window already sent does not reopen
+		ASSERT_EQ(Rollup_Add(rollup, 0, 10 * Second, &values), -ERANGE);
+		ASSERT_EQ(Rollup_Add(rollup, 0, 61 * Second, &values), 0);
+		ASSERT_EQ(Rollup_Flush(rollup), 2);
+	}
+
+}
@@ -15,6 +15,9 @@
 
 #include "78m6610.h"
 
+#include "frameparser.h"
+#include "serialport.hpp"
+
 namespace PFC
 {
 
@@ -101,7 +104,8 @@ protected:
 
 	TEST_F(SerialTest, test_Serial_Write)
 	{
-		Serial * serial = Serial_New(SerialPath.c_str());
+		monip::SerialPort port(SerialPath.c_str());
+		Serial * serial = port.Get();
 
 		EXPECT_TRUE(serial != NULL);
 
@@ -113,13 +117,38 @@ protected:
 		ASSERT_USECS(SerialStream.read(testReadData, sizeof(testReadData)), 100000);
 
 		ASSERT_TRUE(memcmp(writeData, testReadData, sizeof(writeData)) == 0);
+	}
 
-		Serial_Free(serial);
+	TEST_F(SerialTest, test_Serial_Queue_Drain)
+	{
+		monip::SerialPort port(SerialPath.c_str());
+		Serial * serial = port.Get();
+
+		EXPECT_TRUE(serial != NULL);
+
+		uint8_t first[] = {0xa5, 0x08, 0xa3, 0x02, 0x00, 0xe3, 0x00, 0x00};
+		uint8_t second[] = {0xa5, 0x04, 0x00, 0x57};
+		uint8_t large[SERIAL_QUEUE_SIZE] = {0};
+		char testReadData[sizeof(first) + sizeof(second)] = {0};
+
+		ASSERT_EQ(Serial_Queue(serial, first, sizeof(first)), 0);
+		ASSERT_EQ(Serial_Queue(serial, second, sizeof(second)), 0);
+		ASSERT_EQ(Serial_Pending(serial), sizeof(first) + sizeof(second));
+		ASSERT_EQ(Serial_Queue(serial, large, sizeof(large)), -ENOBUFS);
+
+		ASSERT_EQ(Serial_Drain(serial, 100000), 0);
+		ASSERT_EQ(Serial_Pending(serial), 0u);
+
+		ASSERT_USECS(SerialStream.read(testReadData, sizeof(testReadData)), 100000);
+
+		ASSERT_TRUE(memcmp(first, testReadData, sizeof(first)) == 0);
+		ASSERT_TRUE(memcmp(second, &testReadData[sizeof(first)], sizeof(second)) == 0);
 	}
 
 	TEST_F(SerialTest, test_Serial_Read)
 	{
-		Serial * serial = Serial_New(SerialPath.c_str());
+		monip::SerialPort port(SerialPath.c_str());
+		Serial * serial = port.Get();
 
 		EXPECT_TRUE(serial != NULL);
 
@@ -132,13 +161,12 @@ protected:
 		ASSERT_EQ(Serial_Read(serial, testReadData, sizeof(testReadData)), sizeof(testReadData));
 
 		ASSERT_TRUE(memcmp(writeData, testReadData, sizeof(writeData)) == 0);
-
-		Serial_Free(serial);
 	}
 
 	TEST_F(SerialTest, test_Serial_Read_Timeout)
 	{
-		Serial * serial = Serial_New(SerialPath.c_str());
+		monip::SerialPort port(SerialPath.c_str());
+		Serial * serial = port.Get();
 
 		EXPECT_TRUE(serial != NULL);
 
@@ -151,13 +179,49 @@ protected:
 		ASSERT_EQ(Serial_Read(serial, testReadData, sizeof(testReadData)), 0);
 
 		ASSERT_TRUE(memcmp(writeData, testReadData, sizeof(writeData)) != 0);
+	}
 
-		Serial_Free(serial);
+	TEST_F(SerialTest, test_Serial_ReadTimeout)
+	{
+		monip::SerialPort port(SerialPath.c_str());
+		Serial * serial = port.Get();
+
+		EXPECT_TRUE(serial != NULL);
+
+		unsigned char writeData[] = {0x01, 0x02, 0x03, 0x13, 0x11, 0xff};
+		uint8_t testReadData[sizeof(writeData)] = {0};
+
+		SerialStream.write((char *)writeData, sizeof(writeData));
+		SerialStream.flush();
+
+		ASSERT_EQ(Serial_ReadTimeout(serial, testReadData, sizeof(testReadData), 100000), (int)sizeof(testReadData));
+
+		ASSERT_TRUE(memcmp(writeData, testReadData, sizeof(writeData)) == 0);
+	}
+
+	TEST_F(SerialTest, test_Serial_ReadTimeout_Partial)
+	{
+		monip::SerialPort port(SerialPath.c_str());
+		Serial * serial = port.Get();
+
+		EXPECT_TRUE(serial != NULL);
+
+		unsigned char writeData[] = {0x05, 0x08, 0x02, 0x13, 0x11, 0xff};
+		uint8_t testReadData[sizeof(writeData)] = {0};
+
+		SerialStream.write((char *)writeData, sizeof(writeData) - 2);
+		SerialStream.flush();
+
+		/* well inside the 100 ms VTIME step of Serial_Read() */
+		ASSERT_USECS(ASSERT_EQ(Serial_ReadTimeout(serial, testReadData, sizeof(testReadData), 15000), (int)sizeof(writeData) - 2), 50000);
+
+		ASSERT_TRUE(memcmp(writeData, testReadData, sizeof(writeData) - 2) == 0);
 	}
 
 	TEST_F(SerialTest, test_ReadMessage_Simple)
 	{
-		Serial * serial = Serial_New(SerialPath.c_str());
+		monip::SerialPort port(SerialPath.c_str());
+		Serial * serial = port.Get();
 
 		EXPECT_TRUE(serial != NULL);
 
@@ -169,15 +233,24 @@ protected:
 
 		ASSERT_EQ(ReadMessage(serial, AUTOREPORT_HEADER, testReadData), 28);
 
-		char * output = ConvertAutoReportToJSON((AutoReportMessage *)&testReadData[0]);
+		char output[AUTOREPORT_JSON_MAX];
 
-		ASSERT_TRUE(output != NULL);
-		//printf("%s\n", ConvertAutoReportToJSON((AutoReportMessage *)&testReadData[0]));
+		ASSERT_GT(monip::FrameView(AUTOREPORT_HEADER, testReadData, 28).ToJSON(output, sizeof(output)), 0);
+	}
+
+	TEST(CheckSumTest, test_FrameCheckSum)
+	{
+		uint8_t frame[] = {0xae, 0x1e, 0xdc, 0x4c, 0x00 , 0xc1, 0xac, 0xff , 0xdd, 0xa8, 0x03 , 0x51, 0x11, 0x00 , 0xe9, 0xff, 0xff , 0xec, 0xff, 0xff , 0xf2, 0xff, 0xff , 0x85, 0xc1, 0x00 , 0x00, 0x00, 0x00, 0xaf};
+
+		ASSERT_EQ(FrameCheckSum(frame, sizeof(frame) - 1), 0xaf);
+		ASSERT_EQ(FrameCheckSum(frame, sizeof(frame) - 1), (uint8_t)(CheckSum(frame, sizeof(frame) - 1) + 1));
+		ASSERT_EQ(FrameCheckSum(frame, 0), 0);
 	}
 
 	TEST_F(SerialTest, test_ReadMessage_Checksum_Fail)
 	{
-		Serial * serial = Serial_New(SerialPath.c_str());
+		monip::SerialPort port(SerialPath.c_str());
+		Serial * serial = port.Get();
 
 		EXPECT_TRUE(serial != NULL);
 
@@ -193,7 +266,8 @@ protected:
 
 	TEST_F(SerialTest, test_ReadMessage_BadData)
 	{
-		Serial * serial = Serial_New(SerialPath.c_str());
+		monip::SerialPort port(SerialPath.c_str());
+		Serial * serial = port.Get();
 
 		EXPECT_TRUE(serial != NULL);
 
@@ -231,4 +305,67 @@ protected:
 		ASSERT_EQ(Result, 28);
 	}
 
+	TEST_F(SerialTest, test_FrameParser_Read_BadData)
+	{
+		monip::SerialPort port(SerialPath.c_str());
+		Serial * serial = port.Get();
+		FrameParser * parser = port.Parser();
+
+		EXPECT_TRUE(serial != NULL);
+		EXPECT_TRUE(parser != NULL);
+
+		unsigned char writeData[] = {0xae, 0x1e, 0xdc, 0x4c, 0x00 , 0xc1, 0xac, 0xff , 0xdd, 0xa8, 0x03 , 0x51, 0x11, 0x00 , 0xe9, 0xff, 0xff , 0xec, 0xff, 0xff , 0xf2, 0xff, 0xff , 0x85, 0xc1, 0x00 , 0x00, 0x00, 0x00, 0xaf};
+		uint8_t testReadData[FRAME_MAX_LENGTH] = {0};
+
+		unsigned int i = 0;
+
+		srand(time(NULL));
+
+		for(i = 0; i < 255; i++)
+		{
+			unsigned char random = rand();
+			SerialStream.write((char *)&random, 1);
+		}
+		SerialStream.write((char *)writeData, sizeof(writeData));
+		SerialStream.flush();
+
+		ASSERT_EQ(FrameParser_Read(parser, serial, testReadData), 28);
+		ASSERT_TRUE(memcmp(&writeData[2], testReadData, 28) == 0);
+	}
+
+	TEST_F(SerialTest, test_SerialPort_ReadFrame)
+	{
+		unsigned char writeData[] = {0x55, 0xae, 0x1e, 0xdc, 0x4c, 0x00 , 0xc1, 0xac, 0xff , 0xdd, 0xa8, 0x03 , 0x51, 0x11, 0x00 , 0xe9, 0xff, 0xff , 0xec, 0xff, 0xff , 0xf2, 0xff, 0xff , 0x85, 0xc1, 0x00 , 0x00, 0x00, 0x00, 0xaf};
+		uint8_t buffer[FRAME_MAX_LENGTH];
+		monip::FrameView view;
+		AutoReportValues values;
+
+		monip::SerialPort opened(SerialPath.c_str());
+		ASSERT_TRUE(opened.IsOpen());
+
+		// ownership moves, the moved-from port is empty and frees nothing
+		monip::SerialPort port(std::move(opened));
+		ASSERT_FALSE(opened);
+		ASSERT_TRUE(port);
+
+		SerialStream.write((char *)writeData, sizeof(writeData));
+		SerialStream.flush();
+
+		ASSERT_EQ(port.ReadFrame(buffer, &view), 28);
+		ASSERT_TRUE(view.IsAutoReport());
+		ASSERT_EQ(view.Payload(), buffer);
+
+		ConvertAutoReport(view.Message(), &values);
+		ASSERT_EQ(view.Vrms(), values.Vrms);
+		ASSERT_EQ(view.Freq(), values.Freq);
+		ASSERT_EQ(view.KwH(), values.KwH);
+
+		monip::SerialPort other;
+		other = std::move(port);
+		ASSERT_TRUE(other.IsOpen());
+		ASSERT_EQ(other.ReadFrame(buffer, &view), -EAGAIN);
+
+		ASSERT_FALSE(monip::SerialPort("/nonexistent/monip").IsOpen());
+	}
+
 }
@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "ptypair.h"
+
+#include "serial.h"
+#include "78m6610.h"
+#include "frameparser.h"
+
+namespace PFC
+{
+
+	static const uint8_t AutoReportFrame[] = {0xae, 0x1e, 0xdc, 0x4c, 0x00 , 0xc1, 0xac, 0xff , 0xdd, 0xa8, 0x03 , 0x51, 0x11, 0x00 , 0xe9, 0xff, 0xff , 0xec, 0xff, 0xff , 0xf2, 0xff, 0xff , 0x85, 0xc1, 0x00 , 0x00, 0x00, 0x00, 0xaf};
+
+	class SerialStatsTest : public testing::Test
+	{
+protected:
+		PtyPair pty;
+		Serial * serial;
+		uint8_t buffer[FRAME_MAX_LENGTH];
+
+		SerialStatsTest() : serial(NULL) {}
+
+		void SetUp()
+		{
+			ASSERT_TRUE(pty.Open());
+			serial = Serial_New(pty.path.c_str());
+			ASSERT_TRUE(serial != NULL);
+		}
+		void TearDown()
+		{
+			Serial_Free(serial);
+		}
+
+		void Write(const std::vector<uint8_t> &data)
+		{
+			ASSERT_EQ(write(pty.master, &data[0], data.size()), (ssize_t)data.size());
+		}
+	};
+
+	TEST_F(SerialStatsTest, test_SerialStats_FrameParser)
+	{
+		FrameParser * parser = FrameParser_New(AUTOREPORT_HEADER, AUTOREPORT_LENGTH);
+		std::vector<uint8_t> stream = {0x01, 0x02, 0x03};
+		SerialStats stats;
+		int frames = 0;
+		int Result = 0;
+
+		// garbage, a good frame, a corrupted one, a good one
+		stream.insert(stream.end(), AutoReportFrame, AutoReportFrame + sizeof(AutoReportFrame));
+		stream.insert(stream.end(), AutoReportFrame, AutoReportFrame + sizeof(AutoReportFrame));
+		stream[stream.size() - 10] ^= 0x40;
+		stream.insert(stream.end(), AutoReportFrame, AutoReportFrame + sizeof(AutoReportFrame));
+		Write(stream);
+
+		while ((Result = FrameParser_Read(parser, serial, buffer)) != -EAGAIN)
+		{
+			ASSERT_EQ(Result, AUTOREPORT_PAYLOAD_SIZE);
+			frames++;
+		}
+		ASSERT_EQ(frames, 2);
+
+		Serial_GetStats(serial, &stats);
+		EXPECT_EQ(stats.BytesRead, (uint64_t)stream.size());
+		EXPECT_GE(stats.ReadCalls, 2u);
+		EXPECT_EQ(stats.FramesOk, 2u);
+		EXPECT_EQ(stats.ChecksumErrors, 1u);
+		EXPECT_EQ(stats.HeaderMismatches, 1u);
+		EXPECT_EQ(stats.ResyncBytes, 3u + sizeof(AutoReportFrame));
+		EXPECT_EQ(stats.Timeouts, 1u);
+		EXPECT_EQ(stats.Latency.Count, 2u);
+		EXPECT_EQ(stats.Gap.Count, 1u);
+
+		FrameParser_Free(parser);
+	}
+
+	TEST_F(SerialStatsTest, test_SerialStats_Push)
+	{
+		FrameParser * parser = FrameParser_New(AUTOREPORT_HEADER, AUTOREPORT_LENGTH);
+		SerialStats stats;
+
+		// bytes read elsewhere, in two chunks, count as bytes but not as reads
+		FrameParser_SetSerial(parser, serial);
+		ASSERT_EQ(FrameParser_Push(parser, AutoReportFrame, 10), 10u);
+		ASSERT_EQ(FrameParser_Push(parser, AutoReportFrame + 10, sizeof(AutoReportFrame) - 10), sizeof(AutoReportFrame) - 10);
+		ASSERT_EQ(FrameParser_Next(parser, NULL, buffer), AUTOREPORT_PAYLOAD_SIZE);
+
+		Serial_GetStats(serial, &stats);
+		EXPECT_EQ(stats.BytesRead, (uint64_t)sizeof(AutoReportFrame));
+		EXPECT_EQ(stats.ReadCalls, 0u);
+		EXPECT_EQ(stats.FramesOk, 1u);
+		EXPECT_EQ(stats.Latency.Count, 1u);
+
+		FrameParser_Free(parser);
+	}
+
+	TEST_F(SerialStatsTest, test_SerialStats_Latency)
+	{
+		FrameParser * parser = FrameParser_New(AUTOREPORT_HEADER, AUTOREPORT_LENGTH);
+		SerialStats stats;
+
+		// the first half waits 20 ms for the rest
+		Write(std::vector<uint8_t>(AutoReportFrame, AutoReportFrame + 10));
+		ASSERT_EQ(FrameParser_Read(parser, serial, buffer), -EAGAIN);
+		usleep(20000);
+		Write(std::vector<uint8_t>(AutoReportFrame + 10, AutoReportFrame + sizeof(AutoReportFrame)));
+		ASSERT_EQ(FrameParser_Read(parser, serial, buffer), AUTOREPORT_PAYLOAD_SIZE);
+
+		Serial_GetStats(serial, &stats);
+		EXPECT_EQ(stats.Latency.Count, 1u);
+		EXPECT_GE(stats.Latency.Max, 20000u);
+		EXPECT_LT(stats.Latency.Max, 1000000u);
+		EXPECT_EQ(SerialHistogram_Percentile(&stats.Latency, 0.5), stats.Latency.Max);
+		EXPECT_EQ(stats.Gap.Count, 0u);
+
+		FrameParser_Free(parser);
+	}
+
+	TEST_F(SerialStatsTest, test_SerialStats_ReadMessage)
+	{
+		std::vector<uint8_t> stream(AutoReportFrame, AutoReportFrame + sizeof(AutoReportFrame));
+		SerialStats stats;
+
+		// a bad checksum, then another header with a good one
+		stream.insert(stream.end(), AutoReportFrame, AutoReportFrame + sizeof(AutoReportFrame));
+		stream[stream.size() - 1] ^= 0x01;
+		stream.insert(stream.end(), AutoReportFrame, AutoReportFrame + sizeof(AutoReportFrame));
+		stream[stream.size() - sizeof(AutoReportFrame)] = AUTOREPORT_HEADER - 1;
+		stream[stream.size() - 1] += 1;
+		// and a frame cut short, VTIME ends the read
+		stream.insert(stream.end(), AutoReportFrame, AutoReportFrame + 8);
+		Write(stream);
+
+		ASSERT_EQ(ReadMessage(serial, AUTOREPORT_HEADER, buffer), AUTOREPORT_PAYLOAD_SIZE);
+		ASSERT_EQ(ReadMessage(serial, AUTOREPORT_HEADER, buffer), -EIO);
+		ASSERT_EQ(ReadMessage(serial, AUTOREPORT_HEADER, buffer), -EFAULT);
+		ASSERT_EQ(ReadMessage(serial, AUTOREPORT_HEADER, buffer), -EAGAIN);
+
+		Serial_GetStats(serial, &stats);
+		EXPECT_EQ(stats.BytesRead, (uint64_t)stream.size());
+		EXPECT_EQ(stats.FramesOk, 1u);
+		EXPECT_EQ(stats.ChecksumErrors, 1u);
+		EXPECT_EQ(stats.HeaderMismatches, 1u);
+		EXPECT_EQ(stats.Timeouts, 1u);
+		EXPECT_EQ(stats.Latency.Count, 1u);
+	}
+
+	TEST(SerialHistogramTest, test_SerialHistogram_Percentile)
+	{
+		SerialHistogram histogram;
+
+		memset(&histogram, 0, sizeof(histogram));
+		EXPECT_EQ(SerialHistogram_Percentile(&histogram, 0.5), 0u);
+
+		// 90 values of 5 us, exact below 16 us, and 10 in the bucket of 1000 to 1023 us
+		histogram.Count = 100;
+		histogram.Max = 1010;
+		histogram.Buckets[5] = 90;
+		histogram.Buckets[(6 << SERIAL_HISTOGRAM_SUB_BITS) + 15] = 10;
+
+		EXPECT_EQ(SerialHistogram_Percentile(&histogram, 0.0), 5u);
+		EXPECT_EQ(SerialHistogram_Percentile(&histogram, 0.9), 5u);
+		EXPECT_EQ(SerialHistogram_Percentile(&histogram, 0.95), 1010u);
+
+		histogram.Max = 5000;
+		EXPECT_EQ(SerialHistogram_Percentile(&histogram, 0.99), 1023u);
+	}
+
+}
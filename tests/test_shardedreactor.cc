@@ -0,0 +1,197 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "ptypair.h"
+
+#include "serial.h"
+#include "78m6610.h"
+#include "shardedreactor.h"
+
+namespace PFC
+{
+
+	static const uint8_t AutoReportFrame[] = {0xae, 0x1e, 0xdc, 0x4c, 0x00 , 0xc1, 0xac, 0xff , 0xdd, 0xa8, 0x03 , 0x51, 0x11, 0x00 , 0xe9, 0xff, 0xff , 0xec, 0xff, 0xff , 0xf2, 0xff, 0xff , 0x85, 0xc1, 0x00 , 0x00, 0x00, 0x00, 0xaf};
+
+	static int TotalFrames = 0;
+
+	static void OnFrame(void * context, Serial * serial, const AutoReportMessage * message, const AutoReportValues * values)
+	{
+		if (message != NULL)
+		{
+			__atomic_add_fetch((int *)context, 1, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&TotalFrames, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	class ShardedReactorTest : public testing::Test
+	{
+protected:
+		static const int DeviceCount = 16;
+
+		ShardedReactor * sharded;
+		std::vector<PtyPair> ptys;
+		std::vector<Serial *> serials;
+		std::vector<int> frames;
+
+		ShardedReactorTest() : sharded(NULL), ptys(DeviceCount), serials(DeviceCount), frames(DeviceCount) {}
+
+		void SetUp()
+		{
+			TotalFrames = 0;
+
+			sharded = ShardedReactor_New(4, 1);
+			ASSERT_TRUE(sharded != NULL);
+			ASSERT_EQ(ShardedReactor_ShardCount(sharded), 4u);
+
+			for (int i = 0; i < DeviceCount; i++)
+			{
+				ASSERT_TRUE(ptys[i].Open());
+				serials[i] = Serial_New(ptys[i].path.c_str());
+				ASSERT_TRUE(serials[i] != NULL);
+				ASSERT_EQ(ShardedReactor_Add(sharded, serials[i], OnFrame, &frames[i]), i % 4);
+			}
+		}
+		void TearDown()
+		{
+			ShardedReactor_Free(sharded);
+
+			for (int i = 0; i < DeviceCount; i++)
+			{
+				Serial_Free(serials[i]);
+			}
+		}
+
+		void Send(int device, int count)
+		{
+			for (int j = 0; j < count; j++)
+			{
+				ASSERT_EQ(write(ptys[device].master, AutoReportFrame, sizeof(AutoReportFrame)), (ssize_t)sizeof(AutoReportFrame));
+			}
+		}
+
+		bool WaitFor(int total)
+		{
+			for (int i = 0; i < 200 && __atomic_load_n(&TotalFrames, __ATOMIC_RELAXED) < total; i++)
+			{
+				usleep(10000);
+			}
+
+			return __atomic_load_n(&TotalFrames, __ATOMIC_RELAXED) == total;
+		}
+	};
+
+	TEST_F(ShardedReactorTest, test_ShardedReactor_AllShards)
+	{
+		for (int i = 0; i < DeviceCount; i++)
+		{
+			Send(i, 3);
+		}
+
+		ASSERT_TRUE(WaitFor(DeviceCount * 3));
+
+		for (unsigned s = 0; s < 4; s++)
+		{
+			EXPECT_EQ(ShardedReactor_Frames(sharded, s), (uint64_t)(DeviceCount / 4) * 3);
+		}
+
+		ASSERT_EQ(ShardedReactor_Remove(sharded, serials[5]), 0);
+		ASSERT_EQ(ShardedReactor_ShardOf(sharded, serials[5]), -ENOENT);
+		ASSERT_EQ(ShardedReactor_Remove(sharded, serials[5]), -ENOENT);
+	}
+
+	TEST_F(ShardedReactorTest, test_ShardedReactor_Rebalance)
+	{
+		int moved = 0;
+
+		// devices 0, 4 and 8 all live on shard 0
+		Send(0, 40);
+		Send(4, 40);
+		Send(8, 40);
+
+		for (int i = 0; i < DeviceCount; i++)
+		{
+			if (i % 4 != 0)
+			{
+				Send(i, 1);
+			}
+		}
+
+		ASSERT_TRUE(WaitFor(120 + DeviceCount * 3 / 4));
+
+		moved = ShardedReactor_Rebalance(sharded);
+		ASSERT_EQ(moved, 1);
+
+		int onShard0 = 0;
+		for (int i = 0; i < DeviceCount; i += 4)
+		{
+			onShard0 += (ShardedReactor_ShardOf(sharded, serials[i]) == 0);
+		}
+		ASSERT_EQ(onShard0, 3);
+
+		// moved devices keep delivering
+		for (int i = 0; i < DeviceCount; i++)
+		{
+			Send(i, 1);
+		}
+		ASSERT_TRUE(WaitFor(120 + DeviceCount * 3 / 4 + DeviceCount));
+
+		// no traffic since the last pass, nothing to move
+		ASSERT_GE(ShardedReactor_Rebalance(sharded), 0);
+		ASSERT_EQ(ShardedReactor_Rebalance(sharded), 0);
+	}
+
+	TEST_F(ShardedReactorTest, test_ShardedReactor_RebalanceSplitFrame)
+	{
+		const size_t split = 10;
+
+		Send(0, 40);
+		Send(4, 40);
+		Send(8, 40);
+		ASSERT_TRUE(WaitFor(120));
+
+		// whichever shard 0 device moves has the first part of a frame buffered
+		for (int i = 0; i < DeviceCount; i += 4)
+		{
+			ASSERT_EQ(write(ptys[i].master, AutoReportFrame, split), (ssize_t)split);
+		}
+		usleep(100000);
+
+		ASSERT_EQ(ShardedReactor_Rebalance(sharded), 1);
+
+		for (int i = 0; i < DeviceCount; i += 4)
+		{
+			ASSERT_EQ(write(ptys[i].master, AutoReportFrame + split, sizeof(AutoReportFrame) - split), (ssize_t)(sizeof(AutoReportFrame) - split));
+		}
+		ASSERT_TRUE(WaitFor(120 + DeviceCount / 4));
+		EXPECT_EQ(frames[0] + frames[4] + frames[8], 123);
+	}
+
+	TEST_F(ShardedReactorTest, test_ShardedReactor_Hangup)
+	{
+		ptys[1].Close();
+
+		for (int i = 0; i < 200 && ShardedReactor_ShardOf(sharded, serials[1]) != -ENOENT; i++)
+		{
+			usleep(10000);
+			ASSERT_GE(ShardedReactor_Rebalance(sharded), 0);
+		}
+		ASSERT_EQ(ShardedReactor_ShardOf(sharded, serials[1]), -ENOENT);
+
+		// shard 1 is a device short, the next one goes there
+		PtyPair pty;
+		ASSERT_TRUE(pty.Open());
+		Serial * serial = Serial_New(pty.path.c_str());
+		ASSERT_TRUE(serial != NULL);
+		ASSERT_EQ(ShardedReactor_Add(sharded, serial, OnFrame, &frames[1]), 1);
+
+		ASSERT_EQ(write(pty.master, AutoReportFrame, sizeof(AutoReportFrame)), (ssize_t)sizeof(AutoReportFrame));
+		ASSERT_TRUE(WaitFor(1));
+
+		ASSERT_EQ(ShardedReactor_Remove(sharded, serial), 0);
+		Serial_Free(serial);
+	}
+
+}
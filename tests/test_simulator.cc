@@ -0,0 +1,219 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "serial.h"
+#include "78m6610.h"
+#include "frameparser.h"
+#include "reactor.h"
+#include "simulator.h"
+
+namespace PFC
+{
+
+	static void OnFrame(void * context, Serial * serial, const AutoReportMessage * message, const AutoReportValues * values)
+	{
+		if (message != NULL)
+		{
+			(*(int *)context)++;
+		}
+	}
+
+	static bool Expired(const struct timespec * deadline)
+	{
+		struct timespec now;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		return now.tv_sec > deadline->tv_sec || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+	}
+
+	TEST(SimulatorTest, test_Simulator_Encode)
+	{
+		AutoReportValues values = {239.837f, 2.5f, 569.6f, 570.1f, 0.95f, 49.98f, 12.345f};
+		AutoReportValues decoded;
+		uint8_t frame[AUTOREPORT_LENGTH];
+
+		Simulator_EncodeAutoReport(&values, frame);
+		ASSERT_EQ(frame[0], AUTOREPORT_HEADER);
+		ASSERT_EQ(frame[1], AUTOREPORT_LENGTH);
+		ASSERT_EQ(ValidateMessage(frame[0], frame[1], frame + 2, AUTOREPORT_PAYLOAD_SIZE), 0);
+
+		ConvertAutoReport((const AutoReportMessage *)(frame + 2), &decoded);
+		EXPECT_NEAR(decoded.Vrms, values.Vrms, 0.001f);
+		EXPECT_NEAR(decoded.Irms, values.Irms, 0.00001f);
+		EXPECT_NEAR(decoded.Watts, values.Watts, 0.005f);
+		EXPECT_NEAR(decoded.Pavg, values.Pavg, 0.005f);
+		EXPECT_NEAR(decoded.PF, values.PF, 0.001f);
+		EXPECT_NEAR(decoded.Freq, values.Freq, 0.001f);
+		EXPECT_NEAR(decoded.KwH, values.KwH, 0.001f);
+
+		// the energy counter wraps at 24 bits
+		values.KwH = 16778.0f;
+		Simulator_EncodeAutoReport(&values, frame);
+		ConvertAutoReport((const AutoReportMessage *)(frame + 2), &decoded);
+		EXPECT_NEAR(decoded.KwH, 16778.0f - 16777.216f, 0.001f);
+	}
+
+	TEST(SimulatorTest, test_Simulator_Waveforms)
+	{
+		const int MeterCount = 8;
+		const int FrameCount = 20;
+		SimulatorOptions options;
+		Simulator * simulator = NULL;
+		std::vector<Serial *> serials(MeterCount);
+		std::vector<FrameParser *> parsers(MeterCount);
+		uint8_t buffer[FRAME_MAX_LENGTH];
+
+		Simulator_DefaultOptions(&options);
+		options.Vrms.Period = 1.0f;
+		options.Vrms.Amplitude = 10.0f;
+		simulator = Simulator_New(MeterCount, &options);
+		ASSERT_TRUE(simulator != NULL);
+		ASSERT_EQ(Simulator_Count(simulator), (size_t)MeterCount);
+
+		for (int i = 0; i < MeterCount; i++)
+		{
+			serials[i] = Serial_New(Simulator_Path(simulator, i));
+			ASSERT_TRUE(serials[i] != NULL);
+			parsers[i] = FrameParser_New(AUTOREPORT_HEADER, AUTOREPORT_LENGTH);
+		}
+
+		for (int j = 0; j < FrameCount; j++)
+		{
+			for (int i = 0; i < MeterCount; i++)
+			{
+				AutoReportValues sent;
+				AutoReportValues received;
+
+				ASSERT_EQ(Simulator_Emit(simulator, i, &sent), 0);
+				ASSERT_EQ(FrameParser_Read(parsers[i], serials[i], buffer), AUTOREPORT_PAYLOAD_SIZE);
+
+				ConvertAutoReport((const AutoReportMessage *)buffer, &received);
+				EXPECT_NEAR(received.Vrms, sent.Vrms, 0.001f);
+				EXPECT_NEAR(received.Irms, sent.Irms, 0.00001f);
+				EXPECT_NEAR(received.Freq, sent.Freq, 0.001f);
+				EXPECT_NEAR(received.Watts, sent.Vrms * sent.Irms * sent.PF, 0.01f);
+				EXPECT_NEAR(sent.Vrms, 230.0f, 10.5f);
+			}
+		}
+
+		for (int i = 0; i < MeterCount; i++)
+		{
+			FrameParser_Free(parsers[i]);
+			Serial_Free(serials[i]);
+		}
+		Simulator_Free(simulator);
+	}
+
+	TEST(SimulatorTest, test_Simulator_Faults)
+	{
+		const int FrameCount = 400;
+		SimulatorOptions options;
+		SimulatorStats stats;
+		Simulator * simulator = NULL;
+		Serial * serial = NULL;
+		FrameParser * parser = FrameParser_New(AUTOREPORT_HEADER, AUTOREPORT_LENGTH);
+		uint8_t buffer[FRAME_MAX_LENGTH];
+		int valid = 0;
+		int Result = 0;
+
+		Simulator_DefaultOptions(&options);
+		options.NoiseRate = 0.1f;
+		options.CorruptRate = 0.1f;
+		options.TruncateRate = 0.1f;
+		simulator = Simulator_New(1, &options);
+		ASSERT_TRUE(simulator != NULL);
+		serial = Serial_New(Simulator_Path(simulator, 0));
+		ASSERT_TRUE(serial != NULL);
+
+		// batches small enough for the pty buffer, read until the line goes quiet
+		for (int j = 0; j < FrameCount; j += 20)
+		{
+			for (int k = 0; k < 20; k++)
+			{
+				ASSERT_EQ(Simulator_Emit(simulator, 0, NULL), 0);
+			}
+			while ((Result = FrameParser_Read(parser, serial, buffer)) != -EAGAIN)
+			{
+				ASSERT_GE(Result, 0);
+				valid += Result == AUTOREPORT_PAYLOAD_SIZE;
+			}
+		}
+
+		Simulator_GetStats(simulator, &stats);
+		EXPECT_EQ(stats.Frames, (uint64_t)FrameCount);
+		EXPECT_EQ(stats.Dropped, 0u);
+		EXPECT_GT(stats.Noise, 10u);
+		EXPECT_GT(stats.Corrupted, 10u);
+		EXPECT_GT(stats.Truncated, 10u);
+
+		// every fault costs at most the faulty frame and the one after it
+		EXPECT_LT(valid, FrameCount);
+		EXPECT_GE(valid, FrameCount - 2 * (int)(stats.Noise + stats.Corrupted + stats.Truncated));
+
+		Serial_Free(serial);
+		Simulator_Free(simulator);
+		FrameParser_Free(parser);
+	}
+
+	TEST(SimulatorTest, test_Simulator_Run)
+	{
+		const int MeterCount = 64;
+		SimulatorOptions options;
+		SimulatorStats stats;
+		Simulator * simulator = NULL;
+		Reactor * reactor = Reactor_New();
+		std::vector<Serial *> serials(MeterCount);
+		std::vector<int> frames(MeterCount);
+		struct timespec deadline;
+
+		Simulator_DefaultOptions(&options);
+		options.IntervalUs = 10000;
+		simulator = Simulator_New(MeterCount, &options);
+		ASSERT_TRUE(simulator != NULL);
+
+		for (int i = 0; i < MeterCount; i++)
+		{
+			serials[i] = Serial_New(Simulator_Path(simulator, i));
+			ASSERT_TRUE(serials[i] != NULL);
+			ASSERT_EQ(Reactor_Add(reactor, serials[i], OnFrame, &frames[i]), 0);
+		}
+
+		ASSERT_EQ(Simulator_Start(simulator), 0);
+		ASSERT_EQ(Simulator_Start(simulator), -EALREADY);
+		ASSERT_EQ(Simulator_Emit(simulator, 0, NULL), -EBUSY);
+
+		// a few slots of every meter, within two seconds
+		Serial_Deadline(&deadline, 2000000);
+		while (frames[MeterCount - 1] < 5 && !Expired(&deadline))
+		{
+			ASSERT_GE(Reactor_RunOnce(reactor, 10), 0);
+		}
+
+		Simulator_Stop(simulator);
+		while (Reactor_RunOnce(reactor, 50) > 0)
+		{
+		}
+
+		Simulator_GetStats(simulator, &stats);
+		for (int i = 0; i < MeterCount; i++)
+		{
+			EXPECT_GE(frames[i], 1);
+		}
+		EXPECT_GE(stats.Frames, (uint64_t)MeterCount * 5);
+		EXPECT_EQ(stats.Dropped, 0u);
+
+		Reactor_Free(reactor);
+		for (int i = 0; i < MeterCount; i++)
+		{
+			Serial_Free(serials[i]);
+		}
+		Simulator_Free(simulator);
+	}
+
+}
@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "ptypair.h"
+#include "serial_data.h"
+
+#include "serial.h"
+#include "78m6610.h"
+#include "frameparser.h"
+#include "jsonbuffer.h"
+#include "reactor.h"
+
+// Count allocations made by anyone in the process while armed. The test
+// binary's definitions take precedence over libc's for libmonip as well.
+extern "C"
+{
+	void * __libc_malloc(size_t size);
+	void * __libc_calloc(size_t count, size_t size);
+	void * __libc_realloc(void * ptr, size_t size);
+
+	static volatile int AllocationsArmed = 0;
+	static volatile int Allocations = 0;
+
+	void * malloc(size_t size)
+	{
+		Allocations = Allocations + AllocationsArmed;
+		return __libc_malloc(size);
+	}
+
+	void * calloc(size_t count, size_t size)
+	{
+		Allocations = Allocations + AllocationsArmed;
+		return __libc_calloc(count, size);
+	}
+
+	void * realloc(void * ptr, size_t size)
+	{
+		Allocations = Allocations + AllocationsArmed;
+		return __libc_realloc(ptr, size);
+	}
+}
+
+namespace PFC
+{
+
+	static void Arm()
+	{
+		Allocations = 0;
+		AllocationsArmed = 1;
+	}
+
+	static int Disarm()
+	{
+		AllocationsArmed = 0;
+		return Allocations;
+	}
+
+	static void OnAutoReport(void * context, Serial * serial, const AutoReportMessage * message, const AutoReportValues * values)
+	{
+		static char text[AUTOREPORT_JSON_MAX];
+
+		if (message != NULL && AutoReportToJSON(message, text, sizeof(text)) > 0)
+		{
+			(*(int *)context)++;
+		}
+	}
+
+	class StaticAllocationTest : public testing::Test
+	{
+protected:
+		PtyPair pty;
+		std::vector<Frame> frames;
+		SerialStorage serialStorage;
+		FrameParserStorage parserStorage;
+		Serial * serial;
+		FrameParser * parser;
+
+		void SetUp()
+		{
+			frames = LoadSerialData(MONIP_SERIAL_DATA);
+			ASSERT_FALSE(frames.empty());
+			ASSERT_TRUE(pty.Open());
+
+			ASSERT_LE(Serial_Size(), sizeof(serialStorage));
+			ASSERT_LE(FrameParser_Size(), sizeof(parserStorage));
+
+			serial = (Serial *)&serialStorage;
+			parser = (FrameParser *)&parserStorage;
+			ASSERT_EQ(Serial_Init(serial, pty.path.c_str(), NULL), 0);
+			FrameParser_Init(parser, AUTOREPORT_HEADER, AUTOREPORT_LENGTH);
+		}
+
+		void TearDown()
+		{
+			Serial_Deinit(serial);
+		}
+
+		void SendFrames()
+		{
+			for (size_t i = 0; i < frames.size(); i++)
+			{
+				ASSERT_EQ(write(pty.master, &frames[i][0], frames[i].size()), (ssize_t)frames[i].size());
+			}
+		}
+	};
+
+	TEST_F(StaticAllocationTest, test_StaticAllocation_FramePath)
+	{
+		static char storage[64 * 1024];
+		uint8_t buffer[FRAME_MAX_LENGTH];
+		uint8_t packet[] = { 0xa5, 0x07, 0xa3, 0x30, 0x00, 0xe3, 0x00 };
+		JSONBuffer json;
+		size_t decoded = 0;
+		int appended = 0;
+
+		JSONBuffer_InitStatic(&json, JSON_MODE_NDJSON, storage, sizeof(storage));
+		SendFrames();
+
+		Arm();
+		while (FrameParser_Read(parser, serial, buffer) == AUTOREPORT_PAYLOAD_SIZE)
+		{
+			AutoReportValues values;
+			AutoReportValuesFixed fixed;
+			char text[AUTOREPORT_JSON_MAX];
+
+			ConvertAutoReport((const AutoReportMessage *)buffer, &values);
+			ConvertAutoReportFixed((const AutoReportMessage *)buffer, &fixed);
+			AutoReportFixedToJSON(&fixed, text, sizeof(text));
+			appended += (JSONBuffer_AppendAutoReport(&json, (const AutoReportMessage *)buffer) == 0);
+			decoded++;
+		}
+		Serial_Queue(serial, packet, sizeof(packet));
+		Serial_Flush(serial);
+		int allocations = Disarm();
+
+		ASSERT_EQ(decoded, frames.size());
+		ASSERT_EQ(appended, (int)frames.size());
+		ASSERT_EQ(allocations, 0);
+	}
+
+	TEST_F(StaticAllocationTest, test_StaticAllocation_Reactor)
+	{
+		// the reactor allocates its device table at startup, not per frame
+		Reactor * reactor = Reactor_New();
+		int reports = 0;
+		int loops = 0;
+
+		ASSERT_EQ(Reactor_Add(reactor, serial, OnAutoReport, &reports), 0);
+		SendFrames();
+
+		Arm();
+		while (reports < (int)frames.size() && loops++ < 100)
+		{
+			Reactor_RunOnce(reactor, 100);
+		}
+		int allocations = Disarm();
+
+		ASSERT_EQ(reports, (int)frames.size());
+		ASSERT_EQ(allocations, 0);
+
+		Reactor_Free(reactor);
+	}
+
+}
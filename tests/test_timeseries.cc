@@ -0,0 +1,213 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <random>
+#include <vector>
+
+#include "serial_data.h"
+
+#include "78m6610.h"
+#include "timeseries.h"
+
+namespace PFC
+{
+
+	static const uint64_t Millisecond = 1000000ull;
+	static const uint64_t Second = 1000000000ull;
+
+	struct Sample
+	{
+		uint64_t Timestamp;
+		AutoReportValues Values;
+	};
+
+	static void Collect(void * context, uint64_t timestamp, const AutoReportValues * values)
+	{
+		Sample sample = {timestamp, *values};
+
+		((std::vector<Sample> *)context)->push_back(sample);
+	}
+
+	static void SetField(std::vector<uint8_t> &payload, size_t field, int32_t value)
+	{
+		uint8_t * ptr = &payload[AUTOREPORT_FIELD_OFFSET(field)];
+
+		ptr[0] = (uint8_t)value;
+		ptr[1] = (uint8_t)(value >> 8);
+		ptr[2] = (uint8_t)(value >> 16);
+	}
+
+	static int32_t GetField(const std::vector<uint8_t> &payload, size_t field)
+	{
+		const uint8_t * ptr = &payload[AUTOREPORT_FIELD_OFFSET(field)];
+		uint32_t value = ptr[0] | (ptr[1] << 8) | (ptr[2] << 16);
+
+		return (int32_t)(value << 8) >> 8;
+	}
+
+	// A meter every 100 ms with a few ms of jitter, fields wandering like those of serial_data.txt
+	class TimeSeriesTest : public testing::Test
+	{
+protected:
+		std::vector<std::vector<uint8_t> > payloads;
+		std::vector<uint64_t> timestamps;
+
+		void Generate(size_t count)
+		{
+			const int32_t steps[] = {200, 400, 100, 2, 100, 1, 0};
+			std::vector<Frame> frames = LoadSerialData(MONIP_SERIAL_DATA);
+			std::vector<uint8_t> payload(frames[0].begin() + 2, frames[0].end());
+			std::mt19937 random(7);
+			uint64_t timestamp = 1000 * Second;
+
+			for (size_t k = 0; k < count; k++)
+			{
+				for (size_t i = 0; i < AUTOREPORT_FIELD_COUNT; i++)
+				{
+					int32_t step = steps[i] ? (int32_t)(random() % (2 * steps[i] + 1)) - steps[i] : 0;
+
+					SetField(payload, i, GetField(payload, i) + step);
+				}
+				// the energy counter ticks now and then
+				if (k % 50 == 0)
+				{
+					SetField(payload, 6, GetField(payload, 6) + 1);
+				}
+
+				payloads.push_back(payload);
+				timestamps.push_back(timestamp + random() % (3 * Millisecond));
+				timestamp += 100 * Millisecond;
+			}
+		}
+
+		// serial_data.txt played forwards and backwards every 100 ms, with up to 3 ms of jitter as in the benchmark
+		void Record(size_t count)
+		{
+			std::vector<Frame> frames = LoadSerialData(MONIP_SERIAL_DATA);
+
+			for (size_t k = 0; k < count; k++)
+			{
+				size_t cycle = k % (2 * frames.size() - 2);
+				const Frame &frame = frames[(cycle < frames.size()) ? cycle : 2 * frames.size() - 2 - cycle];
+
+				payloads.push_back(std::vector<uint8_t>(frame.begin() + 2, frame.end()));
+				timestamps.push_back(1000 * Second + k * 100 * Millisecond + (k * 7919) % (3 * Millisecond));
+			}
+		}
+
+		void ExpectSample(const Sample &sample, size_t k, uint64_t resolution)
+		{
+			AutoReportValues values;
+
+			ConvertAutoReport((const AutoReportMessage *)&payloads[k][0], &values);
+			ASSERT_EQ(sample.Timestamp, timestamps[k] / resolution * resolution) << "sample " << k;
+			ASSERT_EQ(memcmp(&sample.Values, &values, sizeof(values)), 0) << "sample " << k;
+		}
+	};
+
+	TEST_F(TimeSeriesTest, test_TimeSeries_RoundTrip)
+	{
+		TimeSeries * series = TimeSeries_New(0, 0);
+		std::vector<Sample> samples;
+
+		Record(20000);
+		for (size_t k = 0; k < payloads.size(); k++)
+		{
+			ASSERT_EQ(TimeSeries_Append(series, timestamps[k], (const AutoReportMessage *)&payloads[k][0]), 0);
+		}
+		ASSERT_EQ(TimeSeries_Count(series), payloads.size());
+
+		ASSERT_EQ(TimeSeries_Query(series, 0, UINT64_MAX, Collect, &samples), (int)payloads.size());
+		for (size_t k = 0; k < samples.size(); k++)
+		{
+			ExpectSample(samples[k], k, TIMESERIES_DEFAULT_RESOLUTION_NS);
+		}
+
+		// at least 5x smaller than the floats and a timestamp
+		size_t plain = payloads.size() * (sizeof(AutoReportValues) + sizeof(uint64_t));
+		EXPECT_LT(TimeSeries_MemoryUsage(series) * 5, plain);
+
+		TimeSeries_Free(series);
+	}
+
+	TEST_F(TimeSeriesTest, test_TimeSeries_Extremes)
+	{
+		TimeSeries * series = TimeSeries_New(1, TIMESERIES_MIN_BLOCK_SIZE);
+		const int32_t fields[] = {0x7fffff, -0x800000, 0, 0x7fffff, 1, -1, -0x800000};
+		std::vector<Sample> samples;
+
+		// full scale swings, a repeated timestamp and gaps of hours at ns resolution
+		Generate(1);
+		for (size_t k = 0; k < 200; k++)
+		{
+			std::vector<uint8_t> payload = payloads[0];
+
+			for (size_t i = 0; i < AUTOREPORT_FIELD_COUNT; i++)
+			{
+				SetField(payload, i, fields[(i + k) % AUTOREPORT_FIELD_COUNT]);
+			}
+			payloads.push_back(payload);
+			timestamps.push_back(timestamps.back() + ((k % 3 == 0) ? 0 : (k % 3 == 1) ? 7 : 3600 * Second + k));
+		}
+
+		for (size_t k = 0; k < payloads.size(); k++)
+		{
+			ASSERT_EQ(TimeSeries_Append(series, timestamps[k], (const AutoReportMessage *)&payloads[k][0]), 0);
+		}
+		ASSERT_EQ(TimeSeries_Append(series, timestamps.back() - 1, (const AutoReportMessage *)&payloads[0][0]), -ERANGE);
+
+		ASSERT_EQ(TimeSeries_Query(series, 0, UINT64_MAX, Collect, &samples), (int)payloads.size());
+		for (size_t k = 0; k < samples.size(); k++)
+		{
+			ExpectSample(samples[k], k, 1);
+		}
+
+		TimeSeries_Free(series);
+	}
+
+	TEST_F(TimeSeriesTest, test_TimeSeries_Range)
+	{
+		TimeSeries * series = TimeSeries_New(0, TIMESERIES_MIN_BLOCK_SIZE);
+		std::vector<Sample> samples;
+
+		Generate(3000);
+		for (size_t k = 0; k < payloads.size(); k++)
+		{
+			ASSERT_EQ(TimeSeries_Append(series, timestamps[k], (const AutoReportMessage *)&payloads[k][0]), 0);
+		}
+
+		// one minute from the middle, spanning several blocks
+		uint64_t from = timestamps[1000] / Millisecond * Millisecond;
+		uint64_t to = timestamps[1600] / Millisecond * Millisecond;
+		ASSERT_EQ(TimeSeries_Query(series, from, to, Collect, &samples), 600);
+		for (size_t k = 0; k < samples.size(); k++)
+		{
+			ExpectSample(samples[k], 1000 + k, Millisecond);
+		}
+		ASSERT_EQ(TimeSeries_Query(series, to, to, Collect, &samples), 0);
+
+		// whole blocks go, the block holding the cut and what follows stay
+		size_t before = TimeSeries_MemoryUsage(series);
+		int dropped = TimeSeries_DropBefore(series, from);
+		ASSERT_GT(dropped, 0);
+		ASSERT_LE(dropped, 1000);
+		ASSERT_LT(TimeSeries_MemoryUsage(series), before);
+		ASSERT_EQ(TimeSeries_Count(series), payloads.size() - dropped);
+
+		samples.clear();
+		ASSERT_EQ(TimeSeries_Query(series, 0, UINT64_MAX, Collect, &samples), (int)(payloads.size() - dropped));
+		ExpectSample(samples[0], dropped, Millisecond);
+
+		// dropping everything, appending goes on in a new block
+		ASSERT_EQ(TimeSeries_DropBefore(series, UINT64_MAX), (int)(payloads.size() - dropped));
+		ASSERT_EQ(TimeSeries_Append(series, timestamps.back(), (const AutoReportMessage *)&payloads.back()[0]), 0);
+		samples.clear();
+		ASSERT_EQ(TimeSeries_Query(series, 0, UINT64_MAX, Collect, &samples), 1);
+		ExpectSample(samples[0], payloads.size() - 1, Millisecond);
+
+		TimeSeries_Free(series);
+	}
+
+}
@@ -0,0 +1,568 @@
+/*
+ * monip_convert - convert hex frame logs (one frame per line, as in
+ * tests/serial_data.txt) to CSV, NDJSON or a binary recording.
+ *
+ * The input is mapped and cut into chunks on line boundaries. A pool of
+ * workers decodes, validates and converts chunks while the main thread
+ * writes the finished ones out in input order. At most a few chunks per
+ * worker are in flight so memory use is bounded for any input size.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "78m6610.h"
+#include "frameparser.h"
+#include "jsonbuffer.h"
+#include "recording.h"
+
+#define DEFAULT_CHUNK_SIZE (4 << 20)
+
+/* chunks in flight per worker */
+#define CHUNKS_PER_WORKER 4
+
+/* shortest line holding an AutoReport frame, bounds records per chunk */
+#define MIN_FRAME_LINE (AUTOREPORT_LENGTH * 2)
+
+#define CSV_HEADER "Vrms,Irms,Watts,Pavg,PF,Freq,kWh\n"
+
+typedef enum
+{
+    FORMAT_CSV,
+    FORMAT_NDJSON,
+    FORMAT_BINARY,
+} OutputFormat;
+
+typedef struct
+{
+    const char * start;
+    const char * end;
+    int done;
+
+    /* results */
+    JSONBuffer text;                /* CSV or NDJSON */
+    RecordingRecord * records;      /* binary */
+    size_t frames;
+    size_t invalid;
+} Chunk;
+
+typedef struct
+{
+    OutputFormat format;
+    uint32_t device;
+
+    Chunk * chunks;
+    size_t count;
+    size_t next;                    /* next chunk to claim */
+    size_t written;                 /* chunks handed to the writer */
+    size_t window;                  /* max chunks claimed ahead of written */
+
+    pthread_mutex_t lock;
+    pthread_cond_t chunkDone;
+    pthread_cond_t chunkWritten;
+} Converter;
+
+static int8_t HexValue[256];
+
+static void InitHex(void)
+{
+    int i = 0;
+
+    memset(HexValue, -1, sizeof(HexValue));
+
+    for(i = 0; i < 10; i++)
+    {
+        HexValue['0' + i] = i;
+    }
+
+    for(i = 0; i < 6; i++)
+    {
+        HexValue['a' + i] = 10 + i;
+        HexValue['A' + i] = 10 + i;
+    }
+}
+
+/* Returns the frame length or -EINVAL for odd length, oversize or non hex lines */
+static int DecodeLine(const char * line, size_t length, uint8_t * frame)
+{
+    size_t pos = 0;
+
+    if(length > 0 && line[length - 1] == '\r')
+    {
+        length--;
+    }
+
+    if((length & 1) != 0 || length / 2 > FRAME_MAX_LENGTH)
+    {
+        return -EINVAL;
+    }
+
+    for(pos = 0; pos < length / 2; pos++)
+    {
+        int8_t high = HexValue[(uint8_t)line[2 * pos]];
+        int8_t low = HexValue[(uint8_t)line[2 * pos + 1]];
+
+        if((high | low) < 0)
+        {
+            return -EINVAL;
+        }
+
+        frame[pos] = (uint8_t)((high << 4) | low);
+    }
+
+    return (int)(length / 2);
+}
+
+/* Same acceptance as ReadMessage(AUTOREPORT_HEADER) */
+static int ValidFrame(const uint8_t * frame, int length)
+{
+    return length == AUTOREPORT_LENGTH
+           && frame[0] == AUTOREPORT_HEADER
+           && frame[1] == AUTOREPORT_LENGTH
+           && ValidateMessage(frame[0], frame[1], &frame[2], length - 2) == 0;
+}
+
+static int AppendCSV(JSONBuffer * buffer, const AutoReportMessage * message)
+{
+    char line[AUTOREPORT_JSON_MAX];
+    int length = AutoReportToCSV(message, line, sizeof(line));
+
+    /* NDJSON mode adds the newline */
+    return (length < 0) ? length : JSONBuffer_AppendRecord(buffer, line, length);
+}
+
+static void ConvertChunk(Converter * converter, Chunk * chunk)
+{
+    const char * line = chunk->start;
+    uint8_t frame[FRAME_MAX_LENGTH];
+
+    if(converter->format == FORMAT_BINARY)
+    {
+        chunk->records = malloc(((chunk->end - chunk->start) / MIN_FRAME_LINE + 1) * sizeof(RecordingRecord));
+    }
+    else
+    {
+        JSONBuffer_Init(&chunk->text, JSON_MODE_NDJSON);
+    }
+
+    while(line < chunk->end)
+    {
+        const char * eol = memchr(line, '\n', chunk->end - line);
+        int length = 0;
+
+        if(eol == NULL)
+        {
+            eol = chunk->end;
+        }
+
+        length = DecodeLine(line, eol - line, frame);
+        line = eol + 1;
+
+        if(length <= 2)
+        {
+            /* blank lines are skipped like LoadSerialData() does */
+            chunk->invalid += (length != 0);
+            continue;
+        }
+
+        if(!ValidFrame(frame, length))
+        {
+            chunk->invalid++;
+            continue;
+        }
+
+        switch(converter->format)
+        {
+        case FORMAT_CSV:
+            if(AppendCSV(&chunk->text, (const AutoReportMessage *)&frame[2]) < 0)
+            {
+                chunk->invalid++;
+                continue;
+            }
+            break;
+
+        case FORMAT_NDJSON:
+            if(JSONBuffer_AppendAutoReport(&chunk->text, (const AutoReportMessage *)&frame[2]) < 0)
+            {
+                chunk->invalid++;
+                continue;
+            }
+            break;
+
+        case FORMAT_BINARY:
+            if(chunk->records == NULL)
+            {
+                chunk->invalid++;
+                continue;
+            }
+            else
+            {
+                RecordingRecord * record = &chunk->records[chunk->frames];
+
+                /* hex logs carry no time, the writer numbers records in order */
+                memset(record, 0, sizeof(*record));
+                record->Timestamp = chunk->frames;
+                record->Device = converter->device;
+                record->Length = length;
+                memcpy(record->Frame, frame, length);
+            }
+            break;
+        }
+
+        chunk->frames++;
+    }
+}
+
+static void * Worker(void * arg)
+{
+    Converter * converter = arg;
+
+    for(;;)
+    {
+        size_t index = 0;
+
+        pthread_mutex_lock(&converter->lock);
+
+        while(converter->next < converter->count
+              && converter->next >= converter->written + converter->window)
+        {
+            pthread_cond_wait(&converter->chunkWritten, &converter->lock);
+        }
+
+        index = converter->next++;
+
+        pthread_mutex_unlock(&converter->lock);
+
+        if(index >= converter->count)
+        {
+            break;
+        }
+
+        ConvertChunk(converter, &converter->chunks[index]);
+
+        pthread_mutex_lock(&converter->lock);
+        converter->chunks[index].done = 1;
+        pthread_cond_broadcast(&converter->chunkDone);
+        pthread_mutex_unlock(&converter->lock);
+    }
+
+    return NULL;
+}
+
+/* Cut the input into chunks of about chunkSize ending on a newline */
+static Chunk * SplitInput(const char * data, size_t size, size_t chunkSize, size_t * count)
+{
+    Chunk * chunks = NULL;
+    size_t capacity = size / chunkSize + 1;
+    size_t pos = 0;
+
+    chunks = calloc(capacity, sizeof(*chunks));
+    *count = 0;
+
+    while(chunks != NULL && pos < size)
+    {
+        size_t end = (size - pos > chunkSize) ? pos + chunkSize : size;
+        const char * eol = memchr(data + end - 1, '\n', size - end + 1);
+
+        end = (eol != NULL) ? (size_t)(eol - data) + 1 : size;
+
+        chunks[*count].start = data + pos;
+        chunks[*count].end = data + end;
+        (*count)++;
+        pos = end;
+    }
+
+    return chunks;
+}
+
+static int WriteAll(int fd, const void * data, size_t size)
+{
+    const char * pos = data;
+
+    while(size > 0)
+    {
+        ssize_t ret = write(fd, pos, size);
+
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -errno;
+        }
+
+        pos += ret;
+        size -= ret;
+    }
+
+    return 0;
+}
+
+static int WriteChunk(Converter * converter, Chunk * chunk, int fd, Recorder * recorder, uint64_t * sequence)
+{
+    int Result = 0;
+    size_t i = 0;
+
+    if(converter->format == FORMAT_BINARY)
+    {
+        for(i = 0; i < chunk->frames; i++)
+        {
+            chunk->records[i].Timestamp += *sequence;
+        }
+
+        Result = Recorder_WriteRecords(recorder, chunk->records, chunk->frames);
+        free(chunk->records);
+        chunk->records = NULL;
+    }
+    else
+    {
+        Result = WriteAll(fd, chunk->text.data, chunk->text.length);
+        JSONBuffer_Free(&chunk->text);
+    }
+
+    *sequence += chunk->frames;
+
+    return Result;
+}
+
+static double Seconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void Usage(const char * name)
+{
+    fprintf(stderr,
+            "usage: %s [-f csv|ndjson|binary] [-j threads] [-c chunk_kb] [-d device] input output\n"
+            "  output '-' writes CSV/NDJSON to stdout, binary needs a file\n",
+            name);
+}
+
+int main(int argc, char ** argv)
+{
+    Converter converter;
+    Recorder * recorder = NULL;
+    pthread_t * workers = NULL;
+    const char * data = NULL;
+    struct stat st;
+    size_t chunkSize = DEFAULT_CHUNK_SIZE;
+    size_t threads = 0;
+    size_t frames = 0;
+    size_t invalid = 0;
+    uint64_t sequence = 0;
+    double start = Seconds();
+    int Result = 0;
+    int input = -1;
+    int output = -1;
+    int opt = 0;
+    size_t i = 0;
+
+    memset(&converter, 0, sizeof(converter));
+    converter.format = FORMAT_CSV;
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    while((opt = getopt(argc, argv, "f:j:c:d:h")) != -1)
+    {
+        switch(opt)
+        {
+        case 'f':
+            if(strcmp(optarg, "csv") == 0)
+            {
+                converter.format = FORMAT_CSV;
+            }
+            else if(strcmp(optarg, "ndjson") == 0)
+            {
+                converter.format = FORMAT_NDJSON;
+            }
+            else if(strcmp(optarg, "binary") == 0)
+            {
+                converter.format = FORMAT_BINARY;
+            }
+            else
+            {
+                Usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'j':
+            threads = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            chunkSize = strtoul(optarg, NULL, 0) * 1024;
+            break;
+        case 'd':
+            converter.device = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if(argc - optind != 2 || chunkSize == 0
+       || (converter.format == FORMAT_BINARY && strcmp(argv[optind + 1], "-") == 0))
+    {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    threads = (threads > 0) ? threads : 1;
+
+    input = open(argv[optind], O_RDONLY | O_CLOEXEC);
+
+    if(input < 0 || fstat(input, &st) < 0)
+    {
+        fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    if(st.st_size > 0)
+    {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, input, 0);
+
+        if(data == MAP_FAILED)
+        {
+            fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+            return 1;
+        }
+
+        madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+    }
+
+    close(input);
+
+    if(converter.format == FORMAT_BINARY)
+    {
+        /* start a fresh recording rather than appending to an old one */
+        output = open(argv[optind + 1], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+        if(output >= 0)
+        {
+            close(output);
+            recorder = Recorder_Open(argv[optind + 1]);
+        }
+
+        if(recorder == NULL)
+        {
+            fprintf(stderr, "%s: %s\n", argv[optind + 1], strerror(errno));
+            return 1;
+        }
+    }
+    else
+    {
+        output = (strcmp(argv[optind + 1], "-") == 0) ? STDOUT_FILENO
+                 : open(argv[optind + 1], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+        if(output < 0)
+        {
+            fprintf(stderr, "%s: %s\n", argv[optind + 1], strerror(errno));
+            return 1;
+        }
+
+        if(converter.format == FORMAT_CSV)
+        {
+            Result = WriteAll(output, CSV_HEADER, strlen(CSV_HEADER));
+        }
+    }
+
+    InitHex();
+
+    converter.chunks = SplitInput(data, st.st_size, chunkSize, &converter.count);
+    converter.window = threads * CHUNKS_PER_WORKER;
+    pthread_mutex_init(&converter.lock, NULL);
+    pthread_cond_init(&converter.chunkDone, NULL);
+    pthread_cond_init(&converter.chunkWritten, NULL);
+
+    workers = calloc(threads, sizeof(*workers));
+
+    if(converter.chunks == NULL || workers == NULL)
+    {
+        fprintf(stderr, "%s\n", strerror(ENOMEM));
+        return 1;
+    }
+
+    for(i = 0; i < threads; i++)
+    {
+        pthread_create(&workers[i], NULL, Worker, &converter);
+    }
+
+    /* write chunks in input order as they complete */
+    for(i = 0; i < converter.count; i++)
+    {
+        Chunk * chunk = &converter.chunks[i];
+
+        pthread_mutex_lock(&converter.lock);
+
+        while(!chunk->done)
+        {
+            pthread_cond_wait(&converter.chunkDone, &converter.lock);
+        }
+
+        pthread_mutex_unlock(&converter.lock);
+
+        if(Result == 0)
+        {
+            Result = WriteChunk(&converter, chunk, output, recorder, &sequence);
+        }
+        else
+        {
+            free(chunk->records);
+            JSONBuffer_Free(&chunk->text);
+        }
+
+        frames += chunk->frames;
+        invalid += chunk->invalid;
+
+        pthread_mutex_lock(&converter.lock);
+        converter.written++;
+        pthread_cond_broadcast(&converter.chunkWritten);
+        pthread_mutex_unlock(&converter.lock);
+    }
+
+    for(i = 0; i < threads; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+
+    if(recorder != NULL)
+    {
+        int CloseResult = Recorder_Close(recorder);
+        Result = (Result == 0) ? CloseResult : Result;
+    }
+    else if(output != STDOUT_FILENO && close(output) < 0 && Result == 0)
+    {
+        Result = -errno;
+    }
+
+    if(Result < 0)
+    {
+        fprintf(stderr, "%s: %s\n", argv[optind + 1], strerror(-Result));
+    }
+
+    fprintf(stderr, "%zu frames, %zu invalid lines, %.1f MB in %.3f s with %zu threads\n",
+            frames, invalid, st.st_size / 1e6, Seconds() - start, threads);
+
+    if(data != NULL)
+    {
+        munmap((void *)data, st.st_size);
+    }
+
+    free(workers);
+    free(converter.chunks);
+
+    return (Result == 0) ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+/*
+ * monip_sim - run virtual 78M6610 meters on ptys for load testing readers.
+ *
+ * Prints one pty path per meter on stdout, then emits AutoReport frames
+ * until interrupted or the duration runs out, reporting totals to stderr
+ * every second.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "simulator.h"
+
+static volatile sig_atomic_t Interrupted = 0;
+
+static void OnSignal(int signal)
+{
+    (void)signal;
+    Interrupted = 1;
+}
+
+static void Usage(const char * name)
+{
+    fprintf(stderr,
+            "usage: %s [-n meters] [-i interval_us] [-N noise] [-c corrupt] [-t truncate] [-s seed] [-d seconds]\n"
+            "  noise, corrupt and truncate are fault rates per frame from 0 to 1\n"
+            "  -d 0 (the default) runs until interrupted\n",
+            name);
+}
+
+static void PrintStats(Simulator * simulator)
+{
+    SimulatorStats stats;
+
+    Simulator_GetStats(simulator, &stats);
+    fprintf(stderr, "frames %" PRIu64 " noise %" PRIu64 " corrupted %" PRIu64 " truncated %" PRIu64
+            " dropped %" PRIu64 " max late %" PRIu64 " us\n",
+            stats.Frames, stats.Noise, stats.Corrupted, stats.Truncated, stats.Dropped, stats.MaxLateUs);
+}
+
+int main(int argc, char ** argv)
+{
+    SimulatorOptions options;
+    Simulator * simulator = NULL;
+    size_t meters = 1;
+    unsigned long duration = 0;
+    unsigned long elapsed = 0;
+    int Result = 0;
+    int opt = 0;
+    size_t i = 0;
+
+    Simulator_DefaultOptions(&options);
+
+    while((opt = getopt(argc, argv, "n:i:N:c:t:s:d:h")) != -1)
+    {
+        switch(opt)
+        {
+        case 'n':
+            meters = strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            options.IntervalUs = strtoul(optarg, NULL, 0);
+            break;
+        case 'N':
+            options.NoiseRate = strtof(optarg, NULL);
+            break;
+        case 'c':
+            options.CorruptRate = strtof(optarg, NULL);
+            break;
+        case 't':
+            options.TruncateRate = strtof(optarg, NULL);
+            break;
+        case 's':
+            options.Seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            duration = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+
+    simulator = Simulator_New(meters, &options);
+    if(simulator == NULL)
+    {
+        fprintf(stderr, "cannot open %zu meters: %s\n", meters, meters == 0 || options.IntervalUs == 0 ? strerror(EINVAL) : strerror(errno));
+        return 1;
+    }
+
+    for(i = 0; i < meters; i++)
+    {
+        printf("%s\n", Simulator_Path(simulator, i));
+    }
+    fflush(stdout);
+
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+
+    Result = Simulator_Start(simulator);
+    if(Result != 0)
+    {
+        fprintf(stderr, "cannot start: %s\n", strerror(-Result));
+        Simulator_Free(simulator);
+        return 1;
+    }
+
+    while(!Interrupted && (duration == 0 || elapsed < duration))
+    {
+        sleep(1);
+        elapsed++;
+        PrintStats(simulator);
+    }
+
+    Simulator_Stop(simulator);
+    PrintStats(simulator);
+    Simulator_Free(simulator);
+
+    return 0;
+}